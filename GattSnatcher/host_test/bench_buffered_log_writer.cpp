@@ -0,0 +1,268 @@
+#include "buffered_log_writer.h"
+#include "test_util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+#if BENCH_LITTLEFS
+#include "lfs.h"
+#endif
+
+/**
+ * Scanner-side cost of logging 16-byte records: the former per-record path
+ * (fwrite + fflush, fsync every 257 records) against BufferedLogWriter.
+ *
+ * Both run once on the host file system, in the working directory, and, when the
+ * littlefs sources were found (see CMakeLists.txt), once on a LittleFS image of the
+ * storage partition with the sdkconfig geometry, on a RAM block device that counts
+ * what reaches the flash. The host file system rows only show the CPU cost of the
+ * two paths behind a page cache; the LittleFS rows show what each fsync costs in
+ * metadata commits, flash programs and erases. The flash time is estimated from
+ * typical SPI NOR figures, it is not measured.
+ *
+ * The producer here is faster than any radio, so for the buffered writer a dropped
+ * record is retried: records/s is the sustained rate, the latencies are of single
+ * write() calls, and the retries show how often all pages were waiting.
+ */
+static const char *PATH = "bench_log_writer.bin";
+static constexpr size_t RECORD_SIZE = 16;
+static constexpr uint32_t RECORDS = 100000;
+
+struct Result {
+    double totalSec;
+    int64_t p99Ns;
+    int64_t worstNs;
+};
+
+static Result summarize(std::vector<int64_t> &lat, double totalSec)
+{
+    std::sort(lat.begin(), lat.end());
+    return {totalSec, lat[lat.size() * 99 / 100], lat.back()};
+}
+
+static Result perRecordFlush(FILE *f)
+{
+    std::vector<int64_t> lat(RECORDS);
+    uint8_t rec[RECORD_SIZE] = {};
+    int flip = 0;
+    int64_t begin = hostNowNs();
+    for (uint32_t i = 0; i < RECORDS; i++) {
+        memcpy(rec, &i, 4);
+        int64_t start = hostNowNs();
+        fwrite(rec, 1, sizeof(rec), f);
+        fflush(f);
+        if (++flip == 257) {
+            fsync(fileno(f));
+            flip = 0;
+        }
+        lat[i] = hostNowNs() - start;
+    }
+    fsync(fileno(f));
+    double total = (hostNowNs() - begin) / 1e9;
+    return summarize(lat, total);
+}
+
+static Result buffered(FILE *f, uint32_t &retries)
+{
+    static BufferedLogWriter writer;
+    writer.start(f);
+    std::vector<int64_t> lat(RECORDS);
+    uint8_t rec[RECORD_SIZE] = {};
+    int64_t begin = hostNowNs();
+    for (uint32_t i = 0; i < RECORDS; i++) {
+        memcpy(rec, &i, 4);
+        for (;;) {
+            int64_t start = hostNowNs();
+            bool queued = writer.write(rec, sizeof(rec));
+            lat[i] = hostNowNs() - start;
+            if (queued) {
+                break;
+            }
+            std::this_thread::yield();
+        }
+    }
+    writer.flush();
+    double total = (hostNowNs() - begin) / 1e9;
+    retries = writer.stats().droppedRecords;
+    writer.stop();
+    return summarize(lat, total);
+}
+
+#if BENCH_LITTLEFS
+// sdkconfig CONFIG_LITTLEFS_* and the storage partition in partitions.csv
+static constexpr lfs_size_t FLASH_SECTOR = 4096;
+static constexpr lfs_size_t FLASH_SECTORS = 0x2B0000 / FLASH_SECTOR;
+static constexpr lfs_size_t FLASH_PAGE = 256;
+// typical 32 Mbit SPI NOR: page program 0.4 ms, 4 KiB sector erase 45 ms
+static constexpr double PAGE_PROGRAM_MS = 0.4;
+static constexpr double SECTOR_ERASE_MS = 45;
+// what fileno() returns for the stream backed by the littlefs file
+static constexpr int LFS_STREAM_FD = 0x4c4653;
+
+struct FlashStats {
+    uint64_t programmedBytes;
+    uint32_t erasedSectors;
+    uint32_t commits;
+};
+
+static std::vector<uint8_t> flash(FLASH_SECTOR * FLASH_SECTORS, 0xff);
+static FlashStats flashStats;
+static lfs_t lfs;
+static lfs_file_t lfsFile;
+static FILE *lfsStream = nullptr;
+
+static int flashRead(const lfs_config *, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size)
+{
+    memcpy(buffer, &flash[block * FLASH_SECTOR + off], size);
+    return LFS_ERR_OK;
+}
+
+static int flashProgram(const lfs_config *, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size)
+{
+    // NOR flash only clears bits
+    uint8_t *dst = &flash[block * FLASH_SECTOR + off];
+    for (lfs_size_t i = 0; i < size; i++) {
+        dst[i] &= static_cast<const uint8_t *>(buffer)[i];
+    }
+    flashStats.programmedBytes += size;
+    return LFS_ERR_OK;
+}
+
+static int flashErase(const lfs_config *, lfs_block_t block)
+{
+    memset(&flash[block * FLASH_SECTOR], 0xff, FLASH_SECTOR);
+    flashStats.erasedSectors++;
+    return LFS_ERR_OK;
+}
+
+static int flashSync(const lfs_config *)
+{
+    return LFS_ERR_OK;
+}
+
+static lfs_config flashConfig()
+{
+    lfs_config cfg = {};
+    cfg.read = flashRead;
+    cfg.prog = flashProgram;
+    cfg.erase = flashErase;
+    cfg.sync = flashSync;
+    cfg.read_size = 128;
+    cfg.prog_size = FLASH_PAGE;
+    cfg.block_size = FLASH_SECTOR;
+    cfg.block_count = FLASH_SECTORS;
+    cfg.block_cycles = 512;
+    cfg.cache_size = 512;
+    cfg.lookahead_size = 128;
+    return cfg;
+}
+
+static const lfs_config LFS_CONFIG = flashConfig();
+
+static ssize_t lfsStreamWrite(void *, const char *buf, size_t size)
+{
+    lfs_ssize_t written = lfs_file_write(&lfs, &lfsFile, buf, size);
+    return written < 0 ? -1 : written;
+}
+
+static int lfsStreamClose(void *)
+{
+    lfsStream = nullptr;
+    return lfs_file_close(&lfs, &lfsFile) < 0 ? -1 : 0;
+}
+
+// The writer syncs with fsync(fileno(file)), as it does through the ESP-IDF VFS
+extern "C" int __real_fileno(FILE *f);
+extern "C" int __real_fsync(int fd);
+
+extern "C" int __wrap_fileno(FILE *f)
+{
+    return f != nullptr && f == lfsStream ? LFS_STREAM_FD : __real_fileno(f);
+}
+
+extern "C" int __wrap_fsync(int fd)
+{
+    if (fd != LFS_STREAM_FD) {
+        return __real_fsync(fd);
+    }
+    flashStats.commits++;
+    return lfs_file_sync(&lfs, &lfsFile) < 0 ? -1 : 0;
+}
+
+/** Formats and mounts an empty partition and opens the log file on it as a stream. */
+static FILE *lfsOpen()
+{
+    std::fill(flash.begin(), flash.end(), 0xff);
+    if (lfs_format(&lfs, &LFS_CONFIG) != LFS_ERR_OK || lfs_mount(&lfs, &LFS_CONFIG) != LFS_ERR_OK ||
+        lfs_file_open(&lfs, &lfsFile, PATH, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) != LFS_ERR_OK) {
+        return nullptr;
+    }
+    lfsStream = fopencookie(nullptr, "w", {nullptr, lfsStreamWrite, nullptr, lfsStreamClose});
+    flashStats = {};
+    return lfsStream;
+}
+
+/** Closes the stream and checks that every record made it into the file. */
+static bool lfsClose(FILE *f)
+{
+    bool closed = fclose(f) == 0;
+    lfs_info info;
+    bool complete = lfs_stat(&lfs, PATH, &info) == LFS_ERR_OK && info.size == RECORDS * RECORD_SIZE;
+    lfs_unmount(&lfs);
+    return closed && complete;
+}
+
+static void printFlash(const FlashStats &s)
+{
+    double flashMs = s.programmedBytes / FLASH_PAGE * PAGE_PROGRAM_MS + s.erasedSectors * SECTOR_ERASE_MS;
+    printf("%-18s %12u %10llu %10u %12.0f\n", "", (unsigned)s.commits,
+           (unsigned long long)(s.programmedBytes / 1024), (unsigned)s.erasedSectors, flashMs);
+}
+#endif
+
+static void print(const char *name, const Result &r)
+{
+    printf("%-18s %12.0f %10lld %10lld\n", name, RECORDS / r.totalSec, (long long)r.p99Ns, (long long)r.worstNs);
+}
+
+int main()
+{
+    printf("%u records of %zu B, page %zu B x %zu\n", (unsigned)RECORDS, RECORD_SIZE,
+           BufferedLogWriter::PAGE_SIZE, BufferedLogWriter::PAGES);
+    printf("host file system\n");
+    printf("%-18s %12s %10s %10s\n", "", "records/s", "p99 ns", "max ns");
+    FILE *f = fopen(PATH, "w");
+    print("fwrite+fflush", perRecordFlush(f));
+    fclose(f);
+    uint32_t retries = 0;
+    f = fopen(PATH, "w");
+    print("BufferedLogWriter", buffered(f, retries));
+    fclose(f);
+    printf("buffered writer retries (all pages busy): %u\n", (unsigned)retries);
+    remove(PATH);
+
+#if BENCH_LITTLEFS
+    printf("\nLittleFS %u x %u B on a RAM block device\n", (unsigned)FLASH_SECTORS, (unsigned)FLASH_SECTOR);
+    printf("%-18s %12s %10s %10s\n", "", "records/s", "p99 ns", "max ns");
+    printf("%-18s %12s %10s %10s %12s\n", "", "fsyncs", "prog KiB", "erases", "est flash ms");
+    bool complete = (f = lfsOpen()) != nullptr;
+    if (complete) {
+        print("fwrite+fflush", perRecordFlush(f));
+        printFlash(flashStats);
+        complete = lfsClose(f);
+    }
+    if (complete && (f = lfsOpen()) != nullptr) {
+        print("BufferedLogWriter", buffered(f, retries));
+        printFlash(flashStats);
+        complete = lfsClose(f);
+        printf("buffered writer retries (all pages busy): %u\n", (unsigned)retries);
+    }
+    if (!complete) {
+        fprintf(stderr, "the LittleFS log file is incomplete\n");
+        return 1;
+    }
+#endif
+    return 0;
+}
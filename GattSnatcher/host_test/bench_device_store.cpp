@@ -0,0 +1,67 @@
+#include "device_store.h"
+#include "test_util.h"
+
+#include <memory>
+#include <vector>
+
+/**
+ * Cost of the DeviceStore operations the interrogator uses: lookups (the dispatcher
+ * does one per request), appends (one per finished interrogation, each fsync()ed)
+ * and the replay at boot. Run it on the storage you care about: the log goes into
+ * the working directory.
+ */
+static const char *LOG_PATH = "bench_device_store.log";
+
+static uint64_t keyOf(uint32_t n)
+{
+    uint8_t address[6] = {0x40, 0x12, (uint8_t)(n >> 24), (uint8_t)(n >> 16), (uint8_t)(n >> 8), (uint8_t)n};
+    return DeviceStore::makeKey(address, 1);
+}
+
+int main()
+{
+    remove(LOG_PATH);
+    const uint32_t devices = DeviceStore::CAPACITY * 3 / 4;
+    auto store = std::make_unique<DeviceStore>();
+    if (!store->open(LOG_PATH)) {
+        fprintf(stderr, "cannot open %s\n", LOG_PATH);
+        return 1;
+    }
+
+    int64_t start = hostNowNs();
+    for (uint32_t i = 0; i < devices; i++) {
+        store->recordProfiled(keyOf(i), i * 0x9E3779B97F4A7C15ULL, i);
+    }
+    for (uint32_t i = 0; i < devices; i++) {
+        store->recordFailure(keyOf(i), i);
+    }
+    double appendSec = (hostNowNs() - start) / 1e9;
+    printf("%u devices, %u appends: %.1f us per append (incl. fsync and compactions)\n",
+           (unsigned)devices, (unsigned)(2 * devices), appendSec * 1e6 / (2 * devices));
+
+    const uint32_t lookups = 10000000;
+    TestRng rng(7);
+    std::vector<uint64_t> keys(4096);
+    for (uint64_t &k : keys) {
+        // half of them unknown
+        k = keyOf(rng.below(2 * devices));
+    }
+    uint32_t hits = 0;
+    start = hostNowNs();
+    for (uint32_t i = 0; i < lookups; i++) {
+        hits += store->find(keys[i & (keys.size() - 1)]) != nullptr;
+    }
+    double lookupSec = (hostNowNs() - start) / 1e9;
+    printf("%u lookups: %.1f ns each, %.0f%% hits\n", (unsigned)lookups, lookupSec * 1e9 / lookups,
+           100.0 * hits / lookups);
+    store->close();
+
+    start = hostNowNs();
+    auto replayed = std::make_unique<DeviceStore>();
+    replayed->open(LOG_PATH);
+    double replaySec = (hostNowNs() - start) / 1e9;
+    printf("replay of %u records: %.2f ms\n", (unsigned)replayed->logRecords(), replaySec * 1e3);
+    replayed->close();
+    remove(LOG_PATH);
+    return 0;
+}
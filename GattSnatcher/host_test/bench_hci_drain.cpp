@@ -0,0 +1,176 @@
+#include "hci_event_parser.h"
+#include "hci_ring_buffer.h"
+#include "hci_stream.h"
+
+#include <vector>
+
+#ifndef CONFIG_HCI_BATCH_SIZE
+#define CONFIG_HCI_BATCH_SIZE 16
+#endif
+#ifndef CONFIG_FREERTOS_HZ
+#define CONFIG_FREERTOS_HZ 1000
+#endif
+
+/**
+ * Replay of an HCI event stream through the HCI task's consumer loop, before and
+ * after draining in batches:
+ *
+ *   one per tick  the former loop: one packet per wakeup into a LeAdvertisingReport,
+ *                 released, then vTaskDelay of one tick
+ *   batch copy    up to CONFIG_HCI_BATCH_SIZE packets into a reusable LeAdvertisingReport
+ *                 array, released, then handed on as one batch (the first batched version)
+ *   batch view    the same into LeAdvertisingReportView, handed on before the release
+ *                 (DeviceScanner::hciEvtProcess today)
+ *
+ *   bench_hci_drain [stream]
+ *
+ * See hci_stream.h for the stream. The ring has the CONFIG_HCI_RING_BUFFER_SIZE default
+ * and is filled before every drain, as by a burst while the task is not running. The
+ * output handlers are replaced by a checksum over the reports of connectable events.
+ * The host cannot sleep for a FreeRTOS tick per packet, so the delay is added to the
+ * measured time: "reports/s" includes it at CONFIG_FREERTOS_HZ, "cpu reports/s" does not.
+ */
+static const int PASSES = 20;
+static const int64_t TICK_NS = 1000000000LL / CONFIG_FREERTOS_HZ;
+
+struct Result {
+    uint64_t reports = 0;
+    uint64_t ticks = 0;         // vTaskDelay calls of one tick
+    uint32_t sink = 0;
+};
+
+static void consume(const LeAdvertisingReport &report, Result &result)
+{
+    for (uint8_t i = 0; i < report.num_reports; i++) {
+        result.sink += report.reports[i].raw_bdaddr[0] + (uint8_t)report.reports[i].rssi;
+    }
+    result.reports += report.num_reports;
+}
+
+static void consume(const LeAdvertisingReportView &view, Result &result)
+{
+    for (uint8_t i = 0; i < view.num_reports; i++) {
+        result.sink += view.bdaddr(i)[0] + (uint8_t)view.reports[i].rssi;
+    }
+    result.reports += view.num_reports;
+}
+
+static bool isExtended(const hci_data_t &d)
+{
+    return HciEventParser::leMetaSubevent(d) == HCI_LE_EXT_ADV_REPORT;
+}
+
+static void drainOnePerTick(HciRingBuffer &ring, Result &result)
+{
+    static LeAdvertisingReport report;
+    hci_data_t d;
+    while (ring.acquire(d)) {
+        if (!isExtended(d) && HciEventParser::fillAdvReport(d, report) == ESP_OK
+            && report.isAdvertisingReportConnectable()) {
+            consume(report, result);
+        }
+        ring.release();
+        result.ticks++;
+    }
+}
+
+static void drainBatchCopy(HciRingBuffer &ring, Result &result)
+{
+    static LeAdvertisingReport batch[CONFIG_HCI_BATCH_SIZE];
+    hci_data_t d;
+    while (!ring.empty()) {
+        size_t count = 0;
+        size_t acquired = 0;
+        while (acquired < CONFIG_HCI_BATCH_SIZE && ring.acquire(d)) {
+            acquired++;
+            if (!isExtended(d) && HciEventParser::fillAdvReport(d, batch[count]) == ESP_OK
+                && batch[count].isAdvertisingReportConnectable()) {
+                count++;
+            }
+        }
+        ring.release();
+        for (size_t i = 0; i < count; i++) {
+            consume(batch[i], result);
+        }
+    }
+}
+
+static void drainBatchView(HciRingBuffer &ring, Result &result)
+{
+    static LeAdvertisingReportView batch[CONFIG_HCI_BATCH_SIZE];
+    hci_data_t d;
+    while (!ring.empty()) {
+        size_t count = 0;
+        size_t acquired = 0;
+        while (acquired < CONFIG_HCI_BATCH_SIZE && ring.acquire(d)) {
+            acquired++;
+            if (!isExtended(d) && HciEventParser::parseAdvReportView(d, batch[count]) == ESP_OK
+                && batch[count].isAdvertisingReportConnectable()) {
+                count++;
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            consume(batch[i], result);
+        }
+        ring.release();
+    }
+}
+
+template <typename Drain>
+static Result replay(HciRingBuffer &ring, const std::vector<uint8_t> &bytes,
+                     const std::vector<HciStreamPacket> &packets, Drain drain, int64_t &elapsedNs)
+{
+    Result result;
+    int64_t start = hostNowNs();
+    for (int p = 0; p < PASSES; p++) {
+        size_t next = 0;
+        while (next < packets.size()) {
+            // a push that does not fit is counted as a drop by the ring, but retried after the drain
+            while (next < packets.size()
+                   && ring.push(bytes.data() + packets[next].offset, packets[next].len, (int64_t)next)) {
+                next++;
+            }
+            drain(ring, result);
+        }
+    }
+    elapsedNs = hostNowNs() - start;
+    return result;
+}
+
+static void report(const char *name, const Result &result, int64_t elapsedNs)
+{
+    double cpuSec = elapsedNs / 1e9;
+    double sec = cpuSec + result.ticks * (TICK_NS / 1e9);
+    printf("%-14s %14.0f %14.0f %10llu\n", name, result.reports / sec, result.reports / cpuSec,
+           (unsigned long long)result.ticks);
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<uint8_t> bytes;
+    std::vector<HciStreamPacket> packets;
+    if (!hciStreamFromArgs(argc, argv, bytes, packets)) {
+        return 1;
+    }
+    static HciRingBuffer ring;
+    if (ring.init(8192) != ESP_OK) {
+        return 1;
+    }
+
+    int64_t tickNs, copyNs, viewNs;
+    Result tick = replay(ring, bytes, packets, drainOnePerTick, tickNs);
+    Result copy = replay(ring, bytes, packets, drainBatchCopy, copyNs);
+    Result view = replay(ring, bytes, packets, drainBatchView, viewNs);
+    if (tick.reports != copy.reports || tick.reports != view.reports) {
+        fprintf(stderr, "the consumers saw different reports\n");
+        return 1;
+    }
+
+    printf("%zu events x %d (%s), batch %d, tick %lld us\n", packets.size(), PASSES,
+           argc > 1 ? argv[1] : "synthetic", CONFIG_HCI_BATCH_SIZE, (long long)(TICK_NS / 1000));
+    printf("%-14s %14s %14s %10s\n", "", "reports/s", "cpu reports/s", "ticks");
+    report("one per tick", tick, tickNs);
+    report("batch copy", copy, copyNs);
+    report("batch view", view, viewNs);
+    return (tick.sink ^ copy.sink ^ view.sink) == 0xFFFFFFFF;
+}
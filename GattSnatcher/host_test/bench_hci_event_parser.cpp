@@ -0,0 +1,65 @@
+#include "hci_event_parser.h"
+#include "hci_stream.h"
+
+#include <vector>
+
+/**
+ * Parser throughput on an HCI event stream: the zero-copy view parser against
+ * fillAdvReport, which still produces the former fat LeAdvertisingSingleReport with
+ * a formatted address and a copied payload.
+ *
+ *   bench_hci_event_parser [stream]
+ *
+ * See hci_stream.h for the stream format and the synthetic stream.
+ */
+int main(int argc, char **argv)
+{
+    std::vector<uint8_t> bytes;
+    std::vector<HciStreamPacket> packets;
+    if (!hciStreamFromArgs(argc, argv, bytes, packets)) {
+        return 1;
+    }
+    const int passes = 20;
+
+    static LeAdvertisingReportView view;
+    static LeExtAdvertisingReportView ext;
+    uint64_t reports = 0;
+    uint32_t sink = 0;
+    int64_t start = hostNowNs();
+    for (int p = 0; p < passes; p++) {
+        for (const HciStreamPacket &pkt : packets) {
+            hci_data_t d = {0, pkt.len, bytes.data() + pkt.offset};
+            if (HciEventParser::leMetaSubevent(d) == HCI_LE_EXT_ADV_REPORT) {
+                if (HciEventParser::parseExtAdvReportView(d, ext) == ESP_OK) {
+                    reports += ext.num_reports;
+                }
+            } else if (HciEventParser::parseAdvReportView(d, view) == ESP_OK) {
+                reports += view.num_reports;
+                sink += view.reports[0].rssi;
+            }
+        }
+    }
+    double viewSec = (hostNowNs() - start) / 1e9;
+
+    static LeAdvertisingReport full;
+    start = hostNowNs();
+    for (int p = 0; p < passes; p++) {
+        for (const HciStreamPacket &pkt : packets) {
+            hci_data_t d = {0, pkt.len, bytes.data() + pkt.offset};
+            if (HciEventParser::leMetaSubevent(d) == HCI_LE_EXT_ADV_REPORT) {
+                HciEventParser::parseExtAdvReportView(d, ext);
+            } else if (HciEventParser::fillAdvReport(d, full) == ESP_OK) {
+                sink += full.reports[0].bdaddr_str[0];
+            }
+        }
+    }
+    double fullSec = (hostNowNs() - start) / 1e9;
+
+    double events = (double)packets.size() * passes;
+    printf("%zu events, %.2f reports per event (%s)\n", packets.size(), reports / events,
+           argc > 1 ? argv[1] : "synthetic");
+    printf("%-14s %14s %12s\n", "", "events/s", "ns/event");
+    printf("%-14s %14.0f %12.1f\n", "view", events / viewSec, viewSec * 1e9 / events);
+    printf("%-14s %14.0f %12.1f\n", "fillAdvReport", events / fullSec, fullSec * 1e9 / events);
+    return sink == 0xFFFFFFFF;
+}
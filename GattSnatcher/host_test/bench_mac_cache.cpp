@@ -0,0 +1,61 @@
+#include "mac_cache.h"
+#include "test_util.h"
+
+#include <memory>
+#include <vector>
+
+/**
+ * Lookups and inserts per second at 1k, 10k and 50k distinct addresses.
+ *
+ * Inserts: every address once into an empty cache; above CONFIG_MAC_CACHE_CAPACITY
+ * each insert recycles the oldest entry, which is what a crowded venue costs.
+ * Lookups: random addresses of the same set, i.e. hits while the set fits the cache
+ * and mostly misses (plus recycling) once it does not.
+ */
+static MacKey makeKey(uint32_t n)
+{
+    MacKey k = {};
+    for (int i = 0; i < 4; ++i) {
+        k.addr[i] = (n * 2654435761u >> (8 * i)) & 0xFF;
+    }
+    k.addr[4] = n >> 24;
+    k.addr[5] = 0x40;       // resolvable private, the common case
+    k.addr_type = 0x01;
+    return k;
+}
+
+int main()
+{
+    const uint32_t sizes[] = {1000, 10000, 50000};
+    const uint32_t lookups = 2000000;
+    printf("capacity %u\n", (unsigned)MacCache::CAPACITY);
+    printf("%8s %14s %14s %8s\n", "devices", "inserts/s", "lookups/s", "printed");
+    for (uint32_t devices : sizes) {
+        std::vector<MacKey> keys(devices);
+        for (uint32_t i = 0; i < devices; ++i) {
+            keys[i] = makeKey(i);
+        }
+        auto cache = std::make_unique<MacCache>();
+        int64_t now = 0;
+        int64_t start = hostNowNs();
+        for (uint32_t i = 0; i < devices; ++i) {
+            cache->shouldPrintAndAddToCache(keys[i], now++);
+        }
+        double insertSec = (hostNowNs() - start) / 1e9;
+
+        TestRng rng(devices);
+        std::vector<uint32_t> order(lookups);
+        for (uint32_t &o : order) {
+            o = rng.below(devices);
+        }
+        uint32_t printed = 0;
+        start = hostNowNs();
+        for (uint32_t o : order) {
+            printed += cache->shouldPrintAndAddToCache(keys[o], now++);
+        }
+        double lookupSec = (hostNowNs() - start) / 1e9;
+        printf("%8u %14.0f %14.0f %8u\n", (unsigned)devices, devices / insertSec, lookups / lookupSec,
+               (unsigned)printed);
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include "scanner_session.h"
+
+#include <cstdio>
+
+/**
+ * Size of a version 4 scanner log against the flat version 2 records carrying the
+ * same payloads, and the encoding time per record.
+ *
+ * usage: bench_scanner_log [session.csv]
+ * The CSV is a recorded session as written by dataAnalysis/process_scanner_files.py;
+ * without it a synthetic session is used.
+ */
+int main(int argc, char **argv)
+{
+    std::vector<SessionRecord> records;
+    if (argc > 1) {
+        if (!readSessionCsv(argv[1], records) || records.empty()) {
+            fprintf(stderr, "cannot read records from %s\n", argv[1]);
+            return 1;
+        }
+        printf("%s: %zu records\n", argv[1], records.size());
+    } else {
+        SyntheticSession session;
+        records.resize(200000);
+        for (SessionRecord &r : records) {
+            session.next(r);
+        }
+        printf("synthetic session: %zu records\n", records.size());
+    }
+
+    size_t flat = SCANNER_LOG_HEADER_SIZE;
+    size_t payload = 0;
+    for (const SessionRecord &r : records) {
+        flat += r.flatSize();
+        payload += r.advData.size();
+    }
+    std::vector<size_t> blockEnds;
+    uint64_t start = hostNowNs();
+    std::vector<uint8_t> file = encodeScannerLog(records, &blockEnds);
+    uint64_t elapsed = hostNowNs() - start;
+
+    printf("flat v2:  %10zu bytes  %6.1f B/record (%zu payload bytes)\n", flat, (double)flat / records.size(),
+           payload);
+    printf("blocks v4: %9zu bytes  %6.1f B/record in %zu blocks of %zu bytes max\n", file.size(),
+           (double)file.size() / records.size(), blockEnds.size(), ScannerLogEncoder::BLOCK_SIZE);
+    printf("ratio %.2fx, encoding %.0f ns/record\n", (double)flat / file.size(), (double)elapsed / records.size());
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include "uart_frame.h"
+#include "test_util.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/**
+ * Bytes per interrogation request on the UART link and the cost to produce and to
+ * parse them: the binary frame against the former CSV "ADV:" line, which carried the
+ * log file name as text and was parsed with strtok_r/atoi and sscanf on the questioner.
+ */
+struct TextReport {
+    int64_t timestamp;
+    uint8_t adv_event_type;
+    uint8_t addr_type;
+    char bdaddr_str[18];
+    uint8_t adv_data_length;
+    int8_t rssi;
+    char filename[64];
+    uint8_t addr[6];
+};
+
+static int textEncode(const UartAdvReportFrame &r, const char *filename, char *out, size_t len)
+{
+    char bdaddr[18];
+    snprintf(bdaddr, sizeof(bdaddr), "%02x:%02x:%02x:%02x:%02x:%02x", r.addr[5], r.addr[4], r.addr[3], r.addr[2],
+             r.addr[1], r.addr[0]);
+    return snprintf(out, len, "%lld,%d,%d,%s,%d,%d%s\n", (long long)r.timestamp, r.event_type, r.addr_type, bdaddr,
+                    r.adv_data_length, r.rssi, filename);
+}
+
+// As parseAdvReportFromString and parse_bdaddr_str did it
+static bool textDecode(const char *line, TextReport &report)
+{
+    char buf[256];
+    strncpy(buf, line, sizeof(buf));
+    buf[sizeof(buf) - 1] = '\0';
+    char *rest = buf;
+    char *token;
+    if (!(token = strtok_r(rest, ",", &rest))) return false;
+    report.timestamp = atoll(token);
+    if (!(token = strtok_r(nullptr, ",", &rest))) return false;
+    report.adv_event_type = (uint8_t)atoi(token);
+    if (!(token = strtok_r(nullptr, ",", &rest))) return false;
+    report.addr_type = (uint8_t)atoi(token);
+    if (!(token = strtok_r(nullptr, ",", &rest))) return false;
+    strncpy(report.bdaddr_str, token, sizeof(report.bdaddr_str));
+    report.bdaddr_str[sizeof(report.bdaddr_str) - 1] = '\0';
+    if (!(token = strtok_r(nullptr, ",", &rest))) return false;
+    report.adv_data_length = (uint8_t)atoi(token);
+    if (!(token = strtok_r(nullptr, ",", &rest))) return false;
+    report.rssi = (int8_t)atoi(token);
+    strncpy(report.filename, rest, sizeof(report.filename));
+    report.filename[sizeof(report.filename) - 1] = '\0';
+    unsigned int b[6];
+    if (sscanf(report.bdaddr_str, "%02x:%02x:%02x:%02x:%02x:%02x", &b[5], &b[4], &b[3], &b[2], &b[1], &b[0]) != 6) {
+        return false;
+    }
+    for (int i = 0; i < 6; i++) {
+        report.addr[i] = (uint8_t)b[i];
+    }
+    return true;
+}
+
+int main()
+{
+    const int n = 200000;
+    const char *filename = "/storage/scanner_log_12.bin";
+    UartAdvReportFrame r = {};
+    r.timestamp = 3600LL * 1000000 * 5;
+    r.addr_type = 1;
+    memcpy(r.addr, "\x11\x22\x33\x44\x55\x66", 6);
+    r.adv_data_length = 27;
+    r.rssi = -67;
+    r.file_id = 12;
+
+    std::string stream;
+    char line[256];
+    uint32_t sink = 0;
+    int64_t start = hostNowNs();
+    for (int i = 0; i < n; i++) {
+        r.timestamp++;
+        int len = textEncode(r, filename, line, sizeof(line));
+        stream.append(line, len);
+    }
+    double textEncodeNs = (hostNowNs() - start) / (double)n;
+    size_t textBytes = stream.size();
+    start = hostNowNs();
+    for (size_t pos = 0; pos < stream.size();) {
+        size_t eol = stream.find('\n', pos);
+        TextReport t;
+        if (textDecode(stream.c_str() + pos, t)) {
+            sink += t.addr[0];
+        }
+        pos = eol + 1;
+    }
+    double textDecodeNs = (hostNowNs() - start) / (double)n;
+
+    std::string frames;
+    uint8_t frame[UART_FRAME_ADV_REPORT_SIZE];
+    start = hostNowNs();
+    for (int i = 0; i < n; i++) {
+        r.timestamp++;
+        size_t len = uartFrameEncodeAdvReport(r, (uint8_t)i, frame);
+        frames.append((const char *)frame, len);
+    }
+    double frameEncodeNs = (hostNowNs() - start) / (double)n;
+    // fed in 128-byte chunks as uart_read_bytes delivers them
+    static UartFrameDecoder decoder;
+    start = hostNowNs();
+    for (size_t pos = 0; pos < frames.size();) {
+        size_t chunk = frames.size() - pos < 128 ? frames.size() - pos : 128;
+        pos += decoder.feed((const uint8_t *)frames.data() + pos, chunk);
+        UartFrameDecoder::Frame f;
+        UartAdvReportFrame out;
+        while (decoder.next(f)) {
+            if (uartFrameDecodeAdvReport(f.payload, f.len, out)) {
+                sink += out.addr[0];
+            }
+        }
+    }
+    double frameDecodeNs = (hostNowNs() - start) / (double)n;
+
+    printf("%-8s %10s %12s %12s\n", "", "B/request", "encode ns", "decode ns");
+    printf("%-8s %10.1f %12.1f %12.1f\n", "text", textBytes / (double)n, textEncodeNs, textDecodeNs);
+    printf("%-8s %10.1f %12.1f %12.1f\n", "frame", frames.size() / (double)n, frameEncodeNs, frameDecodeNs);
+    printf("frames decoded %u, lost %u\n", (unsigned)decoder.framesDecoded(), (unsigned)decoder.framesLost());
+    return sink == 0xFFFFFFFF;
+}
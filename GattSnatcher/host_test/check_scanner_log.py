@@ -0,0 +1,49 @@
+"""
+Decodes the log written by scanner_log_fixture with dataAnalysis/includes/scanner_log.py
+and compares the records with the expected ones; the corrupted block and the torn tail
+must be skipped, and nothing else.
+
+usage: check_scanner_log.py <dataAnalysis/includes> <fixture prefix>
+"""
+import csv
+import sys
+
+sys.path.insert(0, sys.argv[1])
+from scanner_log import read_records  # noqa: E402
+
+COLUMNS = [
+    "timestamp_us", "adv_event_type", "addr_type",
+    "mac_address", "adv_data_length", "rssi",
+    "primary_phy", "secondary_phy", "sid", "tx_power", "periodic_adv_interval",
+    "adv_data"
+]
+
+
+def main():
+    prefix = sys.argv[2]
+    with open(prefix + ".csv", newline="") as csv_file:
+        expected = list(csv.reader(csv_file))[1:]
+    stats = {}
+    decoded = []
+    for record in read_records(prefix + ".bin", stats=stats):
+        record["adv_data"] = record["adv_data"].hex()
+        decoded.append(["" if record[c] is None else str(record[c]) for c in COLUMNS])
+    failures = 0
+    if len(decoded) != len(expected):
+        print(f"decoded {len(decoded)} records, expected {len(expected)}")
+        failures += 1
+    for i, (got, want) in enumerate(zip(decoded, expected)):
+        if got != want:
+            print(f"record {i}: got {got}, expected {want}")
+            failures += 1
+            break
+    if stats["bad_blocks"] != 2:
+        print(f"skipped {stats['bad_blocks']} bad blocks, expected 2")
+        failures += 1
+    print(f"{len(decoded)} records in {stats['blocks']} blocks, {stats['bad_blocks']} bad blocks, "
+          f"{stats['skipped_bytes']} bytes skipped")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
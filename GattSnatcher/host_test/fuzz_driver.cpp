@@ -0,0 +1,75 @@
+#include "test_util.h"
+
+#include <cstdlib>
+#include <vector>
+
+/**
+ * Stand-in for libFuzzer where it is not available (GCC): feeds the seeds of the
+ * fuzz target and random mutations of them to LLVMFuzzerTestOneInput, so the target
+ * also runs under ctest. With Clang the same target links against -fsanitize=fuzzer
+ * instead, see CMakeLists.txt.
+ *
+ *   fuzz_x [iterations [seed]]
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+// Provided by every fuzz target: valid inputs to start the mutations from
+std::vector<std::vector<uint8_t>> fuzzSeeds();
+
+static void mutate(std::vector<uint8_t> &input, TestRng &rng)
+{
+    int edits = 1 + rng.below(4);
+    for (int e = 0; e < edits; e++) {
+        switch (rng.below(6)) {
+        case 0:
+            if (!input.empty()) {
+                input[rng.below(input.size())] ^= (uint8_t)(1 << rng.below(8));
+            }
+            break;
+        case 1:
+            if (!input.empty()) {
+                input[rng.below(input.size())] = (uint8_t)rng.next();
+            }
+            break;
+        case 2:
+            input.resize(rng.below(input.size() + 1));
+            break;
+        case 3:
+            input.insert(input.begin() + rng.below(input.size() + 1), (uint8_t)rng.next());
+            break;
+        case 4:
+            if (!input.empty()) {
+                input.erase(input.begin() + rng.below(input.size()));
+            }
+            break;
+        default:
+            // interesting values for length and count fields
+            if (!input.empty()) {
+                static const uint8_t values[] = {0x00, 0x01, 0x1F, 0x20, 0x7F, 0x80, 0xFE, 0xFF};
+                input[rng.below(input.size())] = values[rng.below(sizeof(values))];
+            }
+            break;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    uint32_t seed = argc > 2 ? (uint32_t)strtoul(argv[2], nullptr, 10) : 1;
+    std::vector<std::vector<uint8_t>> seeds = fuzzSeeds();
+    for (const std::vector<uint8_t> &s : seeds) {
+        LLVMFuzzerTestOneInput(s.data(), s.size());
+    }
+    TestRng rng(seed);
+    std::vector<uint8_t> input;
+    for (unsigned long i = 0; i < iterations; i++) {
+        input = seeds[rng.below(seeds.size())];
+        mutate(input, rng);
+        // an exact-size copy, so the sanitizers catch reads past the end
+        std::vector<uint8_t> exact(input);
+        exact.shrink_to_fit();
+        LLVMFuzzerTestOneInput(exact.empty() ? nullptr : exact.data(), exact.size());
+    }
+    printf("%lu inputs, seed %u\n", iterations + seeds.size(), (unsigned)seed);
+    return 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * Builders for the H4 HCI events the scanner receives, shared by the parser tests,
+ * the fuzz seeds and the benchmarks.
+ */
+struct TestAdvReport {
+    uint8_t eventType;
+    uint8_t addrType;
+    uint8_t address[6];
+    std::vector<uint8_t> data;
+    int8_t rssi;
+};
+
+struct TestExtAdvReport {
+    uint16_t eventType;
+    uint8_t addrType;
+    uint8_t address[6];
+    uint8_t primaryPhy;
+    uint8_t secondaryPhy;
+    uint8_t sid;
+    int8_t txPower;
+    int8_t rssi;
+    uint16_t periodicInterval;
+    std::vector<uint8_t> data;
+};
+
+// H4 type, LE meta event, parameter length, subevent, report count
+inline std::vector<uint8_t> hciLeMetaHeader(uint8_t subevent, uint8_t count)
+{
+    return {0x04, 0x3E, 0, subevent, count};
+}
+
+inline void hciFinishEvent(std::vector<uint8_t> &pkt)
+{
+    pkt[2] = (uint8_t)(pkt.size() - 3);
+}
+
+// HCI_LE_Advertising_Report with the fields of each report next to each other, the
+// layout the parser expects
+inline std::vector<uint8_t> hciAdvReportEvent(const std::vector<TestAdvReport> &reports)
+{
+    std::vector<uint8_t> pkt = hciLeMetaHeader(0x02, (uint8_t)reports.size());
+    for (const TestAdvReport &r : reports) {
+        pkt.push_back(r.eventType);
+        pkt.push_back(r.addrType);
+        pkt.insert(pkt.end(), r.address, r.address + 6);
+        pkt.push_back((uint8_t)r.data.size());
+        pkt.insert(pkt.end(), r.data.begin(), r.data.end());
+        pkt.push_back((uint8_t)r.rssi);
+    }
+    hciFinishEvent(pkt);
+    return pkt;
+}
+
+inline std::vector<uint8_t> hciExtAdvReportEvent(const std::vector<TestExtAdvReport> &reports)
+{
+    std::vector<uint8_t> pkt = hciLeMetaHeader(0x0D, (uint8_t)reports.size());
+    for (const TestExtAdvReport &r : reports) {
+        pkt.push_back(r.eventType & 0xFF);
+        pkt.push_back(r.eventType >> 8);
+        pkt.push_back(r.addrType);
+        pkt.insert(pkt.end(), r.address, r.address + 6);
+        pkt.push_back(r.primaryPhy);
+        pkt.push_back(r.secondaryPhy);
+        pkt.push_back(r.sid);
+        pkt.push_back((uint8_t)r.txPower);
+        pkt.push_back((uint8_t)r.rssi);
+        pkt.push_back(r.periodicInterval & 0xFF);
+        pkt.push_back(r.periodicInterval >> 8);
+        pkt.push_back(0);                           // direct address type
+        pkt.insert(pkt.end(), 6, 0);                // direct address
+        pkt.push_back((uint8_t)r.data.size());
+        pkt.insert(pkt.end(), r.data.begin(), r.data.end());
+    }
+    hciFinishEvent(pkt);
+    return pkt;
+}
+
+// A typical legacy report: flags plus manufacturer data of @p dataLen bytes in total
+inline TestAdvReport hciTypicalAdvReport(uint32_t device, uint8_t dataLen, uint8_t eventType = 0x00)
+{
+    TestAdvReport r = {};
+    r.eventType = eventType;
+    r.addrType = 0x01;
+    for (int i = 0; i < 4; i++) {
+        r.address[i] = (uint8_t)(device >> (8 * i));
+    }
+    r.address[5] = 0x40 | (uint8_t)(device >> 26);
+    r.rssi = (int8_t)(-40 - (int)(device % 50));
+    for (uint8_t i = 0; i < dataLen; i++) {
+        r.data.push_back((uint8_t)(device + i));
+    }
+    return r;
+}
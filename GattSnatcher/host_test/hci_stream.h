@@ -0,0 +1,85 @@
+#pragma once
+#include "hci_packets.h"
+#include "test_util.h"
+
+#include <cstdio>
+#include <vector>
+
+/**
+ * HCI event streams for the benchmarks that replay what the controller delivers.
+ *
+ * A recorded stream is a file of H4 events back to back (type 0x04, event code,
+ * parameter length, parameters), e.g. the HCI events of a btsnoop capture. Without
+ * one a synthetic busy-venue stream is used: 1-3 reports per event, mostly
+ * non-connectable, payloads of 0-31 bytes, a few extended reports in between.
+ */
+struct HciStreamPacket {
+    size_t offset;
+    uint16_t len;
+};
+
+inline bool hciLoadStream(const char *path, std::vector<uint8_t> &bytes, std::vector<HciStreamPacket> &packets)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr) {
+        return false;
+    }
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        bytes.insert(bytes.end(), buf, buf + n);
+    }
+    fclose(f);
+    size_t pos = 0;
+    while (pos + 3 <= bytes.size() && bytes[pos] == 0x04) {
+        uint16_t len = (uint16_t)(3 + bytes[pos + 2]);
+        if (pos + len > bytes.size()) {
+            break;
+        }
+        packets.push_back({pos, len});
+        pos += len;
+    }
+    return !packets.empty();
+}
+
+inline void hciSyntheticStream(std::vector<uint8_t> &bytes, std::vector<HciStreamPacket> &packets)
+{
+    TestRng rng(2024);
+    for (int e = 0; e < 100000; e++) {
+        std::vector<uint8_t> pkt;
+        if (rng.below(50) == 0) {
+            TestExtAdvReport r = {};
+            r.eventType = 0x0001;
+            r.primaryPhy = 1;
+            r.secondaryPhy = 2;
+            r.txPower = 127;
+            r.data.assign(1 + rng.below(200), 0x33);
+            pkt = hciExtAdvReportEvent({r});
+        } else {
+            std::vector<TestAdvReport> reports;
+            uint32_t count = 1 + (rng.below(10) == 0) + (rng.below(20) == 0);
+            for (uint32_t i = 0; i < count; i++) {
+                uint8_t type = rng.below(4) == 0 ? 0x00 : 0x03;
+                reports.push_back(hciTypicalAdvReport(rng.below(500), (uint8_t)rng.below(32), type));
+            }
+            pkt = hciAdvReportEvent(reports);
+        }
+        packets.push_back({bytes.size(), (uint16_t)pkt.size()});
+        bytes.insert(bytes.end(), pkt.begin(), pkt.end());
+    }
+}
+
+// The stream named on the command line, the synthetic one without an argument. @return false if unreadable
+inline bool hciStreamFromArgs(int argc, char **argv, std::vector<uint8_t> &bytes,
+                              std::vector<HciStreamPacket> &packets)
+{
+    if (argc > 1) {
+        if (!hciLoadStream(argv[1], bytes, packets)) {
+            fprintf(stderr, "no H4 events in %s\n", argv[1]);
+            return false;
+        }
+    } else {
+        hciSyntheticStream(bytes, packets);
+    }
+    return true;
+}
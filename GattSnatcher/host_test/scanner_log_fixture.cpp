@@ -0,0 +1,63 @@
+#include "scanner_session.h"
+
+#include <cstdio>
+
+/**
+ * Writes <prefix>.bin, a version 4 scanner log of a synthetic session with one
+ * corrupted block and a torn tail, and <prefix>.csv, the records a decoder must
+ * recover from it in the format of process_scanner_files.py. check_scanner_log.py
+ * then decodes the log with dataAnalysis/includes/scanner_log.py and compares.
+ */
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <output prefix>\n", argv[0]);
+        return 2;
+    }
+    SyntheticSession session;
+    std::vector<SessionRecord> records(20000);
+    for (SessionRecord &r : records) {
+        session.next(r);
+    }
+    std::vector<size_t> blockEnds;
+    std::vector<size_t> blockFirst;
+    std::vector<uint8_t> file = encodeScannerLog(records, &blockEnds, &blockFirst);
+    if (blockEnds.size() < 4) {
+        fprintf(stderr, "session too short: %zu blocks\n", blockEnds.size());
+        return 1;
+    }
+
+    // a flipped bit in the body of the third block
+    const size_t bad = 2;
+    file[blockEnds[bad - 1] + SCANNER_BLOCK_HEADER_SIZE + 5] ^= 0x10;
+    // and half of the last block lost to a power cut
+    const size_t last = blockEnds.size() - 1;
+    file.resize(blockEnds[last - 1] + (blockEnds[last] - blockEnds[last - 1]) / 2);
+
+    std::string path = std::string(argv[1]) + ".bin";
+    FILE *f = fopen(path.c_str(), "wb");
+    if (f == nullptr || fwrite(file.data(), 1, file.size(), f) != file.size()) {
+        perror(path.c_str());
+        return 1;
+    }
+    fclose(f);
+
+    path = std::string(argv[1]) + ".csv";
+    f = fopen(path.c_str(), "w");
+    if (f == nullptr) {
+        perror(path.c_str());
+        return 1;
+    }
+    fprintf(f, "%s\n", SESSION_CSV_HEADER);
+    size_t expected = 0;
+    for (size_t i = 0; i < blockFirst[last]; i++) {
+        if (i >= blockFirst[bad] && i < blockFirst[bad + 1]) {
+            continue;
+        }
+        fprintf(f, "%s\n", records[i].csvRow().c_str());
+        expected++;
+    }
+    fclose(f);
+    printf("%zu blocks, %zu of %zu records expected back\n", blockEnds.size(), expected, records.size());
+    return 0;
+}
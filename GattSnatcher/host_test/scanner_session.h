@@ -0,0 +1,220 @@
+#pragma once
+#include "scanner_log_encoder.h"
+#include "test_util.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// One advertising report as the scanner logs it
+struct SessionRecord {
+    int64_t timestamp = 0;
+    uint8_t advEventType = 0;
+    uint8_t addrType = 0;
+    uint8_t bdaddr[6] = {};
+    int8_t rssi = 0;
+    uint8_t extension[SCANNER_RECORD_EXT_SIZE] = {};
+    std::vector<uint8_t> advData;
+
+    bool extended() const { return advEventType == SCANNER_RECORD_EXT_MARKER; }
+
+    ScannerLogRecord view() const
+    {
+        return {timestamp, advEventType, addrType, bdaddr, (uint8_t)advData.size(), advData.data(), rssi,
+                extension};
+    }
+
+    // Size of the record in the flat version 2 format
+    size_t flatSize() const { return 16 + (extended() ? SCANNER_RECORD_EXT_SIZE : 0) + advData.size(); }
+
+    // The row process_scanner_files.py writes for the record
+    std::string csvRow() const
+    {
+        char buf[160];
+        std::string row;
+        const uint8_t *m = bdaddr;
+        if (extended()) {
+            snprintf(buf, sizeof(buf), "%lld,%u,%u,%02X:%02X:%02X:%02X:%02X:%02X,%zu,%d,%u,%u,%u,%d,%u,",
+                     (long long)timestamp, (unsigned)(extension[0] | extension[1] << 8), addrType, m[5], m[4],
+                     m[3], m[2], m[1], m[0], advData.size(), rssi, extension[2], extension[3], extension[4],
+                     (int8_t)extension[5], (unsigned)(extension[6] | extension[7] << 8));
+        } else {
+            snprintf(buf, sizeof(buf), "%lld,%u,%u,%02X:%02X:%02X:%02X:%02X:%02X,%zu,%d,,,,,,", (long long)timestamp,
+                     advEventType, addrType, m[5], m[4], m[3], m[2], m[1], m[0], advData.size(), rssi);
+        }
+        row = buf;
+        for (uint8_t b : advData) {
+            snprintf(buf, sizeof(buf), "%02x", b);
+            row += buf;
+        }
+        return row;
+    }
+};
+
+#define SESSION_CSV_HEADER                                                                                          \
+    "timestamp_us,adv_event_type,addr_type,mac_address,adv_data_length,rssi,primary_phy,secondary_phy,sid,"         \
+    "tx_power,periodic_adv_interval,adv_data"
+
+/**
+ * Synthetic scan session: a crowd of devices of which a few advertise often, with
+ * payloads that mostly repeat and sometimes change a byte (counters, battery levels),
+ * some random-address devices rotating their address, and a share of extended reports
+ * with longer payloads.
+ */
+class SyntheticSession {
+public:
+    explicit SyntheticSession(uint32_t devices = 400, uint32_t seed = 7) : _rng(seed), _devices(devices)
+    {
+        for (uint32_t i = 0; i < devices; i++) {
+            Device &d = _devices[i];
+            d.addrType = _rng.below(3) == 0 ? 0 : 1;
+            for (uint8_t &b : d.bdaddr) {
+                b = (uint8_t)_rng.next();
+            }
+            d.extended = _rng.below(10) == 0;
+            d.payload.resize(d.extended ? 20 + _rng.below(180) : 3 + _rng.below(29));
+            for (uint8_t &b : d.payload) {
+                b = (uint8_t)_rng.next();
+            }
+            d.rssi = -40 - (int)_rng.below(55);
+        }
+    }
+
+    void next(SessionRecord &r)
+    {
+        _now += 200 + _rng.below(4000);
+        Device &d = _devices[_rng.below(8) == 0 ? _rng.below(_devices.size()) : _rng.below(_devices.size() / 8)];
+        if (_rng.below(8) == 0) {
+            d.payload[_rng.below(d.payload.size())] = (uint8_t)_rng.next();
+        }
+        if (d.addrType == 1 && _rng.below(2000) == 0) {
+            d.bdaddr[0] = (uint8_t)_rng.next();     // address rotation
+        }
+        r.timestamp = _now;
+        r.addrType = d.addrType;
+        memcpy(r.bdaddr, d.bdaddr, 6);
+        r.rssi = (int8_t)(d.rssi + (int)_rng.below(7) - 3);
+        r.advData = d.payload;
+        if (d.extended) {
+            r.advEventType = SCANNER_RECORD_EXT_MARKER;
+            uint8_t ext[SCANNER_RECORD_EXT_SIZE] = {0x00, 0x00, 1, 2, (uint8_t)(d.bdaddr[1] & 0x0F), 0x7F, 0, 0};
+            memcpy(r.extension, ext, sizeof(ext));
+        } else {
+            r.advEventType = (uint8_t)_rng.below(4);
+        }
+    }
+
+private:
+    struct Device {
+        uint8_t addrType;
+        uint8_t bdaddr[6];
+        bool extended;
+        int rssi;
+        std::vector<uint8_t> payload;
+    };
+    TestRng _rng;
+    std::vector<Device> _devices;
+    int64_t _now = 1000000;
+};
+
+static int hexNibble(char c)
+{
+    return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+/**
+ * Reads a session CSV as written by dataAnalysis/process_scanner_files.py.
+ * @return false if the file cannot be read
+ */
+inline bool readSessionCsv(const char *path, std::vector<SessionRecord> &out)
+{
+    FILE *f = fopen(path, "r");
+    if (f == nullptr) {
+        return false;
+    }
+    char line[1024];
+    if (fgets(line, sizeof(line), f) == nullptr) {     // column names
+        fclose(f);
+        return false;
+    }
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        const char *fields[12];
+        size_t n = 0;
+        char *p = line;
+        fields[n++] = p;
+        while (*p != '\0' && *p != '\n' && *p != '\r') {
+            if (*p == ',' && n < 12) {
+                *p = '\0';
+                fields[n++] = p + 1;
+            }
+            p++;
+        }
+        *p = '\0';
+        if (n != 12) {
+            continue;
+        }
+        SessionRecord r;
+        r.timestamp = strtoll(fields[0], nullptr, 10);
+        unsigned eventType = (unsigned)strtoul(fields[1], nullptr, 10);
+        r.addrType = (uint8_t)atoi(fields[2]);
+        for (int i = 0; i < 6; i++) {
+            r.bdaddr[5 - i] = (uint8_t)strtoul(fields[3] + 3 * i, nullptr, 16);
+        }
+        r.rssi = (int8_t)atoi(fields[5]);
+        if (fields[6][0] != '\0') {
+            r.advEventType = SCANNER_RECORD_EXT_MARKER;
+            unsigned interval = (unsigned)strtoul(fields[10], nullptr, 10);
+            uint8_t ext[SCANNER_RECORD_EXT_SIZE] = {(uint8_t)eventType, (uint8_t)(eventType >> 8),
+                                                    (uint8_t)atoi(fields[6]), (uint8_t)atoi(fields[7]),
+                                                    (uint8_t)atoi(fields[8]), (uint8_t)atoi(fields[9]),
+                                                    (uint8_t)interval, (uint8_t)(interval >> 8)};
+            memcpy(r.extension, ext, sizeof(ext));
+        } else {
+            r.advEventType = (uint8_t)eventType;
+        }
+        for (const char *h = fields[11]; h[0] != '\0' && h[1] != '\0'; h += 2) {
+            r.advData.push_back((uint8_t)(hexNibble(h[0]) << 4 | hexNibble(h[1])));
+        }
+        out.push_back(std::move(r));
+    }
+    fclose(f);
+    return true;
+}
+
+/**
+ * Encodes @p records into a version 4 log image, the way FilePrintController writes it.
+ * @p blockEnds receives the end offset of every block.
+ */
+inline std::vector<uint8_t> encodeScannerLog(const std::vector<SessionRecord> &records,
+                                             std::vector<size_t> *blockEnds = nullptr,
+                                             std::vector<size_t> *blockFirstRecord = nullptr)
+{
+    static ScannerLogEncoder encoder;
+    std::vector<uint8_t> file = {'G', 'S', 'N', 'L', SCANNER_LOG_VERSION, 0, 0, 0};
+    const uint8_t *block;
+    size_t len;
+    auto flush = [&]() {
+        if ((len = encoder.finish(block)) > 0) {
+            file.insert(file.end(), block, block + len);
+            if (blockEnds != nullptr) {
+                blockEnds->push_back(file.size());
+            }
+        }
+    };
+    for (size_t i = 0; i < records.size(); i++) {
+        if (encoder.empty() && blockFirstRecord != nullptr) {
+            blockFirstRecord->push_back(i);
+        }
+        if (!encoder.add(records[i].view())) {
+            flush();
+            if (blockFirstRecord != nullptr) {
+                blockFirstRecord->push_back(i);
+            }
+            encoder.add(records[i].view());
+        }
+    }
+    flush();
+    return file;
+}
@@ -0,0 +1,6 @@
+#pragma once
+// Host stand-in for the HCI example component header, only what the host-built sources use
+#define H4_TYPE_COMMAND 0x01
+#define H4_TYPE_EVENT 0x04
+#define LE_META_EVENTS 0x3E
+#define HCI_LE_ADV_REPORT 0x02
@@ -0,0 +1,28 @@
+#pragma once
+// Host stand-in for the ESP-IDF header, only the types struct_and_definitions.h needs
+#include "esp_bt_defs.h"
+
+#define ESP_GATT_MAX_READ_MULTI_HANDLES 10
+
+typedef uint8_t esp_gatt_char_prop_t;
+
+typedef struct {
+    esp_bt_uuid_t uuid;
+    uint8_t inst_id;
+} esp_gatt_id_t;
+
+typedef struct {
+    esp_gatt_id_t id;
+    bool is_primary;
+} esp_gatt_srvc_id_t;
+
+typedef struct {
+    uint16_t char_handle;
+    esp_gatt_char_prop_t properties;
+    esp_bt_uuid_t uuid;
+} esp_gattc_char_elem_t;
+
+typedef struct {
+    uint8_t num_attr;
+    uint16_t handles[ESP_GATT_MAX_READ_MULTI_HANDLES];
+} esp_gattc_multi_t;
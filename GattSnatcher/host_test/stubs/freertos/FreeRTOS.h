@@ -0,0 +1,5 @@
+#pragma once
+// Host stand-in for the FreeRTOS header, only the types struct_and_definitions.h needs
+#include <cstdint>
+
+typedef uint32_t TickType_t;
@@ -0,0 +1,3 @@
+#pragma once
+// Host stand-in, nothing from this header is used by the host-built sources
+#include "FreeRTOS.h"
@@ -0,0 +1,274 @@
+#include "buffered_log_writer.h"
+#include "test_util.h"
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <unistd.h>
+#include <vector>
+
+// Built with a short CONFIG_LOG_WRITER_COMMIT_MS, see CMakeLists.txt
+static const char *PATH_A = "test_log_writer_a.bin";
+static const char *PATH_B = "test_log_writer_b.bin";
+static constexpr size_t RECORD_SIZE = 24;
+
+static void makeRecord(uint32_t seq, uint8_t *rec)
+{
+    memcpy(rec, &seq, 4);
+    memset(rec + 4, seq & 0xFF, RECORD_SIZE - 4);
+}
+
+// Sequence numbers of the records in @p path, -1 for a damaged record
+static std::vector<int64_t> readRecords(const char *path)
+{
+    std::vector<int64_t> seqs;
+    FILE *f = fopen(path, "r");
+    if (f == nullptr) {
+        return seqs;
+    }
+    uint8_t rec[RECORD_SIZE];
+    uint8_t expected[RECORD_SIZE];
+    while (fread(rec, 1, sizeof(rec), f) == sizeof(rec)) {
+        uint32_t seq;
+        memcpy(&seq, rec, 4);
+        makeRecord(seq, expected);
+        seqs.push_back(memcmp(rec, expected, sizeof(rec)) == 0 ? seq : -1);
+    }
+    fclose(f);
+    return seqs;
+}
+
+static bool isSequence(const std::vector<int64_t> &seqs, int64_t first, size_t count)
+{
+    if (seqs.size() != count) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (seqs[i] != first + (int64_t)i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void testWritesAllRecordsInOrder()
+{
+    FILE *f = fopen(PATH_A, "w");
+    auto writer = std::make_unique<BufferedLogWriter>();
+    CHECK(writer->start(f));
+    CHECK(!writer->start(f));
+    const uint32_t n = 20000;
+    uint8_t rec[RECORD_SIZE];
+    uint32_t accepted = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        makeRecord(accepted, rec);
+        if (writer->write(rec, sizeof(rec))) {
+            accepted++;
+        }
+    }
+    CHECK(writer->flush());
+    BufferedLogWriter::Stats st = writer->stats();
+    CHECK_EQ(accepted + st.droppedRecords, n);
+    CHECK_EQ(st.bytesWritten, (uint64_t)accepted * RECORD_SIZE);
+    CHECK_EQ(st.writeErrors, 0);
+    // records are never split across pages, so every page write is whole records
+    CHECK(st.pagesWritten >= accepted * RECORD_SIZE / BufferedLogWriter::PAGE_SIZE);
+    CHECK(isSequence(readRecords(PATH_A), 0, accepted));
+    writer->stop();
+    fclose(f);
+}
+
+static void testRejectsOversizedAndStopped()
+{
+    auto writer = std::make_unique<BufferedLogWriter>();
+    uint8_t rec[RECORD_SIZE] = {};
+    CHECK(!writer->write(rec, sizeof(rec)));
+    CHECK(!writer->flush());
+    static uint8_t big[BufferedLogWriter::PAGE_SIZE + 1];
+    FILE *f = fopen(PATH_A, "w");
+    CHECK(writer->start(f));
+    CHECK(!writer->write(big, sizeof(big)));
+    CHECK(writer->write(big, BufferedLogWriter::PAGE_SIZE));
+    writer->stop();
+    fclose(f);
+}
+
+static void testTimeDrivenCommit()
+{
+    FILE *f = fopen(PATH_A, "w");
+    auto writer = std::make_unique<BufferedLogWriter>();
+    CHECK(writer->start(f));
+    uint8_t rec[RECORD_SIZE];
+    makeRecord(0, rec);
+    CHECK(writer->write(rec, sizeof(rec)));
+    CHECK_EQ(writer->stats().bytesWritten, 0);
+    // one page far from full: only the commit interval gets it to the file
+    std::this_thread::sleep_for(std::chrono::milliseconds(CONFIG_LOG_WRITER_COMMIT_MS * 4));
+    BufferedLogWriter::Stats st = writer->stats();
+    CHECK_EQ(st.bytesWritten, RECORD_SIZE);
+    CHECK(st.commits >= 1);
+    CHECK(isSequence(readRecords(PATH_A), 0, 1));
+    writer->stop();
+    fclose(f);
+}
+
+static void testStopCommitsEverything()
+{
+    FILE *f = fopen(PATH_A, "w");
+    auto writer = std::make_unique<BufferedLogWriter>();
+    CHECK(writer->start(f));
+    uint8_t rec[RECORD_SIZE];
+    for (uint32_t i = 0; i < 10; i++) {
+        makeRecord(i, rec);
+        CHECK(writer->write(rec, sizeof(rec)));
+    }
+    writer->stop();
+    fclose(f);
+    CHECK(isSequence(readRecords(PATH_A), 0, 10));
+}
+
+static void testSwitchFile()
+{
+    FILE *a = fopen(PATH_A, "w");
+    FILE *b = fopen(PATH_B, "w");
+    auto writer = std::make_unique<BufferedLogWriter>();
+    CHECK(writer->start(a));
+    uint8_t rec[RECORD_SIZE];
+    for (uint32_t i = 0; i < 300; i++) {
+        makeRecord(i, rec);
+        CHECK(writer->write(rec, sizeof(rec)));
+    }
+    CHECK(writer->switchFile(b));
+    for (uint32_t i = 300; i < 400; i++) {
+        makeRecord(i, rec);
+        CHECK(writer->write(rec, sizeof(rec)));
+    }
+    CHECK(writer->flush());
+    // the writer closed the first file, everything before the switch is in it
+    CHECK(isSequence(readRecords(PATH_A), 0, 300));
+    CHECK(isSequence(readRecords(PATH_B), 300, 100));
+    writer->stop();
+    fclose(b);
+}
+
+/**
+ * rotate() does no file I/O on the caller: the writer thread opens the next file,
+ * and an opener that fails leaves the log in the current file.
+ */
+static void testRotate()
+{
+    FILE *a = fopen(PATH_A, "w");
+    FILE *b = nullptr;
+    std::thread::id openerThread;
+    int opened = 0;
+    bool fail = true;
+    std::atomic<bool> hold(false);
+    auto writer = std::make_unique<BufferedLogWriter>();
+    CHECK(!writer->rotate());
+    CHECK(writer->start(a, [&]() -> FILE * {
+        openerThread = std::this_thread::get_id();
+        opened++;
+        while (hold) {
+            std::this_thread::yield();
+        }
+        return fail ? nullptr : (b = fopen(PATH_B, "w"));
+    }));
+    uint8_t rec[RECORD_SIZE];
+    uint32_t seq = 0;
+    for (; seq < 100; seq++) {
+        makeRecord(seq, rec);
+        CHECK(writer->write(rec, sizeof(rec)));
+    }
+    CHECK(writer->rotate());
+    CHECK(writer->flush());
+    CHECK_EQ(opened, 1);
+    CHECK(openerThread != std::this_thread::get_id());
+
+    fail = false;
+    hold = true;
+    for (; seq < 200; seq++) {
+        makeRecord(seq, rec);
+        CHECK(writer->write(rec, sizeof(rec)));
+    }
+    CHECK(writer->rotate());
+    // one rotation at a time
+    CHECK(!writer->rotate());
+    CHECK(!writer->switchFile(a));
+    hold = false;
+    for (; seq < 250; seq++) {
+        makeRecord(seq, rec);
+        CHECK(writer->write(rec, sizeof(rec)));
+    }
+    CHECK(writer->flush());
+    CHECK_EQ(opened, 2);
+    CHECK(isSequence(readRecords(PATH_A), 0, 200));
+    CHECK(isSequence(readRecords(PATH_B), 200, 50));
+    writer->stop();
+    if (b != nullptr) {
+        fclose(b);
+    }
+}
+
+/**
+ * A stalled file (a pipe nobody reads) fills every page: write() must drop records
+ * instead of blocking, and what does reach the file is still whole records in order.
+ */
+static void testDropsInsteadOfBlocking()
+{
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    FILE *out = fdopen(fds[1], "w");
+    auto writer = std::make_unique<BufferedLogWriter>();
+    CHECK(writer->start(out));
+    uint8_t rec[RECORD_SIZE];
+    uint32_t accepted = 0;
+    int64_t worstNs = 0;
+    // far more than the pipe buffer and all pages can hold
+    const uint32_t n = (1 << 20) / RECORD_SIZE + BufferedLogWriter::PAGES * BufferedLogWriter::PAGE_SIZE;
+    for (uint32_t i = 0; i < n; i++) {
+        makeRecord(accepted, rec);
+        int64_t start = hostNowNs();
+        accepted += writer->write(rec, sizeof(rec));
+        int64_t took = hostNowNs() - start;
+        worstNs = took > worstNs ? took : worstNs;
+    }
+    BufferedLogWriter::Stats st = writer->stats();
+    CHECK(st.droppedRecords > 0);
+    CHECK_EQ(accepted + st.droppedRecords, n);
+    printf("  %u accepted, %u dropped, worst write() %lld us\n", (unsigned)accepted,
+           (unsigned)st.droppedRecords, (long long)(worstNs / 1000));
+    CHECK(worstNs < 100000000);
+
+    // drain the pipe so the writer can finish
+    std::vector<int64_t> seqs;
+    std::thread reader([&] {
+        FILE *in = fdopen(fds[0], "r");
+        uint8_t r[RECORD_SIZE];
+        while (fread(r, 1, sizeof(r), in) == sizeof(r)) {
+            uint32_t seq;
+            memcpy(&seq, r, 4);
+            seqs.push_back(seq);
+        }
+        fclose(in);
+    });
+    writer->stop();
+    fclose(out);
+    reader.join();
+    // fsync() fails on a pipe, which must show up as a write error, nothing else
+    CHECK(writer->stats().writeErrors > 0);
+    CHECK(isSequence(seqs, 0, accepted));
+}
+
+int main()
+{
+    RUN_TEST(testWritesAllRecordsInOrder);
+    RUN_TEST(testRejectsOversizedAndStopped);
+    RUN_TEST(testTimeDrivenCommit);
+    RUN_TEST(testStopCommitsEverything);
+    RUN_TEST(testSwitchFile);
+    RUN_TEST(testRotate);
+    RUN_TEST(testDropsInsteadOfBlocking);
+    remove(PATH_A);
+    remove(PATH_B);
+    return TEST_MAIN_RESULT();
+}
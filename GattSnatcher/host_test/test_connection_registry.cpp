@@ -0,0 +1,168 @@
+#include "connection_registry.h"
+#include "test_util.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static const uint8_t MAC_A[6] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+static const uint8_t MAC_B[6] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x67};
+
+static int64_t elapsedMs(int64_t startNs)
+{
+    return (hostNowNs() - startNs) / 1000000;
+}
+
+// Spins until @p n waiters are blocked, so the add() really has to wake them
+static void waitForWaiters(std::atomic<int> &started, int n)
+{
+    while (started.load() < n) {
+        std::this_thread::yield();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+}
+
+static void testTable()
+{
+    ConnectionRegistry registry;
+    uint16_t connId = 0;
+    CHECK(!registry.find(MAC_A, connId));
+    CHECK(registry.add(MAC_A, 3));
+    CHECK(registry.find(MAC_A, connId));
+    CHECK_EQ(connId, 3);
+    CHECK(registry.add(MAC_A, 4));     // update, not a second entry
+    CHECK(registry.find(MAC_A, connId));
+    CHECK_EQ(connId, 4);
+    CHECK_EQ(registry.size(), 1);
+    CHECK(!registry.remove(MAC_B));
+    CHECK(registry.remove(MAC_A));
+    CHECK(!registry.find(MAC_A, connId));
+
+    uint8_t mac[6] = {};
+    for (size_t i = 0; i < ConnectionRegistry::CAPACITY; i++) {
+        mac[5] = (uint8_t)i;
+        CHECK(registry.add(mac, (uint16_t)i));
+    }
+    mac[5] = 0xFF;
+    CHECK(!registry.add(mac, 99));
+    CHECK_EQ(registry.size(), ConnectionRegistry::CAPACITY);
+}
+
+static void testWaitForExisting()
+{
+    ConnectionRegistry registry;
+    registry.add(MAC_A, 7);
+    uint16_t connId = 0;
+    int64_t start = hostNowNs();
+    CHECK(registry.wait(MAC_A, connId, 1000) == ConnectionRegistry::WaitResult::Found);
+    CHECK_EQ(connId, 7);
+    CHECK(elapsedMs(start) < 50);
+}
+
+static void testTimeout()
+{
+    ConnectionRegistry registry;
+    uint16_t connId = 0xBEEF;
+    int64_t start = hostNowNs();
+    CHECK(registry.wait(MAC_A, connId, 100) == ConnectionRegistry::WaitResult::Timeout);
+    int64_t ms = elapsedMs(start);
+    CHECK(ms >= 100);
+    CHECK(ms < 1000);
+    CHECK_EQ(connId, 0xBEEF);
+    // a connection to another device does not end the wait early
+    std::thread other([&registry] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        registry.add(MAC_B, 1);
+    });
+    start = hostNowNs();
+    CHECK(registry.wait(MAC_A, connId, 150) == ConnectionRegistry::WaitResult::Timeout);
+    CHECK(elapsedMs(start) >= 150);
+    other.join();
+}
+
+static void testWakeup()
+{
+    ConnectionRegistry registry;
+    std::atomic<int> started{0};
+    ConnectionRegistry::WaitResult result = ConnectionRegistry::WaitResult::Timeout;
+    uint16_t connId = 0;
+    int64_t wokenNs = 0;
+    std::thread waiter([&] {
+        started++;
+        result = registry.wait(MAC_A, connId, 5000);
+        wokenNs = hostNowNs();
+    });
+    waitForWaiters(started, 1);
+    int64_t addedNs = hostNowNs();
+    CHECK(registry.add(MAC_A, 42));
+    waiter.join();
+    CHECK(result == ConnectionRegistry::WaitResult::Found);
+    CHECK_EQ(connId, 42);
+    // woken by add(), not by the timeout or a poll interval
+    int64_t latencyUs = (wokenNs - addedNs) / 1000;
+    printf("  wakeup latency %lld us\n", (long long)latencyUs);
+    CHECK(latencyUs < 50000);
+}
+
+static void testWakesOnlyMatchingWaiters()
+{
+    ConnectionRegistry registry;
+    std::atomic<int> started{0};
+    std::atomic<int> found{0};
+    std::atomic<int> timedOut{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 3; i++) {
+        threads.emplace_back([&, i] {
+            uint16_t connId;
+            started++;
+            // two waiters for A, one for B
+            auto r = registry.wait(i < 2 ? MAC_A : MAC_B, connId, 300);
+            if (r == ConnectionRegistry::WaitResult::Found && connId == 9) {
+                found++;
+            } else if (r == ConnectionRegistry::WaitResult::Timeout) {
+                timedOut++;
+            }
+        });
+    }
+    waitForWaiters(started, 3);
+    registry.add(MAC_A, 9);
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    CHECK_EQ(found.load(), 2);
+    CHECK_EQ(timedOut.load(), 1);
+}
+
+static void testNoWaiterSlot()
+{
+    ConnectionRegistry registry;
+    std::atomic<int> started{0};
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < ConnectionRegistry::MAX_WAITERS; i++) {
+        threads.emplace_back([&] {
+            uint16_t connId;
+            started++;
+            registry.wait(MAC_A, connId, 2000);
+        });
+    }
+    waitForWaiters(started, (int)ConnectionRegistry::MAX_WAITERS);
+    uint16_t connId;
+    CHECK(registry.wait(MAC_B, connId, 10) == ConnectionRegistry::WaitResult::NoWaiterSlot);
+    registry.add(MAC_A, 1);
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    // the slots are free again
+    CHECK(registry.wait(MAC_B, connId, 10) == ConnectionRegistry::WaitResult::Timeout);
+}
+
+int main()
+{
+    RUN_TEST(testTable);
+    RUN_TEST(testWaitForExisting);
+    RUN_TEST(testTimeout);
+    RUN_TEST(testWakeup);
+    RUN_TEST(testWakesOnlyMatchingWaiters);
+    RUN_TEST(testNoWaiterSlot);
+    return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,214 @@
+#include "device_store.h"
+#include "test_util.h"
+
+#include <memory>
+
+static const char *LOG_PATH = "test_device_store.log";
+
+static uint64_t keyOf(uint32_t n, uint8_t addrType = 0)
+{
+    uint8_t address[6] = {0xC0, 0xFF, (uint8_t)(n >> 24), (uint8_t)(n >> 16), (uint8_t)(n >> 8), (uint8_t)n};
+    return DeviceStore::makeKey(address, addrType);
+}
+
+static long fileSize(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == nullptr) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+static void testKeys()
+{
+    uint8_t zero[6] = {};
+    CHECK(DeviceStore::makeKey(zero, 0) != 0);
+    CHECK(keyOf(1, 0) != keyOf(1, 1));
+    CHECK(keyOf(1) != keyOf(256));
+}
+
+static void testRecordAndFind()
+{
+    remove(LOG_PATH);
+    auto store = std::make_unique<DeviceStore>();
+    CHECK(store->open(LOG_PATH));
+    CHECK_EQ(store->boot(), 0);
+    CHECK(store->find(keyOf(1)) == nullptr);
+
+    CHECK(store->recordFailure(keyOf(1), 10));
+    CHECK(store->recordFailure(keyOf(1), 11));
+    const DeviceStore::Entry *e = store->find(keyOf(1));
+    CHECK(e != nullptr);
+    CHECK_EQ(e->failures, 2);
+    CHECK_EQ(e->flags & DEVICE_STORE_FLAG_PROFILED, 0);
+    CHECK_EQ(e->timeS, 11);
+
+    CHECK(store->recordProfiled(keyOf(1), 0x1122334455667788ULL, 20));
+    e = store->find(keyOf(1));
+    CHECK_EQ(e->failures, 0);
+    CHECK(e->fingerprint == 0x1122334455667788ULL);
+    CHECK(e->flags & DEVICE_STORE_FLAG_PROFILED);
+    CHECK_EQ(store->size(), 1);
+    CHECK_EQ(store->logRecords(), 3);
+    CHECK_EQ(fileSize(LOG_PATH), 3 * DEVICE_STORE_RECORD_SIZE);
+}
+
+static void testReplay()
+{
+    remove(LOG_PATH);
+    auto store = std::make_unique<DeviceStore>();
+    CHECK(store->open(LOG_PATH));
+    for (uint32_t i = 0; i < 50; i++) {
+        CHECK(store->recordFailure(keyOf(i), i));
+    }
+    CHECK(store->recordProfiled(keyOf(7), 0xABCD, 100));
+    store->close();
+
+    auto replayed = std::make_unique<DeviceStore>();
+    CHECK(replayed->open(LOG_PATH));
+    CHECK_EQ(replayed->boot(), 1);
+    CHECK_EQ(replayed->size(), 50);
+    const DeviceStore::Entry *e = replayed->find(keyOf(7));
+    CHECK(e != nullptr && e->fingerprint == 0xABCD && e->failures == 0 && e->boot == 0 && e->timeS == 100);
+    e = replayed->find(keyOf(8));
+    CHECK(e != nullptr && e->failures == 1 && e->timeS == 8);
+
+    // records written now carry the new boot number
+    CHECK(replayed->recordFailure(keyOf(8), 5));
+    CHECK_EQ(replayed->find(keyOf(8))->boot, 1);
+    replayed->close();
+    auto again = std::make_unique<DeviceStore>();
+    CHECK(again->open(LOG_PATH));
+    CHECK_EQ(again->boot(), 2);
+}
+
+static void testTornTailIsCompacted()
+{
+    remove(LOG_PATH);
+    auto store = std::make_unique<DeviceStore>();
+    CHECK(store->open(LOG_PATH));
+    for (uint32_t i = 0; i < 10; i++) {
+        CHECK(store->recordFailure(keyOf(i), i));
+        CHECK(store->recordFailure(keyOf(i), i + 1));
+    }
+    store->close();
+    FILE *f = fopen(LOG_PATH, "a");
+    fwrite("torn", 1, 4, f);
+    fclose(f);
+
+    auto replayed = std::make_unique<DeviceStore>();
+    CHECK(replayed->open(LOG_PATH));
+    CHECK_EQ(replayed->size(), 10);
+    // compacted to one record per device, the garbage is gone
+    CHECK_EQ(fileSize(LOG_PATH), 10 * DEVICE_STORE_RECORD_SIZE);
+    CHECK(replayed->recordFailure(keyOf(3), 50));
+    replayed->close();
+
+    auto again = std::make_unique<DeviceStore>();
+    CHECK(again->open(LOG_PATH));
+    CHECK_EQ(again->size(), 10);
+    CHECK_EQ(again->find(keyOf(3))->failures, 3);
+}
+
+static void testCorruptRecordEndsReplay()
+{
+    remove(LOG_PATH);
+    auto store = std::make_unique<DeviceStore>();
+    CHECK(store->open(LOG_PATH));
+    for (uint32_t i = 0; i < 10; i++) {
+        CHECK(store->recordFailure(keyOf(i), i));
+    }
+    store->close();
+    // flip a byte of the sixth record
+    FILE *f = fopen(LOG_PATH, "r+");
+    fseek(f, 5 * DEVICE_STORE_RECORD_SIZE + 3, SEEK_SET);
+    fputc(0x5A, f);
+    fclose(f);
+
+    auto replayed = std::make_unique<DeviceStore>();
+    CHECK(replayed->open(LOG_PATH));
+    CHECK_EQ(replayed->size(), 5);
+    CHECK(replayed->find(keyOf(4)) != nullptr);
+    CHECK(replayed->find(keyOf(5)) == nullptr);
+    CHECK_EQ(fileSize(LOG_PATH), 5 * DEVICE_STORE_RECORD_SIZE);
+}
+
+static void testAutomaticCompaction()
+{
+    remove(LOG_PATH);
+    auto store = std::make_unique<DeviceStore>();
+    CHECK(store->open(LOG_PATH));
+    for (uint32_t i = 0; i < 5000; i++) {
+        CHECK(store->recordFailure(keyOf(i % 20), i));
+    }
+    size_t bound = DEVICE_STORE_COMPACT_RATIO * 20 + DeviceStore::CAPACITY / 4;
+    CHECK(store->logRecords() <= bound);
+    CHECK(fileSize(LOG_PATH) <= (long)(bound * DEVICE_STORE_RECORD_SIZE));
+    CHECK_EQ(store->find(keyOf(19))->failures, 250);
+    store->close();
+
+    auto replayed = std::make_unique<DeviceStore>();
+    CHECK(replayed->open(LOG_PATH));
+    CHECK_EQ(replayed->size(), 20);
+    CHECK_EQ(replayed->find(keyOf(0))->failures, 250);
+}
+
+/**
+ * A full store makes room for a new device: the oldest never-profiled devices are
+ * forgotten first, profiled ones survive, and the replay does not bring anyone back.
+ */
+static void testEvictionWhenFull()
+{
+    remove(LOG_PATH);
+    auto store = std::make_unique<DeviceStore>();
+    CHECK(store->open(LOG_PATH));
+    const uint32_t capacity = DeviceStore::CAPACITY;
+    const uint32_t share = capacity / DEVICE_STORE_EVICT_DIVISOR;
+    for (uint32_t i = 0; i < capacity; i++) {
+        CHECK(i < 4 ? store->recordProfiled(keyOf(i), 0xF00D + i, i) : store->recordFailure(keyOf(i), i));
+    }
+    CHECK_EQ(store->size(), capacity);
+    CHECK_EQ(store->evicted(), 0);
+
+    CHECK(store->recordFailure(keyOf(capacity), capacity));
+    CHECK_EQ(store->evicted(), share);
+    CHECK_EQ(store->size(), capacity - share + 1);
+    for (uint32_t i = 0; i <= capacity; i++) {
+        // the profiled ones are kept despite their age, then the oldest failures go
+        bool kept = i < 4 || i >= 4 + share;
+        CHECK_EQ(store->find(keyOf(i)) != nullptr, kept);
+    }
+    store->close();
+
+    auto replayed = std::make_unique<DeviceStore>();
+    CHECK(replayed->open(LOG_PATH));
+    CHECK_EQ(replayed->size(), capacity - share + 1);
+    CHECK_EQ(replayed->droppedRecords(), 0);
+    CHECK(replayed->find(keyOf(4)) == nullptr);
+    CHECK(replayed->find(keyOf(0))->fingerprint == 0xF00D);
+
+    // keeps accepting new devices
+    for (uint32_t i = capacity + 1; i < 3 * capacity; i++) {
+        CHECK(replayed->recordFailure(keyOf(i), i));
+    }
+    CHECK(replayed->size() <= capacity);
+    CHECK(replayed->find(keyOf(3 * capacity - 1)) != nullptr);
+    CHECK(replayed->find(keyOf(1)) != nullptr);
+}
+
+int main()
+{
+    RUN_TEST(testKeys);
+    RUN_TEST(testRecordAndFind);
+    RUN_TEST(testReplay);
+    RUN_TEST(testTornTailIsCompacted);
+    RUN_TEST(testCorruptRecordEndsReplay);
+    RUN_TEST(testAutomaticCompaction);
+    RUN_TEST(testEvictionWhenFull);
+    remove(LOG_PATH);
+    return TEST_MAIN_RESULT();
+}
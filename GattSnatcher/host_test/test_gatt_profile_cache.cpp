@@ -0,0 +1,154 @@
+#include "gatt_profile_cache.h"
+#include "test_util.h"
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+static const char *PATH = "test_gatt_profile_cache.bin";
+
+static esp_bt_uuid_t uuid16(uint16_t uuid)
+{
+    esp_bt_uuid_t u = {};
+    u.len = ESP_UUID_LEN_16;
+    u.uuid.uuid16 = uuid;
+    return u;
+}
+
+// A profile of one service with a manufacturer name (stable) and a serial number (not)
+static std::unique_ptr<gattc_profile_inst> makeProfile(uint16_t serviceUuid, const std::string &manufacturer)
+{
+    auto profile = std::make_unique<gattc_profile_inst>();
+    ServiceWrapper srv = {};
+    srv.service.id.uuid = uuid16(serviceUuid);
+    srv.service.is_primary = true;
+    CharacteristicWrapper name = {};
+    name.meta.uuid = uuid16(0x2A29);
+    name.meta.char_handle = 3;
+    name.value.assign(manufacturer.begin(), manufacturer.end());
+    name.readable = true;
+    CharacteristicWrapper serial = {};
+    serial.meta.uuid = uuid16(0x2A25);
+    serial.meta.char_handle = 5;
+    serial.value = {1, 2, 3};
+    serial.readable = true;
+    srv.chars = {name, serial};
+    profile->services.push_back(srv);
+    return profile;
+}
+
+// @return the manufacturer name the cache fills in for the layout, empty if it is unknown
+static std::string cachedName(uint16_t serviceUuid)
+{
+    auto profile = makeProfile(serviceUuid, "");
+    GattProfileCache &cache = GattProfileCache::getInstance();
+    if (cache.fillStableValues(*profile, GattProfileCache::fingerprint(*profile)) == 0) {
+        return "";
+    }
+    const CharacteristicWrapper &name = profile->services[0].chars[0];
+    CHECK(name.cached && !name.readable);
+    CHECK(!profile->services[0].chars[1].cached);
+    return std::string(name.value.begin(), name.value.end());
+}
+
+static void add(uint16_t serviceUuid, const std::string &manufacturer)
+{
+    auto profile = makeProfile(serviceUuid, manufacturer);
+    CHECK_EQ(GattProfileCache::getInstance().addLayout(*profile, GattProfileCache::fingerprint(*profile)), ESP_OK);
+}
+
+static long fileSize()
+{
+    FILE *f = fopen(PATH, "r");
+    if (f == nullptr) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+static void appendBytes(const std::vector<uint8_t> &bytes)
+{
+    FILE *f = fopen(PATH, "a");
+    fwrite(bytes.data(), 1, bytes.size(), f);
+    fclose(f);
+}
+
+static void testSurvivesReload()
+{
+    remove(PATH);
+    GattProfileCache &cache = GattProfileCache::getInstance();
+    CHECK_EQ(cache.init(PATH), ESP_OK);
+    CHECK_EQ(cache.size(), 0);
+    add(0x180A, "Acme");
+    add(0x180F, "Initech");
+    add(0x180A, "Other");   // known layout, not replaced
+    CHECK_EQ(cache.init(PATH), ESP_OK);
+    CHECK_EQ(cache.size(), 2);
+    CHECK(cachedName(0x180A) == "Acme");
+    CHECK(cachedName(0x180F) == "Initech");
+    CHECK(cachedName(0x1800).empty());
+}
+
+// Records appended after a torn tail must not be lost behind it on the next replay
+static void testTornTailIsCutOff()
+{
+    remove(PATH);
+    GattProfileCache &cache = GattProfileCache::getInstance();
+    CHECK_EQ(cache.init(PATH), ESP_OK);
+    add(0x180A, "Acme");
+    long good = fileSize();
+    appendBytes({0x11, 0x22, 0x33, 0x44, 0x55});
+    CHECK_EQ(cache.init(PATH), ESP_OK);
+    CHECK_EQ(fileSize(), good);
+    add(0x180F, "Initech");
+    CHECK_EQ(cache.init(PATH), ESP_OK);
+    CHECK_EQ(cache.size(), 2);
+    CHECK(cachedName(0x180F) == "Initech");
+}
+
+static void testCorruptRecordIsDropped()
+{
+    remove(PATH);
+    GattProfileCache &cache = GattProfileCache::getInstance();
+    CHECK_EQ(cache.init(PATH), ESP_OK);
+    add(0x180A, "Acme");
+    long first = fileSize();
+    add(0x180F, "Initech");
+    // a flipped bit inside the value of the second record
+    FILE *f = fopen(PATH, "r+");
+    fseek(f, first + 14, SEEK_SET);
+    int byte = fgetc(f);
+    fseek(f, first + 14, SEEK_SET);
+    fputc(byte ^ 0x04, f);
+    fclose(f);
+    CHECK_EQ(cache.init(PATH), ESP_OK);
+    CHECK_EQ(cache.size(), 1);
+    CHECK(cachedName(0x180A) == "Acme");
+    CHECK(cachedName(0x180F).empty());
+    CHECK_EQ(fileSize(), first);
+}
+
+// A cache written before the records had a CRC is discarded, not misread
+static void testRecordsWithoutCrcAreDiscarded()
+{
+    remove(PATH);
+    appendBytes({1, 2, 3, 4, 5, 6, 7, 8, 1, 0x29, 0x2A, 4, 'A', 'c', 'm', 'e'});
+    GattProfileCache &cache = GattProfileCache::getInstance();
+    CHECK_EQ(cache.init(PATH), ESP_OK);
+    CHECK_EQ(cache.size(), 0);
+    CHECK_EQ(fileSize(), 0);
+    remove(PATH);
+}
+
+int main()
+{
+    RUN_TEST(testSurvivesReload);
+    RUN_TEST(testTornTailIsCutOff);
+    RUN_TEST(testCorruptRecordIsDropped);
+    RUN_TEST(testRecordsWithoutCrcAreDiscarded);
+    return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,365 @@
+#include "hci_event_parser.h"
+#include "hci_packets.h"
+#include "test_util.h"
+
+#include <cstring>
+#include <memory>
+
+// Parses @p pkt from an allocation of exactly its size, so the sanitizers see any overread
+static esp_err_t parse(const std::vector<uint8_t> &pkt, size_t len, LeAdvertisingReportView &view)
+{
+    std::unique_ptr<uint8_t[]> copy(new uint8_t[len ? len : 1]);
+    memcpy(copy.get(), pkt.data(), len);
+    hci_data_t d = {123, (uint16_t)len, copy.get()};
+    esp_err_t err = HciEventParser::parseAdvReportView(d, view);
+    view.data = nullptr;    // the copy is gone
+    return err;
+}
+
+static esp_err_t parseExt(const std::vector<uint8_t> &pkt, size_t len, LeExtAdvertisingReportView &view)
+{
+    std::unique_ptr<uint8_t[]> copy(new uint8_t[len ? len : 1]);
+    memcpy(copy.get(), pkt.data(), len);
+    hci_data_t d = {123, (uint16_t)len, copy.get()};
+    esp_err_t err = HciEventParser::parseExtAdvReportView(d, view);
+    view.data = nullptr;
+    return err;
+}
+
+static void testSingleReport()
+{
+    TestAdvReport r = hciTypicalAdvReport(0x01020304, 11, 0x00);
+    std::vector<uint8_t> pkt = hciAdvReportEvent({r});
+    hci_data_t d = {555, (uint16_t)pkt.size(), pkt.data()};
+    CHECK_EQ(HciEventParser::leMetaSubevent(d), 0x02);
+    LeAdvertisingReportView view;
+    CHECK_EQ(HciEventParser::parseAdvReportView(d, view), ESP_OK);
+    CHECK_EQ(view.timestamp, 555);
+    CHECK_EQ(view.num_reports, 1);
+    CHECK(view.data == pkt.data());
+    CHECK_EQ(view.reports[0].adv_event_type, 0x00);
+    CHECK_EQ(view.reports[0].addr_type, 0x01);
+    CHECK_EQ(view.reports[0].rssi, r.rssi);
+    CHECK_EQ(view.reports[0].adv_data_length, 11);
+    CHECK(memcmp(view.bdaddr(0), r.address, 6) == 0);
+    CHECK(memcmp(view.advData(0), r.data.data(), 11) == 0);
+    CHECK(view.isAdvertisingReportConnectable());
+
+    // the text form is built on demand, most significant byte first
+    char text[18];
+    view.formatBdaddr(0, text);
+    CHECK(strcmp(text, "40:00:01:02:03:04") == 0);
+
+    LeAdvertisingSingleReport single;
+    view.toSingleReport(0, single);
+    CHECK(strcmp(single.bdaddr_str, text) == 0);
+    CHECK_EQ(single.adv_data_length, 11);
+    CHECK(memcmp(single.adv_data, r.data.data(), 11) == 0);
+
+    LeAdvertisingReport full;
+    CHECK_EQ(HciEventParser::fillAdvReport(d, full), ESP_OK);
+    CHECK_EQ(full.num_reports, 1);
+    CHECK_EQ(full.reports[0].rssi, r.rssi);
+}
+
+static void testSeveralReports()
+{
+    std::vector<TestAdvReport> reports;
+    for (uint32_t i = 0; i < 5; i++) {
+        // scannable, non-connectable, scan response, with empty and maximum payloads
+        reports.push_back(hciTypicalAdvReport(i, (uint8_t)(i * 31 / 4), (uint8_t)(2 + i % 3)));
+    }
+    std::vector<uint8_t> pkt = hciAdvReportEvent(reports);
+    LeAdvertisingReportView view;
+    CHECK_EQ(parse(pkt, pkt.size(), view), ESP_OK);
+    CHECK_EQ(view.num_reports, 5);
+    CHECK(!view.isAdvertisingReportConnectable());
+    hci_data_t d = {0, (uint16_t)pkt.size(), pkt.data()};
+    CHECK_EQ(HciEventParser::parseAdvReportView(d, view), ESP_OK);
+    for (uint8_t i = 0; i < 5; i++) {
+        CHECK_EQ(view.reports[i].adv_data_length, reports[i].data.size());
+        CHECK(memcmp(view.advData(i), reports[i].data.data(), reports[i].data.size()) == 0);
+        CHECK(memcmp(view.bdaddr(i), reports[i].address, 6) == 0);
+        CHECK_EQ(view.reports[i].rssi, reports[i].rssi);
+    }
+}
+
+static void testRejectsOtherEvents()
+{
+    LeAdvertisingReportView view;
+    hci_data_t empty = {0, 0, nullptr};
+    CHECK_EQ(HciEventParser::parseAdvReportView(empty, view), ESP_ERR_INVALID_STATE);
+    CHECK_EQ(HciEventParser::leMetaSubevent(empty), 0);
+
+    std::vector<uint8_t> pkt = hciAdvReportEvent({hciTypicalAdvReport(1, 5)});
+    std::vector<uint8_t> other = pkt;
+    other[1] = 0x0E;    // command complete
+    CHECK_EQ(parse(other, other.size(), view), ESP_ERR_NOT_FOUND);
+    other = pkt;
+    other[3] = 0x01;    // connection complete
+    CHECK_EQ(parse(other, other.size(), view), ESP_ERR_NOT_FOUND);
+    other = pkt;
+    other[0] = 0x02;    // ACL data
+    CHECK_EQ(parse(other, other.size(), view), ESP_ERR_NOT_FOUND);
+    // an extended report is not a legacy one and vice versa
+    LeExtAdvertisingReportView ext;
+    CHECK_EQ(parseExt(pkt, pkt.size(), ext), ESP_ERR_NOT_FOUND);
+}
+
+static void testRejectsBadCounts()
+{
+    LeAdvertisingReportView view;
+    std::vector<uint8_t> pkt = hciAdvReportEvent({hciTypicalAdvReport(1, 5)});
+    pkt[4] = 0;
+    CHECK_EQ(parse(pkt, pkt.size(), view), ESP_FAIL);
+    pkt[4] = MAX_NUM_REPORTS + 1;
+    CHECK_EQ(parse(pkt, pkt.size(), view), ESP_FAIL);
+    // more reports announced than present
+    pkt[4] = 2;
+    CHECK_EQ(parse(pkt, pkt.size(), view), ESP_ERR_INVALID_SIZE);
+}
+
+static void testRejectsTruncation()
+{
+    std::vector<TestAdvReport> reports = {hciTypicalAdvReport(1, 31), hciTypicalAdvReport(2, 7)};
+    std::vector<uint8_t> pkt = hciAdvReportEvent(reports);
+    LeAdvertisingReportView view;
+    // every shorter packet is an error, and never an out of bounds read
+    for (size_t len = 1; len < pkt.size(); len++) {
+        CHECK(parse(pkt, len, view) != ESP_OK);
+    }
+    CHECK_EQ(parse(pkt, pkt.size(), view), ESP_OK);
+
+    // the declared parameter length bounds the parse, not the buffer
+    std::vector<uint8_t> shortParams = pkt;
+    shortParams[2] -= 1;
+    CHECK_EQ(parse(shortParams, shortParams.size(), view), ESP_ERR_INVALID_SIZE);
+    std::vector<uint8_t> longParams = pkt;
+    longParams[2] += 1;
+    CHECK_EQ(parse(longParams, longParams.size(), view), ESP_ERR_INVALID_SIZE);
+
+    // legacy payloads are at most 31 bytes
+    std::vector<uint8_t> oversized = hciAdvReportEvent({hciTypicalAdvReport(1, 32)});
+    CHECK_EQ(parse(oversized, oversized.size(), view), ESP_ERR_INVALID_SIZE);
+}
+
+static void testExtendedReport()
+{
+    TestExtAdvReport r = {};
+    r.eventType = 0x0001;       // connectable, complete
+    r.addrType = 0x01;
+    memcpy(r.address, "\x06\x05\x04\x03\x02\xC1", 6);
+    r.primaryPhy = 1;
+    r.secondaryPhy = 2;
+    r.sid = 3;
+    r.txPower = -4;
+    r.rssi = -70;
+    r.periodicInterval = 0x1234;
+    r.data.assign(200, 0x5A);
+    TestExtAdvReport anon = r;
+    anon.eventType = 0x0000;
+    anon.addrType = 0xFF;
+    anon.data.assign(3, 1);
+    std::vector<uint8_t> pkt = hciExtAdvReportEvent({r, anon});
+    hci_data_t d = {9, (uint16_t)pkt.size(), pkt.data()};
+    CHECK_EQ(HciEventParser::leMetaSubevent(d), HCI_LE_EXT_ADV_REPORT);
+    LeExtAdvertisingReportView view;
+    CHECK_EQ(HciEventParser::parseExtAdvReportView(d, view), ESP_OK);
+    CHECK_EQ(view.num_reports, 2);
+    CHECK(view.isConnectable(0));
+    CHECK(!view.isConnectable(1));
+    CHECK(view.isAdvertisingReportConnectable());
+    const LeExtAdvertisingSingleReportView &v = view.reports[0];
+    CHECK_EQ(v.primary_phy, 1);
+    CHECK_EQ(v.secondary_phy, 2);
+    CHECK_EQ(v.sid, 3);
+    CHECK_EQ(v.tx_power, -4);
+    CHECK_EQ(v.rssi, -70);
+    CHECK_EQ(v.periodic_adv_interval, 0x1234);
+    CHECK_EQ(v.adv_data_length, 200);
+    CHECK(memcmp(view.advData(0), r.data.data(), 200) == 0);
+    char text[18];
+    view.formatBdaddr(0, text);
+    CHECK(strcmp(text, "c1:02:03:04:05:06") == 0);
+    CHECK_EQ(view.reports[1].addr_type, 0xFF);
+
+    for (size_t len = 1; len < pkt.size(); len++) {
+        CHECK(parseExt(pkt, len, view) != ESP_OK);
+    }
+}
+
+// A connectable report of device @p device, SID @p sid, with @p len bytes of data starting at @p first
+static TestExtAdvReport fragment(uint8_t device, uint8_t sid, uint8_t status, size_t len, uint8_t first)
+{
+    TestExtAdvReport r = {};
+    r.eventType = (uint16_t)(0x0001 | (status << 5));
+    r.addrType = 0x01;
+    memcpy(r.address, "\x00\x05\x04\x03\x02\xC1", 6);
+    r.address[0] = device;
+    r.primaryPhy = 1;
+    r.secondaryPhy = 2;
+    r.sid = sid;
+    r.txPower = 127;
+    r.rssi = (int8_t)(-60 - status);
+    for (size_t i = 0; i < len; i++) {
+        r.data.push_back((uint8_t)(first + i));
+    }
+    return r;
+}
+
+// Holds the packets, the views point into them
+struct ExtFeed {
+    std::vector<std::vector<uint8_t>> packets;
+    LeExtAdvertisingReportView view;
+
+    const LeExtAdvertisingReportView &parse(const std::vector<TestExtAdvReport> &reports, int64_t timestamp)
+    {
+        packets.push_back(hciExtAdvReportEvent(reports));
+        hci_data_t d = {timestamp, (uint16_t)packets.back().size(), packets.back().data()};
+        CHECK_EQ(HciEventParser::parseExtAdvReportView(d, view), ESP_OK);
+        return view;
+    }
+};
+
+static bool dataIs(const LeExtAdvertisingReportView &view, uint8_t index, size_t len, uint8_t first)
+{
+    if (view.reports[index].adv_data_length != len) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (view.advData(index)[i] != (uint8_t)(first + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void testExtCompleteReportPassesThrough()
+{
+    auto reassembler = std::make_unique<ExtAdvReassembler>();
+    ExtFeed feed;
+    const LeExtAdvertisingReportView &view = feed.parse({fragment(1, 0, EXT_ADV_DATA_COMPLETE, 20, 0)}, 100);
+    const LeExtAdvertisingReportView *out = nullptr;
+    uint8_t index = 9;
+    CHECK(reassembler->add(view, 0, out, index));
+    CHECK(out == &view);
+    CHECK_EQ(index, 0);
+    CHECK_EQ(reassembler->stats().assembled, 0u);
+}
+
+static void testExtFragmentsAreJoined()
+{
+    auto reassembler = std::make_unique<ExtAdvReassembler>();
+    ExtFeed feed;
+    const LeExtAdvertisingReportView *out = nullptr;
+    uint8_t index;
+    // the controller splits the data over three events
+    CHECK(!reassembler->add(feed.parse({fragment(1, 3, EXT_ADV_DATA_MORE, 100, 0)}, 1000), 0, out, index));
+    CHECK(!reassembler->add(feed.parse({fragment(1, 3, EXT_ADV_DATA_MORE, 50, 100)}, 1500), 0, out, index));
+    CHECK(reassembler->add(feed.parse({fragment(1, 3, EXT_ADV_DATA_COMPLETE, 30, 150)}, 2000), 0, out, index));
+    CHECK(out != &feed.view);
+    CHECK_EQ(out->num_reports, 1);
+    CHECK_EQ(out->timestamp, 1000);
+    const LeExtAdvertisingSingleReportView &r = out->reports[index];
+    CHECK_EQ(EXT_ADV_DATA_STATUS(r.event_type), EXT_ADV_DATA_COMPLETE);
+    CHECK(out->isConnectable(index));
+    CHECK_EQ(r.sid, 3);
+    CHECK_EQ(r.secondary_phy, 2);
+    CHECK_EQ(r.rssi, -61);     // of the first fragment
+    CHECK(dataIs(*out, index, 180, 0));
+    CHECK(memcmp(out->bdaddr(index), feed.packets[0].data() + 8, 6) == 0);
+    CHECK_EQ(reassembler->stats().assembled, 1u);
+    CHECK_EQ(reassembler->stats().dropped, 0u);
+}
+
+static void testExtInterleavedChains()
+{
+    auto reassembler = std::make_unique<ExtAdvReassembler>();
+    ExtFeed feed;
+    const LeExtAdvertisingReportView *out = nullptr;
+    uint8_t index;
+    // two devices, and a second advertising set of the first one, in one event
+    const LeExtAdvertisingReportView &heads = feed.parse({fragment(1, 0, EXT_ADV_DATA_MORE, 10, 0),
+                                                          fragment(2, 0, EXT_ADV_DATA_MORE, 10, 100),
+                                                          fragment(1, 1, EXT_ADV_DATA_MORE, 10, 200)}, 10);
+    for (uint8_t i = 0; i < 3; i++) {
+        CHECK(!reassembler->add(heads, i, out, index));
+    }
+    CHECK(reassembler->add(feed.parse({fragment(2, 0, EXT_ADV_DATA_COMPLETE, 5, 110)}, 20), 0, out, index));
+    CHECK(dataIs(*out, index, 15, 100));
+    CHECK_EQ(out->bdaddr(index)[0], 2);
+    CHECK(reassembler->add(feed.parse({fragment(1, 1, EXT_ADV_DATA_COMPLETE, 5, 210)}, 30), 0, out, index));
+    CHECK(dataIs(*out, index, 15, 200));
+    CHECK_EQ(out->reports[index].sid, 1);
+    CHECK(reassembler->add(feed.parse({fragment(1, 0, EXT_ADV_DATA_COMPLETE, 5, 10)}, 40), 0, out, index));
+    CHECK(dataIs(*out, index, 15, 0));
+    CHECK_EQ(out->reports[index].sid, 0);
+    CHECK_EQ(reassembler->stats().assembled, 3u);
+}
+
+static void testExtTruncatedChains()
+{
+    auto reassembler = std::make_unique<ExtAdvReassembler>();
+    ExtFeed feed;
+    const LeExtAdvertisingReportView *out = nullptr;
+    uint8_t index;
+    // the controller gave up after the first fragment
+    CHECK(!reassembler->add(feed.parse({fragment(1, 0, EXT_ADV_DATA_MORE, 40, 0)}, 10), 0, out, index));
+    CHECK(reassembler->add(feed.parse({fragment(1, 0, EXT_ADV_DATA_TRUNCATED, 0, 0)}, 20), 0, out, index));
+    CHECK_EQ(EXT_ADV_DATA_STATUS(out->reports[index].event_type), EXT_ADV_DATA_TRUNCATED);
+    CHECK(dataIs(*out, index, 40, 0));
+
+    // more than a record can hold is cut at 255 bytes
+    CHECK(!reassembler->add(feed.parse({fragment(2, 0, EXT_ADV_DATA_MORE, 200, 0)}, 30), 0, out, index));
+    CHECK(!reassembler->add(feed.parse({fragment(2, 0, EXT_ADV_DATA_MORE, 200, 200)}, 40), 0, out, index));
+    CHECK(reassembler->add(feed.parse({fragment(2, 0, EXT_ADV_DATA_COMPLETE, 10, 144)}, 50), 0, out, index));
+    CHECK_EQ(EXT_ADV_DATA_STATUS(out->reports[index].event_type), EXT_ADV_DATA_TRUNCATED);
+    CHECK(dataIs(*out, index, 255, 0));
+    CHECK_EQ(reassembler->stats().assembled, 2u);
+    CHECK_EQ(reassembler->stats().truncated, 1u);
+}
+
+static void testExtIncompleteChainsAreDropped()
+{
+    auto reassembler = std::make_unique<ExtAdvReassembler>();
+    ExtFeed feed;
+    const LeExtAdvertisingReportView *out = nullptr;
+    uint8_t index;
+    // the continuation never came, a later report stands on its own
+    CHECK(!reassembler->add(feed.parse({fragment(1, 0, EXT_ADV_DATA_MORE, 40, 0)}, 0), 0, out, index));
+    const LeExtAdvertisingReportView &later =
+        feed.parse({fragment(1, 0, EXT_ADV_DATA_COMPLETE, 20, 0)}, EXT_ADV_REASSEMBLY_TIMEOUT_US + 1);
+    CHECK(reassembler->add(later, 0, out, index));
+    CHECK(out == &later);
+    CHECK_EQ(reassembler->stats().dropped, 1u);
+
+    // with every slot in use the chain heard from least recently makes room
+    for (uint8_t device = 0; device <= EXT_ADV_REASSEMBLY_SLOTS; device++) {
+        int64_t now = 2 * EXT_ADV_REASSEMBLY_TIMEOUT_US + device;
+        CHECK(!reassembler->add(feed.parse({fragment(device, 0, EXT_ADV_DATA_MORE, 10, device)}, now), 0, out,
+                                index));
+    }
+    CHECK_EQ(reassembler->stats().dropped, 2u);
+    int64_t now = 2 * EXT_ADV_REASSEMBLY_TIMEOUT_US + 100;
+    const LeExtAdvertisingReportView &tail = feed.parse({fragment(0, 0, EXT_ADV_DATA_COMPLETE, 10, 10)}, now);
+    CHECK(reassembler->add(tail, 0, out, index));
+    CHECK(out == &tail);
+    CHECK(reassembler->add(feed.parse({fragment(1, 0, EXT_ADV_DATA_COMPLETE, 10, 11)}, now), 0, out, index));
+    CHECK(dataIs(*out, index, 20, 1));
+}
+
+int main()
+{
+    RUN_TEST(testSingleReport);
+    RUN_TEST(testSeveralReports);
+    RUN_TEST(testRejectsOtherEvents);
+    RUN_TEST(testRejectsBadCounts);
+    RUN_TEST(testRejectsTruncation);
+    RUN_TEST(testExtendedReport);
+    RUN_TEST(testExtCompleteReportPassesThrough);
+    RUN_TEST(testExtFragmentsAreJoined);
+    RUN_TEST(testExtInterleavedChains);
+    RUN_TEST(testExtTruncatedChains);
+    RUN_TEST(testExtIncompleteChainsAreDropped);
+    return TEST_MAIN_RESULT();
+}
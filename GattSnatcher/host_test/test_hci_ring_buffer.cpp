@@ -0,0 +1,176 @@
+#include "hci_ring_buffer.h"
+#include "test_util.h"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Packet of @p len bytes whose content is derived from @p seq, so corruption is visible
+static void makePacket(uint32_t seq, uint16_t len, uint8_t *out)
+{
+    for (uint16_t i = 0; i < len; i++) {
+        out[i] = (uint8_t)(seq * 31 + i);
+    }
+    if (len >= 4) {
+        memcpy(out, &seq, 4);
+    }
+}
+
+static bool packetIntact(const hci_data_t &d, uint32_t seq, uint16_t len)
+{
+    uint8_t expected[HCI_EVENT_MAX_SIZE];
+    makePacket(seq, len, expected);
+    return d.len == len && memcmp(d.data, expected, len) == 0 && d.timestamp == (int64_t)seq;
+}
+
+static void testInit()
+{
+    HciRingBuffer ring;
+    CHECK_EQ(ring.init(64), ESP_ERR_INVALID_SIZE);
+    CHECK_EQ(ring.init(1000), ESP_OK);
+    CHECK_EQ(ring.capacity(), 1024);
+    CHECK_EQ(ring.init(1000), ESP_ERR_INVALID_STATE);
+    CHECK(ring.empty());
+    hci_data_t d;
+    CHECK(!ring.acquire(d));
+}
+
+static void testPushAcquireRelease()
+{
+    HciRingBuffer ring;
+    CHECK_EQ(ring.init(4096), ESP_OK);
+    uint8_t pkt[HCI_EVENT_MAX_SIZE];
+    for (uint32_t i = 0; i < 5; i++) {
+        makePacket(i, (uint16_t)(10 + i), pkt);
+        CHECK(ring.push(pkt, (uint16_t)(10 + i), i));
+    }
+    CHECK(!ring.empty());
+    // several packets stay valid until the release
+    hci_data_t d[5];
+    for (uint32_t i = 0; i < 5; i++) {
+        CHECK(ring.acquire(d[i]));
+    }
+    CHECK(ring.empty());
+    hci_data_t none;
+    CHECK(!ring.acquire(none));
+    for (uint32_t i = 0; i < 5; i++) {
+        CHECK(packetIntact(d[i], i, (uint16_t)(10 + i)));
+    }
+    ring.release();
+    CHECK_EQ(ring.droppedCount(), 0);
+}
+
+static void testOversizedAndFull()
+{
+    HciRingBuffer ring;
+    CHECK_EQ(ring.init(1024), ESP_OK);
+    uint8_t pkt[HCI_EVENT_MAX_SIZE + 1] = {};
+    CHECK(!ring.push(pkt, HCI_EVENT_MAX_SIZE + 1, 0));
+    CHECK_EQ(ring.droppedCount(), 1);
+
+    uint32_t pushed = 0;
+    while (ring.push(pkt, 100, pushed)) {
+        pushed++;
+    }
+    CHECK(pushed >= 1024 / 116 - 1);
+    CHECK_EQ(ring.droppedCount(), 2);
+    CHECK(ring.highWatermark() <= ring.capacity());
+    // acquired but not released space is still owned by the consumer
+    hci_data_t d;
+    CHECK(ring.acquire(d));
+    CHECK(!ring.push(pkt, 100, 0));
+    ring.release();
+    CHECK(ring.push(pkt, 100, 0));
+}
+
+// Records never straddle the end of the buffer, whatever the lengths
+static void testWrapAround()
+{
+    HciRingBuffer ring;
+    CHECK_EQ(ring.init(1024), ESP_OK);
+    uint8_t pkt[HCI_EVENT_MAX_SIZE];
+    TestRng rng(99);
+    uint32_t next = 0;
+    uint32_t expect = 0;
+    for (int round = 0; round < 5000; round++) {
+        uint16_t len = (uint16_t)(1 + rng.below(HCI_EVENT_MAX_SIZE));
+        makePacket(next, len, pkt);
+        if (ring.push(pkt, len, next)) {
+            next++;
+        }
+        // consume in irregular batches
+        if (rng.below(3) == 0) {
+            hci_data_t d;
+            while (ring.acquire(d)) {
+                uint32_t seq = (uint32_t)d.timestamp;
+                CHECK_EQ(seq, expect);
+                if (!packetIntact(d, seq, d.len)) {
+                    CHECK(!"packet corrupted");
+                    return;
+                }
+                expect++;
+            }
+            ring.release();
+        }
+    }
+    CHECK(next > 1000);
+}
+
+/**
+ * Producer and consumer on their own threads, as the controller callback and the HCI
+ * task are. The producer retries a dropped packet, so every packet must arrive intact
+ * and in order even though the ring is full most of the time.
+ */
+static void testConcurrentProducerConsumer()
+{
+    HciRingBuffer ring;
+    CHECK_EQ(ring.init(8192), ESP_OK);
+    const uint32_t total = 200000;
+    std::atomic<bool> done{false};
+    std::thread producer([&] {
+        uint8_t pkt[HCI_EVENT_MAX_SIZE];
+        TestRng rng(7);
+        for (uint32_t seq = 0; seq < total; seq++) {
+            uint16_t len = (uint16_t)(4 + rng.below(HCI_EVENT_MAX_SIZE - 3));
+            makePacket(seq, len, pkt);
+            while (!ring.push(pkt, len, seq)) {
+                std::this_thread::yield();
+            }
+        }
+        done = true;
+    });
+    uint32_t expect = 0;
+    bool ok = true;
+    hci_data_t d;
+    while (!done.load() || !ring.empty()) {
+        int batch = 0;
+        while (batch < 16 && ring.acquire(d)) {
+            uint32_t seq;
+            memcpy(&seq, d.data, 4);
+            ok = ok && seq == expect && packetIntact(d, seq, d.len);
+            expect++;
+            batch++;
+        }
+        ring.release();
+        if (batch == 0) {
+            // the HCI task blocks on a notification here
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    CHECK(ok);
+    CHECK_EQ(expect, total);
+    printf("  %u delivered, %u pushes found the ring full, high watermark %u/%u B\n", (unsigned)expect,
+           (unsigned)ring.droppedCount(), (unsigned)ring.highWatermark(), (unsigned)ring.capacity());
+}
+
+int main()
+{
+    RUN_TEST(testInit);
+    RUN_TEST(testPushAcquireRelease);
+    RUN_TEST(testOversizedAndFull);
+    RUN_TEST(testWrapAround);
+    RUN_TEST(testConcurrentProducerConsumer);
+    return TEST_MAIN_RESULT();
+}
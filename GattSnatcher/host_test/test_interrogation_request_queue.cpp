@@ -0,0 +1,132 @@
+#include "interrogation_request_queue.h"
+#include "test_util.h"
+
+#include <memory>
+
+static const char *DB_PATH = "test_interrogation_db.log";
+static const int64_t SEC = 1000000;
+
+static interrogation_request_t request(uint8_t device, int8_t rssi)
+{
+    interrogation_request_t r = {};
+    r.address[0] = 0xAB;
+    r.address[5] = device;
+    r.addr_type = BLE_ADDR_TYPE_RANDOM;
+    r.rssi = rssi;
+    return r;
+}
+
+static uint64_t keyOf(uint8_t device)
+{
+    interrogation_request_t r = request(device, 0);
+    return DeviceStore::makeKey(r.address, r.addr_type);
+}
+
+// The device database of the target, reduced to its store
+struct History {
+    std::unique_ptr<DeviceStore> store = std::make_unique<DeviceStore>();
+
+    History()
+    {
+        remove(DB_PATH);
+        store->open(DB_PATH);
+    }
+    ~History() { remove(DB_PATH); }
+
+    void attach(InterrogationRequestQueue &queue)
+    {
+        DeviceStore *s = store.get();
+        queue.setHistoryLookup(
+            [s](const esp_bd_addr_t address, esp_ble_addr_type_t addrType, DeviceStore::Entry &entry) {
+                const DeviceStore::Entry *found = s->find(DeviceStore::makeKey(address, addrType));
+                if (found != nullptr) {
+                    entry = *found;
+                }
+                return found != nullptr;
+            },
+            s->boot());
+    }
+};
+
+static uint8_t popDevice(InterrogationRequestQueue &queue, int64_t now)
+{
+    interrogation_request_t r;
+    return queue.pop(r, now) ? r.address[5] : 0;
+}
+
+static void testMergesAndOrdersByScore()
+{
+    auto queue = std::make_unique<InterrogationRequestQueue>();
+    CHECK_EQ(queue->push(request(1, -70), SEC), ESP_OK);
+    CHECK_EQ(queue->push(request(2, -40), SEC), ESP_OK);
+    CHECK_EQ(queue->push(request(1, -60), SEC), ESP_OK);
+    CHECK_EQ(queue->size(), 2);
+    CHECK_EQ(queue->stats().coalesced, 1);
+    CHECK_EQ(popDevice(*queue, SEC), 2);
+    // in flight until complete()
+    CHECK_EQ(queue->push(request(2, -40), SEC), ESP_OK);
+    CHECK_EQ(queue->stats().rejectedInFlight, 1);
+    queue->complete(request(2, 0).address, BLE_ADDR_TYPE_RANDOM);
+    CHECK_EQ(queue->push(request(2, -40), SEC), ESP_OK);
+    CHECK_EQ(queue->size(), 2);
+}
+
+// The reprofile window comes from the database: only full profiles of this boot count
+static void testReprofileWindowFromDatabase()
+{
+    History history;
+    auto queue = std::make_unique<InterrogationRequestQueue>();
+    queue->setReprofileWindow(60 * SEC);
+    history.attach(*queue);
+
+    history.store->recordProfiled(keyOf(1), 0x1234, 100);
+    CHECK_EQ(queue->push(request(1, -50), 130 * SEC), ESP_OK);
+    CHECK_EQ(queue->stats().rejectedRecent, 1);
+    CHECK_EQ(queue->size(), 0);
+    // the window is over
+    CHECK_EQ(queue->push(request(1, -50), 161 * SEC), ESP_OK);
+    CHECK_EQ(queue->size(), 1);
+
+    // a failure after the profile reopens the device right away
+    history.store->recordProfiled(keyOf(2), 0x1234, 100);
+    history.store->recordFailure(keyOf(2), 110);
+    CHECK_EQ(queue->push(request(2, -50), 120 * SEC), ESP_OK);
+    CHECK_EQ(queue->size(), 2);
+
+    // times of an earlier boot say nothing about now
+    history.store->recordProfiled(keyOf(4), 0x1234, 100);
+    history.store->close();
+    history.store->open(DB_PATH);
+    history.attach(*queue);
+    history.store->recordProfiled(keyOf(3), 0x1234, 5);
+    CHECK_EQ(queue->push(request(3, -50), 10 * SEC), ESP_OK);
+    CHECK_EQ(queue->stats().rejectedRecent, 2);
+    CHECK_EQ(queue->push(request(4, -50), 110 * SEC), ESP_OK);
+    CHECK_EQ(queue->stats().rejectedRecent, 2);
+    CHECK_EQ(queue->size(), 3);
+}
+
+// Failures recorded in the database push a device back behind new ones
+static void testFailuresLowerTheScore()
+{
+    History history;
+    auto queue = std::make_unique<InterrogationRequestQueue>();
+    history.attach(*queue);
+    history.store->recordFailure(keyOf(1), 1);
+    history.store->recordFailure(keyOf(1), 2);
+    CHECK_EQ(queue->push(request(1, -50), SEC), ESP_OK);
+    CHECK_EQ(queue->push(request(2, -60), SEC), ESP_OK);
+    CHECK_EQ(queue->push(request(3, -50), SEC), ESP_OK);
+    CHECK_EQ(popDevice(*queue, SEC), 3);
+    CHECK_EQ(popDevice(*queue, SEC), 2);
+    CHECK_EQ(popDevice(*queue, SEC), 1);
+    CHECK_EQ(popDevice(*queue, SEC), 0);
+}
+
+int main()
+{
+    RUN_TEST(testMergesAndOrdersByScore);
+    RUN_TEST(testReprofileWindowFromDatabase);
+    RUN_TEST(testFailuresLowerTheScore);
+    return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,86 @@
+#include "log_segment_manager.h"
+#include "test_util.h"
+
+#include <cstdio>
+
+static const char *BASENAME = "test_segment_log";
+static const char *EXTENSION = ".bin";
+
+static void removeAll()
+{
+    char path[64];
+    for (int i = 0; i < 16; i++) {
+        snprintf(path, sizeof(path), "%s_%d%s", BASENAME, i, EXTENSION);
+        remove(path);
+    }
+    snprintf(path, sizeof(path), "%s.manifest", BASENAME);
+    remove(path);
+}
+
+static void touch(LogSegmentManager &segments, uint32_t segment)
+{
+    char path[64];
+    segments.segmentPath(segment, 0, path, sizeof(path));
+    FILE *f = fopen(path, "w");
+    fclose(f);
+}
+
+static uint32_t reopenedNext()
+{
+    LogSegmentManager segments;
+    segments.open(&BASENAME, 1, EXTENSION);
+    return segments.next();
+}
+
+static void testBeginSegmentReservesAndPersists()
+{
+    removeAll();
+    LogSegmentManager segments;
+    CHECK(segments.open(&BASENAME, 1, EXTENSION));
+    CHECK_EQ(segments.beginSegment(0), 0);
+    touch(segments, 0);
+    CHECK_EQ(segments.beginSegment(0), 1);
+    CHECK_EQ(reopenedNext(), 2);
+}
+
+// Peeking at the next number takes nothing; only reserve() moves the manifest on
+static void testNextUnusedDoesNotReserve()
+{
+    removeAll();
+    LogSegmentManager segments;
+    CHECK(segments.open(&BASENAME, 1, EXTENSION));
+    CHECK_EQ(segments.beginSegment(0), 0);
+    touch(segments, 0);
+    for (int i = 0; i < 5; i++) {
+        CHECK_EQ(segments.nextUnused(), 1);
+    }
+    CHECK_EQ(reopenedNext(), 1);
+    touch(segments, 1);
+    segments.reserve(1, 0);
+    CHECK_EQ(segments.next(), 2);
+    CHECK_EQ(reopenedNext(), 2);
+}
+
+// A manifest that is behind never hands out the number of an existing segment
+static void testSkipsExistingSegments()
+{
+    removeAll();
+    LogSegmentManager segments;
+    CHECK(segments.open(&BASENAME, 1, EXTENSION));
+    touch(segments, 0);
+    touch(segments, 1);
+    CHECK_EQ(segments.nextUnused(), 2);
+    CHECK_EQ(segments.beginSegment(0), 2);
+    touch(segments, 2);
+    CHECK(segments.dropOldest(0));
+    CHECK_EQ(segments.first(), 1);
+    removeAll();
+}
+
+int main()
+{
+    RUN_TEST(testBeginSegmentReservesAndPersists);
+    RUN_TEST(testNextUnusedDoesNotReserve);
+    RUN_TEST(testSkipsExistingSegments);
+    return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,187 @@
+#include "mac_cache.h"
+#include "test_util.h"
+
+#include <map>
+#include <memory>
+
+static constexpr int64_t MINUTE = 60LL * 1000000;
+
+static MacKey makeKey(uint32_t n, uint8_t addrType = 0x00, uint8_t top = 0x00)
+{
+    MacKey k = {};
+    for (int i = 0; i < 4; ++i) {
+        k.addr[i] = (n >> (8 * i)) & 0xFF;
+    }
+    k.addr[5] = top;
+    k.addr_type = addrType;
+    return k;
+}
+
+static void testClassify()
+{
+    CHECK(classifyMacAddress(makeKey(1, 0x00)) == MacAddressClass::Public);
+    CHECK(classifyMacAddress(makeKey(1, 0x02)) == MacAddressClass::Public);
+    CHECK(classifyMacAddress(makeKey(1, 0x03)) == MacAddressClass::RandomStatic);
+    CHECK(classifyMacAddress(makeKey(1, 0x01, 0xC0)) == MacAddressClass::RandomStatic);
+    CHECK(classifyMacAddress(makeKey(1, 0x01, 0x40)) == MacAddressClass::ResolvablePrivate);
+    CHECK(classifyMacAddress(makeKey(1, 0x01, 0x00)) == MacAddressClass::NonResolvablePrivate);
+    CHECK(classifyMacAddress(makeKey(1, 0x01, 0x80)) == MacAddressClass::Other);
+    CHECK(classifyMacAddress(makeKey(1, 0x7F)) == MacAddressClass::Other);
+}
+
+static void testParseTtlCommand()
+{
+    MacAddressClass c = MacAddressClass::COUNT;
+    uint32_t seconds = 0;
+    CHECK(parseMacTtlCommand("ttl rpa 600", c, seconds));
+    CHECK(c == MacAddressClass::ResolvablePrivate);
+    CHECK_EQ(seconds, 600u);
+    CHECK(parseMacTtlCommand("  ttl   static 0 ", c, seconds));
+    CHECK(c == MacAddressClass::RandomStatic);
+    CHECK_EQ(seconds, 0u);
+    CHECK(parseMacTtlCommand("ttl other 86400", c, seconds));
+    CHECK(c == MacAddressClass::Other);
+    CHECK_EQ(seconds, 86400u);
+
+    // rejected lines leave the outputs alone
+    c = MacAddressClass::Public;
+    seconds = 7;
+    CHECK(!parseMacTtlCommand("", c, seconds));
+    CHECK(!parseMacTtlCommand("ttl", c, seconds));
+    CHECK(!parseMacTtlCommand("ttl rpa", c, seconds));
+    CHECK(!parseMacTtlCommand("ttl rpa -1", c, seconds));
+    CHECK(!parseMacTtlCommand("ttl rpa 86401", c, seconds));
+    CHECK(!parseMacTtlCommand("ttl rpa 4294967296", c, seconds));
+    CHECK(!parseMacTtlCommand("ttl rpa 99999999999999999999", c, seconds));
+    CHECK(!parseMacTtlCommand("ttl rpa 999999999999999999999", c, seconds));
+    CHECK(!parseMacTtlCommand("ttl rpa 10x", c, seconds));
+    CHECK(!parseMacTtlCommand("ttl rpa 10 20", c, seconds));
+    CHECK(!parseMacTtlCommand("ttl random 10", c, seconds));
+    CHECK(!parseMacTtlCommand("ttl nrpaxxxxx 10", c, seconds));
+    CHECK(!parseMacTtlCommand("tll rpa 10", c, seconds));
+    CHECK(c == MacAddressClass::Public);
+    CHECK_EQ(seconds, 7u);
+}
+
+static void testPrintOncePerTtl()
+{
+    auto cache = std::make_unique<MacCache>();
+    MacKey k = makeKey(42);
+    int64_t ttl = cache->ttl(MacAddressClass::Public);
+    CHECK(cache->shouldPrintAndAddToCache(k, 0));
+    CHECK(!cache->shouldPrintAndAddToCache(k, 1));
+    CHECK(!cache->shouldPrintAndAddToCache(k, ttl - 1));
+    CHECK(cache->shouldPrintAndAddToCache(k, ttl));
+    CHECK(!cache->shouldPrintAndAddToCache(k, ttl + 1));
+    CHECK_EQ(cache->size(), 1);
+    // the same address with another type is another device
+    CHECK(cache->shouldPrintAndAddToCache(makeKey(42, 0x03), 2));
+    CHECK_EQ(cache->size(), 2);
+}
+
+static void testPerClassTtl()
+{
+    auto cache = std::make_unique<MacCache>();
+    cache->setTtl(MacAddressClass::ResolvablePrivate, 2 * MINUTE);
+    CHECK_EQ(cache->ttl(MacAddressClass::ResolvablePrivate), 2 * MINUTE);
+    MacKey rpa = makeKey(1, 0x01, 0x40);
+    MacKey pub = makeKey(1, 0x00);
+    CHECK(cache->shouldPrintAndAddToCache(rpa, 0));
+    CHECK(cache->shouldPrintAndAddToCache(pub, 0));
+    CHECK(cache->shouldPrintAndAddToCache(rpa, 2 * MINUTE));
+    CHECK(!cache->shouldPrintAndAddToCache(pub, 2 * MINUTE));
+
+    const MacCache::ClassStats &st = cache->stats(MacAddressClass::ResolvablePrivate);
+    CHECK_EQ(st.forwarded, 2);
+    // the legacy 20 min TTL would have suppressed the second forward
+    CHECK_EQ(st.extraVsLegacy, 1);
+    CHECK_EQ(cache->stats(MacAddressClass::Public).suppressed, 1);
+}
+
+static void testEvictOldIsBounded()
+{
+    auto cache = std::make_unique<MacCache>();
+    int64_t ttl = cache->ttl(MacAddressClass::Public);
+    for (uint32_t i = 0; i < 100; ++i) {
+        cache->shouldPrintAndAddToCache(makeKey(i), i);
+    }
+    CHECK(!cache->hasExpired(ttl));
+    CHECK(cache->hasExpired(ttl + 50));
+    CHECK_EQ(cache->evictOld(ttl + 1000, 30), 30);
+    CHECK_EQ(cache->size(), 70);
+    CHECK_EQ(cache->evictOld(ttl + 1000), 70);
+    CHECK_EQ(cache->size(), 0);
+    CHECK(!cache->hasExpired(ttl + 1000));
+    // an evicted key is new again
+    CHECK(cache->shouldPrintAndAddToCache(makeKey(5), ttl + 2000));
+}
+
+static void testFullCacheRecyclesOldest()
+{
+    auto cache = std::make_unique<MacCache>();
+    for (uint32_t i = 0; i < MacCache::CAPACITY; ++i) {
+        CHECK(cache->shouldPrintAndAddToCache(makeKey(i), i));
+    }
+    CHECK_EQ(cache->size(), MacCache::CAPACITY);
+    CHECK(cache->shouldPrintAndAddToCache(makeKey(MacCache::CAPACITY), MacCache::CAPACITY));
+    CHECK_EQ(cache->size(), MacCache::CAPACITY);
+    CHECK_EQ(cache->evictedWhileFull(), 1);
+    // key 0 was the oldest and is forgotten, key 1 is still known
+    CHECK(!cache->shouldPrintAndAddToCache(makeKey(1), MacCache::CAPACITY + 1));
+    CHECK(cache->shouldPrintAndAddToCache(makeKey(0), MacCache::CAPACITY + 2));
+}
+
+/**
+ * Random traffic against a reference model, exercising probe chains and the
+ * backward-shift deletion. An evicted entry and an expired one both print again, so
+ * the model does not need to know what evictOld removed. The key space stays below
+ * the capacity so nothing is recycled.
+ */
+static void testMatchesReferenceModel()
+{
+    auto cache = std::make_unique<MacCache>();
+    int64_t ttl = 10 * MINUTE;
+    for (size_t c = 0; c < MacCache::CLASS_COUNT; ++c) {
+        cache->setTtl((MacAddressClass)c, ttl);
+    }
+    std::map<uint32_t, int64_t> model;
+    TestRng rng(1234);
+    const uint32_t keys = MacCache::CAPACITY - 1;
+    int64_t now = 0;
+    for (int step = 0; step < 200000; ++step) {
+        now += rng.below(20000);
+        if (rng.below(100) == 0) {
+            size_t budget = rng.below(16);
+            size_t evicted = cache->evictOld(now, budget);
+            CHECK(evicted <= budget);
+            continue;
+        }
+        uint32_t n = rng.below(keys);
+        bool expect;
+        auto it = model.find(n);
+        if (it == model.end() || now - it->second >= ttl) {
+            expect = true;
+            model[n] = now;
+        } else {
+            expect = false;
+        }
+        if (cache->shouldPrintAndAddToCache(makeKey(n), now) != expect) {
+            CHECK(!"cache disagrees with the model");
+            return;
+        }
+    }
+    CHECK(cache->size() <= model.size());
+    CHECK_EQ(cache->evictedWhileFull(), 0);
+}
+
+int main()
+{
+    RUN_TEST(testClassify);
+    RUN_TEST(testParseTtlCommand);
+    RUN_TEST(testPrintOncePerTtl);
+    RUN_TEST(testPerClassTtl);
+    RUN_TEST(testEvictOldIsBounded);
+    RUN_TEST(testFullCacheRecyclesOldest);
+    RUN_TEST(testMatchesReferenceModel);
+    return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,96 @@
+#include "mac_cache.h"
+#include "test_util.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#ifndef CONFIG_MAC_CACHE_EVICT_BUDGET
+#define CONFIG_MAC_CACHE_EVICT_BUDGET 8
+#endif
+
+/**
+ * Tail latency of the eviction step DeviceScanner::evictMacCache runs after every
+ * batch: a full cache expires all at once (a crowd that left), then new batches keep
+ * arriving. With the budget every step removes at most CONFIG_MAC_CACHE_EVICT_BUDGET
+ * entries, so its pause must stay far below one unbounded evictOld over the backlog.
+ */
+static constexpr size_t BATCH = 16;
+
+static MacKey makeKey(uint32_t n)
+{
+    MacKey k = {};
+    for (int i = 0; i < 4; ++i) {
+        k.addr[i] = (n * 2654435761u >> (8 * i)) & 0xFF;
+    }
+    k.addr[4] = n >> 24;
+    k.addr_type = 0x00;
+    return k;
+}
+
+static std::unique_ptr<MacCache> expiredFullCache(int64_t &now)
+{
+    auto cache = std::make_unique<MacCache>();
+    for (uint32_t i = 0; i < MacCache::CAPACITY; ++i) {
+        cache->shouldPrintAndAddToCache(makeKey(i), 0);
+    }
+    now = cache->ttl(MacAddressClass::Public) + 1;
+    return cache;
+}
+
+// Median of a few unbounded evictions of the whole backlog
+static int64_t unboundedPauseNs()
+{
+    std::vector<int64_t> pauses;
+    for (int run = 0; run < 5; ++run) {
+        int64_t now;
+        auto cache = expiredFullCache(now);
+        int64_t start = hostNowNs();
+        size_t evicted = cache->evictOld(now);
+        pauses.push_back(hostNowNs() - start);
+        CHECK_EQ(evicted, MacCache::CAPACITY);
+    }
+    std::sort(pauses.begin(), pauses.end());
+    return pauses[pauses.size() / 2];
+}
+
+static void testEvictionStepIsBounded()
+{
+    int64_t unbounded = unboundedPauseNs();
+
+    int64_t now;
+    auto cache = expiredFullCache(now);
+    std::vector<int64_t> pauses;
+    uint32_t next = MacCache::CAPACITY;
+    while (cache->hasExpired(now)) {
+        for (size_t i = 0; i < BATCH; ++i) {
+            cache->shouldPrintAndAddToCache(makeKey(next++), now);
+        }
+        size_t before = cache->size();
+        int64_t start = hostNowNs();
+        size_t evicted = cache->evictOld(now, CONFIG_MAC_CACHE_EVICT_BUDGET);
+        pauses.push_back(hostNowNs() - start);
+        CHECK(evicted <= CONFIG_MAC_CACHE_EVICT_BUDGET);
+        CHECK_EQ(before - cache->size(), evicted);
+        now++;
+    }
+    // the backlog is gone and only the fresh entries are left
+    CHECK(!cache->hasExpired(now));
+
+    std::sort(pauses.begin(), pauses.end());
+    int64_t p50 = pauses[pauses.size() / 2];
+    int64_t p99 = pauses[pauses.size() * 99 / 100];
+    int64_t worst = pauses.back();
+    printf("  %zu steps, step pause p50 %lld ns, p99 %lld ns, max %lld ns; unbounded sweep %lld ns\n",
+           pauses.size(), (long long)p50, (long long)p99, (long long)worst, (long long)unbounded);
+    // Generous margin: the budget is a small fraction of the capacity. The maximum is
+    // only reported, a host scheduler preempting one step must not fail the test.
+    CHECK(p99 * 4 < unbounded);
+}
+
+int main()
+{
+    static_assert(CONFIG_MAC_CACHE_EVICT_BUDGET * 16 <= MacCache::CAPACITY, "budget too large for the check");
+    RUN_TEST(testEvictionStepIsBounded);
+    return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,237 @@
+#include "payload_dictionary.h"
+#include "test_util.h"
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+/**
+ * Decoder side, written from the format description in payload_dictionary.h (the
+ * same rules dataAnalysis/includes/scanner_log.py implements).
+ */
+class ReferenceDecoder {
+public:
+    // @return false if the encoding references something the decoder does not have
+    bool decode(const uint8_t *in, size_t inLen, uint8_t len, std::vector<uint8_t> &out)
+    {
+        switch (in[0]) {
+        case PAYLOAD_ENCODING_FULL:
+            if (inLen != 1 + (size_t)len) {
+                return false;
+            }
+            out.assign(in + 1, in + 1 + len);
+            add(out);
+            return true;
+        case PAYLOAD_ENCODING_REF:
+            if (inLen != 2 || in[1] >= PayloadDictionary::ENTRIES || !_used[in[1]]) {
+                return false;
+            }
+            out = _entries[in[1]];
+            return out.size() == len;
+        case PAYLOAD_ENCODING_XOR:
+            if (inLen != 3 + 2 * (size_t)in[2] || !_used[in[1]] || _entries[in[1]].size() != len) {
+                return false;
+            }
+            out = _entries[in[1]];
+            for (size_t i = 0; i < in[2]; i++) {
+                uint8_t offset = in[3 + 2 * i];
+                if (offset >= len) {
+                    return false;
+                }
+                out[offset] ^= in[4 + 2 * i];
+            }
+            add(out);
+            return true;
+        default:
+            return false;
+        }
+    }
+    void reset()
+    {
+        for (bool &u : _used) {
+            u = false;
+        }
+        _next = 0;
+    }
+
+private:
+    void add(const std::vector<uint8_t> &payload)
+    {
+        if (payload.size() <= PAYLOAD_DICT_MAX_PAYLOAD) {
+            _entries[_next] = payload;
+            _used[_next] = true;
+            _next = (_next + 1) % PayloadDictionary::ENTRIES;
+        }
+    }
+    std::vector<uint8_t> _entries[PayloadDictionary::ENTRIES];
+    bool _used[PayloadDictionary::ENTRIES] = {};
+    size_t _next = 0;
+};
+
+static const uint8_t MAC_A[6] = {1, 2, 3, 4, 5, 6};
+static const uint8_t MAC_B[6] = {1, 2, 3, 4, 5, 7};
+
+static size_t encodeCommit(PayloadDictionary &dict, const uint8_t *mac, const std::vector<uint8_t> &payload,
+                           uint8_t *out)
+{
+    size_t n = dict.encode(mac, 0, payload.data(), (uint8_t)payload.size(), out);
+    dict.commit();
+    return n;
+}
+
+static void testFullThenReference()
+{
+    auto dict = std::make_unique<PayloadDictionary>();
+    uint8_t out[PAYLOAD_DICT_MAX_ENCODED];
+    std::vector<uint8_t> p = {0x02, 0x01, 0x06, 0x05, 0xFF, 0x4C, 0x00, 0x10};
+    CHECK_EQ(encodeCommit(*dict, MAC_A, p, out), 1 + p.size());
+    CHECK_EQ(out[0], PAYLOAD_ENCODING_FULL);
+    CHECK(memcmp(out + 1, p.data(), p.size()) == 0);
+    CHECK_EQ(encodeCommit(*dict, MAC_A, p, out), 2);
+    CHECK_EQ(out[0], PAYLOAD_ENCODING_REF);
+    CHECK_EQ(out[1], 0);
+    // a repeat by another device (or the same one after an address rotation) too
+    CHECK_EQ(encodeCommit(*dict, MAC_B, p, out), 2);
+    CHECK_EQ(out[0], PAYLOAD_ENCODING_REF);
+
+    PayloadDictionary::Stats st = dict->stats();
+    CHECK_EQ(st.full, 1);
+    CHECK_EQ(st.refs, 2);
+    CHECK_EQ(st.bytesIn, 3 * p.size());
+    CHECK_EQ(st.bytesOut, 1 + p.size() + 4);
+}
+
+static void testXorDelta()
+{
+    auto dict = std::make_unique<PayloadDictionary>();
+    uint8_t out[PAYLOAD_DICT_MAX_ENCODED];
+    std::vector<uint8_t> p(20, 0x33);
+    encodeCommit(*dict, MAC_A, p, out);
+    std::vector<uint8_t> changed = p;
+    changed[7] = 0x99;      // a counter or battery byte
+    CHECK_EQ(encodeCommit(*dict, MAC_A, changed, out), 5);
+    CHECK_EQ(out[0], PAYLOAD_ENCODING_XOR);
+    CHECK_EQ(out[1], 0);
+    CHECK_EQ(out[2], 1);
+    CHECK_EQ(out[3], 7);
+    CHECK_EQ(out[4], 0x33 ^ 0x99);
+    // the delta result is a dictionary entry of its own
+    CHECK_EQ(encodeCommit(*dict, MAC_B, changed, out), 2);
+    CHECK_EQ(out[1], 1);
+
+    // deltas are only against the same device's payload and only when shorter
+    CHECK_EQ(encodeCommit(*dict, MAC_A, std::vector<uint8_t>(20, 0x44), out), 21);
+    CHECK_EQ(out[0], PAYLOAD_ENCODING_FULL);
+    CHECK_EQ(dict->stats().xors, 1);
+    // a different length is never a delta
+    CHECK_EQ(encodeCommit(*dict, MAC_A, std::vector<uint8_t>(19, 0x44), out), 20);
+    CHECK_EQ(out[0], PAYLOAD_ENCODING_FULL);
+}
+
+static void testLongPayloadsAreNotRemembered()
+{
+    auto dict = std::make_unique<PayloadDictionary>();
+    uint8_t out[PAYLOAD_DICT_MAX_ENCODED];
+    std::vector<uint8_t> big(200, 0xAB);
+    CHECK_EQ(encodeCommit(*dict, MAC_A, big, out), 201);
+    CHECK_EQ(encodeCommit(*dict, MAC_A, big, out), 201);
+    CHECK_EQ(out[0], PAYLOAD_ENCODING_FULL);
+    // the slot was not used up
+    std::vector<uint8_t> small = {1, 2, 3};
+    encodeCommit(*dict, MAC_A, small, out);
+    encodeCommit(*dict, MAC_B, small, out);
+    CHECK_EQ(out[1], 0);
+}
+
+static void testEncodeWithoutCommitChangesNothing()
+{
+    auto dict = std::make_unique<PayloadDictionary>();
+    uint8_t out[PAYLOAD_DICT_MAX_ENCODED];
+    std::vector<uint8_t> p = {9, 9, 9};
+    dict->encode(MAC_A, 0, p.data(), 3, out);     // the record was dropped
+    CHECK_EQ(dict->encode(MAC_A, 0, p.data(), 3, out), 4);
+    CHECK_EQ(out[0], PAYLOAD_ENCODING_FULL);
+    CHECK_EQ(dict->stats().full, 0);
+    dict->commit();
+    dict->commit();     // a second commit is a no-op
+    CHECK_EQ(dict->stats().full, 1);
+    CHECK_EQ(encodeCommit(*dict, MAC_A, p, out), 2);
+}
+
+static void testResetAndWrapAround()
+{
+    auto dict = std::make_unique<PayloadDictionary>();
+    uint8_t out[PAYLOAD_DICT_MAX_ENCODED];
+    std::vector<uint8_t> first = {0xF0, 0x0F};
+    encodeCommit(*dict, MAC_A, first, out);
+    dict->reset();
+    CHECK_EQ(encodeCommit(*dict, MAC_A, first, out), 3);
+
+    // ENTRIES more distinct payloads push the first one out
+    for (uint32_t i = 0; i < PayloadDictionary::ENTRIES; i++) {
+        std::vector<uint8_t> p = {(uint8_t)i, (uint8_t)(i >> 8), 0x55, 0x66};
+        uint8_t mac[6] = {0xAA, (uint8_t)i, 0, 0, 0, 0};
+        encodeCommit(*dict, mac, p, out);
+    }
+    CHECK_EQ(encodeCommit(*dict, MAC_B, first, out), 3);
+    CHECK_EQ(out[0], PAYLOAD_ENCODING_FULL);
+}
+
+/**
+ * Random traffic of devices with slowly changing payloads, decoded by the reference
+ * decoder with resets at random points, as at block boundaries.
+ */
+static void testRoundTrip()
+{
+    auto dict = std::make_unique<PayloadDictionary>();
+    ReferenceDecoder decoder;
+    TestRng rng(11);
+    const uint32_t devices = 300;
+    std::vector<std::vector<uint8_t>> payloads(devices);
+    for (auto &p : payloads) {
+        p.resize(rng.below(3) == 0 ? 32 + rng.below(200) : rng.below(32));
+        for (uint8_t &b : p) {
+            b = (uint8_t)rng.next();
+        }
+    }
+    uint8_t out[PAYLOAD_DICT_MAX_ENCODED];
+    std::vector<uint8_t> decoded;
+    size_t bytesIn = 0;
+    size_t bytesOut = 0;
+    for (int i = 0; i < 200000; i++) {
+        uint32_t d = rng.below(20) == 0 ? rng.below(devices) : rng.below(devices / 10);
+        std::vector<uint8_t> &p = payloads[d];
+        if (!p.empty() && rng.below(6) == 0) {
+            p[rng.below(p.size())] ^= (uint8_t)(1 + rng.below(255));
+        }
+        uint8_t mac[6] = {(uint8_t)d, (uint8_t)(d >> 8), 0x10, 0x20, 0x30, 0x40};
+        size_t n = dict->encode(mac, (uint8_t)(d & 1), p.data(), (uint8_t)p.size(), out);
+        if (rng.below(50) == 0) {
+            continue;   // dropped before it reached the log, never committed
+        }
+        dict->commit();
+        if (!decoder.decode(out, n, (uint8_t)p.size(), decoded) || decoded != p) {
+            CHECK(!"round trip failed");
+            return;
+        }
+        bytesIn += p.size();
+        bytesOut += n;
+        if (rng.below(500) == 0) {
+            dict->reset();
+            decoder.reset();
+        }
+    }
+    printf("  %zu payload bytes encoded into %zu\n", bytesIn, bytesOut);
+    CHECK(bytesOut < bytesIn);
+}
+
+int main()
+{
+    RUN_TEST(testFullThenReference);
+    RUN_TEST(testXorDelta);
+    RUN_TEST(testLongPayloadsAreNotRemembered);
+    RUN_TEST(testEncodeWithoutCommitChangesNothing);
+    RUN_TEST(testResetAndWrapAround);
+    RUN_TEST(testRoundTrip);
+    return TEST_MAIN_RESULT();
+}
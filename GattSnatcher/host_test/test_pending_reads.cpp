@@ -0,0 +1,83 @@
+#include "struct_and_definitions.h"
+#include "test_util.h"
+
+#include <memory>
+
+static std::unique_ptr<gattc_profile_inst> makeProfile()
+{
+    auto profile = std::make_unique<gattc_profile_inst>();
+    profile->multi_read_unsupported = false;
+    profile->reads_timed_out = 0;
+    return profile;
+}
+
+// A Read Multiple of handles 10, 11, 12 sent with @p deadline
+static void sendMultiRead(gattc_profile_inst &profile, TickType_t deadline)
+{
+    profile.multi_read.num_attr = 3;
+    for (int i = 0; i < 3; i++) {
+        profile.multi_read.handles[i] = (uint16_t)(10 + i);
+    }
+    profile.pending_requests.push_back({10, deadline, true});
+}
+
+static void testNothingExpiresBeforeTheDeadline()
+{
+    auto profile = makeProfile();
+    sendMultiRead(*profile, 100);
+    profile->pending_requests.push_back({20, 100, false});
+    CHECK_EQ(profile->expirePendingReads(100), 0);
+    CHECK_EQ(profile->pending_requests.size(), 2);
+    CHECK_EQ(profile->reads_timed_out, 0);
+    CHECK(!profile->multi_read_unsupported);
+}
+
+static void testSingleReadsCountAsTimedOut()
+{
+    auto profile = makeProfile();
+    profile->pending_requests.push_back({20, 100, false});
+    profile->pending_requests.push_back({21, 300, false});
+    profile->pending_requests.push_back({22, 50, false});
+    CHECK_EQ(profile->expirePendingReads(200), 2);
+    CHECK_EQ(profile->reads_timed_out, 2);
+    CHECK_EQ(profile->pending_requests.size(), 1);
+    CHECK_EQ(profile->pending_requests[0].handle, 21);
+    CHECK(profile->read_char_queue.empty());
+}
+
+// A peer ignoring Read Multiple is read one handle at a time, and is still complete
+static void testReadMultipleFallsBackToSingleReads()
+{
+    auto profile = makeProfile();
+    sendMultiRead(*profile, 100);
+    CHECK_EQ(profile->expirePendingReads(101), 1);
+    CHECK_EQ(profile->reads_timed_out, 0);
+    CHECK(profile->multi_read_unsupported);
+    CHECK_EQ(profile->multi_read.num_attr, 0);
+    CHECK(profile->pending_requests.empty());
+    CHECK(profile->read_char_queue == std::deque<uint16_t>({10, 11, 12}));
+
+    // the retries have their own deadlines, and only they count once they expire
+    profile->pending_requests.push_back({10, 200, false});
+    profile->read_char_queue.pop_front();
+    CHECK_EQ(profile->expirePendingReads(150), 0);
+    CHECK_EQ(profile->expirePendingReads(201), 1);
+    CHECK_EQ(profile->reads_timed_out, 1);
+}
+
+static void testTickCounterWrap()
+{
+    auto profile = makeProfile();
+    profile->pending_requests.push_back({20, 5, false});
+    CHECK_EQ(profile->expirePendingReads(UINT32_MAX - 5), 0);
+    CHECK_EQ(profile->expirePendingReads(6), 1);
+}
+
+int main()
+{
+    RUN_TEST(testNothingExpiresBeforeTheDeadline);
+    RUN_TEST(testSingleReadsCountAsTimedOut);
+    RUN_TEST(testReadMultipleFallsBackToSingleReads);
+    RUN_TEST(testTickCounterWrap);
+    return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,220 @@
+#include "uart_frame.h"
+#include "test_util.h"
+
+#include <cstring>
+#include <vector>
+
+static UartAdvReportFrame makeReport(uint32_t n)
+{
+    UartAdvReportFrame r = {};
+    r.timestamp = 0x0000123456789ABCLL + n;
+    r.event_type = (uint16_t)(n % 5);
+    r.addr_type = (uint8_t)(n % 4);
+    for (int i = 0; i < 6; i++) {
+        r.addr[i] = (uint8_t)(n >> (4 * i));
+    }
+    r.adv_data_length = (uint8_t)(n % 32);
+    r.rssi = (int8_t)(-30 - (int)(n % 70));
+    r.file_id = (uint16_t)(n % 3 == 0 ? UART_FRAME_NO_FILE_ID : n % 100);
+    return r;
+}
+
+static bool sameReport(const UartAdvReportFrame &a, const UartAdvReportFrame &b)
+{
+    return a.timestamp == b.timestamp && a.event_type == b.event_type && a.addr_type == b.addr_type
+           && memcmp(a.addr, b.addr, 6) == 0 && a.adv_data_length == b.adv_data_length && a.rssi == b.rssi
+           && a.file_id == b.file_id;
+}
+
+// Frames 0..count-1 with sequence numbers equal to their index
+static std::vector<uint8_t> encodeStream(uint32_t count)
+{
+    std::vector<uint8_t> stream;
+    uint8_t frame[UART_FRAME_ADV_REPORT_SIZE];
+    for (uint32_t i = 0; i < count; i++) {
+        size_t n = uartFrameEncodeAdvReport(makeReport(i), (uint8_t)i, frame);
+        stream.insert(stream.end(), frame, frame + n);
+    }
+    return stream;
+}
+
+// Feeds @p stream in one go (in buffer-sized pieces) and returns the decoded report numbers
+static std::vector<uint32_t> decodeAll(UartFrameDecoder &decoder, const std::vector<uint8_t> &stream)
+{
+    std::vector<uint32_t> seen;
+    size_t pos = 0;
+    UartFrameDecoder::Frame frame;
+    while (pos < stream.size()) {
+        pos += decoder.feed(stream.data() + pos, stream.size() - pos);
+        while (decoder.next(frame)) {
+            UartAdvReportFrame r;
+            if (frame.type == UART_FRAME_ADV_REPORT && uartFrameDecodeAdvReport(frame.payload, frame.len, r)) {
+                uint32_t n = (uint32_t)(r.timestamp - makeReport(0).timestamp);
+                seen.push_back(sameReport(r, makeReport(n)) ? n : UINT32_MAX);
+            }
+        }
+    }
+    return seen;
+}
+
+static void testCrc()
+{
+    // CRC-16/CCITT-FALSE check value
+    CHECK_EQ(uartFrameCrc16((const uint8_t *)"123456789", 9), 0x29B1);
+    // can be computed in pieces
+    uint16_t part = uartFrameCrc16((const uint8_t *)"1234", 4);
+    CHECK_EQ(uartFrameCrc16((const uint8_t *)"56789", 5, part), 0x29B1);
+}
+
+static void testRoundTrip()
+{
+    uint8_t frame[UART_FRAME_ADV_REPORT_SIZE];
+    UartAdvReportFrame in = makeReport(77);
+    CHECK_EQ(uartFrameEncodeAdvReport(in, 9, frame), UART_FRAME_ADV_REPORT_SIZE);
+    CHECK_EQ(frame[0], UART_FRAME_SYNC_0);
+    CHECK_EQ(frame[1], UART_FRAME_SYNC_1);
+    CHECK_EQ(frame[2], UART_FRAME_ADV_REPORT);
+    CHECK_EQ(frame[3], 9);
+    CHECK_EQ(frame[4], UART_FRAME_ADV_REPORT_PAYLOAD_SIZE);
+
+    UartFrameDecoder decoder;
+    CHECK_EQ(decoder.feed(frame, sizeof(frame)), sizeof(frame));
+    UartFrameDecoder::Frame f;
+    CHECK(decoder.next(f));
+    CHECK_EQ(f.seq, 9);
+    UartAdvReportFrame out;
+    CHECK(uartFrameDecodeAdvReport(f.payload, f.len, out));
+    CHECK(sameReport(in, out));
+    CHECK(!decoder.next(f));
+    CHECK(!uartFrameDecodeAdvReport(f.payload, f.len - 1, out));
+    CHECK_EQ(decoder.framesDecoded(), 1);
+    CHECK_EQ(decoder.bytesDiscarded(), 0);
+}
+
+static void testStream()
+{
+    std::vector<uint8_t> stream = encodeStream(1000);
+    UartFrameDecoder decoder;
+    std::vector<uint32_t> seen = decodeAll(decoder, stream);
+    CHECK_EQ(seen.size(), 1000);
+    for (uint32_t i = 0; i < seen.size(); i++) {
+        CHECK_EQ(seen[i], i);
+    }
+    CHECK_EQ(decoder.framesLost(), 0);
+    CHECK_EQ(decoder.crcErrors(), 0);
+}
+
+static void testSequenceGapsAreCounted()
+{
+    std::vector<uint8_t> stream = encodeStream(10);
+    // drop frames 3 and 4 on the "wire"
+    stream.erase(stream.begin() + 3 * UART_FRAME_ADV_REPORT_SIZE, stream.begin() + 5 * UART_FRAME_ADV_REPORT_SIZE);
+    UartFrameDecoder decoder;
+    CHECK_EQ(decodeAll(decoder, stream).size(), 8);
+    CHECK_EQ(decoder.framesLost(), 2);
+}
+
+static void testResyncAfterCorruption()
+{
+    std::vector<uint8_t> stream = encodeStream(20);
+    // a flipped payload bit in frame 5, garbage between frames 10 and 11, a cut-off frame before 15
+    stream[5 * UART_FRAME_ADV_REPORT_SIZE + 12] ^= 0x10;
+    std::vector<uint8_t> garbage = {0x00, UART_FRAME_SYNC_0, 0x13, UART_FRAME_SYNC_1, UART_FRAME_SYNC_0};
+    stream.insert(stream.begin() + 11 * UART_FRAME_ADV_REPORT_SIZE, garbage.begin(), garbage.end());
+    std::vector<uint8_t> partial(stream.begin(), stream.begin() + 12);     // header and a bit of frame 0
+    stream.insert(stream.begin() + 15 * UART_FRAME_ADV_REPORT_SIZE + garbage.size(), partial.begin(),
+                  partial.end());
+
+    UartFrameDecoder decoder;
+    std::vector<uint32_t> seen = decodeAll(decoder, stream);
+    std::vector<uint32_t> expected;
+    for (uint32_t i = 0; i < 20; i++) {
+        if (i != 5) {
+            expected.push_back(i);
+        }
+    }
+    CHECK(seen == expected);
+    CHECK(decoder.crcErrors() >= 2);
+    CHECK_EQ(decoder.framesLost(), 1);
+    CHECK(decoder.bytesDiscarded() >= garbage.size() + partial.size());
+}
+
+// Decodes whatever is buffered and returns the report numbers
+static std::vector<uint32_t> drain(UartFrameDecoder &decoder)
+{
+    std::vector<uint32_t> seen;
+    UartFrameDecoder::Frame frame;
+    while (decoder.next(frame)) {
+        UartAdvReportFrame r;
+        CHECK(frame.type == UART_FRAME_ADV_REPORT && uartFrameDecodeAdvReport(frame.payload, frame.len, r));
+        seen.push_back((uint32_t)(r.timestamp - makeReport(0).timestamp));
+    }
+    return seen;
+}
+
+static void testBadHeaderIsRejectedAtOnce()
+{
+    std::vector<uint8_t> good = encodeStream(2);
+    // an unknown type and a wrong length for a known one, both claiming a long payload
+    std::vector<std::vector<uint8_t>> headers = {
+        {UART_FRAME_SYNC_0, UART_FRAME_SYNC_1, 0x7E, 0, 200},
+        {UART_FRAME_SYNC_0, UART_FRAME_SYNC_1, UART_FRAME_ADV_REPORT, 0, 200},
+        {UART_FRAME_SYNC_0, UART_FRAME_SYNC_1, UART_FRAME_ADV_REPORT, 0, UART_FRAME_ADV_REPORT_PAYLOAD_SIZE - 1},
+    };
+    for (const auto &header : headers) {
+        UartFrameDecoder decoder;
+        std::vector<uint8_t> stream = header;
+        stream.insert(stream.end(), good.begin(), good.end());
+        CHECK_EQ(decoder.feed(stream.data(), stream.size()), stream.size());
+        // the good frames come out without waiting for the 200 bytes the header claims
+        CHECK(drain(decoder) == std::vector<uint32_t>({0, 1}));
+        CHECK_EQ(decoder.headerErrors(), 1);
+        CHECK_EQ(decoder.crcErrors(), 0);
+        CHECK_EQ(decoder.bytesDiscarded(), header.size());
+    }
+
+    // rejected once the header is complete, not before
+    UartFrameDecoder decoder;
+    const std::vector<uint8_t> &header = headers[0];
+    CHECK_EQ(decoder.feed(header.data(), 4), 4);
+    CHECK(drain(decoder).empty());
+    CHECK_EQ(decoder.headerErrors(), 0);
+    CHECK_EQ(decoder.feed(header.data() + 4, 1), 1);
+    CHECK(drain(decoder).empty());
+    CHECK_EQ(decoder.headerErrors(), 1);
+    CHECK_EQ(decoder.feed(good.data(), good.size()), good.size());
+    CHECK(drain(decoder) == std::vector<uint32_t>({0, 1}));
+}
+
+// Random corruption anywhere: a frame is either decoded intact or missing, never wrong
+static void testRandomCorruption()
+{
+    TestRng rng(5);
+    for (int round = 0; round < 200; round++) {
+        std::vector<uint8_t> stream = encodeStream(50);
+        int flips = 1 + rng.below(10);
+        for (int i = 0; i < flips; i++) {
+            stream[rng.below(stream.size())] ^= (uint8_t)(1 + rng.below(255));
+        }
+        UartFrameDecoder decoder;
+        std::vector<uint32_t> seen = decodeAll(decoder, stream);
+        // each flip damages at most two frames (a frame and its neighbour's sync)
+        CHECK(seen.size() + 2 * flips >= 50);
+        for (size_t i = 0; i < seen.size(); i++) {
+            CHECK(seen[i] < 50);
+            CHECK(i == 0 || seen[i] > seen[i - 1]);
+        }
+    }
+}
+
+int main()
+{
+    RUN_TEST(testCrc);
+    RUN_TEST(testRoundTrip);
+    RUN_TEST(testStream);
+    RUN_TEST(testSequenceGapsAreCounted);
+    RUN_TEST(testResyncAfterCorruption);
+    RUN_TEST(testBadHeaderIsRejectedAtOnce);
+    RUN_TEST(testRandomCorruption);
+    return TEST_MAIN_RESULT();
+}
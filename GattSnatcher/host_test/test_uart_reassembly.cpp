@@ -0,0 +1,168 @@
+#include "uart_frame.h"
+#include "test_util.h"
+
+#include <vector>
+
+/**
+ * Harness for the reassembly in DeviceInterrogator::questioner_uart_task: the stream
+ * arrives as UART_DATA events of arbitrary size, each read in pieces of at most
+ * READ_SIZE bytes and fed with the same loop the task uses. No frame may be lost,
+ * wherever the boundaries fall.
+ */
+static constexpr size_t READ_SIZE = 128;     // UART_BUF_SIZE of the task
+
+struct Receiver {
+    UartFrameDecoder decoder;
+    std::vector<uint8_t> seqs;
+    uint32_t malformed = 0;
+
+    // The UART_DATA branch of the task for one event of @p len bytes
+    void onData(const uint8_t *data, size_t len)
+    {
+        size_t pending = len;
+        while (pending > 0) {
+            size_t n = pending < READ_SIZE ? pending : READ_SIZE;
+            const uint8_t *chunk = data + (len - pending);
+            pending -= n;
+            size_t fed = 0;
+            while (fed < n) {
+                fed += decoder.feed(chunk + fed, n - fed);
+                UartFrameDecoder::Frame frame;
+                while (decoder.next(frame)) {
+                    UartAdvReportFrame report;
+                    if (frame.type == UART_FRAME_ADV_REPORT
+                        && uartFrameDecodeAdvReport(frame.payload, frame.len, report)) {
+                        seqs.push_back(frame.seq);
+                    } else {
+                        malformed++;
+                    }
+                }
+            }
+        }
+    }
+};
+
+static std::vector<uint8_t> encodeStream(uint32_t count, uint32_t firstSeq = 0)
+{
+    std::vector<uint8_t> stream;
+    uint8_t frame[UART_FRAME_ADV_REPORT_SIZE];
+    for (uint32_t i = 0; i < count; i++) {
+        UartAdvReportFrame r = {};
+        r.timestamp = i;
+        r.addr[0] = (uint8_t)i;
+        // payload bytes that look like sync sequences must not confuse the reassembly
+        r.addr[1] = UART_FRAME_SYNC_0;
+        r.addr[2] = UART_FRAME_SYNC_1;
+        r.file_id = 7;
+        size_t n = uartFrameEncodeAdvReport(r, (uint8_t)(firstSeq + i), frame);
+        stream.insert(stream.end(), frame, frame + n);
+    }
+    return stream;
+}
+
+static bool allInOrder(const Receiver &rx, uint32_t count, uint32_t firstSeq = 0)
+{
+    if (rx.seqs.size() != count) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (rx.seqs[i] != (uint8_t)(firstSeq + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void testRandomChunkBoundaries()
+{
+    const uint32_t frames = 5000;
+    std::vector<uint8_t> stream = encodeStream(frames);
+    for (uint32_t seed = 1; seed <= 20; seed++) {
+        TestRng rng(seed);
+        Receiver rx;
+        size_t pos = 0;
+        while (pos < stream.size()) {
+            // mostly small events, sometimes more than the decoder buffer holds
+            size_t len = rng.below(8) == 0 ? 1 + rng.below(3 * UART_FRAME_MAX_SIZE) : 1 + rng.below(40);
+            len = len < stream.size() - pos ? len : stream.size() - pos;
+            rx.onData(stream.data() + pos, len);
+            pos += len;
+        }
+        CHECK(allInOrder(rx, frames));
+        CHECK_EQ(rx.malformed, 0);
+        CHECK_EQ(rx.decoder.crcErrors(), 0);
+        CHECK_EQ(rx.decoder.bytesDiscarded(), 0);
+        CHECK_EQ(rx.decoder.framesLost(), 0);
+    }
+}
+
+static void testByteByByte()
+{
+    std::vector<uint8_t> stream = encodeStream(300);
+    Receiver rx;
+    for (uint8_t b : stream) {
+        rx.onData(&b, 1);
+    }
+    CHECK(allInOrder(rx, 300));
+}
+
+static void testOneHugeEvent()
+{
+    std::vector<uint8_t> stream = encodeStream(2000);
+    Receiver rx;
+    rx.onData(stream.data(), stream.size());
+    CHECK(allInOrder(rx, 2000));
+}
+
+// feed() takes what fits and the caller drains next() before feeding the rest
+static void testFeedBackpressure()
+{
+    std::vector<uint8_t> stream = encodeStream(500);
+    UartFrameDecoder decoder;
+    uint32_t decoded = 0;
+    size_t fed = 0;
+    bool partial = false;
+    while (fed < stream.size()) {
+        size_t n = decoder.feed(stream.data() + fed, stream.size() - fed);
+        partial = partial || n < stream.size() - fed;
+        fed += n;
+        UartFrameDecoder::Frame frame;
+        while (decoder.next(frame)) {
+            decoded++;
+        }
+    }
+    CHECK(partial);
+    CHECK_EQ(decoded, 500);
+    CHECK_EQ(decoder.bytesDiscarded(), 0);
+}
+
+// An RX overflow flushes the driver: the frame cut in half is counted, the next ones decode
+static void testOverflowMidFrame()
+{
+    std::vector<uint8_t> before = encodeStream(10);
+    std::vector<uint8_t> after = encodeStream(10, 100);
+    Receiver rx;
+    rx.onData(before.data(), before.size() - 7);
+    CHECK_EQ(rx.seqs.size(), 9);
+    rx.decoder.reset();
+    CHECK_EQ(rx.decoder.framesTruncated(), 1);
+    rx.onData(after.data(), after.size());
+    CHECK_EQ(rx.seqs.size(), 19);
+    CHECK_EQ(rx.seqs.back(), 109);
+    // the jump in sequence numbers across the reset is not counted as lost frames
+    CHECK_EQ(rx.decoder.framesLost(), 0);
+    CHECK_EQ(rx.decoder.crcErrors(), 0);
+    // a reset between frames truncates nothing
+    rx.decoder.reset();
+    CHECK_EQ(rx.decoder.framesTruncated(), 1);
+}
+
+int main()
+{
+    RUN_TEST(testRandomChunkBoundaries);
+    RUN_TEST(testByteByByte);
+    RUN_TEST(testOneHugeEvent);
+    RUN_TEST(testFeedBackpressure);
+    RUN_TEST(testOverflowMidFrame);
+    return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+/**
+ * Minimal checks for the host tests, no framework needed. A failed CHECK prints the
+ * location and counts the failure, TEST_MAIN_RESULT turns the count into the exit code.
+ */
+inline int g_testFailures = 0;
+
+#define CHECK(cond)                                                             \
+    do {                                                                        \
+        if (!(cond)) {                                                          \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            g_testFailures++;                                                   \
+        }                                                                       \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                          \
+    do {                                                                        \
+        long long _a = (long long)(a), _b = (long long)(b);                     \
+        if (_a != _b) {                                                         \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n",   \
+                    __FILE__, __LINE__, #a, #b, _a, _b);                        \
+            g_testFailures++;                                                   \
+        }                                                                       \
+    } while (0)
+
+#define RUN_TEST(fn)                                                            \
+    do {                                                                        \
+        int _before = g_testFailures;                                           \
+        fn();                                                                   \
+        printf("%s %s\n", g_testFailures == _before ? "ok  " : "FAIL", #fn);    \
+    } while (0)
+
+#define TEST_MAIN_RESULT() (g_testFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE)
+
+// Monotonic time in ns for the benchmarks and latency checks
+static inline int64_t hostNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Deterministic pseudo random numbers (xorshift32), so failures reproduce
+struct TestRng {
+    uint32_t state;
+    explicit TestRng(uint32_t seed) : state(seed ? seed : 1) {}
+    uint32_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    uint32_t below(uint32_t n) { return next() % n; }
+};
@@ -0,0 +1,252 @@
+#include "buffered_log_writer.h"
+
+#include <chrono>
+#include <cstring>
+#include <unistd.h>
+#ifdef ESP_PLATFORM
+#include <esp_pthread.h>
+#endif
+
+BufferedLogWriter::~BufferedLogWriter()
+{
+    stop();
+}
+
+bool BufferedLogWriter::start(FILE *file, FileOpener opener)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_running || file == nullptr) {
+        return false;
+    }
+    _file = file;
+    _opener = std::move(opener);
+    _running = true;
+#ifdef ESP_PLATFORM
+    esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
+    cfg.stack_size = LOG_WRITER_TASK_STACK;
+    cfg.prio = LOG_WRITER_TASK_PRIORITY;
+    cfg.thread_name = "LOG_WRITER";
+    esp_pthread_set_cfg(&cfg);
+#endif
+    _thread = std::thread(&BufferedLogWriter::run, this);
+    return true;
+}
+
+void BufferedLogWriter::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_running) {
+            return;
+        }
+        sealCurrentLocked();
+        _running = false;
+    }
+    _wake.notify_one();
+    _thread.join();
+}
+
+void BufferedLogWriter::sealCurrentLocked()
+{
+    Page &page = _pages[_current];
+    if (page.used == 0 || page.sealedSeq != 0) {
+        // nothing to seal, or every page is sealed and waiting already
+        return;
+    }
+    page.sealedSeq = ++_sealSeq;
+    // the next page may still be waiting for the flash, write() checks before using it
+    _current = (_current + 1) % PAGES;
+}
+
+bool BufferedLogWriter::write(const void *data, size_t len)
+{
+    if (len > PAGE_SIZE) {
+        return false;
+    }
+    bool sealed = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Page *page = &_pages[_current];
+        if (page->sealedSeq == 0 && page->used + len > PAGE_SIZE) {
+            sealCurrentLocked();
+            sealed = true;
+            page = &_pages[_current];
+        }
+        if (page->sealedSeq != 0 || !_running) {
+            // every page is waiting for the writer thread
+            _stats.droppedRecords++;
+            if (sealed) {
+                _wake.notify_one();
+            }
+            return false;
+        }
+        if (page->used == 0) {
+            _firstUnsealedWrite = std::chrono::steady_clock::now();
+        }
+        memcpy(page->data + page->used, data, len);
+        page->used += len;
+    }
+    if (sealed) {
+        _wake.notify_one();
+    }
+    return true;
+}
+
+bool BufferedLogWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!_running) {
+        return false;
+    }
+    sealCurrentLocked();
+    uint64_t target = _sealSeq;
+    _flushRequested = true;
+    _wake.notify_one();
+    _committed.wait(lock, [&] { return _committedSeq >= target || !_running; });
+    return _lastCommitOk;
+}
+
+void BufferedLogWriter::commitAsync()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_running) {
+            return;
+        }
+        sealCurrentLocked();
+    }
+    _wake.notify_one();
+}
+
+bool BufferedLogWriter::switchFile(FILE *file)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_running || _nextFile != nullptr || _rotateRequested) {
+            return false;
+        }
+        sealCurrentLocked();
+        _nextFile = file;
+        _switchAfterSeq = _sealSeq;
+    }
+    _wake.notify_one();
+    return true;
+}
+
+bool BufferedLogWriter::rotate()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_running || !_opener || _nextFile != nullptr || _rotateRequested) {
+            return false;
+        }
+        sealCurrentLocked();
+        _rotateRequested = true;
+        _switchAfterSeq = _sealSeq;
+    }
+    _wake.notify_one();
+    return true;
+}
+
+// Commits and closes the current file, @return false if the commit failed
+bool BufferedLogWriter::switchFileLocked(std::unique_lock<std::mutex> &lock)
+{
+    FILE *old = _file;
+    lock.unlock();
+    bool ok = fflush(old) == 0 && fsync(fileno(old)) == 0;
+    fclose(old);
+    lock.lock();
+    if (!ok) {
+        _stats.writeErrors++;
+    }
+    _stats.commits++;
+    _file = _nextFile;
+    _nextFile = nullptr;
+    return ok;
+}
+
+BufferedLogWriter::Page *BufferedLogWriter::nextSealedLocked()
+{
+    Page *oldest = nullptr;
+    for (Page &page : _pages) {
+        if (page.sealedSeq != 0 && (oldest == nullptr || page.sealedSeq < oldest->sealedSeq)) {
+            oldest = &page;
+        }
+    }
+    return oldest;
+}
+
+void BufferedLogWriter::run()
+{
+    const auto commitInterval = std::chrono::milliseconds(CONFIG_LOG_WRITER_COMMIT_MS);
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;) {
+        _wake.wait_for(lock, commitInterval, [&] {
+            return nextSealedLocked() != nullptr || _nextFile != nullptr || _rotateRequested || _flushRequested
+                   || !_running;
+        });
+        if (_rotateRequested) {
+            // the next file is ready before the pages that still go to the current one are written
+            lock.unlock();
+            FILE *next = _opener();
+            lock.lock();
+            _rotateRequested = false;
+            _nextFile = next;
+        }
+        // time-driven commit of a page that is filling up slowly
+        if (_pages[_current].used > 0
+            && std::chrono::steady_clock::now() - _firstUnsealedWrite >= commitInterval) {
+            sealCurrentLocked();
+        }
+        bool wrote = false;
+        bool ok = true;
+        while (Page *page = nextSealedLocked()) {
+            if (_nextFile != nullptr && page->sealedSeq > _switchAfterSeq) {
+                ok = switchFileLocked(lock) && ok;
+                _lastCommitOk = ok;
+                wrote = false;
+                continue;
+            }
+            // the page is no longer touched by write() once sealed, so the lock can be dropped
+            lock.unlock();
+            size_t written = fwrite(page->data, 1, page->used, _file);
+            lock.lock();
+            if (written != page->used) {
+                ok = false;
+                _stats.writeErrors++;
+            }
+            _stats.pagesWritten++;
+            _stats.bytesWritten += written;
+            _committedSeq = page->sealedSeq;
+            page->used = 0;
+            page->sealedSeq = 0;
+            wrote = true;
+        }
+        if (_nextFile != nullptr) {
+            // everything up to the switch is written, the old file is committed as it is closed
+            ok = switchFileLocked(lock) && ok;
+            _lastCommitOk = ok;
+        } else if (wrote) {
+            lock.unlock();
+            bool synced = fflush(_file) == 0 && fsync(fileno(_file)) == 0;
+            lock.lock();
+            if (!synced) {
+                _stats.writeErrors++;
+            }
+            ok = synced && ok;
+            _stats.commits++;
+            _lastCommitOk = ok;
+        }
+        _flushRequested = false;
+        _committed.notify_all();
+        if (!_running && nextSealedLocked() == nullptr) {
+            return;
+        }
+    }
+}
+
+BufferedLogWriter::Stats BufferedLogWriter::stats()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
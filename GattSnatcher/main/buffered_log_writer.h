@@ -0,0 +1,123 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <thread>
+#if __has_include("sdkconfig.h")
+#include "sdkconfig.h"
+#endif
+
+#ifndef CONFIG_LOG_WRITER_PAGE_SIZE
+#define CONFIG_LOG_WRITER_PAGE_SIZE 4096
+#endif
+#ifndef CONFIG_LOG_WRITER_PAGES
+#define CONFIG_LOG_WRITER_PAGES 4
+#endif
+#ifndef CONFIG_LOG_WRITER_COMMIT_MS
+#define CONFIG_LOG_WRITER_COMMIT_MS 1000
+#endif
+
+#define LOG_WRITER_TASK_PRIORITY 1  // just above idle, below the HCI task
+#define LOG_WRITER_TASK_STACK 3072
+
+/**
+ * Group-committing writer for append-only binary logs.
+ *
+ * write() copies a record into a RAM page and returns; it never touches the file.
+ * A page is committed by a low-priority writer thread when it is full, when it has
+ * held data for CONFIG_LOG_WRITER_COMMIT_MS, or on flush(). Each commit writes the
+ * pages that are ready and then fsyncs once, so LittleFS updates its metadata once
+ * per commit instead of once per record.
+ *
+ * A record is never split across pages. If every page is waiting for the flash,
+ * write() drops the record rather than blocking and counts it in droppedRecords.
+ *
+ * Moving the log to a new file is the writer thread's job as well: rotate() only
+ * marks the point, and the thread opens the next file through the FileOpener
+ * given to start() before it writes out the pages that still go to the current one.
+ *
+ * Standard C++ only (plus the pthread configuration on ESP-IDF), so it builds for
+ * the host. Thread-safe.
+ */
+class BufferedLogWriter {
+public:
+    static constexpr size_t PAGE_SIZE = CONFIG_LOG_WRITER_PAGE_SIZE;
+    static constexpr size_t PAGES = CONFIG_LOG_WRITER_PAGES;
+
+    struct Stats {
+        uint32_t commits;           // fsyncs
+        uint32_t pagesWritten;
+        uint64_t bytesWritten;
+        uint32_t droppedRecords;    // no free page
+        uint32_t writeErrors;
+    };
+
+    // Opens the file the log continues in, on the writer thread; nullptr stays in the current file
+    using FileOpener = std::function<FILE *()>;
+
+    ~BufferedLogWriter();
+
+    // Starts the writer thread appending to @p file, which stays owned by the caller until switchFile()
+    bool start(FILE *file, FileOpener opener = nullptr);
+    // Commits everything and stops the thread
+    void stop();
+
+    // Queues one record, @return false if it was dropped
+    bool write(const void *data, size_t len);
+    // Commits everything written so far, blocking until it is on flash
+    bool flush();
+    // Like flush(), but returns right away
+    void commitAsync();
+
+    /**
+     * Sends everything written from now on to @p file. The writer thread commits and
+     * closes the current file once all records written before are in it, so the
+     * caller must not use that file anymore.
+     * @return false if the previous switch has not happened yet
+     */
+    bool switchFile(FILE *file);
+
+    /**
+     * Like switchFile(), but the writer thread opens the file through the FileOpener,
+     * so the caller does no file I/O.
+     * @return false if there is no opener or the previous switch has not happened yet
+     */
+    bool rotate();
+
+    Stats stats();
+
+private:
+    struct Page {
+        uint8_t data[PAGE_SIZE];
+        size_t used;
+        uint64_t sealedSeq;     // order in which the page was sealed, 0 while it is free or being filled
+    };
+
+    void run();
+    void sealCurrentLocked();
+    Page *nextSealedLocked();
+    bool switchFileLocked(std::unique_lock<std::mutex> &lock);
+
+    std::mutex _mutex;
+    std::condition_variable _wake;      // the writer thread: a page was sealed or a flush requested
+    std::condition_variable _committed; // flush() and write(): pages were freed
+    Page _pages[PAGES] = {};
+    size_t _current = 0;                // page being filled
+    uint64_t _sealSeq = 0;
+    uint64_t _committedSeq = 0;
+    std::chrono::steady_clock::time_point _firstUnsealedWrite;
+    FILE *_file = nullptr;
+    FILE *_nextFile = nullptr;          // pending switchFile()
+    uint64_t _switchAfterSeq = 0;       // the last page that still goes to _file
+    FileOpener _opener;
+    bool _rotateRequested = false;      // pending rotate(), _nextFile comes from the opener
+    std::thread _thread;
+    bool _running = false;
+    bool _flushRequested = false;
+    bool _lastCommitOk = true;
+    Stats _stats = {};
+};
@@ -0,0 +1,126 @@
+#include "connection_profiler.h"
+
+#include <cstring>
+
+static uint16_t stageMs(int64_t from, int64_t to)
+{
+    if (from == 0 || to == 0) {
+        return TIMING_STAGE_NOT_REACHED;
+    }
+    int64_t ms = (to - from) / 1000;
+    if (ms < 0) {
+        ms = 0;
+    }
+    return ms > TIMING_STAGE_MAX_MS ? TIMING_STAGE_MAX_MS : (uint16_t)ms;
+}
+
+void ConnectionTimingRecord::encode(uint8_t out[TIMING_RECORD_SIZE]) const
+{
+    uint64_t ts = (uint64_t)dispatchedAt;
+    for (int i = 0; i < 6; ++i) {
+        out[i] = ts & 0xFF;
+        ts >>= 8;
+    }
+    memcpy(out + 6, address, 6);
+    out[12] = addrType;
+    out[13] = flags;
+    out[14] = 0;    // reserved
+    out[15] = 0;
+    uint8_t *p = out + 16;
+    for (int s = 0; s < CONNECTION_STAGE_COUNT; ++s) {
+        *p++ = stageMs[s] & 0xFF;
+        *p++ = stageMs[s] >> 8;
+    }
+    *p++ = readsDone & 0xFF;
+    *p++ = readsDone >> 8;
+    *p++ = readsTimedOut & 0xFF;
+    *p++ = readsTimedOut >> 8;
+}
+
+ConnectionTimingRecord ConnectionProfiler::record(const gattc_profile_inst &profile, bool profiled)
+{
+    const int64_t *m = profile.marks;
+    ConnectionTimingRecord rec = {};
+    rec.dispatchedAt = m[MARK_DISPATCH];
+    memcpy(rec.address, profile.interrogation_request.address, sizeof(rec.address));
+    rec.addrType = profile.interrogation_request.addr_type;
+    rec.flags = profiled ? TIMING_FLAG_PROFILED : 0;
+    rec.stageMs[STAGE_CONNECT] = stageMs(m[MARK_DISPATCH], m[MARK_OPEN]);
+    rec.stageMs[STAGE_MTU] = stageMs(m[MARK_OPEN], m[MARK_MTU]);
+    rec.stageMs[STAGE_DISCOVERY] = stageMs(m[MARK_MTU], m[MARK_SEARCH_CMPL]);
+    rec.stageMs[STAGE_READS] = stageMs(m[MARK_SEARCH_CMPL], m[MARK_END]);
+    rec.stageMs[STAGE_TOTAL] = stageMs(m[MARK_DISPATCH], m[MARK_END]);
+    rec.readsDone = profile.reads_done;
+    rec.readsTimedOut = profile.reads_timed_out;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (int s = 0; s < CONNECTION_STAGE_COUNT; ++s) {
+        if (rec.stageMs[s] != TIMING_STAGE_NOT_REACHED) {
+            _histogram[s][bucketOf(rec.stageMs[s])]++;
+            _count[s]++;
+        }
+    }
+    return rec;
+}
+
+// 0-3 exact, then four buckets per power of two: [4,5) [5,6) [6,7) [7,8) [8,10) ...
+size_t ConnectionProfiler::bucketOf(uint16_t ms)
+{
+    if (ms < 4) {
+        return ms;
+    }
+    int exp = 31 - __builtin_clz(ms);
+    size_t sub = (ms >> (exp - 2)) & 3;
+    return 4 + (exp - 2) * 4 + sub;
+}
+
+uint32_t ConnectionProfiler::bucketMidpoint(size_t bucket)
+{
+    if (bucket < 4) {
+        return bucket;
+    }
+    int exp = (bucket - 4) / 4 + 2;
+    uint32_t width = 1u << (exp - 2);
+    uint32_t low = (1u << exp) + ((bucket - 4) % 4) * width;
+    return low + width / 2;
+}
+
+int32_t ConnectionProfiler::percentile(ConnectionStage stage, unsigned percentile)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t total = _count[stage];
+    if (total == 0) {
+        return -1;
+    }
+    // rank of the wanted sample, 1-based, rounded up
+    uint32_t rank = (uint32_t)(((uint64_t)total * percentile + 99) / 100);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint32_t seen = 0;
+    for (size_t b = 0; b < BUCKETS; ++b) {
+        seen += _histogram[stage][b];
+        if (seen >= rank) {
+            return (int32_t)bucketMidpoint(b);
+        }
+    }
+    return (int32_t)bucketMidpoint(BUCKETS - 1);
+}
+
+uint32_t ConnectionProfiler::samples(ConnectionStage stage)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _count[stage];
+}
+
+const char *ConnectionProfiler::stageName(ConnectionStage stage)
+{
+    switch (stage) {
+    case STAGE_CONNECT:   return "connect";
+    case STAGE_MTU:       return "mtu";
+    case STAGE_DISCOVERY: return "discovery";
+    case STAGE_READS:     return "reads";
+    case STAGE_TOTAL:     return "total";
+    default:              return "?";
+    }
+}
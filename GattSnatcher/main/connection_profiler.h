@@ -0,0 +1,68 @@
+#pragma once
+#include "struct_and_definitions.h"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+// Stages between consecutive ConnectionMarks, plus the whole interrogation
+enum ConnectionStage {
+    STAGE_CONNECT = 0,  // MARK_DISPATCH -> MARK_OPEN
+    STAGE_MTU,          // MARK_OPEN -> MARK_MTU
+    STAGE_DISCOVERY,    // MARK_MTU -> MARK_SEARCH_CMPL
+    STAGE_READS,        // MARK_SEARCH_CMPL -> MARK_END
+    STAGE_TOTAL,        // MARK_DISPATCH -> MARK_END
+    CONNECTION_STAGE_COUNT
+};
+
+// Stage duration in a timing record when the stage was never reached
+#define TIMING_STAGE_NOT_REACHED 0xFFFF
+#define TIMING_STAGE_MAX_MS 0xFFFE  // longer stages are saturated
+#define TIMING_FLAG_PROFILED 0x01   // at least one service was discovered
+
+/**
+ * One finished interrogation as written to the interrogator timing log, TIMING_RECORD_SIZE bytes,
+ * little endian: dispatch timestamp (6, μs), address (6, as dispatched), addr_type (1), flags (1),
+ * CONNECTION_STAGE_COUNT stage durations (2 each, ms), reads done (2), reads timed out (2).
+ */
+#define TIMING_RECORD_SIZE (16 + 2 * CONNECTION_STAGE_COUNT + 4)
+
+struct ConnectionTimingRecord {
+    int64_t dispatchedAt;
+    esp_bd_addr_t address;
+    uint8_t addrType;
+    uint8_t flags;
+    uint16_t stageMs[CONNECTION_STAGE_COUNT];
+    uint16_t readsDone;
+    uint16_t readsTimedOut;
+
+    void encode(uint8_t out[TIMING_RECORD_SIZE]) const;
+};
+
+/**
+ * Per-stage latency histograms over all interrogations since boot.
+ *
+ * Buckets are log-linear in milliseconds: exact below 4 ms, then four buckets per
+ * power of two up to TIMING_STAGE_MAX_MS, so percentiles are within 25 % of the
+ * true value with a fixed, small footprint. Thread-safe.
+ */
+class ConnectionProfiler {
+public:
+    static constexpr size_t BUCKETS = 60;
+
+    // Turns the profile's marks into a record and adds its stages to the histograms
+    ConnectionTimingRecord record(const gattc_profile_inst &profile, bool profiled);
+
+    // Approximate @p percentile (0-100) of a stage in ms, -1 without samples
+    int32_t percentile(ConnectionStage stage, unsigned percentile);
+    uint32_t samples(ConnectionStage stage);
+
+    static const char *stageName(ConnectionStage stage);
+
+private:
+    static size_t bucketOf(uint16_t ms);
+    static uint32_t bucketMidpoint(size_t bucket);
+
+    std::mutex _mutex;
+    uint32_t _histogram[CONNECTION_STAGE_COUNT][BUCKETS] = {};
+    uint32_t _count[CONNECTION_STAGE_COUNT] = {};
+};
@@ -0,0 +1,101 @@
+#include "connection_registry.h"
+
+#include <chrono>
+#include <cstring>
+
+ConnectionRegistry::Connection *ConnectionRegistry::findLocked(const uint8_t address[6])
+{
+    for (Connection &c : _connections) {
+        if (c.used && memcmp(c.address, address, sizeof(c.address)) == 0) {
+            return &c;
+        }
+    }
+    return nullptr;
+}
+
+bool ConnectionRegistry::add(const uint8_t address[6], uint16_t connId)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    Connection *slot = findLocked(address);
+    for (size_t i = 0; slot == nullptr && i < CAPACITY; i++) {
+        if (!_connections[i].used) {
+            slot = &_connections[i];
+        }
+    }
+    if (slot == nullptr) {
+        return false;
+    }
+    memcpy(slot->address, address, sizeof(slot->address));
+    slot->connId = connId;
+    slot->used = true;
+    for (Waiter &w : _waiters) {
+        if (w.used && !w.signalled && memcmp(w.address, address, sizeof(w.address)) == 0) {
+            w.connId = connId;
+            w.signalled = true;
+            w.cv.notify_one();
+        }
+    }
+    return true;
+}
+
+bool ConnectionRegistry::remove(const uint8_t address[6])
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    Connection *c = findLocked(address);
+    if (c == nullptr) {
+        return false;
+    }
+    c->used = false;
+    return true;
+}
+
+bool ConnectionRegistry::find(const uint8_t address[6], uint16_t &connId)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    Connection *c = findLocked(address);
+    if (c == nullptr) {
+        return false;
+    }
+    connId = c->connId;
+    return true;
+}
+
+ConnectionRegistry::WaitResult ConnectionRegistry::wait(const uint8_t address[6], uint16_t &connId,
+                                                        uint32_t timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    Connection *c = findLocked(address);
+    if (c != nullptr) {
+        connId = c->connId;
+        return WaitResult::Found;
+    }
+    Waiter *w = nullptr;
+    for (Waiter &candidate : _waiters) {
+        if (!candidate.used) {
+            w = &candidate;
+            break;
+        }
+    }
+    if (w == nullptr) {
+        return WaitResult::NoWaiterSlot;
+    }
+    memcpy(w->address, address, sizeof(w->address));
+    w->used = true;
+    w->signalled = false;
+    bool signalled = w->cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [w] { return w->signalled; });
+    if (signalled) {
+        connId = w->connId;
+    }
+    w->used = false;
+    return signalled ? WaitResult::Found : WaitResult::Timeout;
+}
+
+size_t ConnectionRegistry::size()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t n = 0;
+    for (const Connection &c : _connections) {
+        n += c.used;
+    }
+    return n;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#if __has_include("sdkconfig.h")
+#include "sdkconfig.h"
+#endif
+
+// One entry per link the Bluetooth stack can hold
+#ifdef CONFIG_BT_ACL_CONNECTIONS
+#define CONNECTION_REGISTRY_CAPACITY CONFIG_BT_ACL_CONNECTIONS
+#else
+#define CONNECTION_REGISTRY_CAPACITY 4
+#endif
+#define CONNECTION_REGISTRY_MAX_WAITERS 4
+
+/**
+ * MAC address to connection id of the open GATT connections, in a flat fixed-size table.
+ *
+ * wait() blocks until the address is added or the timeout expires. Every waiter has its
+ * own condition variable, so add() wakes exactly the waiters for that address and the
+ * rest keep sleeping. Nothing is allocated after construction. Thread-safe, and only
+ * uses the C++ standard library, so it also builds for the host.
+ */
+class ConnectionRegistry {
+public:
+    static constexpr size_t CAPACITY = CONNECTION_REGISTRY_CAPACITY;
+    static constexpr size_t MAX_WAITERS = CONNECTION_REGISTRY_MAX_WAITERS;
+
+    enum class WaitResult {
+        Found,
+        Timeout,
+        NoWaiterSlot,   // MAX_WAITERS tasks are waiting already
+    };
+
+    // Adds or updates the connection, @return false if the table is full
+    bool add(const uint8_t address[6], uint16_t connId);
+    // @return false if the address was not registered
+    bool remove(const uint8_t address[6]);
+    bool find(const uint8_t address[6], uint16_t &connId);
+    WaitResult wait(const uint8_t address[6], uint16_t &connId, uint32_t timeoutMs);
+
+    size_t size();
+
+private:
+    struct Connection {
+        uint8_t address[6];
+        uint16_t connId;
+        bool used;
+    };
+    struct Waiter {
+        uint8_t address[6];
+        uint16_t connId;
+        bool used;
+        bool signalled;
+        std::condition_variable cv;
+    };
+
+    Connection *findLocked(const uint8_t address[6]);
+
+    std::mutex _mutex;
+    Connection _connections[CAPACITY] = {};
+    Waiter _waiters[MAX_WAITERS] = {};
+};
@@ -50,6 +50,21 @@ esp_err_t ConsolePrintController::printAdvertisingSingleReport(const LeAdvertisi
     return ESP_OK;
 }
 
+esp_err_t ConsolePrintController::printExtAdvertisingSingleReport(const LeExtAdvertisingReportView &report, uint8_t index) {
+    const auto &r = report.reports[index];
+    char bdaddr_str[18];
+    report.formatBdaddr(index, bdaddr_str);
+    ESP_LOGI(TAG, "%lld,0x%04x,%d,%s,%d,%d,phy=%u/%u,sid=%u,tx=%d,pi=%u",
+             report.timestamp,
+             r.event_type,
+             r.addr_type,
+             bdaddr_str,
+             r.adv_data_length,
+             r.rssi,
+             r.primary_phy, r.secondary_phy, r.sid, r.tx_power, r.periodic_adv_interval);
+    return ESP_OK;
+}
+
 esp_err_t ConsolePrintController::printAdvertisingReport(const LeAdvertisingReport &advReport) {
     ESP_LOGI(TAG, "LE Advertising Report:");
     ESP_LOGI(TAG, "Timestamp: %lld", advReport.timestamp);
@@ -89,6 +104,8 @@ void ConsolePrintController::printGattProfileJson(int APP_ID, const gattc_profil
     oss << std::dec << "\",\n";
     oss << "  \"advertisement_filename\": \"" << profile.interrogation_request.advertisementFilename << "\",\n";
     oss << "  \"interrogation_timestamp\": " << profile.interrogation_request.timestamp << ",\n";
+    oss << "  \"fingerprint\": \"" << std::hex << std::setw(16) << std::setfill('0') << profile.fingerprint
+        << std::dec << "\",\n";
     oss << "  \"services\": [\n";
     for (size_t si = 0; si < profile.services.size(); ++si) {
         const auto& srv = profile.services[si];
@@ -128,6 +145,9 @@ void ConsolePrintController::printGattProfileJson(int APP_ID, const gattc_profil
 
             oss << "          \"handle\": " << cw.meta.char_handle << ",\n";
             oss << "          \"properties\": " << (int)cw.meta.properties << ",\n";
+            if (cw.cached) {
+                oss << "          \"cached\": true,\n";
+            }
 
             oss << "          \"value\": [";
             for (size_t v = 0; v < cw.value.size(); ++v) {
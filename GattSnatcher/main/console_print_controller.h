@@ -7,7 +7,9 @@ class ConsolePrintController : public OutputHandler {
 public:
     static ConsolePrintController* getInstance();
     esp_err_t init(bool isInterrogator) override;
+    using OutputHandler::printAdvertisingSingleReport;
     esp_err_t printAdvertisingSingleReport(const LeAdvertisingSingleReport &report, int64_t timestamp) override;
+    esp_err_t printExtAdvertisingSingleReport(const LeExtAdvertisingReportView &report, uint8_t index) override;
     esp_err_t printAdvertisingReport(const LeAdvertisingReport &advReport) override;
     esp_err_t printString(const std::string& string) override;
     // esp_err_t printPacketInfo(hci_data_t hciData) override;
@@ -1,11 +1,11 @@
 #include "device_database.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <mutex>
 
 static const char *TAG = "DEV_DB";
 
-//TODO implement DB
 DeviceDatabase &DeviceDatabase::getInstance() {
     static DeviceDatabase instance = {};
     return instance;
@@ -13,60 +13,118 @@ DeviceDatabase &DeviceDatabase::getInstance() {
 DeviceDatabase::DeviceDatabase() = default;
 
 
-esp_err_t DeviceDatabase::init()
+static uint32_t secondsSinceBoot()
 {
+    return (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+static void logEvictions(const DeviceStore &store, uint32_t before)
+{
+    if (store.evicted() != before) {
+        ESP_LOGW(TAG, "DEVICE_DB_CAPACITY reached, forgot %u devices", (unsigned)(store.evicted() - before));
+    }
+}
+
+esp_err_t DeviceDatabase::init(const char *path)
+{
+    std::lock_guard<std::mutex> lock(store_mutex);
+    if (!store.open(path)) {
+        ESP_LOGE(TAG, "Cannot open %s", path);
+        return ESP_FAIL;
+    }
+    if (store.droppedRecords() > 0) {
+        ESP_LOGW(TAG, "%lu devices did not fit into DEVICE_DB_CAPACITY", (unsigned long)store.droppedRecords());
+    }
+    ESP_LOGI(TAG, "%u devices known, %u log records, boot %u",
+             (unsigned)store.size(), (unsigned)store.logRecords(), store.boot());
     return ESP_OK;
 }
 
 
-bool DeviceDatabase::isProfileAlreadyInterrogated(esp_bd_addr_t bdAddr)
+bool DeviceDatabase::isProfileAlreadyInterrogated(const esp_bd_addr_t macAddress, esp_ble_addr_type_t addrType)
+{
+    std::lock_guard<std::mutex> lock(store_mutex);
+    const DeviceStore::Entry *entry = store.find(DeviceStore::makeKey(macAddress, addrType));
+    return entry != nullptr && (entry->flags & DEVICE_STORE_FLAG_PROFILED);
+}
+
+bool DeviceDatabase::lookup(const esp_bd_addr_t macAddress, esp_ble_addr_type_t addrType, DeviceStore::Entry &entry)
+{
+    std::lock_guard<std::mutex> lock(store_mutex);
+    const DeviceStore::Entry *found = store.find(DeviceStore::makeKey(macAddress, addrType));
+    if (found == nullptr) {
+        return false;
+    }
+    entry = *found;
+    return true;
+}
+
+size_t DeviceDatabase::size()
+{
+    std::lock_guard<std::mutex> lock(store_mutex);
+    return store.size();
+}
+
+uint16_t DeviceDatabase::boot()
 {
-    return false;
+    std::lock_guard<std::mutex> lock(store_mutex);
+    return store.boot();
 }
+
 esp_err_t DeviceDatabase::addScan(const LeAdvertisingSingleReport &singleReport,int64_t timestamp)
 {
     return ESP_OK;
 }
-esp_err_t DeviceDatabase::addProfile(const BLEProfile bleProfile)
+esp_err_t DeviceDatabase::addProfile(const esp_bd_addr_t macAddress, esp_ble_addr_type_t addrType, uint64_t fingerprint)
+{
+    std::lock_guard<std::mutex> lock(store_mutex);
+    uint32_t evicted = store.evicted();
+    if (!store.recordProfiled(DeviceStore::makeKey(macAddress, addrType), fingerprint, secondsSinceBoot())) {
+        ESP_LOGE(TAG, "Failed recording profile, %u devices known", (unsigned)store.size());
+        return ESP_FAIL;
+    }
+    logEvictions(store, evicted);
+    return ESP_OK;
+}
+
+esp_err_t DeviceDatabase::addFailure(const esp_bd_addr_t macAddress, esp_ble_addr_type_t addrType)
 {
+    std::lock_guard<std::mutex> lock(store_mutex);
+    uint32_t evicted = store.evicted();
+    if (!store.recordFailure(DeviceStore::makeKey(macAddress, addrType), secondsSinceBoot())) {
+        ESP_LOGE(TAG, "Failed recording failure, %u devices known", (unsigned)store.size());
+        return ESP_FAIL;
+    }
+    logEvictions(store, evicted);
     return ESP_OK;
 }
 
-esp_err_t DeviceDatabase::addConnection(esp_bd_addr_t & macAddress, uint16_t conn_id) {
-    std::lock_guard<std::mutex> lock(connection_mutex);
-    BDAddrWrapper bdWrapper;
-    convertEspBdAddrToBDAddrWrapper(macAddress, bdWrapper);
-    connections[bdWrapper] = conn_id;
-    ESP_LOGI(TAG, "Added connection: %s -> %d", macAddress, conn_id);
+esp_err_t DeviceDatabase::addConnection(const esp_bd_addr_t macAddress, uint16_t conn_id) {
+    if (!connections.add(macAddress, conn_id)) {
+        ESP_LOGE(TAG, "Connection table full, cannot add " ESP_BD_ADDR_STR, ESP_BD_ADDR_HEX(macAddress));
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Added connection: " ESP_BD_ADDR_STR " -> %d", ESP_BD_ADDR_HEX(macAddress), conn_id);
     return ESP_OK;
 }
 
 // Remove a connection entry by MAC address.
-esp_err_t DeviceDatabase::removeConnection(esp_bd_addr_t & macAddress) {
-    std::lock_guard<std::mutex> lock(connection_mutex);
-    size_t erased = connections.erase(macAddress);
-    ESP_LOGI(TAG, "Removed connection for %s, erased: %d", macAddress, erased);
+esp_err_t DeviceDatabase::removeConnection(const esp_bd_addr_t macAddress) {
+    bool removed = connections.remove(macAddress);
+    ESP_LOGI(TAG, "Removed connection for " ESP_BD_ADDR_STR ", erased: %d", ESP_BD_ADDR_HEX(macAddress), removed);
     return ESP_OK;
 }
 
 // Wait for a connection to be available for a given MAC address up to a maximum wait time.
-esp_err_t DeviceDatabase::getConnectionId(esp_bd_addr_t & macAddress, uint16_t &conn_id, uint32_t timeout_ms) {
-    const uint32_t delay_time = 100; // delay per poll in ms
-    uint32_t waited = 0;
-    while (waited < timeout_ms) {
-        {
-            BDAddrWrapper bdWrapper;
-            convertEspBdAddrToBDAddrWrapper(macAddress, bdWrapper);
-            std::lock_guard<std::mutex> lock(connection_mutex);
-            auto it = connections.find(bdWrapper);
-            if (it != connections.end()) {
-                conn_id = it->second;
-                return ESP_OK;
-            }
-        }
-        vTaskDelay(pdMS_TO_TICKS(delay_time));
-        waited += delay_time;
+esp_err_t DeviceDatabase::getConnectionId(const esp_bd_addr_t macAddress, uint16_t &conn_id, uint32_t timeout_ms) {
+    switch (connections.wait(macAddress, conn_id, timeout_ms)) {
+    case ConnectionRegistry::WaitResult::Found:
+        return ESP_OK;
+    case ConnectionRegistry::WaitResult::NoWaiterSlot:
+        ESP_LOGE(TAG, "Too many tasks waiting for connections");
+        return ESP_ERR_NO_MEM;
+    default:
+        ESP_LOGE(TAG, "Timeout waiting for connection for MAC: " ESP_BD_ADDR_STR, ESP_BD_ADDR_HEX(macAddress));
+        return ESP_ERR_TIMEOUT;
     }
-    ESP_LOGE(TAG, "Timeout waiting for connection for MAC: %s", macAddress);
-    return ESP_ERR_TIMEOUT;
-}
\ No newline at end of file
+}
@@ -3,38 +3,23 @@
 #include <esp_err.h>
 #include <interrogator_event_loop.h>
 #include <string>
-#include <map>
 #include <mutex>
+#include "connection_registry.h"
+#include "device_store.h"
 
-struct BDAddrWrapper {
-    esp_bd_addr_t addr; // C array of 6 uint8_t
-    BDAddrWrapper() {
-        memset(addr, 0, sizeof(addr));
-    }
-    BDAddrWrapper(const esp_bd_addr_t input) {
-        memcpy(addr, input, sizeof(addr));
-    }
-    bool operator<(const BDAddrWrapper &other) const {
-        return memcmp(addr, other.addr, sizeof(addr)) < 0;
-    }
-};
-inline void convertEspBdAddrToBDAddrWrapper(esp_bd_addr_t &espAddr, BDAddrWrapper &wrapper)
-{
-    memcpy(wrapper.addr, espAddr, sizeof(wrapper.addr));
-}
-
-// Convert from a BDAddrWrapper (input by reference) to an esp_bd_addr_t (passed by reference)
-inline void convertBDAddrWrapperToEspBdAddr(BDAddrWrapper &wrapper, esp_bd_addr_t &espAddr)
-{
-    memcpy(espAddr, wrapper.addr, sizeof(wrapper.addr));
-}
-
+#define DEVICE_DB_PATH "/storage/device_db.log"
 
+/**
+ * Interrogated devices: per MAC address plus addr_type the fingerprint of the latest
+ * full GATT profile (see GattProfileCache), the time of the latest interrogation and
+ * the failures since. Backed by a DeviceStore log at DEVICE_DB_PATH, so devices stay
+ * known across reboots; this class adds the locking and the ESP-IDF glue.
+ */
 class DeviceDatabase {
     DeviceDatabase();
-    //mac address, and connection ID
-    std::map<BDAddrWrapper, uint16_t> connections;
-    std::mutex connection_mutex;
+    ConnectionRegistry connections;
+    DeviceStore store;
+    std::mutex store_mutex;
 public:
     DeviceDatabase(const DeviceDatabase&) = delete;             // Copy ctor
     DeviceDatabase(DeviceDatabase&&) = delete;                  // Move ctor
@@ -42,14 +27,21 @@ public:
     DeviceDatabase& operator=(DeviceDatabase&&) = delete;       // Move assignment
     static DeviceDatabase& getInstance();
 
-    esp_err_t init();
-    esp_err_t addProfile(const BLEProfile bleProfile);
+    esp_err_t init(const char *path = DEVICE_DB_PATH);
+    esp_err_t addProfile(const esp_bd_addr_t macAddress, esp_ble_addr_type_t addrType, uint64_t fingerprint);
+    esp_err_t addFailure(const esp_bd_addr_t macAddress, esp_ble_addr_type_t addrType);
     esp_err_t addScan(const LeAdvertisingSingleReport &singleReport,int64_t timestamp);
-    bool isProfileAlreadyInterrogated(esp_bd_addr_t macAddress);
+    bool isProfileAlreadyInterrogated(const esp_bd_addr_t macAddress, esp_ble_addr_type_t addrType);
+    // Copies the device's entry, @return false if the device was never interrogated
+    bool lookup(const esp_bd_addr_t macAddress, esp_ble_addr_type_t addrType, DeviceStore::Entry &entry);
+    size_t size();
+    // Boot number the entries' times of this boot carry
+    uint16_t boot();
 
 
-    esp_err_t addConnection(esp_bd_addr_t & macAddress, uint16_t conn_id);
-    esp_err_t removeConnection(esp_bd_addr_t & macAddress);
+    // Registers an open connection and wakes the getConnectionId callers waiting for it
+    esp_err_t addConnection(const esp_bd_addr_t macAddress, uint16_t conn_id);
+    esp_err_t removeConnection(const esp_bd_addr_t macAddress);
     /**
      * Wait for the connection associated with macAddress to become available.
      *
@@ -57,7 +49,8 @@ public:
      * @param conn_id Output parameter that will receive the connection ID.
      * @param timeout_ms Maximum time to wait (in milliseconds).
      *
-     * @return ESP_OK if connection was found within timeout, otherwise ESP_ERR_TIMEOUT.
+     * @return ESP_OK if connection was found within timeout, otherwise ESP_ERR_TIMEOUT,
+     * or ESP_ERR_NO_MEM if too many tasks are waiting already.
      */
-    esp_err_t getConnectionId(esp_bd_addr_t & macAddress, uint16_t &conn_id, uint32_t timeout_ms);
+    esp_err_t getConnectionId(const esp_bd_addr_t macAddress, uint16_t &conn_id, uint32_t timeout_ms);
 };
@@ -14,6 +14,9 @@
 #include <esp_bt.h>
 #include "hci_event_parser.h"
 #include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "device_database.h"
+#include "gatt_profile_cache.h"
 
 // Mutex to serialize dispatching requests
 static SemaphoreHandle_t dispatchMutex = NULL;
@@ -23,25 +26,29 @@ static const char *TAG = "QUESTIONER";
 
 // Using UART0 in this example (adjust as needed)
 // #define UART_NUM UART_NUM_0
-#define UART_BUF_SIZE 128 //assure its more than sizeof(LeAdvertisingSingleReportWithTimestamp)
+#define UART_BUF_SIZE 128 //bytes taken from the UART driver per read, frames may span reads
 
 DeviceInterrogator &DeviceInterrogator::getInstance() {
     static DeviceInterrogator instance = {};
     return instance;
 }
 DeviceInterrogator::DeviceInterrogator() {
-    profileTabs[PROFILE_A_APP_ID].gattc_cb = InterrogatorEventLoop::gattc_profile_a_event_handler;
-    profileTabs[PROFILE_A_APP_ID].gattc_if = ESP_GATT_IF_NONE;
-    profileTabs[PROFILE_A_APP_ID].conn_id = UNUSED_CONN_ID;
-
-    profileTabs[PROFILE_B_APP_ID].gattc_cb = InterrogatorEventLoop::gattc_profile_b_event_handler;
-    profileTabs[PROFILE_B_APP_ID].gattc_if = ESP_GATT_IF_NONE;
-    profileTabs[PROFILE_B_APP_ID].conn_id = UNUSED_CONN_ID;
-
-    profileTabs[PROFILE_C_APP_ID].gattc_cb = InterrogatorEventLoop::gattc_profile_c_event_handler;
-    profileTabs[PROFILE_C_APP_ID].gattc_if = ESP_GATT_IF_NONE;
-    profileTabs[PROFILE_C_APP_ID].conn_id = UNUSED_CONN_ID;
+    // The profile index doubles as the GATT client app_id
+    for (int app_id = 0; app_id < PROFILE_NUM; app_id++) {
+        profileTabs[app_id].app_id = app_id;
+        profileTabs[app_id].gattc_if = ESP_GATT_IF_NONE;
+        profileTabs[app_id].conn_id = UNUSED_CONN_ID;
+    }
+}
 
+int DeviceInterrogator::findProfileByGattcIf(esp_gatt_if_t gattc_if)
+{
+    for (int app_id = 0; app_id < PROFILE_NUM; app_id++) {
+        if (profileTabs[app_id].gattc_if == gattc_if) {
+            return app_id;
+        }
+    }
+    return -1;
 }
 
 
@@ -74,66 +81,115 @@ esp_err_t DeviceInterrogator::initOutputHandler(void)
     return ESP_OK;
 }
 
-esp_err_t DeviceInterrogator::initQueues(){
-    if (interrogationRequestQueue == nullptr)
-    {
-        interrogationRequestQueue = xQueueCreate(50, sizeof(interrogation_request_t));
-        if (interrogationRequestQueue == nullptr)
-        {
-            ESP_LOGE(TAG, "Failed to create interrogation request queue");
-            return ESP_FAIL;
-        }
+// Turns one decoded advertising report frame into an interrogation request.
+static bool handleUartFrame(const UartFrameDecoder::Frame &frame)
+{
+    UartAdvReportFrame report;
+    if (frame.type != UART_FRAME_ADV_REPORT
+        || !uartFrameDecodeAdvReport(frame.payload, frame.len, report)) {
+        ESP_LOGE(TAG, "Unexpected UART frame type %u length %u", frame.type, frame.len);
+        return false;
     }
-    return ESP_OK;
+    interrogation_request_t request{};
+    request.addr_type = static_cast<esp_ble_addr_type_t>(report.addr_type);
+    request.timestamp = report.timestamp;
+    request.rssi = report.rssi;
+    // HCI sends the address least significant byte first, esp_bd_addr_t is the other way round
+    for (int i = 0; i < ESP_BD_ADDR_LEN; i++) {
+        request.address[i] = report.addr[ESP_BD_ADDR_LEN - 1 - i];
+    }
+    if (report.file_id != UART_FRAME_NO_FILE_ID) {
+        snprintf(request.advertisementFilename, sizeof(request.advertisementFilename), "%s_%u%s",
+                 SCANNER_LOG_BASENAME, (unsigned)report.file_id, LOG_FILE_EXTENSION);
+    } else {
+        strcpy(request.advertisementFilename, "-");
+    }
+    DeviceInterrogator::getInstance().sendInterrogationRequestToQueue(request);
+    return true;
 }
 
-
-// UART task that waits for incoming data, looks for the magic prefix,
-// parses the MAC address, and posts an event.
+// UART task that sleeps on the driver's event queue, reassembles frames from
+// whatever chunks the driver hands over and posts interrogation requests.
+// The decoder persists across reads, so a frame split over two reads is not lost.
 void DeviceInterrogator::questioner_uart_task(void *pvParameters)
 {
     ESP_LOGI(TAG, "Starting Questioner Uart Task");
+    QueueHandle_t eventQueue = UartController::getInstance()->getEventQueue();
+    if (eventQueue == nullptr) {
+        ESP_LOGE(TAG, "UART driver has no event queue");
+        vTaskDelete(nullptr);
+        return;
+    }
+    static UartFrameDecoder decoder;
+    uint32_t malformedFrames = 0;   // CRC-valid frames with an unexpected type or length
+    uint32_t lineErrors = 0;        // parity and framing errors reported by the driver
     uint8_t data[UART_BUF_SIZE];
+    uart_event_t event;
     while (1) {
-        int len = uart_read_bytes(CONFIG_UART_PORT_NUM, data, UART_BUF_SIZE - 1, pdMS_TO_TICKS(20));
-        if (len > 0) {
-            data[len] = '\0'; // Ensure null termination
-            char *saveptr;
-            char *line = strtok_r(reinterpret_cast<char *>(data), "\n", &saveptr);
-            while (line != nullptr) {
-                LeAdvertisingSingleReportWithTimestamp report = {};
-                if (HciEventParser::parseAdvReportFromString(line, report)) {
-                    // ESP_LOGI(TAG, "Parsed Adv Report: timestamp %lld, adv_event_type %u, addr_type %u, bdaddr %s, adv_data_length %u, rssi %d",
-                    //          report.timestamp, report.adv_event_type, report.addr_type,
-                    //          report.bdaddr_str, report.adv_data_length, report.rssi);
-
-                    interrogation_request_t request{};
-                    request.addr_type = static_cast<esp_ble_addr_type_t>(report.addr_type);
-                    request.timestamp = report.timestamp;
-                    if (!DeviceInterrogator::parse_bdaddr_str(report.bdaddr_str, request.address)) {
-                        ESP_LOGE(TAG, "Failed to parse BDADDR string");
-                        return;
+        if (xQueueReceive(eventQueue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        switch (event.type) {
+        case UART_DATA: {
+            size_t pending = event.size;
+            while (pending > 0) {
+                int len = uart_read_bytes(CONFIG_UART_PORT_NUM, data,
+                                          pending < UART_BUF_SIZE ? pending : UART_BUF_SIZE, 0);
+                if (len <= 0) {
+                    break;
+                }
+                pending -= len;
+                int fed = 0;
+                while (fed < len) {
+                    fed += decoder.feed(data + fed, len - fed);
+                    UartFrameDecoder::Frame frame;
+                    while (decoder.next(frame)) {
+                        if (!handleUartFrame(frame)) {
+                            malformedFrames++;
+                        }
                     }
-                    strncpy(request.advertisementFilename, report.advertisementFilename, sizeof(request.advertisementFilename));
-                    request.advertisementFilename[sizeof(request.advertisementFilename)-1] = '\0';
-                    DeviceInterrogator::getInstance().sendInterrogationRequestToQueue(request);
-                } else {
-                    ESP_LOGE(TAG, "Failed to parse advertising report from: %s", line);
                 }
-
-                line = strtok_r(nullptr, "\n", &saveptr);
             }
+            break;
+        }
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            // The driver cannot keep up, the buffered bytes are no longer contiguous with what follows
+            ESP_LOGW(TAG, "UART RX overflow, flushing input");
+            uart_flush_input(CONFIG_UART_PORT_NUM);
+            xQueueReset(eventQueue);
+            decoder.reset();
+            break;
+        case UART_PARITY_ERR:
+        case UART_FRAME_ERR:
+            lineErrors++;
+            break;
+        default:
+            break;
+        }
+        if (event.type != UART_DATA) {
+            ESP_LOGI(TAG, "UART frames: %lu ok, %lu crc errors, %lu bad headers, %lu malformed, %lu truncated, "
+                     "%lu lost, %lu line errors",
+                     (unsigned long)decoder.framesDecoded(), (unsigned long)decoder.crcErrors(),
+                     (unsigned long)decoder.headerErrors(), (unsigned long)malformedFrames, (unsigned long)decoder.framesTruncated(),
+                     (unsigned long)decoder.framesLost(), (unsigned long)lineErrors);
         }
-        vTaskDelay(1 / portTICK_PERIOD_MS);
     }
 }
 
 esp_err_t DeviceInterrogator::sendInterrogationRequestToQueue(interrogation_request_t req)
 {
-    if (xQueueSendToBack(interrogationRequestQueue, &req, 0) != pdPASS) {
+#if CONFIG_GATT_PROFILE_CACHE_SKIP_KNOWN_MACS
+    if (DeviceDatabase::getInstance().isProfileAlreadyInterrogated(req.address, req.addr_type)) {
+        knownDevicesSkipped++;
+        return ESP_OK;
+    }
+#endif
+    if (interrogationRequests.push(req, esp_timer_get_time()) != ESP_OK) {
         ESP_LOGE("UART_TASK", "Failed to enqueue interrogation request");
         return ESP_ERR_NO_MEM;
     }
+    notifyDispatcher();
     return ESP_OK;
 }
 
@@ -186,8 +242,13 @@ void DeviceInterrogator::esp_gattc_cb(esp_gattc_cb_event_t event, esp_gatt_if_t
 
     /* If event is register event, store the gattc_if for each profile */
     if (event == ESP_GATTC_REG_EVT) {
+        if (param->reg.app_id >= PROFILE_NUM) {
+            ESP_LOGE(TAG, "Reg for unknown app_id %u", param->reg.app_id);
+            return;
+        }
         if (param->reg.status == ESP_GATT_OK) {
             interrogator.profileTabs[param->reg.app_id].gattc_if = gattc_if;
+            interrogator.notifyDispatcher();
         } else {
             ESP_LOGI(TAG, "Reg app failed, app_id %04x, status %d",
                     param->reg.app_id,
@@ -196,24 +257,19 @@ void DeviceInterrogator::esp_gattc_cb(esp_gattc_cb_event_t event, esp_gatt_if_t
         }
     }
 
-    /* If the gattc_if equal to profile A, call profile A cb handler,
-     * so here call each profile's callback */
-    do {
-        int idx;
-        bool found = false;
-        for (idx = 0; idx < PROFILE_NUM; idx++) {
-            /* ESP_GATT_IF_NONE, not specify a certain gatt_if, need to call every profile cb function */
-            if (gattc_if == ESP_GATT_IF_NONE || gattc_if == interrogator.profileTabs[idx].gattc_if) {
-                if (interrogator.profileTabs[idx].gattc_cb) {
-                    interrogator.profileTabs[idx].gattc_cb(event, gattc_if, param);
-                    found = true;
-                }
-            }
+    /* ESP_GATT_IF_NONE does not specify a certain gattc_if, every profile has to see the event */
+    if (gattc_if == ESP_GATT_IF_NONE) {
+        for (int idx = 0; idx < PROFILE_NUM; idx++) {
+            InterrogatorEventLoop::gattc_profile_universal_event_handler(idx, event, gattc_if, param);
         }
-        if (!found){
-            ESP_LOGE(TAG,"The callback was not matched to any of the interfaces");
-        }
-    } while (0);
+        return;
+    }
+    int idx = interrogator.findProfileByGattcIf(gattc_if);
+    if (idx < 0) {
+        ESP_LOGE(TAG,"The callback was not matched to any of the interfaces");
+        return;
+    }
+    InterrogatorEventLoop::gattc_profile_universal_event_handler(idx, event, gattc_if, param);
 }
 // Create and start the UART controller task
 esp_err_t DeviceInterrogator::startUartTask(void)
@@ -274,9 +330,9 @@ static void timeoutEnforcerTask(void *pvParameters) {
 }
 esp_err_t DeviceInterrogator::deinit_ble() {
     // Unregister all GATT client apps
-    esp_ble_gattc_app_unregister(PROFILE_A_APP_ID);
-    esp_ble_gattc_app_unregister(PROFILE_B_APP_ID);
-    esp_ble_gattc_app_unregister(PROFILE_C_APP_ID);
+    for (int app_id = 0; app_id < PROFILE_NUM; app_id++) {
+        esp_ble_gattc_app_unregister(app_id);
+    }
     // Disable and deinitialize Bluedroid
     esp_bluedroid_disable();
     esp_bluedroid_deinit();
@@ -304,6 +360,7 @@ void DeviceInterrogator::resetState() {
         conn_device[i] = false;
         get_service[i] = false;
     }
+    interrogationRequests.clearInFlight();
     // Reset flags
     Isconnecting = false;
     stop_scan_done = false;
@@ -328,9 +385,9 @@ esp_err_t DeviceInterrogator::init_ble()
     ERR_GUARD_LOGE(esp_ble_gap_register_callback(DeviceInterrogator::esp_gap_cb), "gap register error");
     ERR_GUARD_LOGE(esp_ble_gattc_register_callback(DeviceInterrogator::esp_gattc_cb), "gattc register error");
 
-    ERR_GUARD_LOGE(esp_ble_gattc_app_register(PROFILE_A_APP_ID), "gattc app A register error");
-    ERR_GUARD_LOGE(esp_ble_gattc_app_register(PROFILE_B_APP_ID), "gattc app B register error");
-    ERR_GUARD_LOGE(esp_ble_gattc_app_register(PROFILE_C_APP_ID), "gattc app C register error");
+    for (int app_id = 0; app_id < PROFILE_NUM; app_id++) {
+        ERR_GUARD_LOGE(esp_ble_gattc_app_register(app_id), "gattc app register error");
+    }
     ERR_GUARD_LOGE(esp_ble_gatt_set_local_mtu(200), "set local MTU failed");
 
     startPendingMonitor();
@@ -339,81 +396,122 @@ esp_err_t DeviceInterrogator::init_ble()
 
 
 
-void interrogationDispatcherTask(void *pvParameters) {
-    interrogation_request_t request;
-    QueueHandle_t interrogationRequestQueue = DeviceInterrogator::getInstance().getInterrogationRequestQueue();
-    // Lazily create dispatch mutex once
-    if (dispatchMutex == NULL) {
-        dispatchMutex = xSemaphoreCreateMutex();
-        if (dispatchMutex == NULL) {
-            ESP_LOGE("DISPATCH", "Failed to create dispatch mutex");
+// Hands the best scored waiting request (see InterrogationRequestQueue::pop) to a free GATT profile.
+// Returns false when there is nothing to dispatch or nowhere to dispatch it to.
+static bool dispatchOneRequest(DeviceInterrogator &interrogator)
+{
+    bool assigned = false;
+    // lock dispatch to avoid race between dispatcher tasks
+    if (dispatchMutex) {
+        xSemaphoreTake(dispatchMutex, portMAX_DELAY);
+    }
+    int freeProfiles = 0;
+    for (int profile_num = 0; profile_num < PROFILE_NUM; profile_num++) {
+        auto &profile = interrogator.profileTabs[profile_num];
+        // skip any profile whose interface isn't initialized (for example when reinitializing)
+        if (profile.gattc_if != ESP_GATT_IF_NONE && !profile.is_busy) {
+            freeProfiles++;
         }
     }
-    while (1) {
-
-        if (xQueueReceive(interrogationRequestQueue, &request, 0) == pdTRUE) {
-            bool assigned = false;
-            // lock dispatch to avoid race between dispatcher tasks
-            if (dispatchMutex) {
-                xSemaphoreTake(dispatchMutex, portMAX_DELAY);
-            }
-            for (int profile_num = 0; profile_num < PROFILE_NUM; profile_num++) {
-                auto &profile = DeviceInterrogator::getInstance().profileTabs[profile_num];
-                // skip any profile whose interface isn't initialized (for example when reinitializing)
-                if (profile.gattc_if == ESP_GATT_IF_NONE) {
-                    continue;
-                }
-                if (!profile.is_busy) {
-                    // Print MAC address being dispatched
-                    char mac_str[18];
-                    sprintf(mac_str, "%02x:%02x:%02x:%02x:%02x:%02x",
-                            request.address[0], request.address[1], request.address[2],
-                            request.address[3], request.address[4], request.address[5]);
-                    ESP_LOGW("DISPATCH", "Dispatching request for %s to profile %d",
-                            mac_str, profile_num);
-                    esp_err_t err = esp_ble_gattc_open(
-                        profile.gattc_if,
-                        request.address,
-                        request.addr_type,
-                        true
-                    );
-                    if (err == ESP_OK) {
-                        // only mark busy when the open request was accepted
-                        memcpy(profile.remote_bda, request.address, 6);
-                        profile.is_busy = true;
-                        profile.busy_since = xTaskGetTickCount();
-                        profile.interrogation_request = request;
-                        assigned = true;
-                        break;
-                    } else {
-                        ESP_LOGE("DISPATCH", "esp_ble_gattc_open failed: %x", err);
-                    }
-                }
-            }
-            if (dispatchMutex) {
-                xSemaphoreGive(dispatchMutex);
+    interrogation_request_t request;
+    // Only take a request out of the queue when a profile can take it, so nothing has to be requeued.
+    // The queue hands out the best scored request, see InterrogationRequestQueue::score
+    if (freeProfiles > 0 && interrogator.interrogationRequests.pop(request, esp_timer_get_time())) {
+        for (int profile_num = 0; profile_num < PROFILE_NUM; profile_num++) {
+            auto &profile = interrogator.profileTabs[profile_num];
+            if (profile.gattc_if == ESP_GATT_IF_NONE || profile.is_busy) {
+                continue;
             }
-            if (!assigned) { // No free profile was found.Requeue at front so it’s retried immediately once a profile frees up
-                xQueueSendToFront(interrogationRequestQueue, &request, 0);
+            // Print MAC address being dispatched
+            char mac_str[18];
+            sprintf(mac_str, "%02x:%02x:%02x:%02x:%02x:%02x",
+                    request.address[0], request.address[1], request.address[2],
+                    request.address[3], request.address[4], request.address[5]);
+            ESP_LOGW("DISPATCH", "Dispatching request for %s to profile %d",
+                    mac_str, profile_num);
+            memset(profile.marks, 0, sizeof(profile.marks));
+            profile.marks[MARK_DISPATCH] = esp_timer_get_time();
+            esp_err_t err = esp_ble_gattc_open(
+                profile.gattc_if,
+                request.address,
+                request.addr_type,
+                true
+            );
+            if (err == ESP_OK) {
+                // only mark busy when the open request was accepted
+                memcpy(profile.remote_bda, request.address, 6);
+                profile.is_busy = true;
+                profile.busy_since = xTaskGetTickCount();
+                profile.interrogation_request = request;
+                interrogator.recordDispatchLatency(esp_timer_get_time() - request.queued_at);
+                assigned = true;
+                break;
+            } else {
+                profile.marks[MARK_DISPATCH] = 0;
+                ESP_LOGE("DISPATCH", "esp_ble_gattc_open failed: %x", err);
             }
         }
-        vTaskDelay(pdMS_TO_TICKS(10));
+        if (!assigned) { // Every free profile refused it, put it back for the retry
+            interrogator.interrogationRequests.requeue(request);
+        }
+    }
+    if (dispatchMutex) {
+        xSemaphoreGive(dispatchMutex);
+    }
+    return assigned;
+}
+
+// Sleeps until a request is queued or a profile slot frees up (see notifyDispatcher),
+// then dispatches as many requests as there are free profiles.
+void interrogationDispatcherTask(void *pvParameters) {
+    DeviceInterrogator &interrogator = DeviceInterrogator::getInstance();
+    while (1) {
+        while (dispatchOneRequest(interrogator)) {
+        }
+        // The timeout only matters when esp_ble_gattc_open was refused, nothing else would wake us up then
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DISPATCH_RETRY_MS));
     }
 }
 
+void DeviceInterrogator::notifyDispatcher()
+{
+    if (dispatcherTaskHandle != nullptr) {
+        xTaskNotifyGive(dispatcherTaskHandle);
+    }
+}
 
-QueueHandle_t DeviceInterrogator::getInterrogationRequestQueue()
+void DeviceInterrogator::recordDispatchLatency(int64_t latencyUs)
 {
-    return interrogationRequestQueue;
+    dispatchLatencyUs[dispatchLatencyNext] = latencyUs;
+    dispatchLatencyNext = (dispatchLatencyNext + 1) % DISPATCH_LATENCY_SAMPLES;
+    if (dispatchLatencyCount < DISPATCH_LATENCY_SAMPLES) {
+        dispatchLatencyCount++;
+    }
 }
 
-void DeviceInterrogator::setInterrogationRequestQueue(QueueHandle_t par)
+int64_t DeviceInterrogator::medianDispatchLatency()
 {
-    interrogationRequestQueue = par;
+    int64_t samples[DISPATCH_LATENCY_SAMPLES];
+    size_t count;
+    if (dispatchMutex) {
+        xSemaphoreTake(dispatchMutex, portMAX_DELAY);
+    }
+    count = dispatchLatencyCount;
+    memcpy(samples, dispatchLatencyUs, count * sizeof(samples[0]));
+    if (dispatchMutex) {
+        xSemaphoreGive(dispatchMutex);
+    }
+    if (count == 0) {
+        return -1;
+    }
+    std::nth_element(samples, samples + count / 2, samples + count);
+    return samples[count / 2];
 }
 
 
 
+
+
 void DeviceInterrogator::esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
 {
     ESP_LOGI("GAP_CB", "Received GAP_CB event %s",gapEvtToString(event));
@@ -456,8 +554,6 @@ esp_err_t DeviceInterrogator::launchTimeoutEnforcerTask(void)
 
 esp_err_t DeviceInterrogator::launchProfileStatusPrinterTask()
 {
-    ERR_GUARD(startDispatcherTask());
-
     // Start periodic state-dump task (every 2 seconds)
     xTaskCreate(
         dumpStateTask,            // function
@@ -476,13 +572,21 @@ esp_err_t DeviceInterrogator::mainFunction()
     ERR_GUARD(DeviceInterrogator::getInstance().initNvs());
     ERR_GUARD(DeviceInterrogator::getInstance().init_ble());
     ERR_GUARD(DeviceInterrogator::getInstance().initOutputHandler());
-    ERR_GUARD(DeviceInterrogator::getInstance().initQueues());
+    // Without them every device is simply interrogated in full
+    if (DeviceDatabase::getInstance().init() == ESP_OK) {
+        // the scheduler takes past attempts from the database
+        interrogationRequests.setHistoryLookup(
+            [](const esp_bd_addr_t address, esp_ble_addr_type_t addrType, DeviceStore::Entry &entry) {
+                return DeviceDatabase::getInstance().lookup(address, addrType, entry);
+            },
+            DeviceDatabase::getInstance().boot());
+    }
+    ESP_ERROR_CHECK_WITHOUT_ABORT(GattProfileCache::getInstance().init());
     ESP_LOGI(TAG,"After stack init");
     vTaskDelay(pdMS_TO_TICKS(10));
     ERR_GUARD(startUartTask());
     vTaskDelay(pdMS_TO_TICKS(10));
 
-    // parse_bdaddr_str("00:1B:66:B6:1C:AE",bda);
     // ESP_LOGI(TAG,"before open connection");
     // esp_ble_gattc_open(3, bda, BLE_ADDR_TYPE_PUBLIC,true);
     // ESP_LOGI(TAG,"after open connection");
@@ -522,29 +626,25 @@ esp_err_t DeviceInterrogator::awaitAssertInterfacesInitialized()
 }
 esp_err_t DeviceInterrogator::startDispatcherTask()
 {
-    BaseType_t ret = xTaskCreate(interrogationDispatcherTask, "DISPATCH", 2048, NULL, 4, NULL);
+    if (dispatcherTaskHandle != nullptr) {
+        ESP_LOGW(TAG, "DISPATCH_TASK already running");
+        return ESP_OK;
+    }
+    // before the task exists, so neither it nor medianDispatchLatency() ever runs unlocked
+    if (dispatchMutex == NULL) {
+        dispatchMutex = xSemaphoreCreateMutex();
+        if (dispatchMutex == NULL) {
+            ESP_LOGE(TAG, "Failed to create dispatch mutex");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    BaseType_t ret = xTaskCreate(interrogationDispatcherTask, "DISPATCH", 2048, NULL, 4, &dispatcherTaskHandle);
     if (ret != pdPASS) {
         ESP_LOGE(TAG, "Failed to create DISPATCH_TASK");
         return ESP_FAIL;
     }
     return ESP_OK;
 }
-bool DeviceInterrogator::parse_bdaddr_str(const char *bdaddr_str, esp_bd_addr_t & bd_addr)
-{
-    // Temporary array to store integer values
-    int values[6] = {0};
-    // sscanf will extract 6 hexadecimal values separated by colons.
-    if (sscanf(bdaddr_str, "%x:%x:%x:%x:%x:%x",
-               &values[0], &values[1], &values[2],
-               &values[3], &values[4], &values[5]) != 6) {
-        return false;
-               }
-    // Convert the integers to uint8_t and store in bd_addr
-    for (int i = 0; i < 6; i++) {
-        bd_addr[i] = (uint8_t) values[i];
-    }
-    return true;
-}
 esp_err_t DeviceInterrogator::initNvs()
 {
     esp_err_t ret = nvs_flash_init();
@@ -560,29 +660,24 @@ static void pendingMonitorTask(void *pvParameters) {
     DeviceInterrogator &intr = DeviceInterrogator::getInstance();
 
     while (intr.continueMonitorTask){
-        vTaskDelay(pdMS_TO_TICKS(2000));
+        vTaskDelay(pdMS_TO_TICKS(READ_MONITOR_PERIOD_MS));
 
         for (int app_id = 0; app_id < PROFILE_NUM; ++app_id) {
             auto &profile = intr.profileTabs[app_id];
 
-            // 1) Purge any pending_requests older than 120 s:
+            // 1) Give up reads past their deadline, so one silent characteristic cannot stall the profile
             TickType_t now = xTaskGetTickCount();
-            profile.pending_requests.erase(
-                std::remove_if(
-                    profile.pending_requests.begin(),
-                    profile.pending_requests.end(),
-                    [&](auto &pr){
-                        return (now - pr.timestamp) > pdMS_TO_TICKS(120000);
-                    }
-                ),
-                profile.pending_requests.end()
-            );
-
-            // 2) Check for “completely done”
-            if (profile.is_char_scheduled
-                && profile.read_char_queue.empty()
-                && profile.pending_requests.empty())
+            size_t expired = 0;
             {
+                std::lock_guard<std::mutex> lock(profile.read_lock);
+                expired = profile.expirePendingReads(now);
+            }
+            if (expired > 0) {
+                ESP_LOGW(TAG, "profile %d: %u characteristic reads timed out", app_id, (unsigned)expired);
+            }
+
+            // 2) Refill the window, or finalise if that was the last outstanding read
+            if (InterrogatorEventLoop::fillReadWindow(app_id)) {
                 ESP_LOGI(TAG,
                     "Finished all characteristic reads for profile %d → finalProcedure",
                     app_id);
@@ -610,6 +705,14 @@ void DeviceInterrogator::startPendingMonitor() {
 esp_err_t DeviceInterrogator::finalProcedure(int APP_ID,bool print) {
     auto &profile = profileTabs[APP_ID];
     ESP_LOGI(TAG,"FINAL_PROCEDURE triggered for the profile %d",APP_ID);
+    // Ends the read phase: from here on the GATTC callback drops read responses instead of
+    // storing them, so the services can be printed without the lock
+    bool readsFinished;
+    {
+        std::lock_guard<std::mutex> lock(profile.read_lock);
+        readsFinished = !profile.is_char_scheduled;
+        profile.is_char_scheduled = false;
+    }
 
     // Attempt to close the GATT connection, but always proceed to clear state
     // If we ever opened, formally close; otherwise skip
@@ -631,11 +734,54 @@ esp_err_t DeviceInterrogator::finalProcedure(int APP_ID,bool print) {
         _console->printGattProfileJson(APP_ID,profileTabs);
     }
     _rom->printGattProfileJson(APP_ID,profileTabs);
+    if (profile.connected_since != 0) {
+        uint32_t connectedMs = (xTaskGetTickCount() - profile.connected_since) * portTICK_PERIOD_MS;
+        ESP_LOGI(TAG, "Profile %d: %u reads, %u timed out, %u not sent in %lu ms connected, %.1f reads/s",
+                 APP_ID, profile.reads_done, profile.reads_timed_out, profile.reads_failed,
+                 (unsigned long)connectedMs,
+                 connectedMs ? profile.reads_done * 1000.0 / connectedMs : 0.0);
+        readsTotal += profile.reads_done;
+        readTimeoutsTotal += profile.reads_timed_out;
+        connectedMsTotal += connectedMs;
+    }
+    if (profile.marks[MARK_DISPATCH] != 0) {
+        profile.marks[MARK_END] = esp_timer_get_time();
+        ConnectionTimingRecord timing = connectionProfiler.record(profile, !profile.services.empty());
+        _rom->printConnectionTiming(timing);
+    }
+    // Only a profile whose reads all finished, none by giving up or failing to send, describes the device completely;
+    // a partial one must not keep the device out for good (GATT_PROFILE_CACHE_SKIP_KNOWN_MACS)
+    if (!profile.services.empty() && profile.fingerprint != 0 && readsFinished && profile.reads_timed_out == 0
+        && profile.reads_failed == 0) {
+        GattProfileCache::getInstance().addLayout(profile, profile.fingerprint);
+        DeviceDatabase::getInstance().addProfile(profile.interrogation_request.address,
+                                                 profile.interrogation_request.addr_type, profile.fingerprint);
+    } else if (profile.marks[MARK_DISPATCH] != 0) {
+        DeviceDatabase::getInstance().addFailure(profile.interrogation_request.address,
+                                                 profile.interrogation_request.addr_type);
+    }
+    // The outcome is in the device database now, which keeps a profiled device out for the reprofile window
+    interrogationRequests.complete(profile.interrogation_request.address,
+                                   profile.interrogation_request.addr_type);
     // 3) Reset profile state for reuse
-    profile.services.clear();
-    profile.read_char_queue.clear();
-    profile.pending_requests.clear();
-    profile.is_char_scheduled = false;
+    {
+        std::lock_guard<std::mutex> lock(profile.read_lock);
+        profile.services.clear();
+        profile.read_char_queue.clear();
+        profile.pending_requests.clear();
+    }
+    profile.multi_read.num_attr = 0;
+    profile.multi_read_unsupported = false;
+    profile.mtu = ATT_DEFAULT_MTU;
+    profile.connected_since = 0;
+    profile.fingerprint = 0;
+    memset(profile.marks, 0, sizeof(profile.marks));
+    profile.reads_done = 0;
+    profile.reads_timed_out = 0;
+    profile.reads_failed = 0;
+    if (profile.conn_id != UNUSED_CONN_ID) {
+        DeviceDatabase::getInstance().removeConnection(profile.remote_bda);
+    }
     profile.conn_id = UNUSED_CONN_ID;
     conn_device[APP_ID] = false;
     get_service[APP_ID] = false;
@@ -644,55 +790,52 @@ esp_err_t DeviceInterrogator::finalProcedure(int APP_ID,bool print) {
     ESP_LOGI(TAG, "Profile %d cleaned up and ready for next use", APP_ID);
     profileTabs[APP_ID].should_force_unregister = false;
     profileTabs[APP_ID].is_busy = false;
+    notifyDispatcher();
     return ESP_OK;
 }
 
 
 void DeviceInterrogator::dumpState() {
-    UBaseType_t qlen = uxQueueMessagesWaiting(interrogationRequestQueue);
+    unsigned qlen = (unsigned)interrogationRequests.size();
+    InterrogationRequestQueue::Stats qstats = interrogationRequests.stats();
     TickType_t now = xTaskGetTickCount();
-    unsigned busy_sec0 = profileTabs[0].is_busy ? (unsigned)((now - profileTabs[0].busy_since) * portTICK_PERIOD_MS / 1000) : 0;
-    unsigned busy_sec1 = profileTabs[1].is_busy ? (unsigned)((now - profileTabs[1].busy_since) * portTICK_PERIOD_MS / 1000) : 0;
-    unsigned busy_sec2 = profileTabs[2].is_busy ? (unsigned)((now - profileTabs[2].busy_since) * portTICK_PERIOD_MS / 1000) : 0;
     ESP_LOGI(TAG,
         "\n======================================================\n"
-        "StateDump: queue=%p, qlen=%u; \n"
-        "P0:[app=%u,if=%u,cid=%u,addr=%02x:%02x:%02x:%02x:%02x:%02x,b=%d,s=%d,pr=%u,rq=%u,sv=%u,bs=%u]; \n"
-        "P1:[app=%u,if=%u,cid=%u,addr=%02x:%02x:%02x:%02x:%02x:%02x,b=%d,s=%d,pr=%u,rq=%u,sv=%u,bs=%u]; \n"
-        "P2:[app=%u,if=%u,cid=%u,addr=%02x:%02x:%02x:%02x:%02x:%02x,b=%d,s=%d,pr=%u,rq=%u,sv=%u,bs=%u]; \n"
-        "conn_dev=[%d,%d,%d], get_svc=[%d,%d,%d]; \n"
-        "flags:[contTask=%d,connecting=%d,stopScanDone=%d]\n"
-        "======================================================\n\n",
-        interrogationRequestQueue, (unsigned)qlen,
-        // P0
-        profileTabs[0].app_id, profileTabs[0].gattc_if, profileTabs[0].conn_id,
-          profileTabs[0].remote_bda[0], profileTabs[0].remote_bda[1], profileTabs[0].remote_bda[2],
-          profileTabs[0].remote_bda[3], profileTabs[0].remote_bda[4], profileTabs[0].remote_bda[5],
-          profileTabs[0].is_busy, profileTabs[0].is_char_scheduled,
-          (unsigned)profileTabs[0].pending_requests.size(),
-          (unsigned)profileTabs[0].read_char_queue.size(),
-          (unsigned)profileTabs[0].services.size(), busy_sec0,
-        // P1
-        profileTabs[1].app_id, profileTabs[1].gattc_if, profileTabs[1].conn_id,
-          profileTabs[1].remote_bda[0], profileTabs[1].remote_bda[1], profileTabs[1].remote_bda[2],
-          profileTabs[1].remote_bda[3], profileTabs[1].remote_bda[4], profileTabs[1].remote_bda[5],
-          profileTabs[1].is_busy, profileTabs[1].is_char_scheduled,
-          (unsigned)profileTabs[1].pending_requests.size(),
-          (unsigned)profileTabs[1].read_char_queue.size(),
-          (unsigned)profileTabs[1].services.size(), busy_sec1,
-        // P2
-        profileTabs[2].app_id, profileTabs[2].gattc_if, profileTabs[2].conn_id,
-          profileTabs[2].remote_bda[0], profileTabs[2].remote_bda[1], profileTabs[2].remote_bda[2],
-          profileTabs[2].remote_bda[3], profileTabs[2].remote_bda[4], profileTabs[2].remote_bda[5],
-          profileTabs[2].is_busy, profileTabs[2].is_char_scheduled,
-          (unsigned)profileTabs[2].pending_requests.size(),
-          (unsigned)profileTabs[2].read_char_queue.size(),
-          (unsigned)profileTabs[2].services.size(), busy_sec2,
-        // connections & flags
-        conn_device[0], conn_device[1], conn_device[2],
-        get_service[0], get_service[1], get_service[2],
+        "StateDump: qlen=%u, enq=%lu, avoided=%lu (coalesced=%lu, inflight=%lu, recent=%lu), full=%lu, expired=%lu, dispatch_median_us=%lld; \n"
+        "reads=%lu, read_timeouts=%lu, reads_per_conn_s=%.2f; layouts=%u, layout_hits=%lu, devices=%u, known_skipped=%lu; \n"
+        "flags:[contTask=%d,connecting=%d,stopScanDone=%d]",
+        qlen, (unsigned long)qstats.enqueued, (unsigned long)qstats.avoided(),
+        (unsigned long)qstats.coalesced, (unsigned long)qstats.rejectedInFlight,
+        (unsigned long)qstats.rejectedRecent, (unsigned long)qstats.droppedFull, (unsigned long)qstats.expired,
+        (long long)medianDispatchLatency(),
+        (unsigned long)readsTotal, (unsigned long)readTimeoutsTotal,
+        connectedMsTotal ? readsTotal * 1000.0 / connectedMsTotal : 0.0,
+        (unsigned)GattProfileCache::getInstance().size(), (unsigned long)GattProfileCache::getInstance().hits(),
+        (unsigned)DeviceDatabase::getInstance().size(), (unsigned long)knownDevicesSkipped,
         continueMonitorTask, Isconnecting, stop_scan_done
     );
+    for (int s = 0; s < CONNECTION_STAGE_COUNT; s++) {
+        ConnectionStage stage = (ConnectionStage)s;
+        ESP_LOGI(TAG, "stage %-9s n=%lu p50=%ldms p90=%ldms p99=%ldms",
+                 ConnectionProfiler::stageName(stage), (unsigned long)connectionProfiler.samples(stage),
+                 (long)connectionProfiler.percentile(stage, 50), (long)connectionProfiler.percentile(stage, 90),
+                 (long)connectionProfiler.percentile(stage, 99));
+    }
+    for (int i = 0; i < PROFILE_NUM; i++) {
+        const auto &p = profileTabs[i];
+        unsigned busy_sec = p.is_busy ? (unsigned)((now - p.busy_since) * portTICK_PERIOD_MS / 1000) : 0;
+        ESP_LOGI(TAG,
+            "P%d:[app=%u,if=%u,cid=%u,addr=%02x:%02x:%02x:%02x:%02x:%02x,b=%d,s=%d,pr=%u,rq=%u,sv=%u,bs=%u,conn=%d,svc=%d]",
+            i, p.app_id, p.gattc_if, p.conn_id,
+            p.remote_bda[0], p.remote_bda[1], p.remote_bda[2],
+            p.remote_bda[3], p.remote_bda[4], p.remote_bda[5],
+            p.is_busy, p.is_char_scheduled,
+            (unsigned)p.pending_requests.size(),
+            (unsigned)p.read_char_queue.size(),
+            (unsigned)p.services.size(), busy_sec,
+            conn_device[i], get_service[i]);
+    }
+    ESP_LOGI(TAG, "======================================================\n");
 }
 
 static void dumpStateTask(void *pvParameters) {
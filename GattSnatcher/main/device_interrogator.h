@@ -12,8 +12,12 @@
 #include <interrogator_event_loop.h>
 #include <uart_controller.h>
 #include "rom_print_controller.h"
+#include "interrogation_request_queue.h"
+#include "connection_profiler.h"
 
 #define UNUSED_CONN_ID UINT16_MAX
+#define DISPATCH_RETRY_MS 1000      // retry period after esp_ble_gattc_open refused a request
+#define DISPATCH_LATENCY_SAMPLES 32
 #define REMOTE_SERVICE_UUID        0x00FF
 #define REMOTE_NOTIFY_CHAR_UUID    0xFF01
 
@@ -71,7 +75,6 @@ class DeviceInterrogator {
     esp_err_t deinit_ble();
     void resetState();
     esp_err_t initOutputHandler();
-    esp_err_t initQueues();
     esp_err_t awaitAssertInterfacesInitialized();
     esp_err_t startUartTask();//TODO this will always have to use UART..
 
@@ -84,8 +87,14 @@ class DeviceInterrogator {
     esp_err_t sendInterrogationRequestToQueue(interrogation_request_t req);
 
     esp_err_t startDispatcherTask();
+    // Profile slot registered with the given interface, -1 if none
+    int findProfileByGattcIf(esp_gatt_if_t gattc_if);
+    // Wakes the dispatcher, call after queueing a request or freeing a profile
+    void notifyDispatcher();
+    void recordDispatchLatency(int64_t latencyUs);
+    // Median time from queueing a request to its accepted esp_ble_gattc_open, -1 without samples
+    int64_t medianDispatchLatency();
 
-    static bool parse_bdaddr_str(const char *bdaddr_str, esp_bd_addr_t & bd_addr);
     void startPendingMonitor();
     esp_err_t isCharReadFinished(bool & returnVal);
     esp_err_t finalProcedure(int APP_ID, bool print);
@@ -97,15 +106,23 @@ class DeviceInterrogator {
     esp_err_t launchProfileStatusPrinterTask();
     esp_err_t launchTimeoutEnforcerTask();
 
-    bool conn_device[PROFILE_NUM] = {false,false,false};
-    bool get_service[PROFILE_NUM] = {false,false,false};
+    bool conn_device[PROFILE_NUM] = {};
+    bool get_service[PROFILE_NUM] = {};
     bool continueMonitorTask = true;
     bool Isconnecting    = false;
     bool stop_scan_done  = false;
 
-    QueueHandle_t interrogationRequestQueue = nullptr;
-    QueueHandle_t getInterrogationRequestQueue();
-    void setInterrogationRequestQueue(QueueHandle_t par);
+    InterrogationRequestQueue interrogationRequests;
+    ConnectionProfiler connectionProfiler;
+    TaskHandle_t dispatcherTaskHandle = nullptr;
+    // Characteristic read throughput over all finished connections
+    uint32_t readsTotal = 0;
+    uint32_t readTimeoutsTotal = 0;
+    uint64_t connectedMsTotal = 0;
+    uint32_t knownDevicesSkipped = 0;   // requests dropped because DeviceDatabase already has the device
+    int64_t dispatchLatencyUs[DISPATCH_LATENCY_SAMPLES] = {};
+    size_t dispatchLatencyNext = 0;
+    size_t dispatchLatencyCount = 0;
 
     struct gattc_profile_inst profileTabs[PROFILE_NUM] = {};//rest in the constructor
 };
@@ -23,6 +23,8 @@
 #include "constants.h"
 #include <struct_and_definitions.h>
 #define UART_NUM UART_NUM_0
+#define CONSOLE_LINE_MAX 48
+#define CONSOLE_RX_BUFFER_SIZE 256  // the driver wants more than the 128-byte hardware FIFO
 
 DeviceScanner &DeviceScanner::getInstance() {
     static DeviceScanner instance = {};
@@ -72,12 +74,26 @@ esp_err_t DeviceScanner::initOutputHandler()
         return ESP_FAIL;
     }
     ERR_GUARD(_rom->init(false));
-    currentlyUsedFilename = _rom->getFilename();
     ERR_GUARD(_uart->init(true));
-    _uart->setCurrentlyUsedFilename(currentlyUsedFilename);
+    syncUartFileId();
     return ESP_OK;
 }
 
+/**
+ * Points the UART frames at the scanner log segment the reports are being written to.
+ * The writer task switches segments some time after the HCI task asked for it, so
+ * for the reports around a switch the file_id can be off by one segment.
+ */
+void DeviceScanner::syncUartFileId()
+{
+    int fileIndex = _rom->getFileIndex();
+    if (__builtin_expect(fileIndex == _uartFileIndex, true)) {
+        return;
+    }
+    _uartFileIndex = fileIndex;
+    _uart->setCurrentFileId(fileIndex < 0 ? UART_FRAME_NO_FILE_ID : (uint16_t)fileIndex);
+}
+
 esp_err_t DeviceScanner::releaseBluetoothClassicHeap() {
     /* Release the heap of Bluetooth Classic as we won't need it */
     esp_err_t errCode = esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT);
@@ -104,22 +120,12 @@ esp_err_t DeviceScanner::initBluetoothController(esp_bt_controller_config_t & bt
     return ESP_OK;
 }
 
-esp_err_t DeviceScanner::initAdvQueue() {
-    /* A queue for storing the received HCI packets */
-    _adv_queue = xQueueCreate(40, sizeof(hci_data_t));
-    if (_adv_queue == NULL) {
-        ESP_LOGE(TAG, "Cannot create HCI IN queue");
-        return ESP_FAIL;
-    }
-    return ESP_OK;
-}
-
-esp_err_t DeviceScanner::initHciBuffer() {
-    /* Create the HCI buffer */
-    _hci_buffer = (uint8_t *)malloc(sizeof(uint8_t) * HCI_BUFFER_SIZE * HCI_EVENT_MAX_SIZE);
-    if (_hci_buffer == NULL) {
-        ESP_LOGE(TAG, "Cannot allocate heap for HCI buffer.");
-        return ESP_FAIL;
+esp_err_t DeviceScanner::initHciRing() {
+    /* Ring storing the received HCI packets until the processing task consumes them */
+    esp_err_t err = _hciRing.init(CONFIG_HCI_RING_BUFFER_SIZE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot create HCI ring buffer");
+        return err;
     }
     return ESP_OK;
 }
@@ -160,9 +166,72 @@ esp_err_t DeviceScanner::startBleScan() {
 }
 
 esp_err_t DeviceScanner::setMonitoredChannel(uint8_t monitoredChannel) {
+#if CONFIG_IDF_TARGET_ESP32
     ESP_LOGI(TAG, "Locking the BLE Scanning to channel %u", MONITORED_CHANNEL);
     btdm_scan_channel_setting(MONITORED_CHANNEL);
     esp_rom_printf("Locked to channel: %u\n", MONITORED_CHANNEL);
+#else
+    // The channel lock lives in the patched ESP32 controller library only
+    ESP_LOGW(TAG, "Channel lock not available on this target, scanning all primary channels");
+#endif
+    return ESP_OK;
+}
+
+// HCI LE commands not provided by bt_hci_common [Vol. 4, Part E, 7.8]
+#define HCI_OPCODE_LE(ocf) (uint16_t)((0x08 << 10) | (ocf))
+#define HCI_LE_SET_EVENT_MASK 0x0001
+#define HCI_LE_SET_EXT_SCAN_PARAMS 0x0041
+#define HCI_LE_SET_EXT_SCAN_ENABLE 0x0042
+
+static uint16_t make_cmd_le(uint8_t *buf, uint16_t ocf, const uint8_t *params, uint8_t params_len)
+{
+    uint16_t opcode = HCI_OPCODE_LE(ocf);
+    buf[0] = H4_TYPE_COMMAND;
+    buf[1] = opcode & 0xFF;
+    buf[2] = opcode >> 8;
+    buf[3] = params_len;
+    memcpy(buf + 4, params, params_len);
+    return 4 + params_len;
+}
+
+esp_err_t DeviceScanner::applyLeEventMask() {
+    ESP_LOGI(TAG, "Applying LE event mask");
+    // Default LE mask (0x1F) plus bit 12 => LE Extended Advertising Report
+    uint8_t le_evt_mask[8] = {0x1F, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    _size = make_cmd_le(_hci_message, HCI_LE_SET_EVENT_MASK, le_evt_mask, sizeof(le_evt_mask));
+    esp_vhci_host_send_packet(_hci_message, _size);
+    return ESP_OK;
+}
+
+esp_err_t DeviceScanner::setUpBleExtScan() {
+    ESP_LOGI(TAG, "Setting up BLE extended scan parameters");
+    // Passive scan on the 1M PHY with the same timing as the legacy scan
+    uint16_t scan_interval = 0x50;
+    uint16_t scan_window = 0x50;
+    uint8_t params[] = {
+        0x00,   // own address type: public
+        0x00,   // filter policy: accept everything
+        0x01,   // scanning PHYs: LE 1M
+        0x00,   // scan type: passive
+        (uint8_t)(scan_interval & 0xFF), (uint8_t)(scan_interval >> 8),
+        (uint8_t)(scan_window & 0xFF), (uint8_t)(scan_window >> 8),
+    };
+    _size = make_cmd_le(_hci_message, HCI_LE_SET_EXT_SCAN_PARAMS, params, sizeof(params));
+    esp_vhci_host_send_packet(_hci_message, _size);
+    return ESP_OK;
+}
+
+esp_err_t DeviceScanner::startBleExtScan() {
+    ESP_LOGI(TAG, "Starting BLE extended scanning");
+    uint8_t params[] = {
+        0x01,       // enable
+        0x00,       // duplicates filtering disabled
+        0x00, 0x00, // duration: scan until disabled
+        0x00, 0x00, // period: continuous
+    };
+    _size = make_cmd_le(_hci_message, HCI_LE_SET_EXT_SCAN_ENABLE, params, sizeof(params));
+    esp_vhci_host_send_packet(_hci_message, _size);
+    _ble_scan_initialising = false;
     return ESP_OK;
 }
 
@@ -173,7 +242,7 @@ esp_err_t DeviceScanner::startControlThread() {
     // Task stack size - 2048B - taken from ESP HCI example
     // Priority 6 - taken from ESP HCI example
     // Pinned to core 0 - taken from ESP HCI example - Good to do it on the PRO core..
-    xTaskCreatePinnedToCore(&hciEvtProcessWrapper, "Process HCI Event", 8192, NULL, 6, NULL, 0);
+    xTaskCreatePinnedToCore(&hciEvtProcessWrapper, "Process HCI Event", 8192, NULL, 6, &_hciTask, 0);
     return ESP_OK;
 }
 
@@ -209,73 +278,275 @@ esp_err_t DeviceScanner::zeroHciDataMemory() {
 
 
 /**
+ * Hand a batch of parsed advertising reports to the output handlers.
+ * Every report goes to the file, only new or expired MACs are forwarded over UART.
+ */
+void DeviceScanner::processReportBatch(size_t count)
+{
+    _rom->printAdvertisingReportBatch(_reportBatch, count);
+    syncUartFileId();
+    int64_t now = esp_timer_get_time();    // current time in μs
+    for (size_t b = 0; b < count; b++) {
+        const auto &leAdvertisingReport = _reportBatch[b];
+        for (uint8_t i = 0; i < leAdvertisingReport.num_reports; i++) {
+            MacKey key;
+            std::memcpy(key.addr, leAdvertisingReport.bdaddr(i), 6);
+            key.addr_type = leAdvertisingReport.reports[i].addr_type;
+            if ( __builtin_expect(_macCache.shouldPrintAndAddToCache(key, now),false)) {
+                _uart->printAdvertisingSingleReport(leAdvertisingReport, i);
+            }
+        }
+    }
+    evictMacCache(now, MAC_CACHE_EVICT_BUDGET);
+    _reportsProcessed += count;
+}
+
+/**
+ * Bounded eviction step, cheap enough to run after every batch.
+ */
+void DeviceScanner::evictMacCache(int64_t now, size_t budget)
+{
+    if (!_macCache.hasExpired(now)) {
+        return;
+    }
+    int64_t start = esp_timer_get_time();
+    _evictedSinceStats += _macCache.evictOld(now, budget);
+    int64_t pause = esp_timer_get_time() - start;
+    if (pause > _maxEvictPauseUs) {
+        _maxEvictPauseUs = pause;
+    }
+}
+
+/**
+ * Background sweep while the radio is quiet. Still done in bounded slices,
+ * so a packet arriving mid-sweep waits for at most one slice.
+ */
+void DeviceScanner::sweepMacCache()
+{
+    int64_t now = esp_timer_get_time();
+    while (_hciRing.empty() && _macCache.hasExpired(now)) {
+        evictMacCache(now, MAC_CACHE_EVICT_BUDGET);
+    }
+}
+
+/**
+ * Extended reports are rare compared to legacy ones, so they skip the batch and go out one event at a time.
+ */
+void DeviceScanner::processExtReport()
+{
+    int64_t now = esp_timer_get_time();
+    for (uint8_t i = 0; i < _extReport.num_reports; i++) {
+        const LeExtAdvertisingReportView *report;
+        uint8_t index;
+        // Fragments are held back until the advertiser's data is complete
+        if (!_extReassembler.add(_extReport, i, report, index)) {
+            continue;
+        }
+        _rom->printExtAdvertisingSingleReport(*report, index);
+        syncUartFileId();
+        // Anonymous advertisers cannot be connected to, nothing to forward
+        if (!report->isConnectable(index) || report->reports[index].addr_type == 0xFF) {
+            continue;
+        }
+        MacKey key;
+        std::memcpy(key.addr, report->bdaddr(index), 6);
+        key.addr_type = report->reports[index].addr_type;
+        if ( __builtin_expect(_macCache.shouldPrintAndAddToCache(key, now),false)) {
+            _uart->printExtAdvertisingSingleReport(*report, index);
+        }
+    }
+    evictMacCache(now, MAC_CACHE_EVICT_BUDGET);
+    _reportsProcessed++;
+}
+
+/**
+ * Drains every pending HCI packet in passes of up to HCI_BATCH_SIZE packets, so the
+ * ring space is handed back after at most that many, whether they were logged or
+ * skipped. The task only blocks once the ring is empty.
  *
  * @note keep this function lean, as it can stuck bluetooth stack as a whole
  */
 void DeviceScanner::hciEvtProcess(void *pvParameters)
 {
-    LeAdvertisingReport leAdvertisingReport;
     esp_err_t err = DeviceScanner::zeroHciDataMemory();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to initialize HCI data structure");
         return;
     }
+    int64_t statsSince = esp_timer_get_time();
 
     while (1) {
-        if (xQueueReceive(_adv_queue, &_hci_data, portMAX_DELAY) != pdTRUE) {
-            ESP_LOGE(TAG, "Error while receiving a packet from HCI queue.");
-            continue;
-        }
-        esp_err_t err = HciEventParser::fillAdvReport(_hci_data, leAdvertisingReport);
-        if (err == ESP_OK){
-            if (leAdvertisingReport.isAdvertisingReportConnectable()){
-                int64_t now = esp_timer_get_time();    // current time in μs
-                for (uint8_t i = 0;i < leAdvertisingReport.num_reports; i++){
-                    auto& singleReport = leAdvertisingReport.reports[i];
-
-                    MacKey key;
-                    std::memcpy(key.addr,singleReport.bdaddr_str, 6);
-                    key.addr_type = singleReport.addr_type;
-                    _rom->printAdvertisingSingleReport(singleReport,leAdvertisingReport.timestamp);
-                    if ( __builtin_expect(_macCache.shouldPrintAndAddToCache(key, now),false)) {
-                        _macCache.evictOld(now);
-                        _uart->printAdvertisingSingleReport(singleReport,leAdvertisingReport.timestamp);
+        size_t count = 0;
+        size_t acquired = 0;
+        // bounded by packets, not by batched reports: skipped ones hold ring space until release() too
+        while (acquired < HCI_BATCH_SIZE && _hciRing.acquire(_hci_data)) {
+            acquired++;
+            if (HciEventParser::leMetaSubevent(_hci_data) == HCI_LE_EXT_ADV_REPORT) {
+                if (HciEventParser::parseExtAdvReportView(_hci_data, _extReport) == ESP_OK
+                    && _extReport.isAdvertisingReportConnectable()) {
+                    // Keep the file in arrival order: flush what was batched so far first
+                    if (count > 0) {
+                        processReportBatch(count);
+                        count = 0;
                     }
+                    processExtReport();
                 }
+                continue;
+            }
+            auto &leAdvertisingReport = _reportBatch[count];
+            if (HciEventParser::parseAdvReportView(_hci_data, leAdvertisingReport) == ESP_OK
+                && leAdvertisingReport.isAdvertisingReportConnectable()) {
+                count++;
+            }
+        }
+        if (count > 0) {
+            processReportBatch(count);
+        }
+        // The batch views point into the ring, only now can the producer reuse the space
+        _hciRing.release();
+        if (count == 0) {
+            // Producer notifies after every push, so a packet arriving in between is not missed.
+            // Nothing arriving for a while means the radio is quiet, a good time to sweep the cache.
+            if (_hciRing.empty() && ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MAC_CACHE_SWEEP_IDLE_MS)) == 0) {
+                sweepMacCache();
             }
+            // No new records to close the block on, so the open one is closed by the clock
+            _rom->closeBlockIfDue(esp_timer_get_time());
         }
-        vTaskDelay(1 / portTICK_PERIOD_MS);//give space to scheduler to force bluetooth to run faster
 
+        int64_t now = esp_timer_get_time();
+        if (now - statsSince >= HCI_STATS_PERIOD_US) {
+            ESP_LOGI(TAG, "HCI throughput: %.1f events/s, ring dropped %u, ring high watermark %u/%u B",
+                     _reportsProcessed * 1000000.0 / (now - statsSince),
+                     (unsigned)_hciRing.droppedCount(),
+                     (unsigned)_hciRing.highWatermark(),
+                     (unsigned)_hciRing.capacity());
+            ESP_LOGI(TAG, "MAC cache: %u entries, %u evicted, %u recycled while full, worst eviction pause %lld us",
+                     (unsigned)_macCache.size(),
+                     (unsigned)_evictedSinceStats,
+                     (unsigned)_macCache.evictedWhileFull(),
+                     _maxEvictPauseUs);
+            logMacCacheClassStats();
+            BufferedLogWriter::Stats ws = _rom->writerStats();
+            ESP_LOGI(TAG, "Log writer: %u commits, %u pages, %llu B written, %u blocks dropped, %u write errors",
+                     (unsigned)ws.commits, (unsigned)ws.pagesWritten, (unsigned long long)ws.bytesWritten,
+                     (unsigned)ws.droppedRecords, (unsigned)ws.writeErrors);
+            ExtAdvReassembler::Stats es = _extReassembler.stats();
+            ESP_LOGI(TAG, "Extended advertising: %u reassembled (%u truncated), %u incomplete dropped",
+                     (unsigned)es.assembled, (unsigned)es.truncated, (unsigned)es.dropped);
+            PayloadDictionary::Stats ds = _rom->dictionaryStats();
+            ESP_LOGI(TAG, "Payloads: %u full, %u repeated, %u delta, %llu B -> %llu B",
+                     (unsigned)ds.full, (unsigned)ds.refs, (unsigned)ds.xors,
+                     (unsigned long long)ds.bytesIn, (unsigned long long)ds.bytesOut);
+            _reportsProcessed = 0;
+            _evictedSinceStats = 0;
+            _maxEvictPauseUs = 0;
+            statsSince = now;
+        }
+    }
+}
+
+/**
+ * Totals since boot, per address class. "saved" counts reports the legacy 20 min TTL would have
+ * forwarded, "extra" the ones it would have suppressed; an address forgotten and seen again is not counted.
+ */
+void DeviceScanner::logMacCacheClassStats()
+{
+    for (size_t c = 0; c < MacCache::CLASS_COUNT; ++c) {
+        MacAddressClass cls = (MacAddressClass)c;
+        const MacCache::ClassStats &st = _macCache.stats(cls);
+        ESP_LOGI(TAG, "MAC cache %-6s ttl %lld s: forwarded %u, suppressed %u, saved %u, extra %u",
+                 macAddressClassName(cls),
+                 _macCache.ttl(cls) / 1000000,
+                 (unsigned)st.forwarded,
+                 (unsigned)st.suppressed,
+                 (unsigned)st.savedVsLegacy,
+                 (unsigned)st.extraVsLegacy);
     }
 }
 
+/**
+ * Safe to call from any task, takes effect for the next report of that class.
+ */
+void DeviceScanner::setMacCacheTtl(MacAddressClass addressClass, uint32_t ttlSeconds)
+{
+    _macCache.setTtl(addressClass, (int64_t)ttlSeconds * 1000000);
+    ESP_LOGI(TAG, "MAC cache TTL for %s set to %u s", macAddressClassName(addressClass), (unsigned)ttlSeconds);
+}
+
+#if CONFIG_ESP_CONSOLE_UART && CONFIG_ESP_CONSOLE_UART_NUM != CONFIG_UART_PORT_NUM
+/**
+ * Reads commands from the serial console, one per line. The only one is
+ * "ttl <public|static|rpa|nrpa|other> <seconds>", see parseMacTtlCommand.
+ */
+void DeviceScanner::consoleTask(void *pvParameters)
+{
+    char line[CONSOLE_LINE_MAX];
+    size_t len = 0;
+    while (true) {
+        uint8_t c;
+        if (uart_read_bytes(CONFIG_ESP_CONSOLE_UART_NUM, &c, 1, portMAX_DELAY) != 1) {
+            continue;
+        }
+        if (c != '\r' && c != '\n') {
+            // an overlong line is cut off and then rejected by the parser
+            if (len < sizeof(line) - 1) {
+                line[len++] = (char)c;
+            }
+            continue;
+        }
+        if (len == 0) {
+            continue;
+        }
+        line[len] = '\0';
+        len = 0;
+        MacAddressClass addressClass;
+        uint32_t ttlSeconds;
+        if (parseMacTtlCommand(line, addressClass, ttlSeconds)) {
+            getInstance().setMacCacheTtl(addressClass, ttlSeconds);
+        } else {
+            ESP_LOGW(TAG, "Unknown command \"%s\", expected: ttl <public|static|rpa|nrpa|other> <seconds>", line);
+        }
+    }
+}
+#endif
+
+esp_err_t DeviceScanner::startConsoleTask()
+{
+#if CONFIG_ESP_CONSOLE_UART && CONFIG_ESP_CONSOLE_UART_NUM != CONFIG_UART_PORT_NUM
+    // The console is written without the driver; installing it only adds the RX buffer
+    ERR_GUARD_LOGE(uart_driver_install(CONFIG_ESP_CONSOLE_UART_NUM, CONSOLE_RX_BUFFER_SIZE, 0, 0, nullptr, 0),
+                   "console uart_driver_install failed");
+    if (xTaskCreate(consoleTask, "console", 3072, nullptr, tskIDLE_PRIORITY + 1, nullptr) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create console task");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Console commands: ttl <public|static|rpa|nrpa|other> <seconds>");
+#else
+    ESP_LOGW(TAG, "No UART console, MAC cache TTLs stay at their Kconfig values");
+#endif
+    return ESP_OK;
+}
+
 void DeviceScanner::hciEvtProcessWrapper(void *pvParameters) {
     DeviceScanner::getInstance().hciEvtProcess(pvParameters);
 }
 
 int DeviceScanner::controllerOutRdy(uint8_t *data, uint16_t len)
 {
-    hci_data_t queue_data;
-    queue_data.timestamp = esp_timer_get_time();  // Get microseconds since ESP boot
+    int64_t timestamp = esp_timer_get_time();  // Get microseconds since ESP boot
 
     if (len > HCI_EVENT_MAX_SIZE) {
         ESP_LOGD(TAG, "Packet too large.");
         return ESP_FAIL;
     }
-    if (uxQueueMessagesWaitingFromISR(_adv_queue) >= HCI_BUFFER_SIZE) {
-        ESP_LOGD(TAG, "Failed to enqueue advertising report. Queue full.");
+    if (!_hciRing.push(data, len, timestamp)) {
+        ESP_LOGD(TAG, "Failed to enqueue advertising report. Ring full.");
         return ESP_FAIL;
     }
-    uint8_t* packet = _hci_buffer + _hci_buffer_idx * HCI_EVENT_MAX_SIZE;
-    _hci_buffer_idx = (_hci_buffer_idx + 1) % HCI_BUFFER_SIZE;
-    memcpy(packet, data, len);
-
-    queue_data.data = packet;
-    queue_data.len = len;
-    if (xQueueSendToBackFromISR(_adv_queue, (void*)&queue_data, NULL) != pdTRUE) {
-        ESP_LOGD(TAG, "Failed to enqueue advertising report. Queue full.");
+    if (_hciTask != nullptr) {
+        vTaskNotifyGiveFromISR(_hciTask, NULL);
     }
-
     return ESP_OK;
 }
 
@@ -292,8 +563,7 @@ esp_err_t DeviceScanner::mainFunction() {
 
     ESP_ERROR_CHECK(releaseBluetoothClassicHeap());
     ESP_ERROR_CHECK(initBluetoothController(bt_cfg));
-    ERR_GUARD(initAdvQueue());
-    ERR_GUARD(initHciBuffer());
+    ERR_GUARD(initHciRing());
 
     // Has to be set before any Bluetooth operations (like sending data, scanning or connecting).
     ERR_GUARD(registerVhciHostCallback());
@@ -310,6 +580,20 @@ esp_err_t DeviceScanner::mainFunction() {
                 case 1:
                     ERR_GUARD(applyHciEventMask());
                     break;
+#if CONFIG_SCANNER_EXTENDED_ADVERTISING
+                case 2:
+                    ERR_GUARD(applyLeEventMask());
+                    break;
+                case 3:
+                    ERR_GUARD(setUpBleExtScan());
+                    break;
+                case 4:
+                    ERR_GUARD(startControlThread());
+                    break;
+                case 5:
+                    ERR_GUARD(startBleExtScan());
+                    break;
+#else
                 case 2:
                     ERR_GUARD(setUpBleScan());
                     break;
@@ -322,6 +606,7 @@ esp_err_t DeviceScanner::mainFunction() {
                 case 5:
                     ERR_GUARD(startBleScan());
                     break;
+#endif
                 default:
                     _ble_scan_initialising = false;
                     break;
@@ -330,6 +615,8 @@ esp_err_t DeviceScanner::mainFunction() {
         }
         vTaskDelay(1000 / portTICK_PERIOD_MS);  // Watchdog
     }
+    // Scanning works without it, only the TTLs cannot be changed then
+    ESP_ERROR_CHECK_WITHOUT_ABORT(startConsoleTask());
     return ESP_OK;
 }
 
@@ -5,25 +5,37 @@
 #include <cstring>
 #include <esp_bt.h>
 #include <mac_cache.h>
+#include <hci_ring_buffer.h>
+#include <hci_event_parser.h>
 
 
 #include "driver/uart.h"
 
 
 static const uint8_t MONITORED_CHANNEL = 37;
+#define HCI_BATCH_SIZE CONFIG_HCI_BATCH_SIZE
+#define HCI_STATS_PERIOD_US (60LL * 1000000) // how often the HCI throughput is logged
+#define MAC_CACHE_EVICT_BUDGET CONFIG_MAC_CACHE_EVICT_BUDGET
+#define MAC_CACHE_SWEEP_IDLE_MS CONFIG_MAC_CACHE_SWEEP_IDLE_MS
 
 
 
 class DeviceScanner {
     DeviceScanner();
     QueueHandle_t _uart_queue;
-    QueueHandle_t _adv_queue;
 
     MacCache _macCache;
-    // Buffer for HCI events;
-    uint8_t *_hci_buffer = NULL;
-    uint8_t _hci_buffer_idx = 0;
+    // Packets handed over from the controller callback to the processing task
+    HciRingBuffer _hciRing;
+    TaskHandle_t _hciTask = nullptr;
     hci_data_t _hci_data;
+    // Views into the ring for every drained batch, valid until the ring is released
+    LeAdvertisingReportView _reportBatch[HCI_BATCH_SIZE];
+    LeExtAdvertisingReportView _extReport;
+    ExtAdvReassembler _extReassembler;
+    uint32_t _reportsProcessed = 0;
+    int64_t _maxEvictPauseUs = 0;       // worst single evictOld call since the last stats log
+    uint32_t _evictedSinceStats = 0;
     uint8_t _hci_message[HCI_EVENT_MAX_SIZE];
     uint16_t _size;
 
@@ -36,14 +48,18 @@ class DeviceScanner {
     esp_err_t initOutputHandler();
     esp_err_t releaseBluetoothClassicHeap();
     esp_err_t initBluetoothController(esp_bt_controller_config_t & bt_cfg);
-    esp_err_t initAdvQueue();
-    esp_err_t initHciBuffer();
+    esp_err_t initHciRing();
     esp_err_t registerVhciHostCallback();
     esp_err_t resetBluetoothController();
     esp_err_t applyHciEventMask();
     esp_err_t startBleScan();
+    esp_err_t applyLeEventMask();
+    esp_err_t setUpBleExtScan();
+    esp_err_t startBleExtScan();
     esp_err_t setMonitoredChannel(uint8_t monitoredChannel);
     esp_err_t startControlThread();
+    esp_err_t startConsoleTask();
+    static void consoleTask(void *pvParameters);
     esp_err_t setUpBleScan();
 
     /*
@@ -51,11 +67,17 @@ class DeviceScanner {
  */
     int controllerOutRdy(uint8_t *data, uint16_t len);
     static int controllerOutRdyWrapper(uint8_t *data, uint16_t len);
+    void processReportBatch(size_t count);
+    void processExtReport();
+    void syncUartFileId();
+    void evictMacCache(int64_t now, size_t budget);
+    void sweepMacCache();
+    void logMacCacheClassStats();
     void hciEvtProcess(void *pvParameters);
     static void hciEvtProcessWrapper(void *pvParameters);
     esp_err_t zeroHciDataMemory();
 
-    char * currentlyUsedFilename;
+    int _uartFileIndex = -1;    // scanner log segment the UART frames point to
 public:
     DeviceScanner(const DeviceScanner&) = delete;             // Copy ctor
     DeviceScanner(DeviceScanner&&) = delete;                  // Move ctor
@@ -64,4 +86,5 @@ public:
     static DeviceScanner& getInstance();
 
     esp_err_t mainFunction();
+    void setMacCacheTtl(MacAddressClass addressClass, uint32_t ttlSeconds);
 };
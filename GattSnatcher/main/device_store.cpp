@@ -0,0 +1,304 @@
+#include "device_store.h"
+#include "uart_frame.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+#define KEY_PRESENT (1ULL << 63)    // keeps the key of address 00:00:00:00:00:00 type 0 non-zero
+
+uint64_t DeviceStore::makeKey(const uint8_t address[6], uint8_t addrType)
+{
+    uint64_t key = addrType;
+    for (int i = 0; i < 6; i++) {
+        key = (key << 8) | address[i];
+    }
+    return key | KEY_PRESENT;
+}
+
+DeviceStore::~DeviceStore()
+{
+    close();
+}
+
+void DeviceStore::encode(const Entry &entry, uint8_t out[DEVICE_STORE_RECORD_SIZE])
+{
+    uint64_t key = entry.key;
+    for (int i = 5; i >= 0; --i) {     // address as in esp_bd_addr_t, then addr_type
+        out[i] = key & 0xFF;
+        key >>= 8;
+    }
+    out[6] = key & 0xFF;
+    out[7] = entry.flags;
+    for (int i = 0; i < 8; i++) {
+        out[8 + i] = (entry.fingerprint >> (8 * i)) & 0xFF;
+    }
+    out[16] = entry.boot & 0xFF;
+    out[17] = entry.boot >> 8;
+    for (int i = 0; i < 4; i++) {
+        out[18 + i] = (entry.timeS >> (8 * i)) & 0xFF;
+    }
+    out[22] = entry.failures & 0xFF;
+    out[23] = entry.failures >> 8;
+    uint16_t crc = uartFrameCrc16(out, 24);
+    out[24] = crc & 0xFF;
+    out[25] = crc >> 8;
+}
+
+bool DeviceStore::decode(const uint8_t in[DEVICE_STORE_RECORD_SIZE], Entry &entry)
+{
+    if (uartFrameCrc16(in, 24) != (uint16_t)(in[24] | (in[25] << 8))) {
+        return false;
+    }
+    entry.key = makeKey(in, in[6]);
+    entry.flags = in[7];
+    entry.fingerprint = 0;
+    for (int i = 7; i >= 0; --i) {
+        entry.fingerprint = (entry.fingerprint << 8) | in[8 + i];
+    }
+    entry.boot = in[16] | (in[17] << 8);
+    entry.timeS = 0;
+    for (int i = 3; i >= 0; --i) {
+        entry.timeS = (entry.timeS << 8) | in[18 + i];
+    }
+    entry.failures = in[22] | (in[23] << 8);
+    return true;
+}
+
+size_t DeviceStore::homeSlot(uint64_t key)
+{
+    // Fibonacci hashing spreads the sequential low bytes of similar addresses
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (SLOTS - 1);
+}
+
+DeviceStore::Entry *DeviceStore::slotFor(uint64_t key)
+{
+    size_t i = homeSlot(key);
+    for (size_t probes = 0; probes < SLOTS; probes++) {
+        Entry &slot = _slots[i];
+        if (slot.key == key || slot.key == 0) {
+            return &slot;
+        }
+        i = (i + 1) & (SLOTS - 1);
+    }
+    return nullptr;
+}
+
+const DeviceStore::Entry *DeviceStore::find(uint64_t key) const
+{
+    Entry *slot = const_cast<DeviceStore *>(this)->slotFor(key);
+    return slot && slot->key == key ? slot : nullptr;
+}
+
+DeviceStore::Entry *DeviceStore::upsert(uint64_t key, bool evict)
+{
+    Entry *slot = slotFor(key);
+    if (slot != nullptr && slot->key == 0 && _count >= CAPACITY && evict && this->evict()) {
+        // the entries moved
+        slot = slotFor(key);
+    }
+    if (slot == nullptr) {
+        return nullptr;
+    }
+    if (slot->key == 0) {
+        if (_count >= CAPACITY) {
+            return nullptr;
+        }
+        *slot = {};
+        slot->key = key;
+        _count++;
+    }
+    return slot;
+}
+
+// Backward-shift deletion, so the probe sequences of the other keys stay intact
+void DeviceStore::erase(Entry *slot)
+{
+    size_t i = slot - _slots;
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & (SLOTS - 1);
+        if (_slots[j].key == 0) {
+            break;
+        }
+        // an entry whose home lies cyclically in (i, j] is still reachable without slot i
+        size_t home = homeSlot(_slots[j].key);
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j)) {
+            continue;
+        }
+        _slots[i] = _slots[j];
+        i = j;
+    }
+    _slots[i] = {};
+    _count--;
+}
+
+bool DeviceStore::evict()
+{
+    // rank: profiled above never profiled, then the latest interrogation; the lowest ranks go
+    auto rank = [](const Entry &e) {
+        return (uint64_t)(e.flags & DEVICE_STORE_FLAG_PROFILED) << 48 | (uint64_t)e.boot << 32 | e.timeS;
+    };
+    const size_t n = std::max<size_t>(CAPACITY / DEVICE_STORE_EVICT_DIVISOR, 1);
+    // max-heap of the n lowest ranks seen so far
+    std::vector<std::pair<uint64_t, uint64_t>> victims;
+    victims.reserve(n);
+    for (const Entry &entry : _slots) {
+        if (entry.key == 0) {
+            continue;
+        }
+        std::pair<uint64_t, uint64_t> v(rank(entry), entry.key);
+        if (victims.size() < n) {
+            victims.push_back(v);
+            std::push_heap(victims.begin(), victims.end());
+        } else if (v < victims.front()) {
+            std::pop_heap(victims.begin(), victims.end());
+            victims.back() = v;
+            std::push_heap(victims.begin(), victims.end());
+        }
+    }
+    if (victims.empty()) {
+        return false;
+    }
+    for (const auto &v : victims) {
+        erase(slotFor(v.second));
+    }
+    _evicted += victims.size();
+    // the log must not bring them back on the next replay
+    compact();
+    return true;
+}
+
+bool DeviceStore::open(const char *path)
+{
+    close();
+    memset(_slots, 0, sizeof(_slots));
+    _count = 0;
+    _logRecords = 0;
+    _droppedRecords = 0;
+    _evicted = 0;
+    snprintf(_path, sizeof(_path), "%s", path);
+
+    bool torn = false;
+    int maxBoot = -1;
+    FILE *f = fopen(_path, "r");
+    if (f != nullptr) {
+        uint8_t rec[DEVICE_STORE_RECORD_SIZE];
+        size_t got;
+        while ((got = fread(rec, 1, sizeof(rec), f)) == sizeof(rec)) {
+            Entry entry;
+            if (!decode(rec, entry)) {
+                torn = true;
+                break;
+            }
+            _logRecords++;
+            if (entry.boot > maxBoot) {
+                maxBoot = entry.boot;
+            }
+            Entry *slot = upsert(entry.key, false);
+            if (slot == nullptr) {
+                _droppedRecords++;
+                continue;
+            }
+            *slot = entry;
+        }
+        torn = torn || got != 0;
+        fclose(f);
+    }
+    _boot = (uint16_t)(maxBoot + 1);
+    if (torn) {
+        // drop everything after the last good record
+        return compact();
+    }
+    _file = fopen(_path, "a");
+    return _file != nullptr;
+}
+
+void DeviceStore::close()
+{
+    if (_file != nullptr) {
+        fclose(_file);
+        _file = nullptr;
+    }
+}
+
+bool DeviceStore::append(const Entry &entry)
+{
+    if (_file == nullptr) {
+        return false;
+    }
+    uint8_t rec[DEVICE_STORE_RECORD_SIZE];
+    encode(entry, rec);
+    if (fwrite(rec, 1, sizeof(rec), _file) != sizeof(rec)) {
+        return false;
+    }
+    fflush(_file);
+    fsync(fileno(_file));
+    _logRecords++;
+    if (_logRecords > DEVICE_STORE_COMPACT_RATIO * _count + CAPACITY / 4) {
+        return compact();
+    }
+    return true;
+}
+
+bool DeviceStore::recordProfiled(uint64_t key, uint64_t fingerprint, uint32_t timeS)
+{
+    Entry *entry = upsert(key);
+    if (entry == nullptr) {
+        return false;
+    }
+    entry->fingerprint = fingerprint;
+    entry->flags |= DEVICE_STORE_FLAG_PROFILED;
+    entry->failures = 0;
+    entry->boot = _boot;
+    entry->timeS = timeS;
+    return append(*entry);
+}
+
+bool DeviceStore::recordFailure(uint64_t key, uint32_t timeS)
+{
+    Entry *entry = upsert(key);
+    if (entry == nullptr) {
+        return false;
+    }
+    if (entry->failures < UINT16_MAX) {
+        entry->failures++;
+    }
+    entry->boot = _boot;
+    entry->timeS = timeS;
+    return append(*entry);
+}
+
+bool DeviceStore::compact()
+{
+    close();
+    char tmpPath[sizeof(_path) + 4];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", _path);
+    FILE *tmp = fopen(tmpPath, "w");
+    if (tmp == nullptr) {
+        return false;
+    }
+    bool ok = true;
+    size_t written = 0;
+    for (const Entry &entry : _slots) {
+        if (entry.key == 0) {
+            continue;
+        }
+        uint8_t rec[DEVICE_STORE_RECORD_SIZE];
+        encode(entry, rec);
+        ok = ok && fwrite(rec, 1, sizeof(rec), tmp) == sizeof(rec);
+        written++;
+    }
+    ok = ok && fflush(tmp) == 0 && fsync(fileno(tmp)) == 0;
+    fclose(tmp);
+    // the old log stays in place until the new one is complete
+    if (!ok || rename(tmpPath, _path) != 0) {
+        remove(tmpPath);
+        _file = fopen(_path, "a");
+        return false;
+    }
+    _logRecords = written;
+    _file = fopen(_path, "a");
+    return _file != nullptr;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#if __has_include("sdkconfig.h")
+#include "sdkconfig.h"
+#endif
+
+#ifndef CONFIG_DEVICE_DB_CAPACITY
+#define CONFIG_DEVICE_DB_CAPACITY 512
+#endif
+
+/**
+ * Log record, DEVICE_STORE_RECORD_SIZE bytes, little endian:
+ *   address(6) addr_type(1) flags(1) fingerprint(8) boot(2) time_s(4) failures(2) crc16(2)
+ * Every record is the complete state of one device; the last one wins on replay.
+ * The CRC (see uartFrameCrc16) covers the first 24 bytes.
+ */
+#define DEVICE_STORE_RECORD_SIZE 26
+#define DEVICE_STORE_FLAG_PROFILED 0x01
+// Compact once the log holds this many times more records than there are devices
+#define DEVICE_STORE_COMPACT_RATIO 4
+// A full store forgets this share (1/n) of its devices to make room
+#define DEVICE_STORE_EVICT_DIVISOR 8
+
+/**
+ * Persistent index of interrogated devices: an append-only log file plus an
+ * open-addressing hash table in RAM, keyed on MAC address and addr_type.
+ *
+ * open() replays the log to rebuild the table. A torn or corrupt tail (a crash in
+ * the middle of a write) ends the replay and the log is compacted right away, so
+ * it never grows past a bad record. Lookups are O(1) and never touch the file.
+ *
+ * When a new device finds the table full, the least valuable 1/DEVICE_STORE_EVICT_DIVISOR
+ * of the devices is forgotten and the log compacted without them: devices that were
+ * never profiled go first, oldest interrogation first, then the oldest profiled ones.
+ *
+ * Times are (boot, seconds since boot): there is no wall clock, so every open()
+ * starts a new boot number, one higher than any in the log.
+ *
+ * Depends on the C standard library only (and uart_frame for the CRC), so it also
+ * builds for the host. Not thread-safe, see DeviceDatabase.
+ */
+class DeviceStore {
+public:
+    static constexpr size_t CAPACITY = CONFIG_DEVICE_DB_CAPACITY;
+
+    struct Entry {
+        uint64_t key;           // see makeKey, 0 marks a free slot
+        uint64_t fingerprint;   // GATT layout of the latest full profile, 0 if never profiled
+        uint32_t timeS;         // latest interrogation, seconds since boot @ref boot
+        uint16_t boot;
+        uint16_t failures;      // failed interrogations since the last successful one
+        uint8_t flags;
+    };
+
+    static uint64_t makeKey(const uint8_t address[6], uint8_t addrType);
+
+    ~DeviceStore();
+
+    // Replays and opens @p path for appending, @return false if the file cannot be opened
+    bool open(const char *path);
+    void close();
+
+    const Entry *find(uint64_t key) const;
+    bool recordProfiled(uint64_t key, uint64_t fingerprint, uint32_t timeS);
+    bool recordFailure(uint64_t key, uint32_t timeS);
+
+    // Rewrites the log with one record per device
+    bool compact();
+
+    size_t size() const { return _count; }
+    size_t logRecords() const { return _logRecords; }
+    uint16_t boot() const { return _boot; }
+    uint32_t droppedRecords() const { return _droppedRecords; }
+    uint32_t evicted() const { return _evicted; }
+
+private:
+    static constexpr size_t SLOTS = [] {
+        size_t n = 1;
+        while (n < CAPACITY + CAPACITY / 2) {
+            n <<= 1;
+        }
+        return n;
+    }();
+
+    static size_t homeSlot(uint64_t key);
+    Entry *slotFor(uint64_t key);   // the key's slot or the free one it would go into, nullptr if full
+    bool append(const Entry &entry);
+    // @p evict makes room in a full table, not during the replay
+    Entry *upsert(uint64_t key, bool evict = true);
+    void erase(Entry *slot);
+    // Forgets the least valuable devices and compacts the log, @return false if nothing could be dropped
+    bool evict();
+    static void encode(const Entry &entry, uint8_t out[DEVICE_STORE_RECORD_SIZE]);
+    static bool decode(const uint8_t in[DEVICE_STORE_RECORD_SIZE], Entry &entry);
+
+    Entry _slots[SLOTS] = {};
+    size_t _count = 0;
+    size_t _logRecords = 0;
+    uint32_t _droppedRecords = 0;   // replayed records that did not fit
+    uint32_t _evicted = 0;
+    uint16_t _boot = 0;
+    FILE *_file = nullptr;
+    char _path[64] = {};
+};
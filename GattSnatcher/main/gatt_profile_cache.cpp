@@ -0,0 +1,247 @@
+#include "gatt_profile_cache.h"
+#include "uart_frame.h"
+
+#include <cstdio>
+#include <esp_log.h>
+#include <unistd.h>
+
+static const char *TAG = "PROFILE_CACHE";
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint64_t fnv1a(uint64_t hash, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t fnv1aUuid(uint64_t hash, const esp_bt_uuid_t &uuid)
+{
+    uint8_t len = (uint8_t)uuid.len;
+    hash = fnv1a(hash, &len, 1);
+    return fnv1a(hash, uuid.uuid.uuid128, uuid.len);
+}
+
+GattProfileCache &GattProfileCache::getInstance()
+{
+    static GattProfileCache instance;
+    return instance;
+}
+
+esp_err_t GattProfileCache::init(const char *path)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_file != nullptr) {
+        fclose(_file);
+        _file = nullptr;
+    }
+    _path = path;
+    if (!load()) {
+        // drop everything after the last good record
+        ESP_LOGW(TAG, "Torn or corrupt record in %s, keeping the %u layouts before it", _path,
+                 (unsigned)_layouts.size());
+        if (!rewrite()) {
+            ESP_LOGE(TAG, "Cannot rewrite %s", _path);
+            return ESP_FAIL;
+        }
+    }
+    _file = fopen(_path, "a");
+    if (_file == nullptr) {
+        ESP_LOGE(TAG, "Cannot open %s for appending", _path);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "%u known GATT layouts", (unsigned)_layouts.size());
+    return ESP_OK;
+}
+
+bool GattProfileCache::load()
+{
+    _layouts.clear();
+    FILE *f = fopen(_path, "r");
+    if (f == nullptr) {
+        return true; // first boot
+    }
+    bool good = true;
+    for (;;) {
+        uint8_t hdr[9];
+        size_t got = fread(hdr, 1, sizeof(hdr), f);
+        if (got != sizeof(hdr)) {
+            good = got == 0;
+            break;
+        }
+        uint16_t crc = uartFrameCrc16(hdr, sizeof(hdr));
+        uint64_t fp = 0;
+        for (int i = 7; i >= 0; --i) {
+            fp = (fp << 8) | hdr[i];
+        }
+        std::vector<StableValue> values(hdr[8]);
+        for (auto &v : values) {
+            uint8_t vh[3];
+            if (fread(vh, 1, sizeof(vh), f) != sizeof(vh)) {
+                good = false;
+                break;
+            }
+            v.uuid = vh[0] | (vh[1] << 8);
+            v.value.resize(vh[2]);
+            if (fread(v.value.data(), 1, vh[2], f) != vh[2]) {
+                good = false;
+                break;
+            }
+            crc = uartFrameCrc16(vh, sizeof(vh), crc);
+            crc = uartFrameCrc16(v.value.data(), v.value.size(), crc);
+        }
+        uint8_t stored[2];
+        if (!good || fread(stored, 1, sizeof(stored), f) != sizeof(stored)
+            || crc != (uint16_t)(stored[0] | (stored[1] << 8))) {
+            good = false;
+            break;
+        }
+        if (_layouts.size() < CONFIG_GATT_PROFILE_CACHE_CAPACITY) {
+            _layouts[fp] = std::move(values);
+        }
+    }
+    fclose(f);
+    return good;
+}
+
+bool GattProfileCache::writeRecord(FILE *file, uint64_t fingerprint, const std::vector<StableValue> &values)
+{
+    std::vector<uint8_t> rec(9);
+    for (int i = 0; i < 8; ++i) {
+        rec[i] = (fingerprint >> (8 * i)) & 0xFF;
+    }
+    rec[8] = (uint8_t)values.size();
+    for (const auto &v : values) {
+        rec.push_back(v.uuid & 0xFF);
+        rec.push_back(v.uuid >> 8);
+        rec.push_back((uint8_t)v.value.size());
+        rec.insert(rec.end(), v.value.begin(), v.value.end());
+    }
+    uint16_t crc = uartFrameCrc16(rec.data(), rec.size());
+    rec.push_back(crc & 0xFF);
+    rec.push_back(crc >> 8);
+    return fwrite(rec.data(), 1, rec.size(), file) == rec.size();
+}
+
+bool GattProfileCache::rewrite()
+{
+    char tmpPath[80];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", _path);
+    FILE *tmp = fopen(tmpPath, "w");
+    if (tmp == nullptr) {
+        return false;
+    }
+    bool ok = true;
+    for (const auto &layout : _layouts) {
+        ok = ok && writeRecord(tmp, layout.first, layout.second);
+    }
+    ok = ok && fflush(tmp) == 0 && fsync(fileno(tmp)) == 0;
+    fclose(tmp);
+    // the old file stays in place until the new one is complete
+    if (!ok || rename(tmpPath, _path) != 0) {
+        remove(tmpPath);
+        return false;
+    }
+    return true;
+}
+
+uint64_t GattProfileCache::fingerprint(const gattc_profile_inst &profile)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (const auto &srv : profile.services) {
+        uint8_t primary = srv.service.is_primary ? 1 : 0;
+        hash = fnv1a(hash, &primary, 1);
+        hash = fnv1aUuid(hash, srv.service.id.uuid);
+        for (const auto &cw : srv.chars) {
+            hash = fnv1aUuid(hash, cw.meta.uuid);
+            hash = fnv1a(hash, &cw.meta.properties, 1);
+        }
+    }
+    return hash;
+}
+
+bool GattProfileCache::isStable(const esp_bt_uuid_t &uuid)
+{
+    if (uuid.len != ESP_UUID_LEN_16) {
+        return false;
+    }
+    switch (uuid.uuid.uuid16) {
+    case 0x2A01:    // Appearance
+    case 0x2A24:    // Model Number String
+    case 0x2A27:    // Hardware Revision String
+    case 0x2A29:    // Manufacturer Name String
+        return true;
+    default:        // firmware and software revisions change with updates, the rest is per device
+        return false;
+    }
+}
+
+size_t GattProfileCache::fillStableValues(gattc_profile_inst &profile, uint64_t fingerprint)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _layouts.find(fingerprint);
+    if (it == _layouts.end()) {
+        return 0;
+    }
+    _hits++;
+    size_t filled = 0;
+    for (auto &srv : profile.services) {
+        for (auto &cw : srv.chars) {
+            if (!isStable(cw.meta.uuid)) {
+                continue;
+            }
+            for (const auto &v : it->second) {
+                if (v.uuid == cw.meta.uuid.uuid.uuid16) {
+                    cw.value = v.value;
+                    cw.readable = false;
+                    cw.cached = true;
+                    filled++;
+                    break;
+                }
+            }
+        }
+    }
+    return filled;
+}
+
+esp_err_t GattProfileCache::addLayout(const gattc_profile_inst &profile, uint64_t fingerprint)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_layouts.count(fingerprint) || _layouts.size() >= CONFIG_GATT_PROFILE_CACHE_CAPACITY) {
+        return ESP_OK;
+    }
+    std::vector<StableValue> values;
+    for (const auto &srv : profile.services) {
+        for (const auto &cw : srv.chars) {
+            // only values that were actually read in full are worth reusing
+            if (isStable(cw.meta.uuid) && !cw.value.empty() && !cw.truncated && values.size() < UINT8_MAX
+                && cw.value.size() <= UINT8_MAX) {
+                values.push_back({cw.meta.uuid.uuid.uuid16, cw.value});
+            }
+        }
+    }
+    if (values.empty()) {
+        return ESP_OK;
+    }
+    if (_file != nullptr) {
+        bool ok = writeRecord(_file, fingerprint, values);
+        fflush(_file);
+        fsync(fileno(_file));
+        if (!ok) {
+            ESP_LOGE(TAG, "Failed writing layout %016llx", (unsigned long long)fingerprint);
+            return ESP_FAIL;
+        }
+    }
+    _layouts[fingerprint] = std::move(values);
+    return ESP_OK;
+}
+
+size_t GattProfileCache::size()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _layouts.size();
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "struct_and_definitions.h"
+#include <esp_err.h>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#if __has_include("sdkconfig.h")
+#include "sdkconfig.h"
+#endif
+
+#ifndef CONFIG_GATT_PROFILE_CACHE_CAPACITY
+#define CONFIG_GATT_PROFILE_CACHE_CAPACITY 256
+#endif
+
+#define GATT_PROFILE_CACHE_PATH "/storage/gatt_profile_cache.bin"
+
+/**
+ * Known GATT layouts, keyed by a fingerprint of the service/characteristic UUID tree,
+ * with the values of the characteristics that are the same on every device sharing
+ * the layout (manufacturer, model, ...).
+ *
+ * When a freshly discovered profile matches a known layout, those characteristics are
+ * filled in from the cache instead of being read. The cache is an append-only file on
+ * LittleFS, replayed on init. A torn or corrupt record (a crash in the middle of a
+ * write) ends the replay and the file is rewritten with the layouts read so far, so
+ * appending never continues after a bad record. Thread-safe.
+ *
+ * File record: fingerprint (8, little endian), value count (1),
+ * per value: 16-bit UUID (2), length (1), value bytes; then crc16 (2, see uartFrameCrc16)
+ * over the record. Files of older firmware, without the CRC, are discarded on init.
+ */
+class GattProfileCache {
+public:
+    static GattProfileCache &getInstance();
+
+    esp_err_t init(const char *path = GATT_PROFILE_CACHE_PATH);
+
+    // FNV-1a over the service and characteristic UUIDs and properties, handles excluded
+    static uint64_t fingerprint(const gattc_profile_inst &profile);
+    // Characteristics whose value is a property of the product rather than of the device
+    static bool isStable(const esp_bt_uuid_t &uuid);
+
+    /**
+     * Copies the cached stable values of a known layout into @p profile and marks
+     * those characteristics as not to be read.
+     * @return number of characteristics filled, 0 if the layout is unknown
+     */
+    size_t fillStableValues(gattc_profile_inst &profile, uint64_t fingerprint);
+
+    // Remembers the stable values of a fully read profile, if its layout is new
+    esp_err_t addLayout(const gattc_profile_inst &profile, uint64_t fingerprint);
+
+    size_t size();
+    uint32_t hits() const { return _hits; }
+
+private:
+    struct StableValue {
+        uint16_t uuid;
+        std::vector<uint8_t> value;
+    };
+
+    GattProfileCache() = default;
+    // @return false if the replay stopped at a torn or corrupt record
+    bool load();
+    // Rewrites the file with the layouts in RAM
+    bool rewrite();
+    static bool writeRecord(FILE *file, uint64_t fingerprint, const std::vector<StableValue> &values);
+
+    std::mutex _mutex;
+    std::unordered_map<uint64_t, std::vector<StableValue>> _layouts;
+    FILE *_file = nullptr;
+    const char *_path = nullptr;
+    uint32_t _hits = 0;
+};
@@ -0,0 +1,72 @@
+#include "gatt_read_policy.h"
+
+#include <cstdlib>
+#include <esp_log.h>
+
+static const char *TAG = "READ_POLICY";
+
+const GattReadPolicy &GattReadPolicy::getInstance()
+{
+    static GattReadPolicy instance;
+    return instance;
+}
+
+GattReadPolicy::GattReadPolicy()
+{
+    _allowCount = parseUuidList(CONFIG_GATT_READ_UUID_ALLOW, _allow, GATT_READ_POLICY_MAX_UUIDS);
+    _denyCount = parseUuidList(CONFIG_GATT_READ_UUID_DENY, _deny, GATT_READ_POLICY_MAX_UUIDS);
+    ESP_LOGI(TAG, "skip properties 0x%02x, %u allowed and %u denied UUIDs, values capped at %u bytes",
+             CONFIG_GATT_READ_SKIP_PROPERTIES, (unsigned)_allowCount, (unsigned)_denyCount,
+             (unsigned)maxValueBytes());
+}
+
+// Comma or space separated hex UUIDs, "0x" prefix optional, e.g. "2a00, 0x2a01"
+size_t GattReadPolicy::parseUuidList(const char *list, uint16_t *out, size_t capacity)
+{
+    size_t count = 0;
+    const char *p = list;
+    while (*p != '\0') {
+        if (*p == ',' || *p == ' ') {
+            p++;
+            continue;
+        }
+        char *end;
+        unsigned long value = strtoul(p, &end, 16);
+        if (end == p || value > 0xFFFF) {
+            ESP_LOGE(TAG, "Bad UUID in list \"%s\"", list);
+            return count;
+        }
+        if (count == capacity) {
+            ESP_LOGE(TAG, "UUID list \"%s\" is longer than %u entries", list, (unsigned)capacity);
+            return count;
+        }
+        out[count++] = (uint16_t)value;
+        p = end;
+    }
+    return count;
+}
+
+bool GattReadPolicy::contains(const uint16_t *list, size_t count, uint16_t uuid)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (list[i] == uuid) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GattReadPolicy::shouldRead(const esp_gattc_char_elem_t &meta) const
+{
+    if (!(meta.properties & ESP_GATT_CHAR_PROP_BIT_READ)
+        || (meta.properties & CONFIG_GATT_READ_SKIP_PROPERTIES)) {
+        return false;
+    }
+    if (meta.uuid.len != ESP_UUID_LEN_16) {
+        return true;
+    }
+    if (_allowCount > 0 && !contains(_allow, _allowCount, meta.uuid.uuid.uuid16)) {
+        return false;
+    }
+    return !contains(_deny, _denyCount, meta.uuid.uuid.uuid16);
+}
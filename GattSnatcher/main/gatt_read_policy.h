@@ -0,0 +1,48 @@
+#pragma once
+#include <esp_gattc_api.h>
+#include <cstddef>
+#include <cstdint>
+#if __has_include("sdkconfig.h")
+#include "sdkconfig.h"
+#endif
+
+#ifndef CONFIG_GATT_READ_SKIP_PROPERTIES
+#define CONFIG_GATT_READ_SKIP_PROPERTIES 0x00
+#endif
+#ifndef CONFIG_GATT_READ_UUID_ALLOW
+#define CONFIG_GATT_READ_UUID_ALLOW ""
+#endif
+#ifndef CONFIG_GATT_READ_UUID_DENY
+#define CONFIG_GATT_READ_UUID_DENY ""
+#endif
+#ifndef CONFIG_GATT_READ_MAX_VALUE_BYTES
+#define CONFIG_GATT_READ_MAX_VALUE_BYTES 64
+#endif
+
+#define GATT_READ_POLICY_MAX_UUIDS 16
+
+/**
+ * Decides which discovered characteristics get their value read, and how much of it is kept.
+ *
+ * A characteristic is read if it has the READ property, none of the properties in
+ * GATT_READ_SKIP_PROPERTIES, its 16-bit UUID is on the allow list (an empty list allows
+ * everything) and not on the deny list. 128-bit UUIDs are only subject to the property check.
+ * The lists are parsed once from Kconfig.
+ */
+class GattReadPolicy {
+public:
+    static const GattReadPolicy &getInstance();
+
+    bool shouldRead(const esp_gattc_char_elem_t &meta) const;
+    size_t maxValueBytes() const { return CONFIG_GATT_READ_MAX_VALUE_BYTES; }
+
+private:
+    GattReadPolicy();
+    static size_t parseUuidList(const char *list, uint16_t *out, size_t capacity);
+    static bool contains(const uint16_t *list, size_t count, uint16_t uuid);
+
+    uint16_t _allow[GATT_READ_POLICY_MAX_UUIDS];
+    size_t _allowCount;
+    uint16_t _deny[GATT_READ_POLICY_MAX_UUIDS];
+    size_t _denyCount;
+};
@@ -3,151 +3,245 @@
 #include "hci_event_parser.h"
 #include "esp_log.h"
 #include <cstring>
-#include <device_scanner.h>
 #include <esp_err.h>
 
 #include "bt_hci_common.h"
 
 static const char *TAG = "HCI EVENT PARSER";
 
-esp_err_t HciEventParser::fillAdvReport(hci_data_t & hciData, LeAdvertisingReport &advReport) {
-    // ESP_LOGI(TAG, "Starting AdvReport");
+// Per report: event type, address type, address, data length, RSSI (data itself comes on top)
+static constexpr uint16_t ADV_REPORT_FIXED_SIZE = 1 + 1 + 6 + 1 + 1;
+static constexpr uint8_t LEGACY_ADV_DATA_MAX = 31;
+// Per extended report: event type(2), address type, address(6), primary PHY, secondary PHY, SID,
+// TX power, RSSI, periodic interval(2), direct address type, direct address(6), data length
+static constexpr uint16_t EXT_ADV_REPORT_FIXED_SIZE = 2 + 1 + 6 + 1 + 1 + 1 + 1 + 1 + 2 + 1 + 6 + 1;
 
+uint8_t HciEventParser::leMetaSubevent(const hci_data_t & hciData) {
+    if (hciData.data == NULL || hciData.len < 4) {
+        return 0;
+    }
+    if (hciData.data[0] != H4_TYPE_EVENT || hciData.data[1] != LE_META_EVENTS) {
+        return 0;
+    }
+    return hciData.data[3];
+}
+
+esp_err_t HciEventParser::parseAdvReportView(const hci_data_t & hciData, LeAdvertisingReportView &view) {
     if (hciData.data == NULL || hciData.len == 0) {
         return ESP_ERR_INVALID_STATE;
     }
 
-    uint8_t *cursor = hciData.data;
-    uint8_t *end = hciData.data + hciData.len; // pointer to the end of the data buffer
+    const uint8_t *begin = hciData.data;
+    const uint8_t *cursor = begin;
+    const uint8_t *end = begin + hciData.len; // pointer to the end of the data buffer
 
-    // Check for H4_TYPE_EVENT (1 byte)
-    // if (cursor + 1 > end) return ESP_ERR_INVALID_SIZE;
-    if (*cursor != H4_TYPE_EVENT) {
+    // H4 type, event code, parameter total length, subevent code, report count
+    if (end - cursor < 5) return ESP_ERR_INVALID_SIZE;
+    if (cursor[0] != H4_TYPE_EVENT || cursor[1] != LE_META_EVENTS) {
         return ESP_ERR_NOT_FOUND;
     }
-    cursor++; // Skip H4 header
-
-    // Check for LE_META_EVENTS (1 byte)
-    // if (cursor + 1 > end) return ESP_ERR_INVALID_SIZE
-    if (*cursor != LE_META_EVENTS) {
+    uint8_t param_len = cursor[2];
+    if (param_len > end - (cursor + 3)) return ESP_ERR_INVALID_SIZE;
+    end = cursor + 3 + param_len; // never read past what the controller declared
+    if (cursor[3] != HCI_LE_ADV_REPORT) {
         return ESP_ERR_NOT_FOUND;
     }
-    cursor++; // Skip event code
+    uint8_t report_count = cursor[4];
+    if (report_count < 1 || report_count > MAX_NUM_REPORTS) {
+        ESP_LOGE(TAG, "Invalid report count: %u", report_count);
+        return ESP_FAIL;
+    }
+    cursor += 5;
 
-    // Skip parameter total length (1 byte)
-    // if (cursor + 1 > end) return ESP_ERR_INVALID_SIZE;
-    cursor++;
+    for (uint8_t i = 0; i < report_count; i++) {
+        if (end - cursor < ADV_REPORT_FIXED_SIZE) return ESP_ERR_INVALID_SIZE;
+        auto &r = view.reports[i];
+        r.adv_event_type = cursor[0];
+        r.addr_type = cursor[1];
+        r.bdaddr_offset = (uint16_t)(cursor + 2 - begin);
+        r.adv_data_length = cursor[8];
+        cursor += 9;
+
+        if (r.adv_data_length > LEGACY_ADV_DATA_MAX) return ESP_ERR_INVALID_SIZE;
+        if (end - cursor < r.adv_data_length + 1) return ESP_ERR_INVALID_SIZE;
+        r.adv_data_offset = (uint16_t)(cursor - begin);
+        cursor += r.adv_data_length;
+
+        r.rssi = (int8_t)*cursor;
+        cursor++;
+    }
 
-    // Check for HCI_LE_ADV_REPORT (1 byte)
-    // if (cursor + 1 > end) return ESP_ERR_INVALID_SIZE;
-    if (*cursor != HCI_LE_ADV_REPORT) {
-        return ESP_ERR_NOT_FOUND;
+    view.timestamp = hciData.timestamp;
+    view.data = begin;
+    view.len = hciData.len;
+    view.num_reports = report_count;
+    return ESP_OK;
+}
+
+esp_err_t HciEventParser::parseExtAdvReportView(const hci_data_t & hciData, LeExtAdvertisingReportView &view) {
+    if (hciData.data == NULL || hciData.len == 0) {
+        return ESP_ERR_INVALID_STATE;
     }
-    cursor++; // Skip subevent code
 
-    advReport.timestamp = hciData.timestamp;
+    const uint8_t *begin = hciData.data;
+    const uint8_t *cursor = begin;
+    const uint8_t *end = begin + hciData.len;
 
-    // Get report count (1 byte)
-    // if (cursor + 1 > end) return ESP_ERR_INVALID_SIZE;
-    uint8_t report_count = *cursor;
-    if (report_count < 1 || report_count > MAX_NUM_REPORTS) {
-        ESP_LOGE(TAG, "Invalid report count: %u", report_count);
+    // H4 type, event code, parameter total length, subevent code, report count
+    if (end - cursor < 5) return ESP_ERR_INVALID_SIZE;
+    if (cursor[0] != H4_TYPE_EVENT || cursor[1] != LE_META_EVENTS) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint8_t param_len = cursor[2];
+    if (param_len > end - (cursor + 3)) return ESP_ERR_INVALID_SIZE;
+    end = cursor + 3 + param_len;
+    if (cursor[3] != HCI_LE_EXT_ADV_REPORT) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint8_t report_count = cursor[4];
+    if (report_count < 1 || report_count > MAX_NUM_EXT_REPORTS) {
+        ESP_LOGE(TAG, "Invalid extended report count: %u", report_count);
         return ESP_FAIL;
     }
-    advReport.num_reports = report_count;
-    cursor++; // Skip report count
+    cursor += 5;
 
     for (uint8_t i = 0; i < report_count; i++) {
-        // Advertising event type (1 byte)
-        // if (cursor + 1 > end) return ESP_ERR_INVALID_SIZE;
-        advReport.reports[i].adv_event_type = *cursor;
-        cursor++;
+        if (end - cursor < EXT_ADV_REPORT_FIXED_SIZE) return ESP_ERR_INVALID_SIZE;
+        auto &r = view.reports[i];
+        r.event_type = (uint16_t)(cursor[0] | (cursor[1] << 8));
+        r.addr_type = cursor[2];
+        r.bdaddr_offset = (uint16_t)(cursor + 3 - begin);
+        r.primary_phy = cursor[9];
+        r.secondary_phy = cursor[10];
+        r.sid = cursor[11];
+        r.tx_power = (int8_t)cursor[12];
+        r.rssi = (int8_t)cursor[13];
+        r.periodic_adv_interval = (uint16_t)(cursor[14] | (cursor[15] << 8));
+        // direct address type and direct address (cursor[16..22]) are not stored
+        r.adv_data_length = cursor[23];
+        cursor += EXT_ADV_REPORT_FIXED_SIZE;
+
+        if (end - cursor < r.adv_data_length) return ESP_ERR_INVALID_SIZE;
+        r.adv_data_offset = (uint16_t)(cursor - begin);
+        cursor += r.adv_data_length;
+    }
 
-        // Address type (1 byte)
-        // if (cursor + 1 > end) return ESP_ERR_INVALID_SIZE;
-        advReport.reports[i].addr_type = (esp_ble_addr_type_t) *cursor;
-        cursor++;
+    view.timestamp = hciData.timestamp;
+    view.data = begin;
+    view.len = hciData.len;
+    view.num_reports = report_count;
+    return ESP_OK;
+}
 
-        // Bluetooth address (6 bytes)
-        // if (cursor + 6 > end) return ESP_ERR_INVALID_SIZE;
-        sprintf(advReport.reports[i].bdaddr_str, "%02x:%02x:%02x:%02x:%02x:%02x",
-                cursor[5], cursor[4], cursor[3], cursor[2], cursor[1], cursor[0]);
-        // Copy raw 6-byte BD_ADDR
-        memcpy(advReport.reports[i].raw_bdaddr, cursor, 6);
-        cursor += 6;
-        // Advertisement data length (1 byte)
-        // if (cursor + 1 > end) return ESP_ERR_INVALID_SIZE;
-        advReport.reports[i].adv_data_length = *cursor;
-        cursor++;
+esp_err_t HciEventParser::fillAdvReport(hci_data_t & hciData, LeAdvertisingReport &advReport) {
+    LeAdvertisingReportView view;
+    ERR_GUARD(parseAdvReportView(hciData, view));
+
+    advReport.timestamp = view.timestamp;
+    advReport.num_reports = view.num_reports;
+    for (uint8_t i = 0; i < view.num_reports; i++) {
+        view.toSingleReport(i, advReport.reports[i]);
+    }
+    return ESP_OK;
+}
 
-        // Advertisement data (variable length)
-        // if (cursor + advReport.reports[i].adv_data_length > end) return ESP_ERR_INVALID_SIZE;
-        if (advReport.reports[i].adv_data_length > sizeof(advReport.reports[i].adv_data)) {
-            advReport.reports[i].adv_data_length = sizeof(advReport.reports[i].adv_data);
+bool ExtAdvReassembler::add(const LeExtAdvertisingReportView &view, uint8_t index,
+                            const LeExtAdvertisingReportView *&out, uint8_t &outIndex)
+{
+    expire(view.timestamp);
+    uint8_t status = EXT_ADV_DATA_STATUS(view.reports[index].event_type);
+    Slot *slot = find(view, index);
+    if (slot == nullptr) {
+        if (status == EXT_ADV_DATA_MORE) {
+            start(view, index);
+            return false;
         }
-        memcpy(advReport.reports[i].adv_data, cursor, advReport.reports[i].adv_data_length);
-        cursor += advReport.reports[i].adv_data_length;
+        // the common case, a report that is complete on its own
+        out = &view;
+        outIndex = index;
+        return true;
+    }
+    append(*slot, view, index);
+    slot->lastSeen = view.timestamp;
+    if (status == EXT_ADV_DATA_MORE) {
+        return false;
+    }
 
-        // RSSI (1 byte)
-        // if (cursor + 1 > end) return ESP_ERR_INVALID_SIZE;
-        advReport.reports[i].rssi = (int8_t)*cursor;
-        cursor++;
+    slot->used = false;
+    _stats.assembled++;
+    if (slot->overflow) {
+        status = EXT_ADV_DATA_TRUNCATED;
+        _stats.truncated++;
     }
+    _out.timestamp = slot->timestamp;
+    _out.data = slot->data;
+    _out.len = (uint16_t)(6 + slot->report.adv_data_length);
+    _out.num_reports = 1;
+    _out.reports[0] = slot->report;
+    _out.reports[0].event_type = (uint16_t)((slot->report.event_type & ~0x0060) | (status << 5));
+    out = &_out;
+    outIndex = 0;
+    return true;
+}
 
-    return ESP_OK;
+ExtAdvReassembler::Slot *ExtAdvReassembler::find(const LeExtAdvertisingReportView &view, uint8_t index)
+{
+    const auto &r = view.reports[index];
+    for (Slot &slot : _slots) {
+        if (slot.used && slot.report.addr_type == r.addr_type && slot.report.sid == r.sid
+            && memcmp(slot.data, view.bdaddr(index), 6) == 0) {
+            return &slot;
+        }
+    }
+    return nullptr;
 }
 
+ExtAdvReassembler::Slot *ExtAdvReassembler::start(const LeExtAdvertisingReportView &view, uint8_t index)
+{
+    Slot *slot = &_slots[0];
+    for (Slot &candidate : _slots) {
+        if (!candidate.used) {
+            slot = &candidate;
+            break;
+        }
+        if (candidate.lastSeen < slot->lastSeen) {
+            slot = &candidate;
+        }
+    }
+    if (slot->used) {
+        _stats.dropped++;
+    }
+    slot->used = true;
+    slot->overflow = false;
+    slot->timestamp = view.timestamp;
+    slot->lastSeen = view.timestamp;
+    slot->report = view.reports[index];
+    slot->report.bdaddr_offset = 0;
+    slot->report.adv_data_offset = 6;
+    slot->report.adv_data_length = 0;
+    memcpy(slot->data, view.bdaddr(index), 6);
+    append(*slot, view, index);
+    return slot;
+}
 
-bool HciEventParser::parseAdvReportFromString(const char *adv_str, LeAdvertisingSingleReportWithTimestamp &report) {
-    // Copy input since strtok_r modifies the string
-    char buf[256];
-    strncpy(buf, adv_str, sizeof(buf));
-    buf[sizeof(buf)-1] = '\0';
-
-    char *token = nullptr;
-    char *rest = buf;
-
-    // Parse timestamp
-    token = strtok_r(rest, ",", &rest);
-    if (!token) return false;
-    report.timestamp = static_cast<int64_t>(atoll(token));
-
-    // Parse adv_event_type
-    token = strtok_r(nullptr, ",", &rest);
-    if (!token) return false;
-    report.adv_event_type = static_cast<uint8_t>(atoi(token));
-
-    // Parse addr_type
-    token = strtok_r(nullptr, ",", &rest);
-    if (!token) return false;
-    report.addr_type = static_cast<esp_ble_addr_type_t>(atoi(token));
-
-    // Parse bdaddr_str
-    token = strtok_r(nullptr, ",", &rest);
-    if (!token) return false;
-    strncpy(report.bdaddr_str, token, sizeof(report.bdaddr_str));
-    report.bdaddr_str[sizeof(report.bdaddr_str)-1] = '\0';
-
-    // Parse adv_data_length
-    token = strtok_r(nullptr, ",", &rest);
-    if (!token) return false;
-    report.adv_data_length = static_cast<uint8_t>(atoi(token));
-
-    // Parse rssi
-    token = strtok_r(nullptr, ",", &rest);
-    if (!token) return false;
-    report.rssi = static_cast<int8_t>(atoi(token));
-
-    // Parse optional filename (rest of string, no commas in filename)
-    if (rest && *rest != '\0') {
-        size_t len = strlen(rest);
-        // Trim trailing newline if present
-        if (len > 0 && rest[len-1] == '\n') rest[len-1] = '\0';
-        strncpy(report.advertisementFilename, rest, sizeof(report.advertisementFilename));
-        report.advertisementFilename[sizeof(report.advertisementFilename)-1] = '\0';
-    } else {
-        report.advertisementFilename[0] = '\0';
+void ExtAdvReassembler::append(Slot &slot, const LeExtAdvertisingReportView &view, uint8_t index)
+{
+    size_t len = view.reports[index].adv_data_length;
+    size_t room = UINT8_MAX - slot.report.adv_data_length;
+    if (len > room) {
+        len = room;
+        slot.overflow = true;
     }
+    memcpy(slot.data + 6 + slot.report.adv_data_length, view.advData(index), len);
+    slot.report.adv_data_length = (uint8_t)(slot.report.adv_data_length + len);
+}
 
-    return true;
-}
\ No newline at end of file
+void ExtAdvReassembler::expire(int64_t now)
+{
+    for (Slot &slot : _slots) {
+        if (slot.used && now - slot.lastSeen > EXT_ADV_REASSEMBLY_TIMEOUT_US) {
+            slot.used = false;
+            _stats.dropped++;
+        }
+    }
+}
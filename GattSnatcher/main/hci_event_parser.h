@@ -5,10 +5,92 @@
 #include <esp_bt_defs.h>
 #include <esp_err.h>
 
+#ifndef HCI_LE_EXT_ADV_REPORT
+#define HCI_LE_EXT_ADV_REPORT 0x0D
+#endif
+
+// Data status, bits 5-6 of an extended report's event_type [Vol. 4, Part E, 7.7.65.13]
+#define EXT_ADV_DATA_STATUS(eventType) (((eventType) >> 5) & 0x03)
+#define EXT_ADV_DATA_COMPLETE 0
+#define EXT_ADV_DATA_MORE 1         // more fragments of this advertisement follow
+#define EXT_ADV_DATA_TRUNCATED 2    // the controller gave up, no more fragments follow
+
+// Advertisements being reassembled at the same time, each ~300 B
+#define EXT_ADV_REASSEMBLY_SLOTS 4
+// A chain is sent within a few ms on air; a fragment older than this lost its continuation
+#define EXT_ADV_REASSEMBLY_TIMEOUT_US 500000
 
 class HciEventParser {
 public:
+    /**
+     * @return the LE meta subevent code of hciData, or 0 if it is not a well-formed LE meta event.
+     */
+    static uint8_t leMetaSubevent(const hci_data_t & hciData);
+    /**
+     * Validates an HCI LE Advertising Report event and fills a view pointing into hciData.
+     * Nothing is copied; the view is only valid while hciData.data is.
+     * @return ESP_ERR_NOT_FOUND for other events, ESP_ERR_INVALID_SIZE for truncated or inconsistent ones.
+     */
+    static esp_err_t parseAdvReportView(const hci_data_t & hciData, LeAdvertisingReportView &view);
+    /**
+     * Same as parseAdvReportView for HCI LE Extended Advertising Report events.
+     */
+    static esp_err_t parseExtAdvReportView(const hci_data_t & hciData, LeExtAdvertisingReportView &view);
     static esp_err_t fillAdvReport(hci_data_t & hciData ,LeAdvertisingReport &advReport);
-    static bool parseAdvReportFromString(const char *adv_str, LeAdvertisingSingleReportWithTimestamp &report);
 
 };
+
+/**
+ * Joins extended advertising data the controller delivers in several reports.
+ *
+ * A report with data status EXT_ADV_DATA_MORE is copied into a slot keyed by
+ * address and SID, and the following reports of that advertiser are appended
+ * until one arrives with another status; only then is the advertisement handed
+ * out, with the fields of its first fragment and the status of its last. Reports
+ * that are not part of a chain are handed out as they are, without copying.
+ *
+ * The records hold at most UINT8_MAX data bytes, so longer advertisements are cut
+ * there and marked EXT_ADV_DATA_TRUNCATED. A chain that is not continued within
+ * EXT_ADV_REASSEMBLY_TIMEOUT_US, or whose slot is needed for a newer chain while
+ * all are in use, is dropped.
+ *
+ * Standard C++ only, builds for the host. Not thread-safe.
+ */
+class ExtAdvReassembler {
+public:
+    struct Stats {
+        uint32_t assembled;     // advertisements joined from several reports
+        uint32_t truncated;     // of those, cut at UINT8_MAX bytes
+        uint32_t dropped;       // chains that never completed
+    };
+
+    /**
+     * Feeds report @p index of @p view.
+     * @return false if it is an incomplete fragment, which is kept; true if an advertisement
+     *         is complete, @p out / @p outIndex then point at it: at the report itself or at
+     *         the assembled one, which stays valid until the next add()
+     */
+    bool add(const LeExtAdvertisingReportView &view, uint8_t index,
+             const LeExtAdvertisingReportView *&out, uint8_t &outIndex);
+
+    Stats stats() const { return _stats; }
+
+private:
+    struct Slot {
+        bool used;
+        bool overflow;
+        int64_t timestamp;              // of the first fragment
+        int64_t lastSeen;
+        LeExtAdvertisingSingleReportView report;
+        uint8_t data[6 + UINT8_MAX];    // bdaddr, then the data joined so far
+    };
+
+    Slot *find(const LeExtAdvertisingReportView &view, uint8_t index);
+    Slot *start(const LeExtAdvertisingReportView &view, uint8_t index);
+    static void append(Slot &slot, const LeExtAdvertisingReportView &view, uint8_t index);
+    void expire(int64_t now);
+
+    Slot _slots[EXT_ADV_REASSEMBLY_SLOTS] = {};
+    LeExtAdvertisingReportView _out = {};
+    Stats _stats = {};
+};
@@ -0,0 +1,107 @@
+#include "hci_ring_buffer.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <esp_log.h>
+
+static const char *TAG = "HCI RING";
+
+HciRingBuffer::~HciRingBuffer() {
+    free(_buffer);
+}
+
+esp_err_t HciRingBuffer::init(size_t capacity) {
+    if (_buffer != nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    if (rounded < 2 * recordSize(HCI_EVENT_MAX_SIZE)) {
+        ESP_LOGE(TAG, "Ring capacity %u cannot hold two maximum sized HCI events", (unsigned)rounded);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    _buffer = (uint8_t *)malloc(rounded);
+    if (_buffer == nullptr) {
+        ESP_LOGE(TAG, "Cannot allocate %u bytes for HCI ring", (unsigned)rounded);
+        return ESP_ERR_NO_MEM;
+    }
+    _capacity = rounded;
+    _mask = rounded - 1;
+    _head.store(0, std::memory_order_relaxed);
+    _tail.store(0, std::memory_order_relaxed);
+    _read = 0;
+    return ESP_OK;
+}
+
+bool HciRingBuffer::push(const uint8_t *data, uint16_t len, int64_t timestamp) {
+    if (__builtin_expect(len > HCI_EVENT_MAX_SIZE, false)) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    const uint32_t head = _head.load(std::memory_order_relaxed);
+    const uint32_t tail = _tail.load(std::memory_order_acquire);
+    const size_t used = head - tail;
+    const size_t offset = head & _mask;
+    const size_t contiguous = _capacity - offset;
+    const size_t need = recordSize(len);
+
+    // A record never straddles the end of the buffer. If it does not fit,
+    // the remainder of the buffer is skipped and the record starts at 0.
+    size_t skip = 0;
+    if (contiguous < need) {
+        skip = contiguous;
+    }
+    if (used + skip + need > _capacity) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (skip != 0 && skip >= HEADER_SIZE) {
+        // Tell the consumer to jump to the start. Shorter gaps are implied.
+        HciRingRecordHeader marker = {0, WRAP_MARKER, 0};
+        memcpy(_buffer + offset, &marker, HEADER_SIZE);
+    }
+    uint8_t *record = _buffer + ((head + skip) & _mask);
+    HciRingRecordHeader hdr = {timestamp, len, 0};
+    memcpy(record, &hdr, HEADER_SIZE);
+    memcpy(record + HEADER_SIZE, data, len);
+
+    _head.store(head + skip + need, std::memory_order_release);
+    if (used + skip + need > _highWatermark) {
+        _highWatermark = used + skip + need;
+    }
+    return true;
+}
+
+bool HciRingBuffer::acquire(hci_data_t &hciData) {
+    const uint32_t head = _head.load(std::memory_order_acquire);
+    while (_read != head) {
+        const size_t offset = _read & _mask;
+        const size_t contiguous = _capacity - offset;
+        if (contiguous < HEADER_SIZE) {
+            _read += contiguous;
+            continue;
+        }
+        HciRingRecordHeader hdr;
+        memcpy(&hdr, _buffer + offset, HEADER_SIZE);
+        if (hdr.len == WRAP_MARKER) {
+            _read += contiguous;
+            continue;
+        }
+        hciData.timestamp = hdr.timestamp;
+        hciData.len = hdr.len;
+        hciData.data = _buffer + offset + HEADER_SIZE;
+        _read += recordSize(hdr.len);
+        return true;
+    }
+    return false;
+}
+
+void HciRingBuffer::release() {
+    _tail.store(_read, std::memory_order_release);
+}
+
+bool HciRingBuffer::empty() const {
+    return _head.load(std::memory_order_acquire) == _read;
+}
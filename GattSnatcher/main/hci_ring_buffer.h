@@ -0,0 +1,81 @@
+#pragma once
+#include "struct_and_definitions.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <esp_err.h>
+
+/**
+ * Single-producer / single-consumer byte ring holding whole HCI packets.
+ *
+ * Producer is the VHCI controller callback (DeviceScanner::controllerOutRdy),
+ * consumer is the HCI processing task. Each packet is stored contiguously as
+ * [HciRingRecordHeader][payload], padded to 4 bytes, so the consumer can parse it
+ * in place without copying it out of the ring.
+ *
+ * Ownership is explicit: bytes between tail and head belong to the consumer,
+ * everything else belongs to the producer. The producer only ever writes _head,
+ * the consumer only ever writes _tail.
+ */
+class HciRingBuffer {
+public:
+    HciRingBuffer() = default;
+    ~HciRingBuffer();
+    HciRingBuffer(const HciRingBuffer&) = delete;
+    HciRingBuffer& operator=(const HciRingBuffer&) = delete;
+
+    /**
+     * Allocate the storage. Capacity is rounded up to a power of two.
+     */
+    esp_err_t init(size_t capacity);
+
+    /**
+     * Producer side. Copies the packet into the ring.
+     * @return false if there is not enough free space (packet dropped).
+     */
+    bool push(const uint8_t *data, uint16_t len, int64_t timestamp);
+
+    /**
+     * Consumer side. Points hciData at the next unread packet inside the ring.
+     * The packet stays valid until release() is called, so several packets
+     * may be acquired before releasing them all at once.
+     * @return false if no packet is pending.
+     */
+    bool acquire(hci_data_t &hciData);
+
+    /**
+     * Consumer side. Hands every acquired packet back to the producer.
+     */
+    void release();
+
+    bool empty() const;
+    size_t capacity() const { return _capacity; }
+    uint32_t droppedCount() const { return _dropped.load(std::memory_order_relaxed); }
+    uint32_t highWatermark() const { return _highWatermark; }
+
+private:
+    struct HciRingRecordHeader {
+        int64_t timestamp;
+        uint16_t len;
+        uint16_t reserved;
+    };
+    static constexpr uint16_t WRAP_MARKER = 0xFFFF;
+    static constexpr size_t HEADER_SIZE = sizeof(HciRingRecordHeader);
+    static constexpr size_t ALIGNMENT = 4;
+
+    static size_t recordSize(uint16_t len) {
+        return (HEADER_SIZE + len + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    uint8_t *_buffer = nullptr;
+    size_t _capacity = 0;
+    size_t _mask = 0;
+
+    // Free running positions, reduced with _mask when indexing
+    std::atomic<uint32_t> _head{0};  // written by producer only
+    std::atomic<uint32_t> _tail{0};  // written by consumer only
+    uint32_t _read = 0;              // consumer-private, acquired but not yet released
+
+    std::atomic<uint32_t> _dropped{0};
+    uint32_t _highWatermark = 0;     // producer-private
+};
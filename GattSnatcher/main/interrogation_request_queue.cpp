@@ -0,0 +1,201 @@
+#include "interrogation_request_queue.h"
+
+#include <cstdint>
+#include <cstring>
+
+InterrogationRequestQueue::InterrogationRequestQueue()
+    : _reprofileWindowUs((int64_t)CONFIG_INTERROGATION_REPROFILE_WINDOW_MIN * 60 * 1000000),
+      _staleUs((int64_t)CONFIG_INTERROGATION_STALE_SEC * 1000000)
+{
+}
+
+bool InterrogationRequestQueue::sameKey(const Key &key, const esp_bd_addr_t address, esp_ble_addr_type_t addrType)
+{
+    return key.addrType == addrType && memcmp(key.address, address, sizeof(esp_bd_addr_t)) == 0;
+}
+
+int InterrogationRequestQueue::findInFlight(const esp_bd_addr_t address, esp_ble_addr_type_t addrType) const
+{
+    for (size_t i = 0; i < _inFlightCount; i++) {
+        if (sameKey(_inFlight[i], address, addrType)) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+bool InterrogationRequestQueue::findHistory(const esp_bd_addr_t address, esp_ble_addr_type_t addrType,
+                                            DeviceStore::Entry &entry) const
+{
+    return _history && _history(address, addrType, entry);
+}
+
+// The latest interrogation was a full profile, taken in this boot less than the window ago
+bool InterrogationRequestQueue::profiledWithinWindow(const DeviceStore::Entry &entry, int64_t now) const
+{
+    if (!(entry.flags & DEVICE_STORE_FLAG_PROFILED) || entry.failures != 0 || entry.boot != _historyBoot) {
+        return false;
+    }
+    return now - (int64_t)entry.timeS * 1000000 < _reprofileWindowUs;
+}
+
+// Higher goes first. A strong signal, a device never tried before and a recent
+// sighting raise the score; every failed attempt lowers it, much more so for weak
+// devices, which mostly end in the CONNECTION_OPEN_TIMEOUT_SECONDS timeout.
+int32_t InterrogationRequestQueue::score(const interrogation_request_t &request, int64_t now) const
+{
+    int32_t s = request.rssi * SCORE_RSSI_WEIGHT;
+    s -= (int32_t)((now - request.seen_at) / 1000000) * SCORE_AGE_PENALTY_PER_SEC;
+    DeviceStore::Entry history;
+    if (!findHistory(request.address, request.addr_type, history)) {
+        return s + SCORE_NEW_DEVICE_BONUS;
+    }
+    int failures = history.failures < SCORE_MAX_COUNTED_FAILURES ? history.failures : SCORE_MAX_COUNTED_FAILURES;
+    s -= failures * SCORE_FAILURE_PENALTY;
+    if (failures > 0 && request.rssi < SCORE_WEAK_RSSI) {
+        s -= SCORE_WEAK_FAILING_PENALTY;
+    }
+    return s;
+}
+
+void InterrogationRequestQueue::removePending(size_t i)
+{
+    _pending[i] = _pending[--_count];
+}
+
+esp_err_t InterrogationRequestQueue::push(const interrogation_request_t &request, int64_t now)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t i = 0; i < _count; i++) {
+        interrogation_request_t &waiting = _pending[i];
+        if (waiting.addr_type == request.addr_type
+            && memcmp(waiting.address, request.address, sizeof(esp_bd_addr_t)) == 0) {
+            if (request.timestamp >= waiting.timestamp) {
+                waiting.timestamp = request.timestamp;
+                waiting.rssi = request.rssi;
+                memcpy(waiting.advertisementFilename, request.advertisementFilename,
+                       sizeof(waiting.advertisementFilename));
+            }
+            waiting.seen_at = now;
+            _stats.coalesced++;
+            return ESP_OK;
+        }
+    }
+    if (findInFlight(request.address, request.addr_type) >= 0) {
+        _stats.rejectedInFlight++;
+        return ESP_OK;
+    }
+    DeviceStore::Entry history;
+    if (findHistory(request.address, request.addr_type, history) && profiledWithinWindow(history, now)) {
+        _stats.rejectedRecent++;
+        return ESP_OK;
+    }
+    if (_count == CAPACITY) {
+        _stats.droppedFull++;
+        return ESP_ERR_NO_MEM;
+    }
+    interrogation_request_t &slot = _pending[_count++];
+    slot = request;
+    slot.queued_at = now;
+    slot.seen_at = now;
+    _stats.enqueued++;
+    return ESP_OK;
+}
+
+bool InterrogationRequestQueue::pop(interrogation_request_t &request, int64_t now)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t best = 0;
+    int32_t bestScore = INT32_MIN;
+    size_t i = 0;
+    while (i < _count) {
+        const interrogation_request_t &candidate = _pending[i];
+        if (now - candidate.seen_at > _staleUs) {
+            // The device has most likely moved away or rotated its address
+            _stats.expired++;
+            removePending(i);
+            continue;
+        }
+        int32_t s = score(candidate, now);
+        // Ties go to the request that has been waiting longer
+        if (s > bestScore || (s == bestScore && candidate.queued_at < _pending[best].queued_at)) {
+            best = i;
+            bestScore = s;
+        }
+        i++;
+    }
+    if (_count == 0) {
+        return false;
+    }
+    request = _pending[best];
+    removePending(best);
+    // Without a free slot the device simply is not protected against duplicates while in flight
+    if (_inFlightCount < INTERROGATION_MAX_IN_FLIGHT) {
+        Key &key = _inFlight[_inFlightCount++];
+        memcpy(key.address, request.address, sizeof(key.address));
+        key.addrType = request.addr_type;
+    }
+    return true;
+}
+
+esp_err_t InterrogationRequestQueue::requeue(const interrogation_request_t &request)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    int idx = findInFlight(request.address, request.addr_type);
+    if (idx >= 0) {
+        _inFlight[idx] = _inFlight[--_inFlightCount];
+    }
+    if (_count == CAPACITY) {
+        _stats.droppedFull++;
+        return ESP_ERR_NO_MEM;
+    }
+    _pending[_count++] = request;
+    return ESP_OK;
+}
+
+void InterrogationRequestQueue::complete(const esp_bd_addr_t address, esp_ble_addr_type_t addrType)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    int idx = findInFlight(address, addrType);
+    // Not dispatched from this queue (or forgotten by clearInFlight) otherwise
+    if (idx >= 0) {
+        _inFlight[idx] = _inFlight[--_inFlightCount];
+    }
+}
+
+void InterrogationRequestQueue::clearInFlight()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _inFlightCount = 0;
+}
+
+void InterrogationRequestQueue::setReprofileWindow(int64_t windowUs)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _reprofileWindowUs = windowUs;
+}
+
+void InterrogationRequestQueue::setStaleLimit(int64_t staleUs)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _staleUs = staleUs;
+}
+
+void InterrogationRequestQueue::setHistoryLookup(HistoryLookup lookup, uint16_t boot)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _history = std::move(lookup);
+    _historyBoot = boot;
+}
+
+size_t InterrogationRequestQueue::size()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _count;
+}
+
+InterrogationRequestQueue::Stats InterrogationRequestQueue::stats()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
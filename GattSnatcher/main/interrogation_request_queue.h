@@ -0,0 +1,129 @@
+#pragma once
+#include "struct_and_definitions.h"
+#include "device_store.h"
+#include <esp_err.h>
+#include <functional>
+#include <mutex>
+#if __has_include("sdkconfig.h")
+#include "sdkconfig.h"
+#endif
+
+#ifndef CONFIG_INTERROGATION_QUEUE_SIZE
+#define CONFIG_INTERROGATION_QUEUE_SIZE 50
+#endif
+#ifndef CONFIG_INTERROGATION_REPROFILE_WINDOW_MIN
+#define CONFIG_INTERROGATION_REPROFILE_WINDOW_MIN 30
+#endif
+#ifndef CONFIG_INTERROGATION_STALE_SEC
+#define CONFIG_INTERROGATION_STALE_SEC 60
+#endif
+
+#define INTERROGATION_MAX_IN_FLIGHT 16
+
+// Scheduling score weights, see InterrogationRequestQueue::score
+#define SCORE_RSSI_WEIGHT 2             // per dBm
+#define SCORE_NEW_DEVICE_BONUS 40       // never interrogated before
+#define SCORE_AGE_PENALTY_PER_SEC 3     // since the device was last seen
+#define SCORE_FAILURE_PENALTY 30        // per failed attempt, counted up to SCORE_MAX_COUNTED_FAILURES
+#define SCORE_MAX_COUNTED_FAILURES 4
+#define SCORE_WEAK_RSSI (-80)           // below this, past failures are likely to repeat
+#define SCORE_WEAK_FAILING_PENALTY 60
+
+/**
+ * Interrogation scheduler: the pending requests, keyed on MAC address plus addr_type.
+ *
+ * What is known about earlier interrogations (profiled or not, when, failures since)
+ * comes from the device database through the HistoryLookup, so the scheduler and
+ * GATT_PROFILE_CACHE_SKIP_KNOWN_MACS agree on it and it survives reboots.
+ *
+ * A request for a device that is already waiting is merged into the waiting
+ * one (newest timestamp, filename and RSSI win). A request for a device that is
+ * being interrogated right now, or that was successfully profiled within the
+ * reprofile window, is rejected. Popped requests count as in flight until
+ * complete() is called for them.
+ *
+ * pop() hands out the request with the highest score rather than the oldest one,
+ * so strong, fresh and new devices go first and weak devices that keep timing out
+ * wait. Requests whose device has not been seen for the stale limit are expired
+ * instead of being connected to.
+ *
+ * Everything is statically sized, all methods are thread-safe.
+ */
+class InterrogationRequestQueue {
+public:
+    static constexpr size_t CAPACITY = CONFIG_INTERROGATION_QUEUE_SIZE;
+
+    /**
+     * Copies the device's entry of the device database (DeviceDatabase::lookup),
+     * @return false if the device was never interrogated
+     */
+    using HistoryLookup = std::function<bool(const esp_bd_addr_t, esp_ble_addr_type_t, DeviceStore::Entry &)>;
+
+    struct Stats {
+        uint32_t enqueued;          // requests that got a queue slot of their own
+        uint32_t coalesced;         // merged into a request that was already waiting
+        uint32_t rejectedInFlight;  // the device was being interrogated at the time
+        uint32_t rejectedRecent;    // the device was profiled within the reprofile window
+        uint32_t droppedFull;       // no room left in the queue
+        uint32_t expired;           // device not seen for the stale limit when its turn came
+        // Connection attempts the deduplication saved
+        uint32_t avoided() const { return coalesced + rejectedInFlight + rejectedRecent; }
+    };
+
+    InterrogationRequestQueue();
+
+    /**
+     * Queues or merges the request. @p now is the local time in μs.
+     * @return ESP_OK if the request was queued, merged or deliberately rejected,
+     * ESP_ERR_NO_MEM if the queue is full.
+     */
+    esp_err_t push(const interrogation_request_t &request, int64_t now);
+
+    // Takes the best scored request and marks its device as in flight, expiring stale ones on the way
+    bool pop(interrogation_request_t &request, int64_t now);
+
+    // Puts a popped request back, e.g. when no GATT profile accepted it
+    esp_err_t requeue(const interrogation_request_t &request);
+
+    // Ends the in-flight state of a device, once its outcome is in the device database
+    void complete(const esp_bd_addr_t address, esp_ble_addr_type_t addrType);
+
+    // Forgets all in-flight devices, used when the Bluetooth stack is reset
+    void clearInFlight();
+
+    void setReprofileWindow(int64_t windowUs);
+    void setStaleLimit(int64_t staleUs);
+    /**
+     * Sets where the device history comes from. @p boot is the database's current boot
+     * number: its times are seconds since that boot, so only they count for the window.
+     * Without a lookup every device is new.
+     */
+    void setHistoryLookup(HistoryLookup lookup, uint16_t boot);
+
+    size_t size();
+    Stats stats();
+
+private:
+    struct Key {
+        esp_bd_addr_t address;
+        esp_ble_addr_type_t addrType;
+    };
+
+    static bool sameKey(const Key &key, const esp_bd_addr_t address, esp_ble_addr_type_t addrType);
+    int findInFlight(const esp_bd_addr_t address, esp_ble_addr_type_t addrType) const;
+    bool findHistory(const esp_bd_addr_t address, esp_ble_addr_type_t addrType, DeviceStore::Entry &entry) const;
+    bool profiledWithinWindow(const DeviceStore::Entry &entry, int64_t now) const;
+    int32_t score(const interrogation_request_t &request, int64_t now) const;
+    void removePending(size_t i);
+
+    std::mutex _mutex;
+    interrogation_request_t _pending[CAPACITY];   // unordered, pop() picks by score
+    size_t _count = 0;
+    Key _inFlight[INTERROGATION_MAX_IN_FLIGHT];
+    size_t _inFlightCount = 0;
+    HistoryLookup _history;
+    uint16_t _historyBoot = 0;
+    int64_t _reprofileWindowUs;
+    int64_t _staleUs;
+    Stats _stats = {};
+};
@@ -4,9 +4,12 @@
 
 #include "esp_log.h"
 #include "esp_err.h"
+#include "esp_timer.h"
 #include <cstring>
 #include <device_database.h>
 #include <device_interrogator.h>
+#include "gatt_read_policy.h"
+#include "gatt_profile_cache.h"
 
 
 
@@ -16,6 +19,86 @@ static void interrogateProfile(void *pvParameters);
 bool esp_bt_uuid_cmp(const esp_bt_uuid_t *p_uuid1, const esp_bt_uuid_t *p_uuid2);
 static void print_char_properties(uint8_t props);
 
+static CharacteristicWrapper *findCharacteristic(gattc_profile_inst &profile, uint16_t handle)
+{
+    for (auto &srv : profile.services) {
+        for (auto &cw : srv.chars) {
+            if (cw.meta.char_handle == handle) {
+                return &cw;
+            }
+        }
+    }
+    return nullptr;
+}
+
+// Keeps at most GattReadPolicy::maxValueBytes() of a read value
+static void storeValue(CharacteristicWrapper &cw, const uint8_t *value, uint16_t len)
+{
+    size_t cap = GattReadPolicy::getInstance().maxValueBytes();
+    cw.truncated = len > cap;
+    cw.value.assign(value, value + (cw.truncated ? cap : len));
+}
+
+// Value length of SIG characteristics that are fixed size by specification, -1 otherwise
+static int fixedValueSize(const esp_bt_uuid_t &uuid)
+{
+    if (uuid.len != ESP_UUID_LEN_16) {
+        return -1;
+    }
+    switch (uuid.uuid.uuid16) {
+    case 0x2A01: return 2;  // Appearance
+    case 0x2A02: return 1;  // Peripheral Privacy Flag
+    case 0x2A04: return 8;  // Peripheral Preferred Connection Parameters
+    case 0x2A07: return 1;  // Tx Power Level
+    case 0x2A08: return 7;  // Date Time
+    case 0x2A0D: return 1;  // DST Offset
+    case 0x2A0E: return 1;  // Time Zone
+    case 0x2A0F: return 2;  // Local Time Information
+    case 0x2A19: return 1;  // Battery Level
+    case 0x2A23: return 8;  // System ID
+    case 0x2A2B: return 10; // Current Time
+    case 0x2A50: return 7;  // PnP ID
+    case 0x2AA6: return 1;  // Central Address Resolution
+    case 0x2AC9: return 1;  // Resolvable Private Address Only
+    default:     return -1;
+    }
+}
+
+// Splits a Read Multiple response back into the characteristics of profile.multi_read
+static void storeMultiReadValues(gattc_profile_inst &profile, const uint8_t *value, uint16_t len)
+{
+    uint16_t offset = 0;
+    int budget = (profile.mtu ? profile.mtu : ATT_DEFAULT_MTU) - 1;
+    for (int i = 0; i < profile.multi_read.num_attr; i++) {
+        uint16_t handle = profile.multi_read.handles[i];
+        CharacteristicWrapper *cw = findCharacteristic(profile, handle);
+        int size = cw ? fixedValueSize(cw->meta.uuid) : -1;
+        bool last = i == profile.multi_read.num_attr - 1;
+        if (size < 0) {
+            if (!last || offset >= budget) {
+                profile.read_char_queue.push_back(handle);
+                continue;
+            }
+            // the variable length value takes the rest, unless it filled the PDU and may be truncated
+            size = len - offset;
+            if (offset + size >= budget) {
+                profile.read_char_queue.push_back(handle);
+                continue;
+            }
+        }
+        if (offset + size > len) {
+            // shorter than the specification says, read the rest one by one
+            profile.read_char_queue.push_back(handle);
+            continue;
+        }
+        if (cw) {
+            storeValue(*cw, value + offset, size);
+        }
+        offset += size;
+        profile.reads_done++;
+    }
+}
+
 
 void InterrogatorEventLoop::gattc_profile_universal_event_handler(int APP_ID, esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
 {
@@ -49,6 +132,9 @@ void InterrogatorEventLoop::gattc_profile_universal_event_handler(int APP_ID, es
             break;
         }
         profile.conn_id = p_data->open.conn_id;
+        profile.connected_since = xTaskGetTickCount();
+        profile.marks[MARK_OPEN] = esp_timer_get_time();
+        DeviceDatabase::getInstance().addConnection(p_data->open.remote_bda, p_data->open.conn_id);
         ESP_LOGI(TAG, "ESP_GATTC_OPEN_EVT conn_id %d, if %d, status %d, mtu %d", p_data->open.conn_id, gattc_if, p_data->open.status, p_data->open.mtu);
         ESP_LOGI(TAG, "REMOTE BDA:");
         esp_log_buffer_hex(TAG, p_data->open.remote_bda, sizeof(esp_bd_addr_t));
@@ -63,6 +149,8 @@ void InterrogatorEventLoop::gattc_profile_universal_event_handler(int APP_ID, es
             ESP_LOGE(TAG,"Config mtu failed");
         }
         ESP_LOGI(TAG, "Status %d, MTU %d, conn_id %d", param->cfg_mtu.status, param->cfg_mtu.mtu, param->cfg_mtu.conn_id);
+        profile.mtu = param->cfg_mtu.status == ESP_GATT_OK ? param->cfg_mtu.mtu : ATT_DEFAULT_MTU;
+        profile.marks[MARK_MTU] = esp_timer_get_time();
         ESP_ERROR_CHECK_WITHOUT_ABORT(esp_ble_gattc_search_service(gattc_if, param->cfg_mtu.conn_id, nullptr));
         break;
     case ESP_GATTC_SEARCH_RES_EVT: {
@@ -101,6 +189,7 @@ void InterrogatorEventLoop::gattc_profile_universal_event_handler(int APP_ID, es
             DeviceInterrogator::getInstance().finalProcedure(APP_ID, true);
             break;
         }
+        profile.marks[MARK_SEARCH_CMPL] = esp_timer_get_time();
         if (profile.services.size() > 0) {
             ESP_LOGI(TAG,"got some services while running the search, lets get attributes");
             uint16_t count = 0;
@@ -143,9 +232,11 @@ void InterrogatorEventLoop::gattc_profile_universal_event_handler(int APP_ID, es
                 }
                 srv.chars.clear();
                 srv.chars.reserve(req);
+                const GattReadPolicy &policy = GattReadPolicy::getInstance();
                 for (uint16_t i = 0; i < req; ++i) {
                     CharacteristicWrapper cw;
                     cw.meta = metas[i];
+                    cw.readable = policy.shouldRead(metas[i]);
                     srv.chars.push_back(std::move(cw));
                     ESP_LOGI(TAG,
                         "Discovered char UUID 0x%04x, handle %d, props 0x%x",
@@ -156,54 +247,35 @@ void InterrogatorEventLoop::gattc_profile_universal_event_handler(int APP_ID, es
                     print_char_properties(metas[i].properties);
                 }
             }
-            //after we get list of all characteristics, we want to query their values (if readable)
-            //we, however, cannot query their values while we are getting the list of characteristics,
-            //and we also cannot query multiple characteristic values at once.
-            //therefore we just create this sort of queue for all the requests
-            //and then use a semaphore to not query more at once.
-            //semaphore is unlocked in read_char_evt
-            for (auto &srv : profile.services) {
-                for (auto &cw : srv.chars) {
-                    uint8_t props = cw.meta.properties;
-                    // only queue if the characteristic is READ-only (no other flags)
-                    if ((props & ESP_GATT_CHAR_PROP_BIT_READ) &&
-                        (props & ~(ESP_GATT_CHAR_PROP_BIT_READ)) == 0) {
-                        ESP_LOGI(TAG, "Queuing pure-Read characteristic handle %d", cw.meta.char_handle);
-                        profile.read_char_queue.push_back(cw.meta.char_handle);
-                    }
+            profile.fingerprint = GattProfileCache::fingerprint(profile);
+#if CONFIG_GATT_PROFILE_CACHE_SKIP_STABLE_READS
+            {
+                size_t cached = GattProfileCache::getInstance().fillStableValues(profile, profile.fingerprint);
+                if (cached > 0) {
+                    ESP_LOGI(TAG, "Known layout %016llx, %u values taken from the cache",
+                             (unsigned long long)profile.fingerprint, (unsigned)cached);
                 }
             }
-            // ensure our semaphore exists and is initially available
-            if (profile.characteristicReadSemaphore == NULL) {
-                profile.characteristicReadSemaphore = xSemaphoreCreateBinary();
-                // give once so the first take will succeed
-                xSemaphoreGive(profile.characteristicReadSemaphore);
+#endif
+            //after we get list of all characteristics, we want to query their values (if readable).
+            //the reads are pipelined: up to CONFIG_GATT_READ_WINDOW are outstanding, every READ_CHAR_EVT
+            //refills the window and pendingMonitorTask gives up reads that miss their deadline
+            {
+                std::lock_guard<std::mutex> lock(profile.read_lock);
+                for (auto &srv : profile.services) {
+                    for (auto &cw : srv.chars) {
+                        if (cw.readable) {
+                            ESP_LOGI(TAG, "Queuing characteristic handle %d", cw.meta.char_handle);
+                            profile.read_char_queue.push_back(cw.meta.char_handle);
+                        }
+                    }
+                }
+                profile.is_char_scheduled = true;
             }
-            // start first read under semaphore (with timeout)
-            // serially consume the queue, with a 10 s timeout per read
             ESP_LOGI(TAG, "characteristics read start");
-            while (!profile.read_char_queue.empty()) {
-                // wait until the prior read has completed (or timeout)
-                // if (xSemaphoreTake(profile.characteristicReadSemaphore, profile.read_timeout_ticks) != pdTRUE) {
-                //     ESP_LOGE(TAG, "Read timeout while waiting to start next characteristic value read");
-                //     // TODO: your device‐timeout handler here
-                //     break;
-                // }
-
-                // pop the next handle and fire the read
-                uint16_t h = profile.read_char_queue.front();
-                ESP_LOGI(TAG, "Reading characteristic handle %d …", h);
-                TickType_t now = xTaskGetTickCount();
-                profile.pending_requests.push_back({ h, now });
-                profile.read_char_queue.pop_front();
-                esp_ble_gattc_read_char(
-                    gattc_if,
-                    profile.conn_id,
-                    h,
-                    ESP_GATT_AUTH_REQ_NONE
-                );
-                profile.is_char_scheduled = true;
-                // now block again until READ_CHAR_EVT gives us the semaphore
+            if (fillReadWindow(APP_ID)) {
+                // nothing readable, the profile is complete as it is
+                DeviceInterrogator::getInstance().finalProcedure(APP_ID, true);
             }
         }else{
             ESP_LOGI(TAG, "No attribute search is going to take place");
@@ -212,35 +284,82 @@ void InterrogatorEventLoop::gattc_profile_universal_event_handler(int APP_ID, es
     case ESP_GATTC_READ_CHAR_EVT: {
             ESP_LOGI(TAG, "APP_ID %d: READ_CHAR_EVT", APP_ID);
             auto &r = param->read;
-            auto it = std::find_if(//remove from pending_requests
-                profile.pending_requests.begin(),
-                profile.pending_requests.end(),
-                [&](auto &pr){ return pr.handle == r.handle; }
-            );
-            if (it != profile.pending_requests.end()) {
-                profile.pending_requests.erase(it);
-            }
-            if (r.status != ESP_GATT_OK) {
-                ESP_LOGE(TAG, "Read failed, status %s, handle %d", esp_gatt_status_to_str(r.status), r.handle);
-            }else
             {
-                // 1) Print the handle and raw value
-                ESP_LOGI(TAG, "ESP_GATTC_READ_CHAR_EVT, handle = %d, value_len = %d",
-                         r.handle, r.value_len);
+                // finalProcedure() prints and clears the services on the monitor task, it takes the
+                // lock and ends the read phase first, so a value is only stored while that is running
+                std::lock_guard<std::mutex> lock(profile.read_lock);
+                auto it = std::find_if(//remove from pending_requests
+                    profile.pending_requests.begin(),
+                    profile.pending_requests.end(),
+                    [&](auto &pr){ return pr.handle == r.handle; }
+                );
+                if (it != profile.pending_requests.end()) {
+                    profile.pending_requests.erase(it);
+                    profile.reads_done++;
+                } else if (profile.is_char_scheduled) {
+                    // already given up by the deadline check, the value is still worth keeping
+                    ESP_LOGW(TAG, "Late or unexpected read response for handle %d", r.handle);
+                } else {
+                    ESP_LOGW(TAG, "Read response for handle %d after the profile was finished, dropped", r.handle);
+                }
+                if (r.status != ESP_GATT_OK) {
+                    ESP_LOGE(TAG, "Read failed, status %s, handle %d", esp_gatt_status_to_str(r.status), r.handle);
+                } else if (profile.is_char_scheduled) {
+                    // 1) Print the handle and raw value
+                    ESP_LOGI(TAG, "ESP_GATTC_READ_CHAR_EVT, handle = %d, value_len = %d",
+                             r.handle, r.value_len);
 
-                for (auto &srv : profile.services)
-                {
-                    for (auto &cw : srv.chars) {
-                        if (cw.meta.char_handle == r.handle) {
-                            cw.value.assign(r.value, r.value + r.value_len);
-                            ESP_LOGI(TAG, "Stored %d bytes into CharacteristicWrapper.value", r.value_len);
-                            break;
+                    for (auto &srv : profile.services)
+                    {
+                        for (auto &cw : srv.chars) {
+                            if (cw.meta.char_handle == r.handle) {
+                                // Bluedroid already continued a long value with Read Blob requests
+                                storeValue(cw, r.value, r.value_len);
+                                ESP_LOGI(TAG, "Stored %d of %d bytes into CharacteristicWrapper.value",
+                                         (int)cw.value.size(), r.value_len);
+                                break;
+                            }
                         }
                     }
                 }
             }
 
-            xSemaphoreGive(profile.characteristicReadSemaphore);
+            if (fillReadWindow(APP_ID)) {
+                ESP_LOGI(TAG, "Finished all characteristic reads for profile %d → finalProcedure", APP_ID);
+                DeviceInterrogator::getInstance().finalProcedure(APP_ID, true);
+            }
+            break;
+    }
+    case ESP_GATTC_READ_MULTIPLE_EVT: {
+            ESP_LOGI(TAG, "APP_ID %d: READ_MULTIPLE_EVT", APP_ID);
+            auto &r = param->read;
+            {
+                std::lock_guard<std::mutex> lock(profile.read_lock);
+                auto it = std::find_if(
+                    profile.pending_requests.begin(),
+                    profile.pending_requests.end(),
+                    [&](auto &pr){ return pr.multiple; }
+                );
+                if (it == profile.pending_requests.end() || profile.multi_read.num_attr == 0
+                    || !profile.is_char_scheduled) {
+                    ESP_LOGW(TAG, "Late or unexpected Read Multiple response");
+                } else {
+                    profile.pending_requests.erase(it);
+                    if (r.status != ESP_GATT_OK) {
+                        ESP_LOGW(TAG, "Read Multiple failed, status %s, falling back to single reads",
+                                 esp_gatt_status_to_str(r.status));
+                        profile.multi_read_unsupported = true;
+                        profile.requeueMultiRead();
+                    } else {
+                        storeMultiReadValues(profile, r.value, r.value_len);
+                        profile.multi_read.num_attr = 0;
+                    }
+                }
+            }
+            if (fillReadWindow(APP_ID)) {
+                ESP_LOGI(TAG, "Finished all characteristic reads for profile %d → finalProcedure", APP_ID);
+                DeviceInterrogator::getInstance().finalProcedure(APP_ID, true);
+            }
             break;
     }
     case ESP_GATTC_REG_FOR_NOTIFY_EVT: {
@@ -311,134 +430,83 @@ void InterrogatorEventLoop::gattc_profile_universal_event_handler(int APP_ID, es
     }
 }
 
-
-//##############################
-
-
-
-void InterrogatorEventLoop::gattc_profile_a_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
-{
-    InterrogatorEventLoop::gattc_profile_universal_event_handler(PROFILE_A_APP_ID,event, gattc_if, param);
-}
-void InterrogatorEventLoop::gattc_profile_b_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
-{
-    InterrogatorEventLoop::gattc_profile_universal_event_handler(PROFILE_B_APP_ID,event, gattc_if, param);
-}
-void InterrogatorEventLoop::gattc_profile_c_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
+static bool fillMultiRead(gattc_profile_inst &profile)
 {
-    InterrogatorEventLoop::gattc_profile_universal_event_handler(PROFILE_C_APP_ID,event, gattc_if, param);
-}
-void InterrogatorEventLoop::gattc_profile_d_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
-{
-    InterrogatorEventLoop::gattc_profile_universal_event_handler(PROFILE_D_APP_ID,event, gattc_if, param);
-}
-
-
-bool esp_bt_uuid_cmp(const esp_bt_uuid_t *p_uuid1, const esp_bt_uuid_t *p_uuid2) {
-    // Check if the UUID lengths match
-    if (p_uuid1->len != p_uuid2->len) {
+    if (profile.multi_read_unsupported || profile.multi_read.num_attr != 0) {
         return false;
     }
-
-    // Compare the UUIDs based on their length
-    switch (p_uuid1->len) {
-    case ESP_UUID_LEN_16:
-        return (p_uuid1->uuid.uuid16 == p_uuid2->uuid.uuid16);
-    case ESP_UUID_LEN_32:
-        return (p_uuid1->uuid.uuid32 == p_uuid2->uuid.uuid32);
-    case ESP_UUID_LEN_128:
-        // For 128-bit UUID, compare the entire 16-byte array
-    return (memcmp(p_uuid1->uuid.uuid128, p_uuid2->uuid.uuid128, 16) == 0);
-    default:
-        return false; // Handle unknown UUID length gracefully
-    }
-}
-
-const char* esp_gatt_status_to_str(esp_gatt_status_t status) {
-    switch (status) {
-    case ESP_GATT_OK:                    return "ESP_GATT_OK";
-    case ESP_GATT_INVALID_HANDLE:        return "ESP_GATT_INVALID_HANDLE";
-    case ESP_GATT_READ_NOT_PERMIT:       return "ESP_GATT_READ_NOT_PERMIT";
-    case ESP_GATT_WRITE_NOT_PERMIT:      return "ESP_GATT_WRITE_NOT_PERMIT";
-    case ESP_GATT_INVALID_PDU:           return "ESP_GATT_INVALID_PDU";
-    case ESP_GATT_INSUF_AUTHENTICATION:  return "ESP_GATT_INSUF_AUTHENTICATION";
-    case ESP_GATT_REQ_NOT_SUPPORTED:     return "ESP_GATT_REQ_NOT_SUPPORTED";
-    case ESP_GATT_INVALID_OFFSET:        return "ESP_GATT_INVALID_OFFSET";
-    case ESP_GATT_INSUF_AUTHORIZATION:   return "ESP_GATT_INSUF_AUTHORIZATION";
-    case ESP_GATT_PREPARE_Q_FULL:        return "ESP_GATT_PREPARE_Q_FULL";
-    case ESP_GATT_NOT_FOUND:             return "ESP_GATT_NOT_FOUND";
-    case ESP_GATT_NOT_LONG:              return "ESP_GATT_NOT_LONG";
-    case ESP_GATT_INSUF_KEY_SIZE:        return "ESP_GATT_INSUF_KEY_SIZE";
-    case ESP_GATT_INVALID_ATTR_LEN:      return "ESP_GATT_INVALID_ATTR_LEN";
-    case ESP_GATT_ERR_UNLIKELY:          return "ESP_GATT_ERR_UNLIKELY";
-    case ESP_GATT_INSUF_ENCRYPTION:      return "ESP_GATT_INSUF_ENCRYPTION";
-    case ESP_GATT_UNSUPPORT_GRP_TYPE:    return "ESP_GATT_UNSUPPORT_GRP_TYPE";
-    case ESP_GATT_INSUF_RESOURCE:        return "ESP_GATT_INSUF_RESOURCE";
-    case ESP_GATT_NO_RESOURCES:          return "ESP_GATT_NO_RESOURCES";
-    case ESP_GATT_INTERNAL_ERROR:        return "ESP_GATT_INTERNAL_ERROR";
-    case ESP_GATT_WRONG_STATE:           return "ESP_GATT_WRONG_STATE";
-    case ESP_GATT_DB_FULL:               return "ESP_GATT_DB_FULL";
-    case ESP_GATT_BUSY:                  return "ESP_GATT_BUSY";
-    case ESP_GATT_ERROR:                 return "ESP_GATT_ERROR";
-    case ESP_GATT_CMD_STARTED:           return "ESP_GATT_CMD_STARTED";
-    case ESP_GATT_ILLEGAL_PARAMETER:     return "ESP_GATT_ILLEGAL_PARAMETER";
-    case ESP_GATT_PENDING:               return "ESP_GATT_PENDING";
-    case ESP_GATT_AUTH_FAIL:             return "ESP_GATT_AUTH_FAIL";
-    case ESP_GATT_MORE:                  return "ESP_GATT_MORE";
-    case ESP_GATT_INVALID_CFG:           return "ESP_GATT_INVALID_CFG";
-    case ESP_GATT_SERVICE_STARTED:       return "ESP_GATT_SERVICE_STARTED";
-    // case ESP_GATT_ENCRYPTED_MITM:        return "ESP_GATT_ENCRYPTED_MITM";
-    case ESP_GATT_ENCRYPTED_NO_MITM:     return "ESP_GATT_ENCRYPTED_NO_MITM";
-    case ESP_GATT_NOT_ENCRYPTED:         return "ESP_GATT_NOT_ENCRYPTED";
-    case ESP_GATT_CONGESTED:             return "ESP_GATT_CONGESTED";
-    case ESP_GATT_DUP_REG:               return "ESP_GATT_DUP_REG";
-    case ESP_GATT_ALREADY_OPEN:          return "ESP_GATT_ALREADY_OPEN";
-    case ESP_GATT_CANCEL:                return "ESP_GATT_CANCEL";
-    case ESP_GATT_STACK_RSP:             return "ESP_GATT_STACK_RSP";
-    case ESP_GATT_APP_RSP:               return "ESP_GATT_APP_RSP";
-    case ESP_GATT_UNKNOWN_ERROR:         return "ESP_GATT_UNKNOWN_ERROR";
-    case ESP_GATT_CCC_CFG_ERR:           return "ESP_GATT_CCC_CFG_ERR";
-    case ESP_GATT_PRC_IN_PROGRESS:       return "ESP_GATT_PRC_IN_PROGRESS";
-    case ESP_GATT_OUT_OF_RANGE:          return "ESP_GATT_OUT_OF_RANGE";
-    default:                             return "ESP_GATT_STATUS_UNKNOWN";
-    }
-}
-
-// Print GATT characteristic properties in human-readable form
-static void print_char_properties(uint8_t props) {
-    std::vector<const char*> names;
-    if (props & ESP_GATT_CHAR_PROP_BIT_BROADCAST) {
-        names.push_back("Broadcast");
-    }
-    if (props & ESP_GATT_CHAR_PROP_BIT_READ) {
-        names.push_back("Read");
+    // Read Multiple returns the values back to back without lengths, so all but the
+    // last one need a length known from their UUID; the last one takes the rest
+    int budget = (profile.mtu ? profile.mtu : ATT_DEFAULT_MTU) - 1;
+    esp_gattc_multi_t batch = {};
+    int variableIdx = -1;
+    for (size_t i = 0; i < profile.read_char_queue.size() && batch.num_attr < ESP_GATT_MAX_READ_MULTI_HANDLES; i++) {
+        const CharacteristicWrapper *cw = findCharacteristic(profile, profile.read_char_queue[i]);
+        int size = cw ? fixedValueSize(cw->meta.uuid) : -1;
+        if (size > 0 && size <= budget) {
+            batch.handles[batch.num_attr++] = profile.read_char_queue[i];
+            budget -= size;
+        } else if (size < 0 && variableIdx < 0) {
+            variableIdx = (int)i;
+        }
     }
-    if (props & ESP_GATT_CHAR_PROP_BIT_WRITE_NR) {
-        names.push_back("WriteNoResp");
+    if (variableIdx >= 0 && batch.num_attr > 0 && batch.num_attr < ESP_GATT_MAX_READ_MULTI_HANDLES && budget > 0) {
+        batch.handles[batch.num_attr++] = profile.read_char_queue[variableIdx];
     }
-    if (props & ESP_GATT_CHAR_PROP_BIT_WRITE) {
-        names.push_back("Write");
+    if (batch.num_attr < 2) {
+        // nothing to gain over a single read
+        return false;
     }
-    if (props & ESP_GATT_CHAR_PROP_BIT_NOTIFY) {
-        names.push_back("Notify");
+    esp_err_t err = esp_ble_gattc_read_multiple(profile.gattc_if, profile.conn_id, &batch, ESP_GATT_AUTH_REQ_NONE);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "read_multiple failed: %x, falling back to single reads", err);
+        profile.multi_read_unsupported = true;
+        return false;
     }
-    if (props & ESP_GATT_CHAR_PROP_BIT_INDICATE) {
-        names.push_back("Indicate");
+    for (int i = 0; i < batch.num_attr; i++) {
+        auto it = std::find(profile.read_char_queue.begin(), profile.read_char_queue.end(), batch.handles[i]);
+        profile.read_char_queue.erase(it);
     }
-    if (props & ESP_GATT_CHAR_PROP_BIT_AUTH) {
-        names.push_back("AuthSigned");
+    ESP_LOGI(TAG, "Reading %d characteristics with one Read Multiple", batch.num_attr);
+    profile.multi_read = batch;
+    profile.pending_requests.push_back({ batch.handles[0], xTaskGetTickCount() + pdMS_TO_TICKS(CONFIG_GATT_READ_TIMEOUT_MS), true });
+    return true;
+}
+
+bool InterrogatorEventLoop::fillReadWindow(int APP_ID)
+{
+    DeviceInterrogator &interrogator = DeviceInterrogator::getInstance();
+    auto &profile = interrogator.profileTabs[APP_ID];
+    std::lock_guard<std::mutex> lock(profile.read_lock);
+    if (!profile.is_char_scheduled) {
+        // finalProcedure ended the read phase, the connection is being closed
+        return false;
     }
-    if (props & ESP_GATT_CHAR_PROP_BIT_EXT_PROP) {
-        names.push_back("ExtProps");
+    if (profile.pending_requests.size() < CONFIG_GATT_READ_WINDOW) {
+        fillMultiRead(profile);
     }
-    std::string out;
-    for (size_t i = 0; i < names.size(); ++i) {
-        out += names[i];
-        if (i + 1 < names.size()) out += "|";
+    while (profile.pending_requests.size() < CONFIG_GATT_READ_WINDOW && !profile.read_char_queue.empty()) {
+        uint16_t h = profile.read_char_queue.front();
+        profile.read_char_queue.pop_front();
+        ESP_LOGI(TAG, "Reading characteristic handle %d …", h);
+        esp_err_t err = esp_ble_gattc_read_char(
+            profile.gattc_if,
+            profile.conn_id,
+            h,
+            ESP_GATT_AUTH_REQ_NONE
+        );
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "read_char for handle %d failed: %x", h, err);
+            // the value is missing, so the profile is not complete
+            profile.reads_failed++;
+            continue;
+        }
+        profile.pending_requests.push_back({ h, xTaskGetTickCount() + pdMS_TO_TICKS(CONFIG_GATT_READ_TIMEOUT_MS), false });
     }
-    if (out.empty()) {
-        out = "None";
+    if (profile.pending_requests.empty() && profile.read_char_queue.empty()) {
+        // Only one caller gets to finalise the profile
+        profile.is_char_scheduled = false;
+        return true;
     }
-    ESP_LOGI(TAG, "Properties: %s", out.c_str());
+    return false;
 }
-
@@ -10,15 +10,33 @@
 #include "hci_event_parser.h"
 #include <deque>
 #include "freertos/semphr.h"
-#define PROFILE_NUM 3
-#define PROFILE_A_APP_ID 0
-#define PROFILE_B_APP_ID 1
-#define PROFILE_C_APP_ID 2
-#define PROFILE_D_APP_ID 3
+#if __has_include("sdkconfig.h")
+#include "sdkconfig.h"
+#endif
+
+#ifndef CONFIG_GATT_PROFILE_POOL_SIZE
+#define CONFIG_GATT_PROFILE_POOL_SIZE 3
+#endif
+// Number of GATT client profiles, i.e. of concurrent interrogations. Profile i registers as app_id i.
+#define PROFILE_NUM CONFIG_GATT_PROFILE_POOL_SIZE
+#if defined(CONFIG_BT_ACL_CONNECTIONS) && PROFILE_NUM > CONFIG_BT_ACL_CONNECTIONS
+#error "GATT_PROFILE_POOL_SIZE exceeds the Bluedroid connection limit BT_ACL_CONNECTIONS"
+#endif
+#if defined(CONFIG_BTDM_CTRL_BLE_MAX_CONN) && PROFILE_NUM > CONFIG_BTDM_CTRL_BLE_MAX_CONN
+#error "GATT_PROFILE_POOL_SIZE exceeds the controller connection limit BTDM_CTRL_BLE_MAX_CONN"
+#endif
 #define INVALID_HANDLE   0
 #define MAX_SERVICES_PER_PROFILE 10
 #define MAX_CHARACTERISTICS_IN_SERVICE 16
-#define MAX_CHARACTERISTIC_VALUE_SIZE 16
+
+#ifndef CONFIG_GATT_READ_WINDOW
+#define CONFIG_GATT_READ_WINDOW 4
+#endif
+#ifndef CONFIG_GATT_READ_TIMEOUT_MS
+#define CONFIG_GATT_READ_TIMEOUT_MS 3000
+#endif
+#define READ_MONITOR_PERIOD_MS 250
+#define ATT_DEFAULT_MTU 23
 
 const char* esp_gatt_status_to_str(esp_gatt_status_t status);
 
@@ -31,11 +49,12 @@ public:
     // static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
     // static void esp_gattc_cb(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
     static void gattc_profile_universal_event_handler(int APP_ID, esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
-
-    static void gattc_profile_a_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
-    static void gattc_profile_b_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
-    static void gattc_profile_c_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
-    static void gattc_profile_d_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
+    /**
+     * Issues queued characteristic reads until CONFIG_GATT_READ_WINDOW are in flight.
+     * @return true exactly once, when the queue and the window have both run empty
+     * and the caller has to finalise the profile
+     */
+    static bool fillReadWindow(int APP_ID);
 
 };
 
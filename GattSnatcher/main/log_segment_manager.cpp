@@ -0,0 +1,179 @@
+#include "log_segment_manager.h"
+#include "uart_frame.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void putLe32(uint8_t *out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        out[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static uint32_t getLe32(const uint8_t *in)
+{
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+bool LogSegmentManager::open(const char *const *basenames, size_t count, const char *extension)
+{
+    if (count == 0 || count > LOG_SEGMENT_MAX_FAMILY) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        _basenames[i] = basenames[i];
+    }
+    _count = count;
+    _extension = extension;
+    snprintf(_manifestPath, sizeof(_manifestPath), "%s.manifest", basenames[0]);
+    if (load()) {
+        return true;
+    }
+    rebuild();
+    return save(0);
+}
+
+bool LogSegmentManager::load()
+{
+    FILE *f = fopen(_manifestPath, "r");
+    if (f == nullptr) {
+        return false;
+    }
+    uint8_t rec[LOG_MANIFEST_SIZE];
+    bool ok = fread(rec, 1, sizeof(rec), f) == sizeof(rec);
+    fclose(f);
+    if (!ok || memcmp(rec, LOG_MANIFEST_MAGIC, 4) != 0 || rec[4] != LOG_MANIFEST_VERSION) {
+        return false;
+    }
+    uint16_t crc = rec[18] | (rec[19] << 8);
+    if (uartFrameCrc16(rec, 18) != crc) {
+        return false;
+    }
+    _first = getLe32(rec + 6);
+    _next = getLe32(rec + 10);
+    return _first <= _next;
+}
+
+// One pass over the directory instead of probing every index
+void LogSegmentManager::rebuild()
+{
+    _first = 0;
+    _next = 0;
+    const char *slash = strrchr(_basenames[0], '/');
+    const char *prefix = slash != nullptr ? slash + 1 : _basenames[0];
+    char dirPath[sizeof(_manifestPath)];
+    if (slash != nullptr) {
+        snprintf(dirPath, sizeof(dirPath), "%.*s", (int)(slash - _basenames[0]), _basenames[0]);
+    } else {
+        snprintf(dirPath, sizeof(dirPath), ".");
+    }
+    DIR *dir = opendir(dirPath);
+    if (dir == nullptr) {
+        return;
+    }
+    size_t prefixLen = strlen(prefix);
+    size_t extLen = strlen(_extension);
+    bool found = false;
+    while (struct dirent *entry = readdir(dir)) {
+        const char *name = entry->d_name;
+        size_t len = strlen(name);
+        if (len <= prefixLen + 1 + extLen || strncmp(name, prefix, prefixLen) != 0 || name[prefixLen] != '_'
+            || strcmp(name + len - extLen, _extension) != 0) {
+            continue;
+        }
+        char *end;
+        unsigned long index = strtoul(name + prefixLen + 1, &end, 10);
+        if (end != name + len - extLen) {
+            continue;
+        }
+        if (!found || index < _first) {
+            _first = (uint32_t)index;
+        }
+        if (!found || index + 1 > _next) {
+            _next = (uint32_t)index + 1;
+        }
+        found = true;
+    }
+    closedir(dir);
+}
+
+bool LogSegmentManager::save(uint32_t freeBytes)
+{
+    uint8_t rec[LOG_MANIFEST_SIZE] = {};
+    memcpy(rec, LOG_MANIFEST_MAGIC, 4);
+    rec[4] = LOG_MANIFEST_VERSION;
+    putLe32(rec + 6, _first);
+    putLe32(rec + 10, _next);
+    putLe32(rec + 14, freeBytes);
+    uint16_t crc = uartFrameCrc16(rec, 18);
+    rec[18] = crc & 0xFF;
+    rec[19] = crc >> 8;
+
+    char tmpPath[sizeof(_manifestPath) + 4];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", _manifestPath);
+    FILE *tmp = fopen(tmpPath, "w");
+    if (tmp == nullptr) {
+        return false;
+    }
+    bool ok = fwrite(rec, 1, sizeof(rec), tmp) == sizeof(rec);
+    ok = ok && fflush(tmp) == 0 && fsync(fileno(tmp)) == 0;
+    fclose(tmp);
+    if (!ok || rename(tmpPath, _manifestPath) != 0) {
+        remove(tmpPath);
+        return false;
+    }
+    return true;
+}
+
+uint32_t LogSegmentManager::beginSegment(uint32_t freeBytes)
+{
+    uint32_t segment = nextUnused();
+    reserve(segment, freeBytes);
+    return segment;
+}
+
+uint32_t LogSegmentManager::nextUnused()
+{
+    // A manifest that could not be saved last time is behind; never truncate an existing segment
+    char path[sizeof(_manifestPath) + 16];
+    struct stat buffer;
+    segmentPath(_next, 0, path, sizeof(path));
+    while (stat(path, &buffer) == 0) {
+        segmentPath(++_next, 0, path, sizeof(path));
+    }
+    return _next;
+}
+
+void LogSegmentManager::reserve(uint32_t segment, uint32_t freeBytes)
+{
+    if (segment >= _next) {
+        _next = segment + 1;
+    }
+    save(freeBytes);
+}
+
+bool LogSegmentManager::dropOldest(uint32_t freeBytes)
+{
+    // the newest segment is the one being written
+    if (_next - _first <= 1) {
+        return false;
+    }
+    char path[sizeof(_manifestPath) + 16];
+    for (size_t i = 0; i < _count; i++) {
+        segmentPath(_first, i, path, sizeof(path));
+        remove(path);
+    }
+    _first++;
+    save(freeBytes);
+    return true;
+}
+
+void LogSegmentManager::segmentPath(uint32_t segment, size_t which, char *out, size_t len) const
+{
+    snprintf(out, len, "%s_%u%s", _basenames[which], (unsigned)segment, _extension);
+}
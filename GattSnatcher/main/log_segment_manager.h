@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#if __has_include("sdkconfig.h")
+#include "sdkconfig.h"
+#endif
+
+#ifndef CONFIG_LOG_SEGMENT_SIZE_KB
+#define CONFIG_LOG_SEGMENT_SIZE_KB 256
+#endif
+#ifndef CONFIG_LOG_SEGMENT_MIN_FREE_KB
+#define CONFIG_LOG_SEGMENT_MIN_FREE_KB 192
+#endif
+
+/**
+ * Manifest record, LOG_MANIFEST_SIZE bytes, little endian:
+ *   magic(4) version(1) reserved(1) first(4) next(4) free_bytes(4) crc16(2)
+ * The CRC (see uartFrameCrc16) covers the first 18 bytes.
+ */
+#define LOG_MANIFEST_MAGIC "GSSM"
+#define LOG_MANIFEST_VERSION 1
+#define LOG_MANIFEST_SIZE 20
+#define LOG_SEGMENT_MAX_FAMILY 2
+
+/**
+ * Numbering of the log files ("segments") <basename>_<n><extension>.
+ *
+ * A small manifest next to the segments (<basename>.manifest) records the oldest
+ * segment still on flash, the number the next one gets and the free space seen when
+ * it was last written, so finding the next file name costs one small read instead of
+ * a stat() per existing file. A missing or corrupt manifest (first boot, older
+ * firmware, torn write) is rebuilt from one directory listing. The manifest is
+ * replaced through a temporary file and rename(), so it is never half-written.
+ *
+ * A segment can consist of files with several basenames sharing the number (the
+ * interrogator log and its timing file); the first basename owns the manifest.
+ * dropOldest() deletes all of them.
+ *
+ * Depends on the C standard library and POSIX only (and uart_frame for the CRC), so
+ * it also builds for the host. Not thread-safe.
+ */
+class LogSegmentManager {
+public:
+    /**
+     * Loads or rebuilds the manifest for @p count basenames (full paths without
+     * the index), all using @p extension.
+     * @return false if the manifest cannot be written
+     */
+    bool open(const char *const *basenames, size_t count, const char *extension);
+
+    // Reserves the next unused segment number and records it in the manifest, @return the number
+    uint32_t beginSegment(uint32_t freeBytes);
+
+    // The number beginSegment() would reserve, without reserving it
+    uint32_t nextUnused();
+    // Records @p segment, usually from nextUnused(), as the newest one in the manifest
+    void reserve(uint32_t segment, uint32_t freeBytes);
+
+    // Deletes the oldest segment unless it is the current one, @return false if there was none to drop
+    bool dropOldest(uint32_t freeBytes);
+
+    // Path of @p segment for basename number @p which
+    void segmentPath(uint32_t segment, size_t which, char *out, size_t len) const;
+
+    uint32_t first() const { return _first; }
+    uint32_t next() const { return _next; }
+    uint32_t segments() const { return _next - _first; }
+
+private:
+    bool load();
+    void rebuild();
+    bool save(uint32_t freeBytes);
+
+    const char *_basenames[LOG_SEGMENT_MAX_FAMILY] = {};
+    size_t _count = 0;
+    const char *_extension = "";
+    char _manifestPath[72] = {};
+    uint32_t _first = 0;
+    uint32_t _next = 0;
+};
@@ -1,4 +1,7 @@
 #include "mac_cache.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
 // MacKey definitions
@@ -7,74 +10,260 @@ bool MacKey::operator==(MacKey const& o) const {
       && std::memcmp(addr, o.addr, 6) == 0;
 }
 
-std::size_t MacKeyHash::operator()(MacKey const& k) const {
-  // FNV-1a hash over the 6-byte address, mixed with addr_type
-  std::size_t h = 146527;
+std::uint32_t MacKeyHash::operator()(MacKey const& k) const {
+  // 32-bit FNV-1a over the 6-byte address and addr_type, with a final mix
+  // so the low bits used for the table index depend on every input byte
+  std::uint32_t h = 2166136261u;
   for (int i = 0; i < 6; ++i) {
     h ^= k.addr[i];
-    h *= 1099511628211ULL;
+    h *= 16777619u;
   }
-  return h ^ (std::size_t)k.addr_type;
+  h ^= k.addr_type;
+  h *= 16777619u;
+  h ^= h >> 15;
+  h *= 0x2c1b3c6du;
+  h ^= h >> 12;
+  return h;
 }
 
-// MacCache constructor/destructor
-MacCache::MacCache() = default;
+MacAddressClass classifyMacAddress(MacKey const& k) {
+  switch (k.addr_type) {
+    case 0x00: // public device address
+    case 0x02: // public identity, resolved from an RPA by the controller
+      return MacAddressClass::Public;
+    case 0x03: // random static identity, resolved from an RPA by the controller
+      return MacAddressClass::RandomStatic;
+    case 0x01:
+      switch (k.addr[5] >> 6) {
+        case 0x3: return MacAddressClass::RandomStatic;
+        case 0x1: return MacAddressClass::ResolvablePrivate;
+        case 0x0: return MacAddressClass::NonResolvablePrivate;
+        default:  return MacAddressClass::Other;
+      }
+    default:
+      return MacAddressClass::Other;
+  }
+}
+
+const char* macAddressClassName(MacAddressClass c) {
+  switch (c) {
+    case MacAddressClass::Public:               return "public";
+    case MacAddressClass::RandomStatic:         return "static";
+    case MacAddressClass::ResolvablePrivate:    return "rpa";
+    case MacAddressClass::NonResolvablePrivate: return "nrpa";
+    default:                                    return "other";
+  }
+}
 
-MacCache::~MacCache() {
-  Node* curr = head_;
-  while (curr) {
-    Node* next = curr->next;
-    delete curr;
-    curr = next;
+bool parseMacTtlCommand(const char* line, MacAddressClass& c, uint32_t& ttlSeconds) {
+  char name[8];
+  char number[16];
+  char rest;
+  // strtoull would take "-1" as a huge TTL
+  if (std::strchr(line, '-') != nullptr
+      || std::sscanf(line, " ttl %7s %15s %c", name, number, &rest) != 2) {
+    return false;
+  }
+  char* end;
+  errno = 0;
+  unsigned long long seconds = std::strtoull(number, &end, 10);
+  if (end == number || *end != '\0' || errno == ERANGE || seconds > MAC_CACHE_TTL_MAX_SEC) {
+    return false;
   }
+  for (size_t i = 0; i < (size_t)MacAddressClass::COUNT; ++i) {
+    if (std::strcmp(name, macAddressClassName((MacAddressClass)i)) == 0) {
+      c = (MacAddressClass)i;
+      ttlSeconds = (uint32_t)seconds;
+      return true;
+    }
+  }
+  return false;
+}
+
+// MacCache constructor: thread every slab entry into the free list
+MacCache::MacCache() {
+  for (size_t i = 0; i < TABLE_SIZE; ++i) {
+    table_[i] = NIL;
+  }
+  for (size_t i = 0; i < CAPACITY; ++i) {
+    nodes_[i].next = (i + 1 < CAPACITY) ? (uint16_t)(i + 1) : NIL;
+  }
+  free_ = 0;
+  for (size_t c = 0; c < CLASS_COUNT; ++c) {
+    head_[c] = NIL;
+    tail_[c] = NIL;
+  }
+  ttlSec_[(size_t)MacAddressClass::Public] = CONFIG_MAC_CACHE_TTL_PUBLIC_MIN * 60;
+  ttlSec_[(size_t)MacAddressClass::RandomStatic] = CONFIG_MAC_CACHE_TTL_STATIC_MIN * 60;
+  ttlSec_[(size_t)MacAddressClass::ResolvablePrivate] = CONFIG_MAC_CACHE_TTL_RPA_MIN * 60;
+  ttlSec_[(size_t)MacAddressClass::NonResolvablePrivate] = CONFIG_MAC_CACHE_TTL_NRPA_MIN * 60;
+  ttlSec_[(size_t)MacAddressClass::Other] = LEGACY_TTL / 1000000;
+}
+
+void MacCache::setTtl(MacAddressClass c, int64_t ttlUs) {
+  ttlSec_[(size_t)c].store((uint32_t)(ttlUs / 1000000), std::memory_order_relaxed);
+}
+
+int64_t MacCache::ttl(MacAddressClass c) const {
+  return (int64_t)ttlSec_[(size_t)c].load(std::memory_order_relaxed) * 1000000;
+}
+
+int64_t MacCache::ttlOf(MacCacheEntry const& n) const {
+  return (int64_t)ttlSec_[n.cls].load(std::memory_order_relaxed) * 1000000;
 }
 
 //will add too
 bool MacCache::shouldPrintAndAddToCache(MacKey const& k, int64_t now) {
-  auto it = map_.find(k);
-  if (it != map_.end()) {
-    Node* n = it->second;
-    if (now - n->timestamp < TTL) {
+  uint16_t idx = find(k);
+  if (idx != NIL) {
+    MacCacheEntry& n = nodes_[idx];
+    ClassStats& st = stats_[n.cls];
+    int64_t age = now - n.timestamp;
+    if (age < ttlOf(n)) {
+      ++st.suppressed;
+      if (age >= LEGACY_TTL) ++st.savedVsLegacy;
       return false;
     }
-    n->timestamp = now;
-    moveToTail(n);
+    ++st.forwarded;
+    if (age < LEGACY_TTL) ++st.extraVsLegacy;
+    n.timestamp = now;
+    moveToTail(idx);
     return true;
   }
-  Node* n = new Node{k, now, nullptr, nullptr};
-  map_[k] = n;
-  appendToTail(n);
+
+  idx = allocate(now);
+  MacCacheEntry& n = nodes_[idx];
+  n.key = k;
+  n.cls = (uint8_t)classifyMacAddress(k);
+  n.timestamp = now;
+  ++stats_[n.cls].forwarded;
+  size_t slot = MacKeyHash{}(k) & TABLE_MASK;
+  while (table_[slot] != NIL) {
+    slot = (slot + 1) & TABLE_MASK;
+  }
+  table_[slot] = idx;
+  n.slot = (uint16_t)slot;
+  appendToTail(idx);
+  ++size_;
   return true;
 }
 
-void MacCache::evictOld(int64_t now) {
-  while (head_ && now - head_->timestamp > TTL) {
-    Node* old = head_;
-    map_.erase(old->key);
-    head_ = old->next;
-    if (head_) head_->prev = nullptr;
-    else       tail_  = nullptr;
-    delete old;
+size_t MacCache::evictOld(int64_t now, size_t maxNodes) {
+  size_t evicted = 0;
+  for (size_t c = 0; c < CLASS_COUNT; ++c) {
+    int64_t classTtl = ttl((MacAddressClass)c);
+    while (evicted < maxNodes && head_[c] != NIL
+           && now - nodes_[head_[c]].timestamp > classTtl) {
+      remove(head_[c]);
+      ++evicted;
+    }
+  }
+  return evicted;
+}
+
+bool MacCache::hasExpired(int64_t now) const {
+  for (size_t c = 0; c < CLASS_COUNT; ++c) {
+    if (head_[c] != NIL && now - nodes_[head_[c]].timestamp > ttl((MacAddressClass)c)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Head with the least time left to live, the best candidate to recycle
+uint16_t MacCache::expiringFirst(int64_t now) const {
+  uint16_t best = NIL;
+  int64_t bestLeft = 0;
+  for (size_t c = 0; c < CLASS_COUNT; ++c) {
+    if (head_[c] == NIL) continue;
+    int64_t left = ttl((MacAddressClass)c) - (now - nodes_[head_[c]].timestamp);
+    if (best == NIL || left < bestLeft) {
+      best = head_[c];
+      bestLeft = left;
+    }
+  }
+  return best;
+}
+
+uint16_t MacCache::find(MacKey const& k) const {
+  size_t slot = MacKeyHash{}(k) & TABLE_MASK;
+  while (table_[slot] != NIL) {
+    if (nodes_[table_[slot]].key == k) {
+      return table_[slot];
+    }
+    slot = (slot + 1) & TABLE_MASK;
   }
+  return NIL;
+}
+
+uint16_t MacCache::allocate(int64_t now) {
+  if (free_ == NIL) {
+    // Slab is full, recycle the entry closest to expiry
+    remove(expiringFirst(now));
+    ++evictedWhileFull_;
+  }
+  uint16_t idx = free_;
+  free_ = nodes_[idx].next;
+  return idx;
+}
+
+void MacCache::remove(uint16_t idx) {
+  eraseSlot(nodes_[idx].slot);
+  unlink(idx);
+  nodes_[idx].next = free_;
+  free_ = idx;
+  --size_;
+}
+
+// Backward-shift deletion keeps probe chains intact without tombstones
+void MacCache::eraseSlot(size_t slot) {
+  size_t hole = slot;
+  size_t j = slot;
+  while (true) {
+    j = (j + 1) & TABLE_MASK;
+    uint16_t idx = table_[j];
+    if (idx == NIL) {
+      break;
+    }
+    size_t home = MacKeyHash{}(nodes_[idx].key) & TABLE_MASK;
+    // The entry may move into the hole only if the hole lies on its probe path
+    bool homeInRange = (hole <= j) ? (hole < home && home <= j)
+                                   : (hole < home || home <= j);
+    if (homeInRange) {
+      continue;
+    }
+    table_[hole] = idx;
+    nodes_[idx].slot = (uint16_t)hole;
+    hole = j;
+  }
+  table_[hole] = NIL;
+}
+
+void MacCache::unlink(uint16_t idx) {
+  MacCacheEntry& n = nodes_[idx];
+  if (n.prev != NIL) nodes_[n.prev].next = n.next;
+  else               head_[n.cls]        = n.next;
+  if (n.next != NIL) nodes_[n.next].prev = n.prev;
+  else               tail_[n.cls]        = n.prev;
+  n.prev = NIL;
+  n.next = NIL;
 }
 
-void MacCache::appendToTail(Node* n) {
-  if (!tail_) {
-    head_ = tail_ = n;
+void MacCache::appendToTail(uint16_t idx) {
+  MacCacheEntry& n = nodes_[idx];
+  uint16_t& tail = tail_[n.cls];
+  n.prev = tail;
+  n.next = NIL;
+  if (tail == NIL) {
+    head_[n.cls] = idx;
   } else {
-    tail_->next = n;
-    n->prev     = tail_;
-    tail_       = n;
+    nodes_[tail].next = idx;
   }
+  tail = idx;
 }
 
-void MacCache::moveToTail(Node* n) {
-  if (n == tail_) return;
-  if (n->prev) n->prev->next = n->next;
-  else         head_         = n->next;
-  if (n->next) n->next->prev = n->prev;
-  n->prev      = tail_;
-  n->next      = nullptr;
-  tail_->next  = n;
-  tail_        = n;
+void MacCache::moveToTail(uint16_t idx) {
+  if (idx == tail_[nodes_[idx].cls]) return;
+  unlink(idx);
+  appendToTail(idx);
 }
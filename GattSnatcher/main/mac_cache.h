@@ -1,8 +1,29 @@
 #pragma once
+#include <atomic>
 #include <cstdint>
 #include <cstddef>
 #include <cstring>
-#include <unordered_map>
+#if __has_include("sdkconfig.h")
+#include "sdkconfig.h"
+#endif
+
+#ifndef CONFIG_MAC_CACHE_CAPACITY
+#define CONFIG_MAC_CACHE_CAPACITY 2048
+#endif
+#ifndef CONFIG_MAC_CACHE_TTL_PUBLIC_MIN
+#define CONFIG_MAC_CACHE_TTL_PUBLIC_MIN 60
+#endif
+#ifndef CONFIG_MAC_CACHE_TTL_STATIC_MIN
+#define CONFIG_MAC_CACHE_TTL_STATIC_MIN 60
+#endif
+#ifndef CONFIG_MAC_CACHE_TTL_RPA_MIN
+#define CONFIG_MAC_CACHE_TTL_RPA_MIN 15
+#endif
+#ifndef CONFIG_MAC_CACHE_TTL_NRPA_MIN
+#define CONFIG_MAC_CACHE_TTL_NRPA_MIN 5
+#endif
+// Upper end of the Kconfig range of the TTL options, also enforced for console changes
+#define MAC_CACHE_TTL_MAX_SEC (1440 * 60)
 
 struct MacKey {
   uint8_t addr[6];
@@ -11,34 +32,118 @@ struct MacKey {
 };
 
 struct MacKeyHash {
-  std::size_t operator()(MacKey const& k) const;
+  std::uint32_t operator()(MacKey const& k) const;
+};
+
+// Kind of address, decides how long the cache remembers it
+enum class MacAddressClass : uint8_t {
+  Public = 0,           // public or resolved public identity, never rotates
+  RandomStatic,         // random static, constant at least until power cycle
+  ResolvablePrivate,    // RPA, rotated by the device (typically every 15 min)
+  NonResolvablePrivate, // NRPA, may change with every advertising set
+  Other,                // reserved random sub-type or unknown addr_type
+  COUNT
 };
 
-struct Node {
-  MacKey   key;
-  int64_t  timestamp;
-  Node*    prev;
-  Node*    next;
+// Classify from the HCI addr_type and the two most significant address bits.
+// HCI addresses are little-endian, so the most significant byte is addr[5].
+MacAddressClass classifyMacAddress(MacKey const& k);
+const char* macAddressClassName(MacAddressClass c);
+
+// Parses a console command "ttl <class> <seconds>", <class> as named by
+// macAddressClassName(). Returns false if the line is not such a command or
+// the TTL is above MAC_CACHE_TTL_MAX_SEC.
+bool parseMacTtlCommand(const char* line, MacAddressClass& c, uint32_t& ttlSeconds);
+
+// Index table size: power of two, at most half full
+constexpr size_t macCacheTableSize(size_t capacity) {
+  size_t n = 1;
+  while (n < 2 * capacity) n <<= 1;
+  return n;
+}
+
+// One slab entry; prev/next are slab indices forming the LRU/TTL list
+struct MacCacheEntry {
+  int64_t   timestamp;
+  uint16_t  prev;
+  uint16_t  next;
+  uint16_t  slot;   // where the entry sits in the index table
+  MacKey    key;
+  uint8_t   cls;    // MacAddressClass, selects the TTL and the list
 };
 
+/**
+ * Fixed-capacity MAC cache deciding which advertisers get forwarded over UART.
+ *
+ * Entries live in a preallocated slab, an open-addressing (linear probing)
+ * table maps keys to slab indices. Every address class has its own TTL and
+ * its own oldest-first list, so each list expires in order and TTL eviction
+ * only ever looks at the list heads. Nothing is allocated after construction;
+ * when the slab is full the entry closest to expiry is recycled.
+ *
+ * TTLs can be changed at runtime from another task, everything else must be
+ * called from a single task.
+ */
 class MacCache {
 public:
-  static constexpr int64_t TTL = 20LL * 60 * 1000000; // 20 minutes in μs
+  // The single TTL used before addresses were classified, kept as the
+  // reference the saved-forwards counters compare against
+  static constexpr int64_t LEGACY_TTL = 20LL * 60 * 1000000; // 20 minutes in μs
+  static constexpr size_t CAPACITY = CONFIG_MAC_CACHE_CAPACITY;
+  static constexpr size_t CLASS_COUNT = (size_t)MacAddressClass::COUNT;
+  static constexpr uint16_t NIL = 0xFFFF;
+
+  // Per-class forwarding statistics
+  struct ClassStats {
+    uint32_t forwarded;       // reports passed on to the output
+    uint32_t suppressed;      // reports dropped because the entry was still alive
+    uint32_t savedVsLegacy;   // suppressed, but the legacy TTL would have forwarded them
+    uint32_t extraVsLegacy;   // forwarded, but the legacy TTL would have suppressed them
+  };
 
   MacCache();
-  ~MacCache();
+
+  void setTtl(MacAddressClass c, int64_t ttlUs);
+  int64_t ttl(MacAddressClass c) const;
 
   // Returns true if the entry is new or expired and should be printed
   bool shouldPrintAndAddToCache(MacKey const& k, int64_t now);
 
-  // Evict entries older than TTL
-  void evictOld(int64_t now);
+  // Evict at most maxNodes entries older than TTL, returns how many were evicted
+  size_t evictOld(int64_t now, size_t maxNodes = SIZE_MAX);
+
+  // True if the oldest entry is past its TTL, i.e. evictOld has work to do
+  bool hasExpired(int64_t now) const;
+
+  size_t size() const { return size_; }
+  ClassStats const& stats(MacAddressClass c) const { return stats_[(size_t)c]; }
+  // Entries recycled before their TTL ran out because the slab was full
+  uint32_t evictedWhileFull() const { return evictedWhileFull_; }
 
 private:
-  void appendToTail(Node* n);
-  void moveToTail(Node* n);
+  static constexpr size_t TABLE_SIZE = macCacheTableSize(CAPACITY);
+  static constexpr size_t TABLE_MASK = TABLE_SIZE - 1;
+  static_assert(CAPACITY > 0 && CAPACITY < NIL, "MAC cache capacity must fit the 16-bit slab index");
+  static_assert(TABLE_SIZE <= 65536, "MAC cache index table must be addressable by uint16_t");
+
+  int64_t ttlOf(MacCacheEntry const& n) const;
+  uint16_t expiringFirst(int64_t now) const;
+  uint16_t find(MacKey const& k) const;
+  uint16_t allocate(int64_t now);
+  void remove(uint16_t idx);
+  void eraseSlot(size_t slot);
+  void unlink(uint16_t idx);
+  void appendToTail(uint16_t idx);
+  void moveToTail(uint16_t idx);
 
-  std::unordered_map<MacKey, Node*, MacKeyHash> map_;
-  Node* head_ = nullptr;
-  Node* tail_ = nullptr;
+  MacCacheEntry nodes_[CAPACITY];
+  uint16_t table_[TABLE_SIZE];
+  uint16_t head_[CLASS_COUNT];
+  uint16_t tail_[CLASS_COUNT];
+  uint16_t free_ = NIL;
+  size_t size_ = 0;
+  uint32_t evictedWhileFull_ = 0;
+  // Seconds rather than μs so the value stays lock-free on 32-bit targets
+  std::atomic<uint32_t> ttlSec_[CLASS_COUNT];
+  ClassStats stats_[CLASS_COUNT] = {};
 };
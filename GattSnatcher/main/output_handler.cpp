@@ -1,6 +1,34 @@
 #include "output_handler.h"
 #include <rom_print_controller.h>
 #include "uart_controller.h"
+
+esp_err_t OutputHandler::printAdvertisingSingleReport(const LeAdvertisingReportView &report, uint8_t index)
+{
+    LeAdvertisingSingleReport singleReport;
+    report.toSingleReport(index, singleReport);
+    return printAdvertisingSingleReport(singleReport, report.timestamp);
+}
+
+esp_err_t OutputHandler::printExtAdvertisingSingleReport(const LeExtAdvertisingReportView &report, uint8_t index)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+// One failed report does not cost the rest of the batch, @return the first error
+esp_err_t OutputHandler::printAdvertisingReportBatch(const LeAdvertisingReportView *reports, size_t count)
+{
+    esp_err_t ret = ESP_OK;
+    for (size_t b = 0; b < count; b++) {
+        for (uint8_t i = 0; i < reports[b].num_reports; i++) {
+            esp_err_t err = printAdvertisingSingleReport(reports[b], i);
+            if (ret == ESP_OK) {
+                ret = err;
+            }
+        }
+    }
+    return ret;
+}
+
 // // Factory: Get the output handler singleton based on macro switch
 // OutputHandler* OutputHandler::getInstance() {
 // #ifdef CONFIG_OUTPUT_USE_UART
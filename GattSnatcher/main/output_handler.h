@@ -18,6 +18,11 @@ public:
     virtual esp_err_t init(bool isInterrogator) = 0;    // Initialize output with configuration
     virtual esp_err_t printAdvertisingSingleReport(const LeAdvertisingSingleReport &report, int64_t timestamp) = 0;     // Print a single advertising report
     virtual esp_err_t printAdvertisingReport(const LeAdvertisingReport &report) = 0;    // Print the entire advertising report (which contains one or more single reports)
+    // Zero-copy entry points used by the scanner hot path. The defaults materialize the view
+    // into LeAdvertisingSingleReport (formatting bdaddr_str) for sinks that only speak text.
+    virtual esp_err_t printAdvertisingSingleReport(const LeAdvertisingReportView &report, uint8_t index);
+    virtual esp_err_t printAdvertisingReportBatch(const LeAdvertisingReportView *reports, size_t count);    // Print a batch of reports drained in one pass
+    virtual esp_err_t printExtAdvertisingSingleReport(const LeExtAdvertisingReportView &report, uint8_t index);    // Print one extended advertising report
     virtual esp_err_t printString(const std::string& string) = 0;
     // virtual esp_err_t printPacketInfo(hci_data_t hciData) = 0;
 
@@ -0,0 +1,136 @@
+#include "payload_dictionary.h"
+
+#include <cstring>
+
+// FNV-1a, 32-bit
+uint32_t PayloadDictionary::hash(const uint8_t *data, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+PayloadDictionary::Device &PayloadDictionary::deviceFor(const uint8_t address[6], uint8_t addrType)
+{
+    uint32_t h = hash(address, 6) ^ addrType;
+    return _devices[h % MACS];
+}
+
+int PayloadDictionary::findEntry(uint32_t h, const uint8_t *payload, uint8_t len) const
+{
+    for (size_t i = 0; i < ENTRIES; i++) {
+        const Entry &entry = _entries[i];
+        if (entry.generation != 0 && entry.hash == h && entry.len == len
+            && memcmp(entry.data, payload, len) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+size_t PayloadDictionary::encode(const uint8_t address[6], uint8_t addrType, const uint8_t *payload,
+                                 uint8_t len, uint8_t *out)
+{
+    _pending.device = &deviceFor(address, addrType);
+    memcpy(_pending.address, address, 6);
+    _pending.addrType = addrType;
+    _pending.slot = -1;
+    _pending.insert = false;
+    _pending.len = len;
+
+    if (len > PAYLOAD_DICT_MAX_PAYLOAD) {
+        out[0] = PAYLOAD_ENCODING_FULL;
+        memcpy(out + 1, payload, len);
+        _pending.encoding = PAYLOAD_ENCODING_FULL;
+        _pending.encodedLen = 1 + (size_t)len;
+        return _pending.encodedLen;
+    }
+
+    uint32_t h = hash(payload, len);
+    _pending.hash = h;
+    memcpy(_pending.data, payload, len);
+
+    int slot = findEntry(h, payload, len);
+    if (slot >= 0) {
+        out[0] = PAYLOAD_ENCODING_REF;
+        out[1] = (uint8_t)slot;
+        _pending.encoding = PAYLOAD_ENCODING_REF;
+        _pending.slot = slot;
+        _pending.encodedLen = 2;
+        return _pending.encodedLen;
+    }
+
+    _pending.insert = true;
+    const Device &device = *_pending.device;
+    bool known = device.generation != 0 && device.addrType == addrType && memcmp(device.address, address, 6) == 0;
+    if (known && _entries[device.slot].generation == device.generation && _entries[device.slot].len == len) {
+        // Delta against the device's previous payload, if it pays off
+        const uint8_t *base = _entries[device.slot].data;
+        size_t n = 3;
+        for (uint8_t i = 0; i < len && n < 1 + (size_t)len; i++) {
+            if (payload[i] != base[i]) {
+                out[n++] = i;
+                out[n++] = payload[i] ^ base[i];
+            }
+        }
+        if (n < 1 + (size_t)len) {
+            out[0] = PAYLOAD_ENCODING_XOR;
+            out[1] = device.slot;
+            out[2] = (uint8_t)((n - 3) / 2);
+            _pending.encoding = PAYLOAD_ENCODING_XOR;
+            _pending.encodedLen = n;
+            return n;
+        }
+    }
+    out[0] = PAYLOAD_ENCODING_FULL;
+    memcpy(out + 1, payload, len);
+    _pending.encoding = PAYLOAD_ENCODING_FULL;
+    _pending.encodedLen = 1 + (size_t)len;
+    return _pending.encodedLen;
+}
+
+void PayloadDictionary::commit()
+{
+    if (_pending.encodedLen == 0) {
+        return;
+    }
+    switch (_pending.encoding) {
+        case PAYLOAD_ENCODING_REF: _stats.refs++; break;
+        case PAYLOAD_ENCODING_XOR: _stats.xors++; break;
+        default: _stats.full++; break;
+    }
+    _stats.bytesIn += _pending.len;
+    _stats.bytesOut += _pending.encodedLen;
+
+    if (_pending.insert) {
+        Entry &entry = _entries[_next];
+        _pending.slot = (int)_next;
+        _next = (_next + 1) % ENTRIES;
+        if (++_generation == 0) {
+            _generation = 1;
+        }
+        entry.hash = _pending.hash;
+        entry.generation = _generation;
+        entry.len = _pending.len;
+        memcpy(entry.data, _pending.data, _pending.len);
+    }
+    if (_pending.slot >= 0) {
+        Device &device = *_pending.device;
+        memcpy(device.address, _pending.address, 6);
+        device.addrType = _pending.addrType;
+        device.slot = (uint8_t)_pending.slot;
+        device.generation = _entries[_pending.slot].generation;
+    }
+    _pending.encodedLen = 0;
+}
+
+void PayloadDictionary::reset()
+{
+    memset(_entries, 0, sizeof(_entries));
+    memset(_devices, 0, sizeof(_devices));
+    _next = 0;
+    _pending.encodedLen = 0;
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#if __has_include("sdkconfig.h")
+#include "sdkconfig.h"
+#endif
+
+#ifndef CONFIG_SCANNER_LOG_DICT_ENTRIES
+#define CONFIG_SCANNER_LOG_DICT_ENTRIES 64
+#endif
+#ifndef CONFIG_SCANNER_LOG_DICT_MACS
+#define CONFIG_SCANNER_LOG_DICT_MACS 128
+#endif
+
+// Payloads longer than this are always stored in full (legacy advertising data is at most 31 bytes)
+#define PAYLOAD_DICT_MAX_PAYLOAD 31
+
+/**
+ * Payload encodings, the first byte of an encoded payload:
+ *   FULL  payload bytes
+ *   REF   slot(1): the payload is the dictionary entry in that slot
+ *   XOR   slot(1) count(1) count x (offset(1) xor(1)): the entry in that slot, with
+ *         the listed bytes XORed; only for payloads of the same length as the entry
+ * FULL and XOR payloads of at most PAYLOAD_DICT_MAX_PAYLOAD bytes are then added to the
+ * dictionary, in the slot after the previously added one (wrapping around). REF adds nothing.
+ */
+#define PAYLOAD_ENCODING_FULL 0
+#define PAYLOAD_ENCODING_REF 1
+#define PAYLOAD_ENCODING_XOR 2
+// Largest encoded payload: the encoding byte and a full 255-byte payload
+#define PAYLOAD_DICT_MAX_ENCODED (1 + UINT8_MAX)
+
+/**
+ * Dictionary coder for advertisement payloads in the scanner log.
+ *
+ * Devices repeat the same AD payload hundreds of times, or change only a counter or a
+ * battery byte. The coder remembers the last CONFIG_SCANNER_LOG_DICT_ENTRIES distinct
+ * payloads and writes a repeat (from any device, so it also spans address rotations)
+ * as a back-reference; a changed payload is written as an XOR delta against the
+ * previous payload of the same device when that is shorter than the payload.
+ *
+ * The decoder (dataAnalysis/includes/scanner_log.py) only needs the dictionary, which it
+ * rebuilds from the records. The per-device table is a hint for the encoder only, so it
+ * is a direct-mapped cache that simply forgets devices on collision.
+ *
+ * encode() does not change any state; commit() applies the last encoding once the
+ * record is actually in the log, so a dropped record cannot desynchronise the decoder.
+ * Standard C++ only, builds for the host. Not thread-safe, one writer per log.
+ */
+class PayloadDictionary {
+public:
+    static constexpr size_t ENTRIES = CONFIG_SCANNER_LOG_DICT_ENTRIES;
+    static constexpr size_t MACS = CONFIG_SCANNER_LOG_DICT_MACS;
+    static_assert(ENTRIES <= UINT8_MAX + 1, "slots are addressed by one byte");
+
+    struct Stats {
+        uint32_t full;
+        uint32_t refs;
+        uint32_t xors;
+        uint64_t bytesIn;       // payload bytes
+        uint64_t bytesOut;      // encoded payload bytes, including the encoding byte
+    };
+
+    /**
+     * Encodes @p payload of the device @p address / @p addrType into @p out.
+     * @return the encoded length, at most PAYLOAD_DICT_MAX_ENCODED
+     */
+    size_t encode(const uint8_t address[6], uint8_t addrType, const uint8_t *payload, uint8_t len,
+                  uint8_t *out);
+    // Applies the last encode() to the dictionary
+    void commit();
+    // Empties the dictionary, e.g. when a new log block is started
+    void reset();
+
+    Stats stats() const { return _stats; }
+
+private:
+    struct Entry {
+        uint32_t hash;
+        uint32_t generation;    // bumped each time the slot is overwritten, 0 while unused
+        uint8_t len;
+        uint8_t data[PAYLOAD_DICT_MAX_PAYLOAD];
+    };
+    struct Device {
+        uint8_t address[6];
+        uint8_t addrType;
+        uint8_t slot;           // dictionary slot holding the device's last payload
+        uint32_t generation;    // of that slot when it was recorded, 0 marks a free entry
+    };
+
+    static uint32_t hash(const uint8_t *data, size_t len);
+    Device &deviceFor(const uint8_t address[6], uint8_t addrType);
+    int findEntry(uint32_t hash, const uint8_t *payload, uint8_t len) const;
+
+    Entry _entries[ENTRIES] = {};
+    Device _devices[MACS] = {};
+    size_t _next = 0;
+    uint32_t _generation = 0;
+    Stats _stats = {};
+
+    // Outcome of the last encode(), applied by commit()
+    struct {
+        Device *device;
+        uint8_t address[6];
+        uint8_t addrType;
+        uint8_t encoding;
+        int slot;               // referenced slot for REF, -1 if nothing to remember
+        bool insert;
+        uint32_t hash;
+        uint8_t len;
+        uint8_t data[PAYLOAD_DICT_MAX_PAYLOAD];
+        size_t encodedLen;      // 0 when there is nothing to commit
+    } _pending = {};
+};
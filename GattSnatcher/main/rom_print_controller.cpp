@@ -3,15 +3,16 @@
 #include <cstring>
 #include <device_interrogator.h>
 #include <string>
-#include <sys/stat.h>
 
+#include <esp_littlefs.h>
 #include <esp_log.h>
 #include <hci_event_parser.h>
 #include <iomanip>
 #include <ios>
 static const char *TAG = "ROMPRINT";
 
-#define NUMBER_OF_ADVERTISEMENTS_TO_FLASH_AFTER 256
+static_assert(ScannerLogEncoder::BLOCK_SIZE <= BufferedLogWriter::PAGE_SIZE,
+              "a scanner log block must fit into one log writer page");
 
 FilePrintController * FilePrintController::getInstance() {
     static FilePrintController instance = {};
@@ -20,88 +21,199 @@ FilePrintController * FilePrintController::getInstance() {
 // FilePrintController class member variable
 FilePrintController::FilePrintController() = default;
 
-esp_err_t FilePrintController::init(bool isInterrogator) {
-    ESP_LOGI(TAG,"using the rom print controller");
-    const char* base_filename;
-    if (isInterrogator)
-    {
-       base_filename  = "/storage/interrogator_log";
-    }else
-    {
-        base_filename = "/storage/scanner_log";
-
+static uint32_t storageFreeBytes()
+{
+    size_t total = 0, used = 0;
+    if (esp_littlefs_info(STORAGE_PARTITION_LABEL, &total, &used) != ESP_OK) {
+        // unknown, assume there is room rather than deleting logs
+        return UINT32_MAX;
     }
-    const char* extension = ".bin";
-    int index = 0;
+    return (uint32_t)(total - used);
+}
 
+static bool writeScannerHeader(FILE *file)
+{
+    uint8_t header[SCANNER_LOG_HEADER_SIZE] = {};
+    memcpy(header, SCANNER_LOG_MAGIC, 4);
+    header[4] = SCANNER_LOG_VERSION;
+    return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
 
-    do {
-        snprintf(filename, sizeof(filename), "%s_%d%s", base_filename, index, extension);
-        ESP_LOGI(TAG, "Testing filename: %s", filename);
-        struct stat buffer;
-        if (stat(filename, &buffer) != 0) {
+// Drops the oldest segments until the partition has CONFIG_LOG_SEGMENT_MIN_FREE_KB free, @return the free bytes
+uint32_t FilePrintController::makeRoom()
+{
+    uint32_t freeBytes = storageFreeBytes();
+    while (freeBytes < (uint32_t)CONFIG_LOG_SEGMENT_MIN_FREE_KB * 1024) {
+        uint32_t oldest = _segments.first();
+        if (!_segments.dropOldest(freeBytes)) {
+            ESP_LOGW(TAG, "Storage nearly full (%u B free), no old segment left to drop", (unsigned)freeBytes);
             break;
         }
-        index++;
-    } while (index < 1000);
+        ESP_LOGW(TAG, "Storage nearly full (%u B free), dropped segment %u", (unsigned)freeBytes, (unsigned)oldest);
+        freeBytes = storageFreeBytes();
+    }
+    return freeBytes;
+}
+
+esp_err_t FilePrintController::init(bool isInterrogator) {
+    ESP_LOGI(TAG,"using the rom print controller");
+    // the timing file shares the number of its interrogator log
+    const char *basenames[] = {
+        isInterrogator ? INTERROGATOR_LOG_BASENAME : SCANNER_LOG_BASENAME,
+        INTERROGATOR_TIMING_BASENAME,
+    };
+    if (!_segments.open(basenames, isInterrogator ? 2 : 1, LOG_FILE_EXTENSION)) {
+        // not fatal, the next boot rebuilds the manifest from the directory
+        ESP_LOGW(TAG, "Failed to write the log manifest");
+    }
+    uint32_t segment = _segments.beginSegment(makeRoom());
+    _segments.segmentPath(segment, 0, filename, sizeof(filename));
 
     _outputFile = fopen(filename, "w");
     if (_outputFile == nullptr) {
         ESP_LOGE(TAG, "Failed to create output file");
         return ESP_FAIL;
     }
-    ESP_LOGI(TAG, "File successfully opened");
+    _fileIndex.store((int)segment, std::memory_order_relaxed);
+    ESP_LOGI(TAG, "File %s successfully opened (segments %u-%u on flash)", filename,
+             (unsigned)_segments.first(), (unsigned)segment);
+    if (!isInterrogator) {
+        if (!writeScannerHeader(_outputFile)) {
+            ESP_LOGE(TAG, "Failed to write the log header");
+            return ESP_FAIL;
+        }
+        if (!_writer.start(_outputFile, [this] { return openNextSegment(); })) {
+            ESP_LOGE(TAG, "Failed to start the log writer");
+            return ESP_FAIL;
+        }
+    }
+    if (isInterrogator)
+    {
+        char timingFilename[64];
+        _segments.segmentPath(segment, 1, timingFilename, sizeof(timingFilename));
+        _timingFile = fopen(timingFilename, "w");
+        if (_timingFile == nullptr) {
+            // not fatal, the profiles are still logged
+            ESP_LOGE(TAG, "Failed to create timing file %s", timingFilename);
+        }
+    }
     return ESP_OK;
 }
 
 esp_err_t FilePrintController::printAdvertisingSingleReport(const LeAdvertisingSingleReport &report, int64_t timestamp) {
+    return writeRecord({timestamp, report.adv_event_type, (uint8_t)report.addr_type, report.raw_bdaddr,
+                        report.adv_data_length, report.adv_data, report.rssi, nullptr});
+}
+
+esp_err_t FilePrintController::printAdvertisingSingleReport(const LeAdvertisingReportView &report, uint8_t index) {
+    const auto &r = report.reports[index];
+    return writeRecord({report.timestamp, r.adv_event_type, r.addr_type, report.bdaddr(index),
+                        r.adv_data_length, report.advData(index), r.rssi, nullptr});
+}
+
+esp_err_t FilePrintController::printExtAdvertisingSingleReport(const LeExtAdvertisingReportView &report, uint8_t index) {
+    const auto &r = report.reports[index];
+    uint8_t ext[SCANNER_RECORD_EXT_SIZE] = {
+        (uint8_t)(r.event_type & 0xFF), (uint8_t)(r.event_type >> 8),
+        r.primary_phy, r.secondary_phy, r.sid, (uint8_t)r.tx_power,
+        (uint8_t)(r.periodic_adv_interval & 0xFF), (uint8_t)(r.periodic_adv_interval >> 8),
+    };
+    return writeRecord({report.timestamp, SCANNER_RECORD_EXT_MARKER, r.addr_type, report.bdaddr(index),
+                        r.adv_data_length, report.advData(index), r.rssi, ext});
+}
+
+esp_err_t FilePrintController::writeRecord(const ScannerLogRecord &record) {
     if (__builtin_expect(_outputFile == nullptr,false))
     {
         ESP_LOGE(TAG, "FILE is not initialized!!");
         return ESP_FAIL;
     }
-    static int flip = 0;
-    // --- build a 16-byte header ---
-    uint8_t hdr[16];
-    uint64_t ts = (uint64_t)timestamp;
-    // copy only the low 48 bits of ts
-    for (int i = 0; i < 6; ++i) {
-        hdr[i] = ts & 0xFF;
-        ts >>= 8;
-    }
-    hdr[6] = report.adv_event_type;
-    hdr[7] = report.addr_type;
-    // raw MAC must be in report.bdaddr[6]
-    memcpy(hdr + 8, report.raw_bdaddr, 6);
-    hdr[14] = report.adv_data_length;
-    hdr[15] = (uint8_t)report.rssi;
-
-    // single atomic write of header
-    size_t written = fwrite(hdr, 1/*sizeof(uint8_t)*/, sizeof(hdr), _outputFile);
-    if (__builtin_expect(written != sizeof(hdr),false)) {
-        ESP_LOGE(TAG, "Failed writing LittleFS record header: expected %u bytes, wrote %u bytes", sizeof(hdr), written);
-        return ESP_FAIL;
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    // A block the writer had no page for is counted in its droppedRecords; this record
+    // goes into the next block either way, so it is not an error of this record
+    if (blockDueLocked(record.timestamp)) {
+        // a block that fills slowly still reaches the flash within the commit interval
+        writeBlockLocked(true);
+    }
+    if (!_encoder.add(record)) {
+        writeBlockLocked(false);
+        if (!_encoder.add(record)) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+    return ESP_OK;
+}
+
+bool FilePrintController::blockDueLocked(int64_t now) const {
+    return !_encoder.empty() && now - _encoder.baseTimestamp() >= (int64_t)CONFIG_LOG_WRITER_COMMIT_MS * 1000;
+}
+
+esp_err_t FilePrintController::closeBlockIfDue(int64_t now) {
+    if (_outputFile == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    return blockDueLocked(now) ? writeBlockLocked(true) : ESP_OK;
+}
+
+// Hands the open block to the writer task, which commits it to flash
+esp_err_t FilePrintController::writeBlockLocked(bool commitNow) {
+    const uint8_t *block;
+    size_t len = _encoder.finish(block);
+    if (len == 0) {
+        return ESP_OK;
+    }
+    if (__builtin_expect(!_writer.write(block, len), false)) {
+        return ESP_ERR_NO_MEM;
+    }
+    _segmentBytes += len;
+    // the writer task opens the next segment; while it is busy with the previous one, try again with the next block
+    if (__builtin_expect(_segmentBytes >= (size_t)CONFIG_LOG_SEGMENT_SIZE_KB * 1024, false) && _writer.rotate()) {
+        _segmentBytes = 0;
+    } else if (commitNow) {
+        _writer.commitAsync();
     }
-    fflush(_outputFile);
-    if (flip == NUMBER_OF_ADVERTISEMENTS_TO_FLASH_AFTER)
-    {
-        flip = 0;
-        ESP_LOGI(TAG,"fsync!");
-        fsync(fileno(_outputFile));
-    }else
-    {
-        flip++;
-    }
-        // fprintf(_outputFile, "%lld,%d,%d,%s,%d,%d\n",
-        //                    timestamp,
-        //                    report.adv_event_type,
-        //                    report.addr_type,
-        //                    report.bdaddr_str,
-        //                    report.adv_data_length,
-        //                    report.rssi);
     return ESP_OK;
 }
 
+/**
+ * Opens the segment the scanner log continues in. Runs on the writer task, which
+ * closes the current segment once it is complete; the number is only reserved in
+ * the manifest once the file is there. @return nullptr to stay in the current segment
+ */
+FILE * FilePrintController::openNextSegment() {
+    char path[sizeof(filename)];
+    uint32_t freeBytes = makeRoom();
+    uint32_t segment = _segments.nextUnused();
+    _segments.segmentPath(segment, 0, path, sizeof(path));
+    FILE *next = fopen(path, "w");
+    if (next == nullptr || !writeScannerHeader(next)) {
+        // the HCI task tries again one segment later
+        ESP_LOGE(TAG, "Failed to create segment %s, staying in %s", path, filename);
+        if (next != nullptr) {
+            fclose(next);
+            remove(path);
+        }
+        return nullptr;
+    }
+    _segments.reserve(segment, freeBytes);
+    ESP_LOGI(TAG, "Scanner log continues in %s", path);
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    _outputFile = next;
+    memcpy(filename, path, sizeof(filename));
+    _fileIndex.store((int)segment, std::memory_order_relaxed);
+    return next;
+}
+
+esp_err_t FilePrintController::flush()
+{
+    {
+        std::lock_guard<std::mutex> lock(_encoderMutex);
+        ERR_GUARD(writeBlockLocked(false));
+    }
+    return _writer.flush() ? ESP_OK : ESP_FAIL;
+}
+
 esp_err_t FilePrintController::printAdvertisingReport(const LeAdvertisingReport &advReport) {
 
     for (uint8_t i = 0; i < advReport.num_reports; i++) {
@@ -130,6 +242,7 @@ void FilePrintController::printGattProfileJson(int APP_ID, const gattc_profile_i
     fprintf(_outputFile, "\",\n");
     fprintf(_outputFile, "  \"advertisement_filename\": \"%s\",\n", profile.interrogation_request.advertisementFilename);
     fprintf(_outputFile, "  \"interrogation_timestamp\": %lld,\n", profile.interrogation_request.timestamp);
+    fprintf(_outputFile, "  \"fingerprint\": \"%016llx\",\n", (unsigned long long)profile.fingerprint);
     fprintf(_outputFile, "  \"services\": [\n");
 
     for (size_t si = 0; si < profile.services.size(); ++si) {
@@ -168,6 +281,9 @@ void FilePrintController::printGattProfileJson(int APP_ID, const gattc_profile_i
 
             fprintf(_outputFile, "          \"handle\": %d,\n", cw.meta.char_handle);
             fprintf(_outputFile, "          \"properties\": %d,\n", cw.meta.properties);
+            if (cw.cached) {
+                fprintf(_outputFile, "          \"cached\": true,\n");
+            }
 
             fprintf(_outputFile, "          \"value\": [");
             for (size_t v = 0; v < cw.value.size(); ++v) {
@@ -189,7 +305,20 @@ void FilePrintController::printGattProfileJson(int APP_ID, const gattc_profile_i
     fsync(fileno(_outputFile));
     ESP_LOGI(TAG, "fsync from json complete!");
 }
-char * FilePrintController::getFilename()
+esp_err_t FilePrintController::printConnectionTiming(const ConnectionTimingRecord &record)
 {
-    return filename;
-}
\ No newline at end of file
+    if (_timingFile == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint8_t buf[TIMING_RECORD_SIZE];
+    record.encode(buf);
+    size_t written = fwrite(buf, 1, sizeof(buf), _timingFile);
+    if (written != sizeof(buf)) {
+        ESP_LOGE(TAG, "Failed writing timing record: expected %u bytes, wrote %u bytes", sizeof(buf), written);
+        return ESP_FAIL;
+    }
+    fflush(_timingFile);
+    fsync(fileno(_timingFile));
+    return ESP_OK;
+}
+
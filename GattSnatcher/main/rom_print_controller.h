@@ -1,6 +1,20 @@
 #pragma once
 #include "struct_and_definitions.h"
 #include "output_handler.h"
+#include "connection_profiler.h"
+#include "buffered_log_writer.h"
+#include "scanner_log_encoder.h"
+#include "log_segment_manager.h"
+
+#include <atomic>
+#include <mutex>
+
+#define SCANNER_LOG_BASENAME "/storage/scanner_log"
+#define INTERROGATOR_LOG_BASENAME "/storage/interrogator_log"
+// Binary ConnectionTimingRecords, one file per interrogator log with the same index
+#define INTERROGATOR_TIMING_BASENAME "/storage/interrogator_timing"
+#define LOG_FILE_EXTENSION ".bin"
+#define STORAGE_PARTITION_LABEL "storage"
 
 class FilePrintController : public OutputHandler {
 
@@ -15,12 +29,41 @@ public:
 
     esp_err_t init(bool isInterrogator) override;
     esp_err_t printAdvertisingSingleReport(const LeAdvertisingSingleReport &report, int64_t timestamp) override;
+    esp_err_t printAdvertisingSingleReport(const LeAdvertisingReportView &report, uint8_t index) override;
+    esp_err_t printExtAdvertisingSingleReport(const LeExtAdvertisingReportView &report, uint8_t index) override;
     esp_err_t printAdvertisingReport(const LeAdvertisingReport &advReport) override;
     esp_err_t printString(const std::string& string) override;
     // esp_err_t printPacketInfo(hci_data_t hciData) override;
     void printGattProfileJson(int APP_ID, const gattc_profile_inst* gl_profile_tab);
-    char * getFilename();
+    esp_err_t printConnectionTiming(const ConnectionTimingRecord &record);
+    /**
+     * Segment the scanner log is written to, -1 before init(); it moves to a new one every
+     * CONFIG_LOG_SEGMENT_SIZE_KB. The writer task switches segments, so records handed over
+     * shortly before a switch can still land in the previous one.
+     */
+    int getFileIndex() const { return _fileIndex.load(std::memory_order_relaxed); }
+    // Commits the buffered scanner records to flash, blocking until they are written
+    esp_err_t flush();
+    // Hands the open block to the writer once it is CONFIG_LOG_WRITER_COMMIT_MS old, for when no records arrive
+    esp_err_t closeBlockIfDue(int64_t now);
+    BufferedLogWriter::Stats writerStats() { return _writer.stats(); }
+    PayloadDictionary::Stats dictionaryStats() {
+        std::lock_guard<std::mutex> lock(_encoderMutex);
+        return _encoder.dictionaryStats();
+    }
     private:
+    esp_err_t writeRecord(const ScannerLogRecord &record);
+    esp_err_t writeBlockLocked(bool commitNow);
+    bool blockDueLocked(int64_t now) const;
+    FILE * openNextSegment();
+    uint32_t makeRoom();
     FILE * _outputFile = nullptr;
-    char filename[64];
+    FILE * _timingFile = nullptr;
+    BufferedLogWriter _writer;  // scanner records only, the interrogator writes its JSON directly
+    std::mutex _encoderMutex;
+    ScannerLogEncoder _encoder;
+    LogSegmentManager _segments;  // used by the writer thread once init() has started it
+    size_t _segmentBytes = 0;   // scanner blocks handed to the writer for the current segment
+    char filename[64];          // only touched by the writer task once init() has started it
+    std::atomic<int> _fileIndex{-1};
 };
\ No newline at end of file
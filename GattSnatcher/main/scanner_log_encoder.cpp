@@ -0,0 +1,125 @@
+#include "scanner_log_encoder.h"
+#include "uart_frame.h"
+
+#include <cstring>
+
+// Largest record apart from its payload: type, two varints, a new device, length, rssi, extension
+#define RECORD_OVERHEAD_MAX (1 + 10 + 2 + 7 + 2 + SCANNER_RECORD_EXT_SIZE)
+
+static size_t putVarint(uint8_t *out, uint64_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+static uint64_t zigzag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+size_t ScannerLogEncoder::findDevice(const uint8_t *bdaddr, uint8_t addrType, size_t &slot) const
+{
+    uint32_t h = addrType;
+    for (int i = 0; i < 6; i++) {
+        h = h * 31 + bdaddr[i];
+    }
+    slot = h % DEVICE_SLOTS;
+    while (_deviceSlots[slot] != 0) {
+        const uint8_t *device = _devices[_deviceSlots[slot] - 1];
+        if (device[6] == addrType && memcmp(device, bdaddr, 6) == 0) {
+            return _deviceSlots[slot] - 1;
+        }
+        slot = (slot + 1) % DEVICE_SLOTS;
+    }
+    return SCANNER_BLOCK_MAX_DEVICES;
+}
+
+bool ScannerLogEncoder::add(const ScannerLogRecord &record)
+{
+    // an encoded payload is never longer than the encoding byte plus the payload
+    size_t worst = RECORD_OVERHEAD_MAX + 1 + record.advDataLength;
+    if (_used + worst + SCANNER_BLOCK_CRC_SIZE > BLOCK_SIZE) {
+        return false;
+    }
+    size_t slot;
+    size_t index = findDevice(record.bdaddr, record.addrType, slot);
+    if (index == SCANNER_BLOCK_MAX_DEVICES && _deviceCount == SCANNER_BLOCK_MAX_DEVICES) {
+        return false;
+    }
+    if (_count == 0) {
+        _base = record.timestamp;
+        _last = record.timestamp;
+    }
+
+    uint8_t *out = _block + _used;
+    size_t n = 0;
+    out[n++] = record.advEventType;
+    n += putVarint(out + n, zigzag(record.timestamp - _last));
+    _last = record.timestamp;
+    if (index == SCANNER_BLOCK_MAX_DEVICES) {
+        index = _deviceCount++;
+        memcpy(_devices[index], record.bdaddr, 6);
+        _devices[index][6] = record.addrType;
+        _deviceSlots[slot] = (uint8_t)(index + 1);
+        n += putVarint(out + n, index);
+        memcpy(out + n, _devices[index], 7);
+        n += 7;
+    } else {
+        n += putVarint(out + n, index);
+    }
+    out[n++] = record.advDataLength;
+    out[n++] = (uint8_t)record.rssi;
+    if (record.advEventType == SCANNER_RECORD_EXT_MARKER) {
+        memcpy(out + n, record.extension, SCANNER_RECORD_EXT_SIZE);
+        n += SCANNER_RECORD_EXT_SIZE;
+    }
+    // The block is written whole or not at all, so the dictionary can learn right away
+    n += _dictionary.encode(record.bdaddr, record.addrType, record.advData, record.advDataLength, out + n);
+    _dictionary.commit();
+
+    _used += n;
+    _count++;
+    return true;
+}
+
+size_t ScannerLogEncoder::finish(const uint8_t *&block)
+{
+    if (_count == 0) {
+        return 0;
+    }
+    size_t bodyLen = _used - SCANNER_BLOCK_HEADER_SIZE;
+    uint8_t *hdr = _block;
+    hdr[0] = SCANNER_BLOCK_SYNC0;
+    hdr[1] = SCANNER_BLOCK_SYNC1;
+    hdr[2] = bodyLen & 0xFF;
+    hdr[3] = bodyLen >> 8;
+    hdr[4] = _count & 0xFF;
+    hdr[5] = _count >> 8;
+    uint64_t ts = (uint64_t)_base;
+    // low 48 bits, as in the older record formats
+    for (int i = 0; i < 6; ++i) {
+        hdr[6 + i] = ts & 0xFF;
+        ts >>= 8;
+    }
+    uint16_t crc = uartFrameCrc16(_block, _used);
+    _block[_used] = crc & 0xFF;
+    _block[_used + 1] = crc >> 8;
+    size_t len = _used + SCANNER_BLOCK_CRC_SIZE;
+    block = _block;
+    reset();
+    return len;
+}
+
+void ScannerLogEncoder::reset()
+{
+    _used = SCANNER_BLOCK_HEADER_SIZE;
+    _count = 0;
+    _deviceCount = 0;
+    memset(_deviceSlots, 0, sizeof(_deviceSlots));
+    _dictionary.reset();
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "payload_dictionary.h"
+
+#include <cstddef>
+#include <cstdint>
+#if __has_include("sdkconfig.h")
+#include "sdkconfig.h"
+#endif
+
+#ifndef CONFIG_SCANNER_LOG_BLOCK_SIZE
+#define CONFIG_SCANNER_LOG_BLOCK_SIZE 2048
+#endif
+
+/**
+ * Scanner log format, decoded by dataAnalysis/includes/scanner_log.py.
+ *
+ * A file starts with SCANNER_LOG_HEADER_SIZE bytes: the magic, the format version and
+ * reserved zeros. Files without the magic are version 1. Versions 1-3 were flat
+ * 16-byte records; version 4 is a sequence of blocks, each decodable on its own:
+ *
+ *   sync(2) body_len(2) count(2) base_timestamp(6) body crc16(2)
+ *
+ * The CRC (see uartFrameCrc16) covers everything from sync to the end of the body, so
+ * a torn or corrupt block is skipped and the reader resynchronises on the next sync.
+ * Every record in the body is
+ *
+ *   adv_event_type  [SCANNER_RECORD_EXT_MARKER for extended reports]
+ *   varint          timestamp delta in μs to the previous record (the base for the first), zigzag
+ *   varint          index into the block's device table; the table size adds a device,
+ *                   followed by bdaddr(6) addr_type(1)
+ *   adv_data_length rssi
+ *   extension       SCANNER_RECORD_EXT_SIZE bytes, extended reports only:
+ *                   event_type(2), primary_phy, secondary_phy, sid, tx_power, periodic_adv_interval(2)
+ *   payload         as encoded by PayloadDictionary
+ *
+ * Varints are LEB128. The device table and the payload dictionary start empty in every block.
+ */
+#define SCANNER_LOG_MAGIC "GSNL"
+#define SCANNER_LOG_VERSION 4
+#define SCANNER_LOG_HEADER_SIZE 8
+
+#define SCANNER_BLOCK_SYNC0 0xB7
+#define SCANNER_BLOCK_SYNC1 0x5C
+#define SCANNER_BLOCK_HEADER_SIZE 12
+#define SCANNER_BLOCK_CRC_SIZE 2
+#define SCANNER_BLOCK_MAX_DEVICES 255
+
+// Value of the adv_event_type byte marking an extended record. Legacy event types are 0x00-0x04.
+#define SCANNER_RECORD_EXT_MARKER 0xFF
+#define SCANNER_RECORD_EXT_SIZE 8
+
+struct ScannerLogRecord {
+    int64_t timestamp;
+    uint8_t advEventType;
+    uint8_t addrType;
+    const uint8_t *bdaddr;
+    uint8_t advDataLength;
+    const uint8_t *advData;
+    int8_t rssi;
+    const uint8_t *extension;   // SCANNER_RECORD_EXT_SIZE bytes if advEventType is the marker
+};
+
+/**
+ * Builds the blocks of a version 4 scanner log in RAM.
+ *
+ * add() appends records to the open block; once a record does not fit, the caller
+ * finish()es the block, writes it out and adds the record again. A block holds
+ * CONFIG_SCANNER_LOG_BLOCK_SIZE bytes at most, which is what a torn write can lose.
+ *
+ * Standard C++ only (plus uart_frame for the CRC), builds for the host. Not thread-safe.
+ */
+class ScannerLogEncoder {
+public:
+    static constexpr size_t BLOCK_SIZE = CONFIG_SCANNER_LOG_BLOCK_SIZE;
+
+    // @return false if the record does not fit into the open block, which is then left unchanged
+    bool add(const ScannerLogRecord &record);
+
+    /**
+     * Closes the open block and points @p block at it; valid until the next add().
+     * @return the block length, 0 if the block is empty
+     */
+    size_t finish(const uint8_t *&block);
+
+    bool empty() const { return _count == 0; }
+    // Timestamp of the first record of the open block
+    int64_t baseTimestamp() const { return _base; }
+    PayloadDictionary::Stats dictionaryStats() const { return _dictionary.stats(); }
+
+private:
+    static constexpr size_t DEVICE_SLOTS = 512;     // open addressing over the device table
+    static_assert(DEVICE_SLOTS > 2 * SCANNER_BLOCK_MAX_DEVICES, "keep the device table sparse");
+    static_assert(BLOCK_SIZE <= UINT16_MAX, "body_len is 16 bits");
+
+    // @return the device's index in the block, SCANNER_BLOCK_MAX_DEVICES if it is new
+    size_t findDevice(const uint8_t *bdaddr, uint8_t addrType, size_t &slot) const;
+    void reset();
+
+    uint8_t _block[BLOCK_SIZE];
+    size_t _used = SCANNER_BLOCK_HEADER_SIZE;
+    size_t _count = 0;
+    int64_t _base = 0;
+    int64_t _last = 0;
+    uint8_t _devices[SCANNER_BLOCK_MAX_DEVICES][7];     // bdaddr, addr_type
+    size_t _deviceCount = 0;
+    uint8_t _deviceSlots[DEVICE_SLOTS] = {};            // device index + 1, 0 is free
+    PayloadDictionary _dictionary;
+};
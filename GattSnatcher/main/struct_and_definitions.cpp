@@ -1,5 +1,9 @@
  #include "struct_and_definitions.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
 
 bool LeAdvertisingReport::isAdvertisingReportConnectable() const
 {
@@ -12,3 +16,78 @@ bool LeAdvertisingReport::isAdvertisingReportConnectable() const
     }
     return false;
 }
+
+bool LeAdvertisingReportView::isAdvertisingReportConnectable() const
+{
+    for (uint8_t i = 0; i < this->num_reports; i++) {
+        uint8_t adv_type = this->reports[i].adv_event_type;
+        // ADV_IND (0x00) and ADV_DIRECT_IND (0x01) are connectable types
+        if (adv_type == 0x00 || adv_type == 0x01) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LeAdvertisingReportView::formatBdaddr(uint8_t i, char (&out)[18]) const
+{
+    const uint8_t *addr = bdaddr(i);
+    snprintf(out, sizeof(out), "%02x:%02x:%02x:%02x:%02x:%02x",
+             addr[5], addr[4], addr[3], addr[2], addr[1], addr[0]);
+}
+
+void LeAdvertisingReportView::toSingleReport(uint8_t i, LeAdvertisingSingleReport &out) const
+{
+    const auto &r = reports[i];
+    out.adv_event_type = r.adv_event_type;
+    out.addr_type = (esp_ble_addr_type_t) r.addr_type;
+    formatBdaddr(i, out.bdaddr_str);
+    memcpy(out.raw_bdaddr, bdaddr(i), 6);
+    out.adv_data_length = r.adv_data_length;
+    memcpy(out.adv_data, advData(i), r.adv_data_length);
+    out.rssi = r.rssi;
+}
+
+bool LeExtAdvertisingReportView::isAdvertisingReportConnectable() const
+{
+    for (uint8_t i = 0; i < this->num_reports; i++) {
+        if (isConnectable(i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LeExtAdvertisingReportView::formatBdaddr(uint8_t i, char (&out)[18]) const
+{
+    const uint8_t *addr = bdaddr(i);
+    snprintf(out, sizeof(out), "%02x:%02x:%02x:%02x:%02x:%02x",
+             addr[5], addr[4], addr[3], addr[2], addr[1], addr[0]);
+}
+
+void gattc_profile_inst::requeueMultiRead()
+{
+    for (int i = 0; i < multi_read.num_attr; i++) {
+        read_char_queue.push_back(multi_read.handles[i]);
+    }
+    multi_read.num_attr = 0;
+}
+
+size_t gattc_profile_inst::expirePendingReads(TickType_t now)
+{
+    auto firstExpired = std::partition(pending_requests.begin(), pending_requests.end(), [&](auto &pr) {
+        return (int32_t)(now - pr.deadline) <= 0;
+    });
+    for (auto it = firstExpired; it != pending_requests.end(); ++it) {
+        if (it->multiple) {
+            // the peer may just not answer Read Multiple, retry the handles one by one
+            multi_read_unsupported = true;
+            requeueMultiRead();
+        } else {
+            reads_timed_out++;
+        }
+    }
+    size_t expired = pending_requests.end() - firstExpired;
+    pending_requests.erase(firstExpired, pending_requests.end());
+    return expired;
+}
@@ -5,6 +5,7 @@
 #include <freertos/semphr.h>
 
 #include <deque>
+#include <mutex>
 // #include <device_interrogator.h>
 #include <esp_bt_defs.h>
 #include <esp_err.h>
@@ -19,6 +20,8 @@
 #define HCI_BUFFER_SIZE 10  // Empirically tested that ESP manages to process messages fast enough,
                             // that 3 items are mostly sufficient
 #define MAX_NUM_REPORTS 0x19
+#define MAX_NUM_EXT_REPORTS 0x0A // [Vol. 4, Part E, 7.7.65.13]
+#define EXT_ADV_DATA_MAX_PER_EVENT 229 // what fits in one event, longer payloads arrive in fragments
 #define CONNECTION_OPEN_TIMEOUT_SECONDS 75
 struct BLEInterrogateProfileParams
 {
@@ -33,6 +36,9 @@ typedef struct
     esp_ble_addr_type_t addr_type;
     int64_t timestamp;
     char advertisementFilename[64];
+    int8_t rssi;
+    int64_t queued_at;  // local esp_timer time the request entered the queue
+    int64_t seen_at;    // local esp_timer time of the latest advertisement merged into it
 } interrogation_request_t;
 
 
@@ -56,22 +62,61 @@ struct LeAdvertisingReport {
 
 };
 
-//im lazy and need to move fast..this is effectively what is sent over uart..
-//<timestamp>,<adv_event_type>,<addr_type>,<bdaddr>,<adv_data_length>,<rssi>,<scanForProfiling>
-//ADV:1623456789,0,0,AA:BB:CC:DD:EE:FF,0,-65
-struct LeAdvertisingSingleReportWithTimestamp
-{
-    int64_t timestamp;
+// Lightweight view of one report: offsets into the HCI packet it was parsed from, nothing is copied
+struct LeAdvertisingSingleReportView {
     uint8_t adv_event_type;
     uint8_t addr_type;
-    char bdaddr_str[18];
     uint8_t adv_data_length;
-    uint8_t adv_data[31];
     int8_t rssi;
-    char advertisementFilename[64];
-    int8_t needForProfiling;
+    uint16_t bdaddr_offset;     // raw 6-byte BD_ADDR, little endian as sent by the controller
+    uint16_t adv_data_offset;
+};
+
+struct LeAdvertisingReportView {
+    int64_t timestamp;       // Timestamp from the HCI data
+    const uint8_t *data;     // HCI packet the offsets point into, must outlive the view
+    uint16_t len;
+    uint8_t num_reports;
+    struct LeAdvertisingSingleReportView reports[MAX_NUM_REPORTS];
+
+    const uint8_t *bdaddr(uint8_t i) const { return data + reports[i].bdaddr_offset; }
+    const uint8_t *advData(uint8_t i) const { return data + reports[i].adv_data_offset; }
+    // Formats "xx:xx:xx:xx:xx:xx" only when somebody needs the text form
+    void formatBdaddr(uint8_t i, char (&out)[18]) const;
+    void toSingleReport(uint8_t i, LeAdvertisingSingleReport &out) const;
+    bool isAdvertisingReportConnectable() const;
+};
+
+// Extended report (LE subevent 0x0D), kept apart so the legacy view stays small
+struct LeExtAdvertisingSingleReportView {
+    uint16_t event_type;            // bit 0 connectable, bit 4 legacy PDU, bits 5-6 data status
+    uint8_t addr_type;              // 0xFF for anonymous advertisements
+    uint8_t primary_phy;
+    uint8_t secondary_phy;
+    uint8_t sid;
+    int8_t tx_power;                // 127 when not available
+    int8_t rssi;
+    uint16_t periodic_adv_interval; // 1.25 ms units, 0 when there is no periodic advertising
+    uint8_t adv_data_length;
+    uint16_t bdaddr_offset;
+    uint16_t adv_data_offset;
 };
 
+struct LeExtAdvertisingReportView {
+    int64_t timestamp;
+    const uint8_t *data;
+    uint16_t len;
+    uint8_t num_reports;
+    struct LeExtAdvertisingSingleReportView reports[MAX_NUM_EXT_REPORTS];
+
+    const uint8_t *bdaddr(uint8_t i) const { return data + reports[i].bdaddr_offset; }
+    const uint8_t *advData(uint8_t i) const { return data + reports[i].adv_data_offset; }
+    void formatBdaddr(uint8_t i, char (&out)[18]) const;
+    bool isConnectable(uint8_t i) const { return reports[i].event_type & 0x0001; }
+    bool isAdvertisingReportConnectable() const;
+};
+
+
 typedef struct {
     int64_t timestamp;
     uint16_t len;
@@ -86,10 +131,6 @@ struct BLEEvent {
     BLEEventType type;
     LeAdvertisingReport report;
 };
-struct BLEProfile
-{
-    //TODO list of services, their values too?
-};
 
 
 struct ServiceRange {
@@ -99,7 +140,10 @@ struct ServiceRange {
 
 struct CharacteristicWrapper {
     esp_gattc_char_elem_t  meta;            // handle/UUID/props
-    std::vector<uint8_t>   value;           // will grow to value_len on read
+    std::vector<uint8_t>   value;           // will grow to value_len on read, capped by GattReadPolicy
+    bool                   readable = false;    // GattReadPolicy verdict, taken once at discovery
+    bool                   truncated = false;   // the value was longer than the cap
+    bool                   cached = false;      // value taken from GattProfileCache instead of read
 };
 
 // holds one service’s handle range + its characteristics
@@ -110,12 +154,22 @@ struct ServiceWrapper {
 };
 
 struct PendingRequest {
-    uint16_t handle;      // which characteristic we asked to read
-    TickType_t timestamp; // xTaskGetTickCount() when we sent it
+    uint16_t handle;      // which characteristic we asked to read, first handle for a Read Multiple
+    TickType_t deadline;  // xTaskGetTickCount() after which the read is given up
+    bool multiple;        // Read Multiple, the handles are in gattc_profile_inst::multi_read
+};
+
+// Milestones of one interrogation, see ConnectionProfiler
+enum ConnectionMark {
+    MARK_DISPATCH = 0,  // esp_ble_gattc_open issued
+    MARK_OPEN,          // ESP_GATTC_OPEN_EVT with success
+    MARK_MTU,           // ESP_GATTC_CFG_MTU_EVT
+    MARK_SEARCH_CMPL,   // ESP_GATTC_SEARCH_CMPL_EVT, the reads start
+    MARK_END,           // finalProcedure, after the reads or a disconnect
+    CONNECTION_MARK_COUNT
 };
 
 struct gattc_profile_inst {
-    esp_gattc_cb_t gattc_cb;
     uint16_t gattc_if;
     uint16_t app_id;
     uint16_t conn_id;
@@ -123,12 +177,31 @@ struct gattc_profile_inst {
     uint16_t char_handle;
     esp_bd_addr_t remote_bda;
     std::deque<uint16_t> read_char_queue;//waiting to be sent
-    std::vector<PendingRequest> pending_requests;//sent, waiting for result
-    SemaphoreHandle_t characteristicReadSemaphore;
-    TickType_t read_timeout_ticks = pdMS_TO_TICKS(10000);
+    std::vector<PendingRequest> pending_requests;//sent, waiting for result, at most GATT_READ_WINDOW
+    std::mutex read_lock;   // guards read_char_queue, pending_requests, is_char_scheduled and the stored values
+                            // between the GATTC callback and the monitor
+    uint16_t mtu;
+    esp_gattc_multi_t multi_read;       // handles of the Read Multiple in flight, num_attr 0 if none
+    bool multi_read_unsupported;        // the peer rejected Read Multiple, read one handle at a time
+    TickType_t connected_since;
+    uint64_t fingerprint;       // GattProfileCache::fingerprint of the discovered layout, 0 before discovery
+    int64_t marks[CONNECTION_MARK_COUNT];   // esp_timer time each milestone was reached, 0 if not (yet)
+    uint16_t reads_done;
+    uint16_t reads_timed_out;
+    uint16_t reads_failed;      // handles whose read request the stack refused, so never read
     bool is_busy;
     TickType_t busy_since;
     bool is_char_scheduled;
     bool should_force_unregister;
     interrogation_request_t interrogation_request;
+
+    // Puts the handles of a failed or timed out Read Multiple back to the single read queue
+    void requeueMultiRead();
+    /**
+     * Gives up the pending requests past their deadline. A Read Multiple is retried as
+     * single reads, which get deadlines of their own, so only single reads are added to
+     * reads_timed_out. Caller holds read_lock.
+     * @return the number of requests given up
+     */
+    size_t expirePendingReads(TickType_t now);
 };
\ No newline at end of file
@@ -10,6 +10,8 @@
 
 static const char *TAG = "UART_CTRL";
 
+#define UART_EVENT_QUEUE_SIZE 20
+
 UartController * UartController::getInstance()
 {
     static UartController instance = {};
@@ -36,40 +38,61 @@ esp_err_t UartController::init(bool isInterrogator)  {
         _uart_num,
         HCI_BUFFER_SIZE * HCI_EVENT_MAX_SIZE,
         HCI_BUFFER_SIZE * HCI_EVENT_MAX_SIZE,
-        HCI_BUFFER_SIZE,
-        nullptr,
+        isInterrogator ? UART_EVENT_QUEUE_SIZE : 0,
+        isInterrogator ? &_eventQueue : nullptr,
         0
         ),"uart_driver_install failed");
     return ESP_OK;
 }
 
+esp_err_t UartController::sendAdvReportFrame(const UartAdvReportFrame &frame)
+{
+    uint8_t encoded[UART_FRAME_ADV_REPORT_SIZE];
+    size_t len = uartFrameEncodeAdvReport(frame, _txSeq++, encoded);
+    if (uart_write_bytes(_uart_num, encoded, len) != (int)len) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
 esp_err_t UartController::printAdvertisingSingleReport(const LeAdvertisingSingleReport &report, int64_t timestamp)  {
-        //<timestamp>,<adv_event_type>,<addr_type>,<bdaddr>,<adv_data_length>,<rssi>
-        //ADV:1623456789,0,0,AA:BB:CC:DD:EE:FF,0,-65
-        char formatted_str[256];
-        if (!currentlyUsedFilename)
-        {
-            snprintf(formatted_str, sizeof(formatted_str), "%lld,%d,%d,%s,%d,%d,-\n",
-             timestamp,
-             report.adv_event_type,
-             report.addr_type,
-             report.bdaddr_str,
-             report.adv_data_length,
-             report.rssi);
-        }else
-        {
-            snprintf(formatted_str, sizeof(formatted_str), "%lld,%d,%d,%s,%d,%d%s\n",
-             timestamp,
-             report.adv_event_type,
-             report.addr_type,
-             report.bdaddr_str,
-             report.adv_data_length,
-             report.rssi,
-             currentlyUsedFilename);
-        }
+    UartAdvReportFrame frame;
+    frame.timestamp = timestamp;
+    frame.event_type = report.adv_event_type;
+    frame.addr_type = report.addr_type;
+    memcpy(frame.addr, report.raw_bdaddr, sizeof(frame.addr));
+    frame.adv_data_length = report.adv_data_length;
+    frame.rssi = report.rssi;
+    frame.file_id = _fileId;
+    return sendAdvReportFrame(frame);
+}
 
-        uart_print(_uart_num, formatted_str);
-    return ESP_OK;
+esp_err_t UartController::printAdvertisingSingleReport(const LeAdvertisingReportView &report, uint8_t index)  {
+    // The frame carries the raw address, so nothing has to be formatted on the hot path
+    const auto &r = report.reports[index];
+    UartAdvReportFrame frame;
+    frame.timestamp = report.timestamp;
+    frame.event_type = r.adv_event_type;
+    frame.addr_type = r.addr_type;
+    memcpy(frame.addr, report.bdaddr(index), sizeof(frame.addr));
+    frame.adv_data_length = r.adv_data_length;
+    frame.rssi = r.rssi;
+    frame.file_id = _fileId;
+    return sendAdvReportFrame(frame);
+}
+
+esp_err_t UartController::printExtAdvertisingSingleReport(const LeExtAdvertisingReportView &report, uint8_t index)  {
+    // Same frame as for legacy reports, event_type carries the 16-bit extended event type
+    const auto &r = report.reports[index];
+    UartAdvReportFrame frame;
+    frame.timestamp = report.timestamp;
+    frame.event_type = r.event_type;
+    frame.addr_type = r.addr_type;
+    memcpy(frame.addr, report.bdaddr(index), sizeof(frame.addr));
+    frame.adv_data_length = r.adv_data_length;
+    frame.rssi = r.rssi;
+    frame.file_id = _fileId;
+    return sendAdvReportFrame(frame);
 }
 
 esp_err_t UartController::printAdvertisingReport(const LeAdvertisingReport &advReport)  {
@@ -97,7 +120,7 @@ esp_err_t UartController::printString(const std::string& string)
 //     return ESP_OK;
 // }
 
-void UartController::setCurrentlyUsedFilename(char * filename)
+void UartController::setCurrentFileId(uint16_t fileId)
 {
-    currentlyUsedFilename = filename;
+    _fileId = fileId;
 }
\ No newline at end of file
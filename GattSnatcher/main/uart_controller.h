@@ -1,8 +1,11 @@
 #pragma once
 #include "struct_and_definitions.h"
 #include <output_handler.h>
+#include <uart_frame.h>
 #include <string>
 #include <hal/uart_types.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
 //---------------------------------------------------------
 // UART Controller Implementation
 //---------------------------------------------------------
@@ -19,13 +22,22 @@ public:
     esp_err_t init(bool isInterrogator) override;
 
     esp_err_t printAdvertisingSingleReport(const LeAdvertisingSingleReport &report, int64_t timestamp) override;
+    esp_err_t printAdvertisingSingleReport(const LeAdvertisingReportView &report, uint8_t index) override;
+    esp_err_t printExtAdvertisingSingleReport(const LeExtAdvertisingReportView &report, uint8_t index) override;
     esp_err_t printAdvertisingReport(const LeAdvertisingReport &advReport) override;
     esp_err_t printString(const std::string& string) override;
     // esp_err_t printPacketInfo(hci_data_t hciData) override;
-    void setCurrentlyUsedFilename(char * filename);
-    char * currentlyUsedFilename;
+    // Index of the collector log file, sent with every report so the questioner can refer to it
+    void setCurrentFileId(uint16_t fileId);
+    // uart_event_t queue of the driver, only created on the receiving (questioner) side
+    QueueHandle_t getEventQueue() const { return _eventQueue; }
 
 private:
+    esp_err_t sendAdvReportFrame(const UartAdvReportFrame &frame);
+    uint16_t _fileId = UART_FRAME_NO_FILE_ID;
+    uint8_t _txSeq = 0;
+    QueueHandle_t _eventQueue = nullptr;
+
     UartController() : _uart_num(CONFIG_UART_PORT_NUM) {} // Private constructor for singleton
     uart_config_t _uartConfig = {
         .baud_rate = CONFIG_UART_BAUD_RATE,
@@ -0,0 +1,170 @@
+#include "uart_frame.h"
+
+#include <cstring>
+
+// CRC-16/CCITT-FALSE (poly 0x1021), nibble table to keep the footprint small
+uint16_t uartFrameCrc16(const uint8_t *data, size_t len, uint16_t crc)
+{
+    static const uint16_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+        0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    };
+    for (size_t i = 0; i < len; i++) {
+        crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (data[i] >> 4)]);
+        crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (data[i] & 0x0F)]);
+    }
+    return crc;
+}
+
+static void putLe16(uint8_t *out, uint16_t value)
+{
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static uint16_t getLe16(const uint8_t *in)
+{
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+size_t uartFrameEncodeAdvReport(const UartAdvReportFrame &report, uint8_t seq, uint8_t *out)
+{
+    out[0] = UART_FRAME_SYNC_0;
+    out[1] = UART_FRAME_SYNC_1;
+    out[2] = UART_FRAME_ADV_REPORT;
+    out[3] = seq;
+    out[4] = UART_FRAME_ADV_REPORT_PAYLOAD_SIZE;
+
+    uint8_t *p = out + UART_FRAME_HEADER_SIZE;
+    for (int i = 0; i < 6; i++) {
+        p[i] = (uint8_t)(report.timestamp >> (8 * i));
+    }
+    putLe16(p + 6, report.event_type);
+    p[8] = report.addr_type;
+    memcpy(p + 9, report.addr, 6);
+    p[15] = report.adv_data_length;
+    p[16] = (uint8_t)report.rssi;
+    putLe16(p + 17, report.file_id);
+
+    uint16_t crc = uartFrameCrc16(out + 2, UART_FRAME_HEADER_SIZE - 2 + UART_FRAME_ADV_REPORT_PAYLOAD_SIZE);
+    putLe16(p + UART_FRAME_ADV_REPORT_PAYLOAD_SIZE, crc);
+    return UART_FRAME_ADV_REPORT_SIZE;
+}
+
+bool uartFrameDecodeAdvReport(const uint8_t *payload, size_t len, UartAdvReportFrame &report)
+{
+    if (len != UART_FRAME_ADV_REPORT_PAYLOAD_SIZE) {
+        return false;
+    }
+    int64_t timestamp = 0;
+    for (int i = 0; i < 6; i++) {
+        timestamp |= (int64_t)payload[i] << (8 * i);
+    }
+    report.timestamp = timestamp;
+    report.event_type = getLe16(payload + 6);
+    report.addr_type = payload[8];
+    memcpy(report.addr, payload + 9, 6);
+    report.adv_data_length = payload[15];
+    report.rssi = (int8_t)payload[16];
+    report.file_id = getLe16(payload + 17);
+    return true;
+}
+
+size_t UartFrameDecoder::feed(const uint8_t *data, size_t len)
+{
+    if (_start == _end) {
+        _start = _end = 0;
+    } else if (_end + len > sizeof(_buffer) && _start > 0) {
+        memmove(_buffer, _buffer + _start, _end - _start);
+        _end -= _start;
+        _start = 0;
+    }
+    size_t room = sizeof(_buffer) - _end;
+    size_t take = len < room ? len : room;
+    memcpy(_buffer + _end, data, take);
+    _end += take;
+    return take;
+}
+
+void UartFrameDecoder::discard(size_t count)
+{
+    _start += count;
+    _bytesDiscarded += count;
+}
+
+void UartFrameDecoder::reset()
+{
+    if (_end > _start) {
+        _framesTruncated++;
+        _bytesDiscarded += _end - _start;
+    }
+    _start = _end = 0;
+    _haveSeq = false;
+}
+
+// Payload length of every frame type the collector sends
+static bool headerValid(uint8_t type, size_t payloadLen)
+{
+    switch (type) {
+    case UART_FRAME_ADV_REPORT:
+        return payloadLen == UART_FRAME_ADV_REPORT_PAYLOAD_SIZE;
+    default:
+        return false;
+    }
+}
+
+bool UartFrameDecoder::next(Frame &frame)
+{
+    while (true) {
+        // Skip to the next sync sequence
+        const uint8_t *base = _buffer + _start;
+        size_t available = _end - _start;
+        size_t skip = 0;
+        while (skip + 1 < available
+               && !(base[skip] == UART_FRAME_SYNC_0 && base[skip + 1] == UART_FRAME_SYNC_1)) {
+            skip++;
+        }
+        if (skip + 1 >= available && available > 0 && base[available - 1] != UART_FRAME_SYNC_0) {
+            // Not even half a sync sequence left
+            skip = available;
+        }
+        if (skip > 0) {
+            discard(skip);
+            continue;
+        }
+        if (available < UART_FRAME_HEADER_SIZE) {
+            return false;
+        }
+
+        size_t payloadLen = base[4];
+        // A corrupted length could otherwise hold back up to a full payload of good frames
+        if (!headerValid(base[2], payloadLen)) {
+            _headerErrors++;
+            discard(1);
+            continue;
+        }
+        size_t total = UART_FRAME_HEADER_SIZE + payloadLen + UART_FRAME_CRC_SIZE;
+        if (available < total) {
+            return false;
+        }
+        uint16_t crc = uartFrameCrc16(base + 2, UART_FRAME_HEADER_SIZE - 2 + payloadLen);
+        if (crc != getLe16(base + UART_FRAME_HEADER_SIZE + payloadLen)) {
+            _crcErrors++;
+            discard(1);
+            continue;
+        }
+
+        frame.type = base[2];
+        frame.seq = base[3];
+        frame.len = (uint8_t)payloadLen;
+        frame.payload = base + UART_FRAME_HEADER_SIZE;
+        if (_haveSeq) {
+            _framesLost += (uint8_t)(frame.seq - _lastSeq - 1);
+        }
+        _haveSeq = true;
+        _lastSeq = frame.seq;
+        _framesDecoded++;
+        _start += total;
+        return true;
+    }
+}
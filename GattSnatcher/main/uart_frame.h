@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Binary framing of the collector -> questioner UART link.
+ *
+ * Frame layout, multi-byte fields little-endian:
+ *   [0xA5][0x5A][type][seq][len][payload: len bytes][crc16]
+ * The CRC (CRC-16/CCITT-FALSE) covers type, seq, len and the payload.
+ * seq is incremented by the sender for every frame, so the receiver can count lost frames.
+ *
+ * Advertising report payload (UART_FRAME_ADV_REPORT, UART_FRAME_ADV_REPORT_PAYLOAD_SIZE bytes):
+ *   timestamp(6, μs) event_type(2) addr_type(1) addr(6, HCI byte order) adv_data_length(1) rssi(1) file_id(2)
+ */
+#define UART_FRAME_SYNC_0 0xA5
+#define UART_FRAME_SYNC_1 0x5A
+#define UART_FRAME_HEADER_SIZE 5
+#define UART_FRAME_CRC_SIZE 2
+#define UART_FRAME_MAX_PAYLOAD 255
+#define UART_FRAME_MAX_SIZE (UART_FRAME_HEADER_SIZE + UART_FRAME_MAX_PAYLOAD + UART_FRAME_CRC_SIZE)
+
+#define UART_FRAME_ADV_REPORT 0x01
+#define UART_FRAME_ADV_REPORT_PAYLOAD_SIZE 19
+#define UART_FRAME_ADV_REPORT_SIZE (UART_FRAME_HEADER_SIZE + UART_FRAME_ADV_REPORT_PAYLOAD_SIZE + UART_FRAME_CRC_SIZE)
+
+// file_id value used when the collector has no log file open
+#define UART_FRAME_NO_FILE_ID 0xFFFF
+
+struct UartAdvReportFrame {
+    int64_t timestamp;
+    uint16_t event_type;
+    uint8_t addr_type;
+    uint8_t addr[6];        // as received over HCI, least significant byte first
+    uint8_t adv_data_length;
+    int8_t rssi;
+    uint16_t file_id;
+};
+
+uint16_t uartFrameCrc16(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF);
+
+/**
+ * Encodes one advertising report frame into out, which must hold UART_FRAME_ADV_REPORT_SIZE bytes.
+ * @return number of bytes written
+ */
+size_t uartFrameEncodeAdvReport(const UartAdvReportFrame &report, uint8_t seq, uint8_t *out);
+
+/**
+ * Decodes an advertising report payload. @return false if the length does not match.
+ */
+bool uartFrameDecodeAdvReport(const uint8_t *payload, size_t len, UartAdvReportFrame &report);
+
+/**
+ * Reassembles frames from an arbitrarily chunked byte stream.
+ *
+ * Bytes are appended with feed(), complete frames are taken out with next().
+ * On a bad CRC only the first sync byte is dropped and the search restarts
+ * right behind it, so a valid frame hidden inside a corrupted one is not lost.
+ * A header with an unknown type, or a length that does not match its type, is
+ * dropped the same way as soon as it is buffered, instead of first waiting for
+ * the up to UART_FRAME_MAX_PAYLOAD bytes its length field claims.
+ */
+class UartFrameDecoder {
+public:
+    struct Frame {
+        uint8_t type;
+        uint8_t seq;
+        uint8_t len;
+        const uint8_t *payload;     // valid until the next feed()
+    };
+
+    /**
+     * @return number of bytes consumed; less than len only if the internal buffer is full,
+     * in which case next() has to be drained before feeding the rest.
+     */
+    size_t feed(const uint8_t *data, size_t len);
+
+    /**
+     * @return true and fills frame if a complete, CRC-valid frame is buffered.
+     */
+    bool next(Frame &frame);
+
+    /**
+     * Drops everything buffered, e.g. after the UART driver flushed its input on an overflow.
+     * A partially received frame is counted as truncated, the sequence tracking restarts.
+     */
+    void reset();
+
+    uint32_t framesDecoded() const { return _framesDecoded; }
+    uint32_t crcErrors() const { return _crcErrors; }
+    uint32_t headerErrors() const { return _headerErrors; }
+    uint32_t bytesDiscarded() const { return _bytesDiscarded; }
+    uint32_t framesLost() const { return _framesLost; }
+    uint32_t framesTruncated() const { return _framesTruncated; }
+
+private:
+    void discard(size_t count);
+
+    uint8_t _buffer[2 * UART_FRAME_MAX_SIZE];
+    size_t _start = 0;          // first unconsumed byte
+    size_t _end = 0;            // one past the last buffered byte
+    bool _haveSeq = false;
+    uint8_t _lastSeq = 0;
+
+    uint32_t _framesDecoded = 0;
+    uint32_t _crcErrors = 0;
+    uint32_t _headerErrors = 0;
+    uint32_t _bytesDiscarded = 0;
+    uint32_t _framesLost = 0;   // gaps in the sequence numbers of valid frames
+    uint32_t _framesTruncated = 0;
+};
@@ -0,0 +1,298 @@
+"""
+Decoder for the scanner log files (scanner_log_<n>.bin), see scanner_log_encoder.h.
+
+Version 2+ files start with an 8-byte header: b"GSNL", the format version, 3 reserved bytes.
+Files without it are version 1 and carry no advertisement payloads.
+
+Every record is a 16-byte header: timestamp(6), adv_event_type, addr_type, mac(6),
+adv_data_length, rssi. Extended records (adv_event_type == EXT_RECORD_MARKER) continue
+with 8 bytes: event_type(2), primary_phy, secondary_phy, sid, tx_power,
+periodic_adv_interval(2). Version 2 follows with the adv_data_length payload bytes,
+version 3 with the payload encoded against a dictionary (payload_dictionary.h):
+  FULL(0) payload | REF(1) slot | XOR(2) slot count count*(offset xor)
+FULL and XOR payloads of at most DICT_MAX_PAYLOAD bytes are added to the dictionary in
+the slot after the previously added one. The dictionary starts empty in every file.
+
+Version 4 drops the flat records for checksummed blocks that decode on their own:
+  sync(2) body_len(2) count(2) base_timestamp(6) body crc16(2)
+with records of
+  adv_event_type, varint zigzag timestamp delta, varint device index [+ mac(6) addr_type],
+  adv_data_length, rssi, [extension], encoded payload
+The device table and the payload dictionary start empty in every block. A block with a
+bad CRC is skipped and decoding resumes at the next sync bytes.
+"""
+import binascii
+import io
+import struct
+
+MAGIC = b"GSNL"
+HEADER_SIZE = 8
+RECORD_HEADER_SIZE = 16
+# adv_event_type value marking an extended advertising record (legacy types are 0x00-0x04)
+EXT_RECORD_MARKER = 0xFF
+EXT_RECORD_SIZE = 8
+SUPPORTED_VERSIONS = (1, 2, 3, 4)
+
+BLOCK_SYNC = b"\xB7\x5C"
+BLOCK_HEADER_SIZE = 12
+BLOCK_CRC_SIZE = 2
+
+PAYLOAD_FULL = 0
+PAYLOAD_REF = 1
+PAYLOAD_XOR = 2
+DICT_MAX_PAYLOAD = 31
+# CONFIG_SCANNER_LOG_DICT_ENTRIES of the firmware that wrote the file
+DEFAULT_DICT_ENTRIES = 64
+
+
+class ScannerLogError(Exception):
+    pass
+
+
+class PayloadDictionary:
+    """Decoder side of PayloadDictionary, rebuilt from the records as they are read."""
+
+    def __init__(self, entries=DEFAULT_DICT_ENTRIES):
+        self.entries = [None] * entries
+        self.next = 0
+
+    def _add(self, payload):
+        if len(payload) <= DICT_MAX_PAYLOAD:
+            self.entries[self.next] = payload
+            self.next = (self.next + 1) % len(self.entries)
+
+    def _entry(self, slot):
+        if slot >= len(self.entries) or self.entries[slot] is None:
+            raise ScannerLogError(f"reference to empty dictionary slot {slot}, wrong entry count?")
+        return self.entries[slot]
+
+    def read_payload(self, bin_file, length):
+        """Reads one encoded payload, @return the payload or None if the file ends inside it."""
+        head = bin_file.read(1)
+        if len(head) < 1:
+            return None
+        encoding = head[0]
+        if encoding == PAYLOAD_FULL:
+            payload = bin_file.read(length)
+            if len(payload) < length:
+                return None
+            self._add(payload)
+            return payload
+        if encoding == PAYLOAD_REF:
+            slot = bin_file.read(1)
+            if len(slot) < 1:
+                return None
+            return self._entry(slot[0])
+        if encoding == PAYLOAD_XOR:
+            head = bin_file.read(2)
+            if len(head) < 2:
+                return None
+            delta = bin_file.read(2 * head[1])
+            if len(delta) < 2 * head[1]:
+                return None
+            payload = bytearray(self._entry(head[0]))
+            if len(payload) != length:
+                raise ScannerLogError("XOR delta against a payload of a different length")
+            for i in range(0, len(delta), 2):
+                payload[delta[i]] ^= delta[i + 1]
+            payload = bytes(payload)
+            self._add(payload)
+            return payload
+        raise ScannerLogError(f"unknown payload encoding {encoding}")
+
+
+def mac_bytes_to_str(mac_bytes):
+    return ':'.join(f'{b:02X}' for b in reversed(mac_bytes))
+
+
+def read_version(bin_file):
+    """Reads the file header and returns the format version, leaving the file at the first record."""
+    header = bin_file.read(HEADER_SIZE)
+    if header[:4] != MAGIC:
+        # version 1 has no header, the bytes belong to the first record
+        bin_file.seek(0)
+        return 1
+    if len(header) < HEADER_SIZE:
+        raise ScannerLogError("truncated file header")
+    version = header[4]
+    if version not in SUPPORTED_VERSIONS:
+        raise ScannerLogError(f"unsupported scanner log version {version}")
+    return version
+
+
+def empty_record():
+    return {
+        "timestamp_us": None,
+        "adv_event_type": None,
+        "addr_type": None,
+        "mac_address": None,
+        "adv_data_length": None,
+        "rssi": None,
+        "primary_phy": None,
+        "secondary_phy": None,
+        "sid": None,
+        "tx_power": None,
+        "periodic_adv_interval": None,
+        "adv_data": None,
+    }
+
+
+def read_extension(record, ext):
+    (record["adv_event_type"], record["primary_phy"], record["secondary_phy"], record["sid"],
+     record["tx_power"], record["periodic_adv_interval"]) = struct.unpack("<HBBBbH", ext)
+
+
+def read_varint(body):
+    value = 0
+    shift = 0
+    while True:
+        byte = body.read(1)
+        if len(byte) < 1:
+            raise ScannerLogError("varint runs past the end of the block")
+        value |= (byte[0] & 0x7F) << shift
+        if byte[0] < 0x80:
+            return value
+        shift += 7
+
+
+def decode_block(body, count, timestamp, dict_entries):
+    """Decodes the records of one block whose CRC was already checked."""
+    body = io.BytesIO(body)
+    dictionary = PayloadDictionary(dict_entries)
+    devices = []
+    for _ in range(count):
+        start = body.tell()
+        record = empty_record()
+        head = body.read(1)
+        if len(head) < 1:
+            raise ScannerLogError("block holds fewer records than its header says")
+        record["adv_event_type"] = head[0]
+        delta = read_varint(body)
+        timestamp += (delta >> 1) ^ -(delta & 1)
+        record["timestamp_us"] = timestamp
+        index = read_varint(body)
+        if index == len(devices):
+            devices.append(body.read(7))
+        elif index > len(devices):
+            raise ScannerLogError(f"device index {index} past the device table")
+        device = devices[index]
+        record["mac_address"] = mac_bytes_to_str(device[0:6])
+        record["addr_type"] = device[6]
+        fields = body.read(2)
+        if len(fields) < 2:
+            raise ScannerLogError("record runs past the end of the block")
+        record["adv_data_length"] = fields[0]
+        record["rssi"] = struct.unpack("b", fields[1:2])[0]
+        if head[0] == EXT_RECORD_MARKER:
+            read_extension(record, body.read(EXT_RECORD_SIZE))
+        record["adv_data"] = dictionary.read_payload(body, record["adv_data_length"])
+        if record["adv_data"] is None:
+            raise ScannerLogError("payload runs past the end of the block")
+        record["record_size"] = body.tell() - start
+        yield record
+
+
+def block_at(data, sync):
+    """@return (end of body, record count) if a valid block starts at @p sync, else None."""
+    end = sync + BLOCK_HEADER_SIZE
+    if end > len(data):
+        return None
+    body_len, count = struct.unpack("<HH", data[sync + 2:sync + 6])
+    end += body_len
+    if end + BLOCK_CRC_SIZE > len(data):
+        return None
+    if binascii.crc_hqx(data[sync:end], 0xFFFF) != struct.unpack("<H", data[end:end + BLOCK_CRC_SIZE])[0]:
+        return None
+    return end, count
+
+
+def find_block(data, pos):
+    """Finds the first valid block at or after @p pos, skipping torn blocks and stray sync bytes."""
+    sync = data.find(BLOCK_SYNC, pos)
+    while sync >= 0:
+        block = block_at(data, sync)
+        if block is not None:
+            return (sync,) + block
+        sync = data.find(BLOCK_SYNC, sync + 1)
+    return None
+
+
+def skip(stats, length):
+    if length > 0:
+        stats["bad_blocks"] += 1
+        stats["skipped_bytes"] += length
+
+
+def iter_blocks(bin_file, dict_entries, stats):
+    # the rest of the file after the header, scanner logs fit into memory easily
+    data = bin_file.read()
+    pos = 0
+    while True:
+        found = find_block(data, pos)
+        if found is None:
+            # the torn tail, if any
+            skip(stats, len(data) - pos)
+            return
+        sync, end, count = found
+        skip(stats, sync - pos)
+        stats["blocks"] += 1
+        timestamp = struct.unpack("<Q", data[sync + 6:sync + 12] + b'\x00\x00')[0]
+        first = True
+        for record in decode_block(data[sync + BLOCK_HEADER_SIZE:end], count, timestamp, dict_entries):
+            if first:
+                record["record_size"] += BLOCK_HEADER_SIZE + BLOCK_CRC_SIZE
+                first = False
+            yield record
+        pos = end + BLOCK_CRC_SIZE
+
+
+def iter_records(bin_file, dict_entries=DEFAULT_DICT_ENTRIES, stats=None):
+    """
+    Yields one dict per record. A truncated last record (power loss during a write) ends
+    the iteration without an error; in version 4 files, corrupt blocks are skipped and
+    counted in @p stats ("blocks", "bad_blocks", "skipped_bytes") if given.
+    "record_size" is the number of bytes the record took in the file, the block overhead
+    is added to the first record of each block.
+    """
+    version = read_version(bin_file)
+    if version >= 4:
+        if stats is None:
+            stats = {}
+        for key in ("blocks", "bad_blocks", "skipped_bytes"):
+            stats.setdefault(key, 0)
+        yield from iter_blocks(bin_file, dict_entries, stats)
+        return
+    dictionary = PayloadDictionary(dict_entries)
+    while True:
+        start = bin_file.tell()
+        hdr = bin_file.read(RECORD_HEADER_SIZE)
+        if len(hdr) < RECORD_HEADER_SIZE:
+            return
+        record = empty_record()
+        record["timestamp_us"] = struct.unpack("<Q", hdr[0:6] + b'\x00\x00')[0]
+        record["adv_event_type"] = hdr[6]
+        record["addr_type"] = hdr[7]
+        record["mac_address"] = mac_bytes_to_str(hdr[8:14])
+        record["adv_data_length"] = hdr[14]
+        record["rssi"] = struct.unpack("b", hdr[15:16])[0]
+        if hdr[6] == EXT_RECORD_MARKER:
+            ext = bin_file.read(EXT_RECORD_SIZE)
+            if len(ext) < EXT_RECORD_SIZE:
+                return
+            read_extension(record, ext)
+        if version == 2:
+            payload = bin_file.read(record["adv_data_length"])
+            if len(payload) < record["adv_data_length"]:
+                return
+            record["adv_data"] = payload
+        elif version >= 3:
+            record["adv_data"] = dictionary.read_payload(bin_file, record["adv_data_length"])
+            if record["adv_data"] is None:
+                return
+        record["record_size"] = bin_file.tell() - start
+        yield record
+
+
+def read_records(input_path, dict_entries=DEFAULT_DICT_ENTRIES, stats=None):
+    with open(input_path, "rb") as bin_file:
+        yield from iter_records(bin_file, dict_entries, stats)
@@ -93,6 +93,8 @@ def extracteachfile(fs, output_dir):
                 local_path = os.path.join('dataFiles', 'scanner', 'unprocessed', rounded_ts, fname)
             elif fname.startswith('interrogator_log_'):
                 local_path = os.path.join('dataFiles', 'questioner', 'unprocessed', rounded_ts, fname)
+            elif fname.startswith('interrogator_timing_'):
+                local_path = os.path.join('dataFiles', 'timing', 'unprocessed', rounded_ts, fname)
             else:
                 local_path = os.path.join(output_dir, root, fname)
             os.makedirs(os.path.dirname(local_path), exist_ok=True)
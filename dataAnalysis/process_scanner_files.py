@@ -1,40 +1,33 @@
-import struct
 import csv
 import os
-import shutil
+import sys
+
+# Add the directory containing scanner_log.py to sys.path
+script_dir = os.path.dirname(__file__)
+includes_dir = os.path.join(script_dir, "includes")
+sys.path.insert(0, includes_dir)
+
+from scanner_log import read_records
 
 INPUT_DIR = "./dataFiles/scanner/unprocessed"
 PROCESSED_DIR = "./dataFiles/scanner/processed"
 
-def mac_bytes_to_str(mac_bytes):
-    return ':'.join(f'{b:02X}' for b in reversed(mac_bytes))
+COLUMNS = [
+    "timestamp_us", "adv_event_type", "addr_type",
+    "mac_address", "adv_data_length", "rssi",
+    "primary_phy", "secondary_phy", "sid", "tx_power", "periodic_adv_interval",
+    "adv_data"
+]
 
 def parse_single_file(input_path, output_path):
-    with open(input_path, "rb") as bin_file, open(output_path, "w", newline="") as csv_file:
+    with open(output_path, "w", newline="") as csv_file:
         writer = csv.writer(csv_file)
-        writer.writerow([
-            "timestamp_us", "adv_event_type", "addr_type",
-            "mac_address", "adv_data_length", "rssi"
-        ])
-
-        while True:
-            hdr = bin_file.read(16)
-            if len(hdr) < 16:
-                break
-
-            ts_bytes = hdr[0:6] + b'\x00\x00'
-            timestamp = struct.unpack("<Q", ts_bytes)[0]
-            adv_event_type = hdr[6]
-            addr_type = hdr[7]
-            mac_address = mac_bytes_to_str(hdr[8:14])
-            adv_data_length = hdr[14]
-            rssi = struct.unpack("b", bytes([hdr[15]]))[0]
-
-            writer.writerow([
-                timestamp, adv_event_type, addr_type,
-                mac_address, adv_data_length, rssi
-            ])
-            # print(f"Record: ts={timestamp}, event={adv_event_type}, type={addr_type}, mac={mac_address}, len={adv_data_length}, rssi={rssi}")
+        writer.writerow(COLUMNS)
+        for record in read_records(input_path):
+            # payloads are stored as hex, empty for version 1 files that did not keep them
+            if record["adv_data"] is not None:
+                record["adv_data"] = record["adv_data"].hex()
+            writer.writerow(["" if record[c] is None else record[c] for c in COLUMNS])
 
 if __name__ == "__main__":
     print("start")
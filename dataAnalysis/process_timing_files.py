@@ -0,0 +1,87 @@
+import struct
+import os
+
+INPUT_DIR = "./dataFiles/timing/unprocessed"
+PROCESSED_DIR = "./dataFiles/timing/processed"
+
+# Layout of ConnectionTimingRecord (connection_profiler.h):
+# timestamp(6), mac(6), addr_type, flags, reserved(2), 5 x stage ms (u16), reads_done (u16), reads_timed_out (u16)
+RECORD_SIZE = 30
+STAGES = ["connect", "mtu", "discovery", "reads", "total"]
+STAGE_NOT_REACHED = 0xFFFF
+FLAG_PROFILED = 0x01
+
+def mac_bytes_to_str(mac_bytes):
+    return ':'.join(f'{b:02X}' for b in mac_bytes)
+
+def read_records(input_path):
+    with open(input_path, "rb") as bin_file:
+        while True:
+            rec = bin_file.read(RECORD_SIZE)
+            if len(rec) < RECORD_SIZE:
+                break
+            timestamp = struct.unpack("<Q", rec[0:6] + b'\x00\x00')[0]
+            values = struct.unpack("<5HHH", rec[16:RECORD_SIZE])
+            yield {
+                "timestamp_us": timestamp,
+                "mac_address": mac_bytes_to_str(rec[6:12]),
+                "addr_type": rec[12],
+                "profiled": bool(rec[13] & FLAG_PROFILED),
+                "stages": dict(zip(STAGES, values[0:5])),
+                "reads_done": values[5],
+                "reads_timed_out": values[6],
+            }
+
+def percentile(sorted_values, p):
+    # nearest rank
+    rank = max(1, -(-len(sorted_values) * p // 100))
+    return sorted_values[rank - 1]
+
+def summarise(records):
+    lines = []
+    profiled = sum(1 for r in records if r["profiled"])
+    reads = sum(r["reads_done"] for r in records)
+    timeouts = sum(r["reads_timed_out"] for r in records)
+    lines.append(f"interrogations: {len(records)}, profiled: {profiled}, reads: {reads}, read timeouts: {timeouts}")
+    lines.append(f"{'stage':<10} {'n':>6} {'p50 ms':>8} {'p90 ms':>8} {'p99 ms':>8} {'max ms':>8}")
+    for stage in STAGES:
+        values = sorted(r["stages"][stage] for r in records if r["stages"][stage] != STAGE_NOT_REACHED)
+        if not values:
+            lines.append(f"{stage:<10} {0:>6}")
+            continue
+        lines.append(f"{stage:<10} {len(values):>6} {percentile(values, 50):>8} {percentile(values, 90):>8} "
+                     f"{percentile(values, 99):>8} {values[-1]:>8}")
+    # where the interrogations that did not finish got stuck
+    stuck = {}
+    for r in records:
+        for stage in STAGES[:-1]:
+            if r["stages"][stage] == STAGE_NOT_REACHED:
+                stuck[stage] = stuck.get(stage, 0) + 1
+                break
+    if stuck:
+        lines.append("ended before: " + ", ".join(f"{stage}={count}" for stage, count in stuck.items()))
+    return lines
+
+if __name__ == "__main__":
+    if not os.path.exists(PROCESSED_DIR):
+        os.makedirs(PROCESSED_DIR)
+
+    session = []
+    for root, _, files in os.walk(INPUT_DIR):
+        for filename in sorted(files):
+            if not filename.endswith(".bin"):
+                continue
+            input_path = os.path.join(root, filename)
+            records = list(read_records(input_path))
+            session.extend(records)
+            rel_path = os.path.relpath(root, INPUT_DIR)
+            output_dir = os.path.join(PROCESSED_DIR, rel_path)
+            os.makedirs(output_dir, exist_ok=True)
+            output_path = os.path.join(output_dir, filename.replace(".bin", ".txt"))
+            with open(output_path, "w") as out:
+                out.write("\n".join(summarise(records)) + "\n")
+            print(f"Processed: {filename} ({len(records)} records)")
+
+    if session:
+        print("\nSession summary")
+        print("\n".join(summarise(session)))
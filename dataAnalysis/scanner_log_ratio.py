@@ -0,0 +1,51 @@
+import os
+import sys
+
+# Add the directory containing scanner_log.py to sys.path
+script_dir = os.path.dirname(__file__)
+includes_dir = os.path.join(script_dir, "includes")
+sys.path.insert(0, includes_dir)
+
+from scanner_log import read_records, RECORD_HEADER_SIZE, EXT_RECORD_SIZE, HEADER_SIZE
+
+INPUT_DIR = "./dataFiles/scanner/unprocessed"
+
+# Size of a flat record with its payload stored as is (format version 2), the baseline for the ratio
+def plain_record_size(record):
+    size = RECORD_HEADER_SIZE
+    if record["adv_data"] is not None:
+        size += len(record["adv_data"])
+    if record["primary_phy"] is not None:
+        size += EXT_RECORD_SIZE
+    return size
+
+def measure_file(input_path):
+    records = 0
+    stored = HEADER_SIZE
+    plain = HEADER_SIZE
+    stats = {}
+    for record in read_records(input_path, stats=stats):
+        records += 1
+        stored += record["record_size"]
+        plain += plain_record_size(record)
+    return records, stored, plain, stats.get("bad_blocks", 0)
+
+def print_line(name, records, stored, plain, bad_blocks):
+    per_record = stored / records if records else 0
+    ratio = plain / stored if stored else 0
+    print(f"{name}: {records} records, {stored} B ({per_record:.1f} B/record), "
+          f"{plain} B as flat records with plain payloads, ratio {ratio:.2f}, {bad_blocks} damaged blocks skipped")
+
+if __name__ == "__main__":
+    # Compression ratio of the scanner logs, per file and per session folder
+    input_dir = sys.argv[1] if len(sys.argv) > 1 else INPUT_DIR
+    for root, _, files in os.walk(input_dir):
+        totals = [0, 0, 0, 0]
+        for filename in sorted(files):
+            if not filename.startswith("scanner_log") or not filename.endswith(".bin"):
+                continue
+            result = measure_file(os.path.join(root, filename))
+            print_line(filename, *result)
+            totals = [t + r for t, r in zip(totals, result)]
+        if totals[0]:
+            print_line(f"session {os.path.relpath(root, input_dir)}", *totals)